@@ -0,0 +1,64 @@
+
+#include "Affine.h"
+
+#include <cmath>
+
+gi::Affine gi::Affine::Constant(double c)
+{
+	return { std::isfinite(c), 0.0, c };
+}
+
+gi::Affine gi::Affine::Variable()
+{
+	return { true, 1.0, 0.0 };
+}
+
+gi::Affine gi::Affine::None()
+{
+	return { false, 0.0, 0.0 };
+}
+
+bool gi::Affine::IsConstant() const
+{
+	return affine && slope == 0.0;
+}
+
+gi::Affine gi::operator-(const Affine& a)
+{
+	return { a.affine, -a.slope, -a.offset };
+}
+
+gi::Affine gi::operator+(const Affine& a, const Affine& b)
+{
+	return { a.affine && b.affine, a.slope + b.slope, a.offset + b.offset };
+}
+
+gi::Affine gi::operator-(const Affine& a, const Affine& b)
+{
+	return { a.affine && b.affine, a.slope - b.slope, a.offset - b.offset };
+}
+
+gi::Affine gi::operator*(const Affine& a, const Affine& b)
+{
+	if (a.IsConstant() && b.affine)
+		return { true, a.offset * b.slope, a.offset * b.offset };
+	if (b.IsConstant() && a.affine)
+		return { true, a.slope * b.offset, a.offset * b.offset };
+	return Affine::None();
+}
+
+gi::Affine gi::operator/(const Affine& a, const Affine& b)
+{
+	if (!a.affine || !b.IsConstant() || b.offset == 0.0)
+		return Affine::None();
+	return { true, a.slope / b.offset, a.offset / b.offset };
+}
+
+gi::Affine gi::Pow(const Affine& base, const Affine& exponent)
+{
+	if (base.IsConstant() && exponent.IsConstant())
+		return Affine::Constant(std::pow(base.offset, exponent.offset));
+	if (exponent.IsConstant() && exponent.offset == 1.0)
+		return base;
+	return Affine::None();
+}
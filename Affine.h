@@ -0,0 +1,25 @@
+#pragma once
+
+namespace gi
+{
+	// slope * v + offset for an expression in one variable v, or not affine in v.
+	// Constant parts are folded in double arithmetic like the evaluator does.
+	struct Affine
+	{
+		bool affine;
+		double slope;
+		double offset;
+
+		static Affine Constant(double c);
+		static Affine Variable();
+		static Affine None();
+		bool IsConstant()const;
+	};
+
+	Affine operator-(const Affine& a);
+	Affine operator+(const Affine& a, const Affine& b);
+	Affine operator-(const Affine& a, const Affine& b);
+	Affine operator*(const Affine& a, const Affine& b);
+	Affine operator/(const Affine& a, const Affine& b);
+	Affine Pow(const Affine& base, const Affine& exponent);
+}
@@ -0,0 +1,196 @@
+
+// Replacements of the global allocation functions feeding AllocationTracker. Kept out of
+// gicore: only a program that links this file (the application, gi_bench) has its heap
+// counted, every other target keeps the standard library's operator new.
+
+#include "AllocationTracker.h"
+
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32) || defined(__linux__)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#endif
+
+namespace
+{
+	size_t UsableSize(void* p)
+	{
+#if defined(_WIN32)
+		return _msize(p);
+#elif defined(__APPLE__)
+		return malloc_size(p);
+#elif defined(__linux__)
+		return malloc_usable_size(p);
+#else
+		(void)p;
+		return 0;
+#endif
+	}
+
+	size_t AlignedUsableSize(void* p, size_t alignment)
+	{
+#ifdef _WIN32
+		return _aligned_msize(p, alignment, 0);
+#else
+		(void)alignment;
+		return UsableSize(p);
+#endif
+	}
+
+	void* Allocate(size_t size)
+	{
+		void* p = std::malloc(size ? size : 1);
+		if (p && gi::AllocationTracker::IsEnabled())
+			gi::AllocationTracker::OnAllocate(UsableSize(p));
+		return p;
+	}
+
+	void Free(void* p)
+	{
+		if (!p)
+			return;
+		if (gi::AllocationTracker::IsEnabled())
+			gi::AllocationTracker::OnFree(UsableSize(p));
+		std::free(p);
+	}
+
+	void* AllocateAligned(size_t size, size_t alignment)
+	{
+		if (!size)
+			size = 1;
+#ifdef _WIN32
+		void* p = _aligned_malloc(size, alignment);
+#else
+		void* p = nullptr;
+		if (posix_memalign(&p, alignment, size) != 0)
+			p = nullptr;
+#endif
+		if (p && gi::AllocationTracker::IsEnabled())
+			gi::AllocationTracker::OnAllocate(AlignedUsableSize(p, alignment));
+		return p;
+	}
+
+	void FreeAligned(void* p, size_t alignment)
+	{
+		if (!p)
+			return;
+		if (gi::AllocationTracker::IsEnabled())
+			gi::AllocationTracker::OnFree(AlignedUsableSize(p, alignment));
+#ifdef _WIN32
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+}
+
+// every form is replaced, so none of them falls back to a library default that
+// allocates or frees behind the tracker's back
+void* operator new(size_t size)
+{
+	void* p = Allocate(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return Allocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	Free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	Free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	Free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	Free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+	Free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+	Free(p);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	void* p = AllocateAligned(size, static_cast<size_t>(alignment));
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return AllocateAligned(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return AllocateAligned(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* p, std::align_val_t alignment) noexcept
+{
+	FreeAligned(p, static_cast<size_t>(alignment));
+}
+
+void operator delete[](void* p, std::align_val_t alignment) noexcept
+{
+	FreeAligned(p, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* p, size_t, std::align_val_t alignment) noexcept
+{
+	FreeAligned(p, static_cast<size_t>(alignment));
+}
+
+void operator delete[](void* p, size_t, std::align_val_t alignment) noexcept
+{
+	FreeAligned(p, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* p, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	FreeAligned(p, static_cast<size_t>(alignment));
+}
+
+void operator delete[](void* p, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	FreeAligned(p, static_cast<size_t>(alignment));
+}
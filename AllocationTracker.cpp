@@ -0,0 +1,194 @@
+
+#include "AllocationTracker.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+	struct Counters
+	{
+		std::atomic<int64_t> allocations{ 0 };
+		std::atomic<int64_t> bytes{ 0 };
+		std::atomic<int64_t> frees{ 0 };
+		std::atomic<int64_t> peakLive{ 0 };
+
+		void Allocate(int64_t size, int64_t live)
+		{
+			allocations.fetch_add(1, std::memory_order_relaxed);
+			bytes.fetch_add(size, std::memory_order_relaxed);
+			int64_t peak = peakLive.load(std::memory_order_relaxed);
+			while (live > peak && !peakLive.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		gi::AllocationTracker::Totals Get()const
+		{
+			return {
+				allocations.load(std::memory_order_relaxed),
+				bytes.load(std::memory_order_relaxed),
+				frees.load(std::memory_order_relaxed),
+				peakLive.load(std::memory_order_relaxed)
+			};
+		}
+	};
+
+	// Statements live in a fixed open-addressed table: the hooks run inside operator new
+	// and must not allocate themselves.
+	struct StatementSlot
+	{
+		std::atomic<size_t> line{ 0 };
+		std::atomic<const char*> kind{ "" }; // stored after line is claimed, read by the report
+		Counters counters;
+	};
+
+	constexpr int StatementSlots = 1024;
+
+	const wchar_t* phaseNames[] = { L"other", L"read", L"lex", L"parse", L"bind", L"evaluate", L"render" };
+
+	std::atomic<int64_t> liveBytes{ 0 };
+	Counters total;
+	Counters phases[static_cast<int>(gi::AllocationPhase::Count)];
+	StatementSlot statements[StatementSlots];
+
+	thread_local gi::AllocationPhase currentPhase = gi::AllocationPhase::Other;
+	thread_local int currentStatement = -1;
+
+	int FindStatementSlot(size_t line, const char* kind)
+	{
+		// line 0 marks an empty slot, lines start at 1
+		if (line == 0)
+			return -1;
+		for (int probe = 0; probe < StatementSlots; ++probe)
+		{
+			int i = static_cast<int>((line + probe) % StatementSlots);
+			size_t expected = 0;
+			if (statements[i].line.compare_exchange_strong(expected, line))
+			{
+				statements[i].kind.store(kind, std::memory_order_relaxed);
+				return i;
+			}
+			if (expected == line)
+				return i;
+		}
+		return -1;
+	}
+}
+
+std::atomic<bool> gi::AllocationTracker::enabled{ false };
+
+void gi::AllocationTracker::Enable()
+{
+	enabled.store(true, std::memory_order_relaxed);
+}
+
+void gi::AllocationTracker::Disable()
+{
+	enabled.store(false, std::memory_order_relaxed);
+}
+
+int64_t gi::AllocationTracker::GetLiveBytes()
+{
+	return liveBytes.load(std::memory_order_relaxed);
+}
+
+void gi::AllocationTracker::OnAllocate(size_t size)
+{
+	int64_t s = static_cast<int64_t>(size);
+	int64_t live = liveBytes.fetch_add(s, std::memory_order_relaxed) + s;
+	total.Allocate(s, live);
+	phases[static_cast<int>(currentPhase)].Allocate(s, live);
+	if (currentStatement >= 0)
+		statements[currentStatement].counters.Allocate(s, live);
+}
+
+void gi::AllocationTracker::OnFree(size_t size)
+{
+	liveBytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+	total.frees.fetch_add(1, std::memory_order_relaxed);
+	phases[static_cast<int>(currentPhase)].frees.fetch_add(1, std::memory_order_relaxed);
+	if (currentStatement >= 0)
+		statements[currentStatement].counters.frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+gi::AllocationTracker::Totals gi::AllocationTracker::GetTotals()
+{
+	return total.Get();
+}
+
+gi::AllocationTracker::Totals gi::AllocationTracker::GetPhaseTotals(AllocationPhase phase)
+{
+	return phases[static_cast<int>(phase)].Get();
+}
+
+void gi::AllocationTracker::ResetPeak()
+{
+	total.peakLive.store(liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void gi::AllocationTracker::PrintReport()
+{
+	// snapshot first, printing allocates
+	Totals phaseTotals[static_cast<int>(AllocationPhase::Count)];
+	for (int i = 0; i < static_cast<int>(AllocationPhase::Count); ++i)
+		phaseTotals[i] = phases[i].Get();
+	struct StatementTotals
+	{
+		size_t line;
+		const char* kind;
+		Totals totals;
+	};
+	std::vector<StatementTotals> statementTotals;
+	for (auto& slot : statements)
+	{
+		size_t line = slot.line.load(std::memory_order_relaxed);
+		if (line != 0)
+			statementTotals.push_back({ line, slot.kind.load(std::memory_order_relaxed), slot.counters.Get() });
+	}
+	std::sort(statementTotals.begin(), statementTotals.end(),
+		[](const StatementTotals& a, const StatementTotals& b) { return a.line < b.line; });
+
+	PrintMessage(L"heap allocations per phase:");
+	for (int i = 0; i < static_cast<int>(AllocationPhase::Count); ++i)
+	{
+		auto& t = phaseTotals[i];
+		PrintMessage(JoinAsWideString(
+			L"  ", phaseNames[i], L": ", t.allocations, L" allocations, ", t.bytes, L" bytes, ",
+			t.frees, L" frees, peak live ", t.peakLive, L" bytes"));
+	}
+	PrintMessage(L"heap allocations per statement:");
+	for (auto& s : statementTotals)
+	{
+		PrintMessage(JoinAsWideString(
+			L"  ", s.kind, L" (line ", s.line, L"): ", s.totals.allocations, L" allocations, ",
+			s.totals.bytes, L" bytes, ", s.totals.frees, L" frees, peak live ", s.totals.peakLive, L" bytes"));
+	}
+}
+
+gi::AllocationPhaseScope::AllocationPhaseScope(AllocationPhase phase)
+	: previous(currentPhase), active(AllocationTracker::IsEnabled())
+{
+	if (active)
+		currentPhase = phase;
+}
+
+gi::AllocationPhaseScope::~AllocationPhaseScope()
+{
+	if (active)
+		currentPhase = previous;
+}
+
+gi::AllocationStatementScope::AllocationStatementScope(size_t line, const char* kind)
+	: previous(currentStatement), active(AllocationTracker::IsEnabled())
+{
+	if (active)
+		currentStatement = FindStatementSlot(line, kind);
+}
+
+gi::AllocationStatementScope::~AllocationStatementScope()
+{
+	if (active)
+		currentStatement = previous;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace gi
+{
+	enum class AllocationPhase
+	{
+		Other = 0,
+		Read,     // file read and UTF-8 decoding
+		Lex,
+		Parse,
+		Bind,     // loop variable symbols set up per FOR iteration
+		Evaluate,
+		Render,   // canvas point storage and painting
+		Count
+	};
+
+	// Counts heap allocations made through the global operator new, attributed to the
+	// phase and the statement active on the allocating thread. Counts nothing unless the
+	// program links AllocationHooks.cpp (the gi_allocation_hooks object library).
+	// Blocks allocated while disabled still reduce the live byte count when they are freed,
+	// so compare live and peak bytes against GetLiveBytes() taken when tracking started.
+	class AllocationTracker
+	{
+	public:
+		struct Totals
+		{
+			int64_t allocations = 0;
+			int64_t bytes = 0;    // usable size reported by the heap
+			int64_t frees = 0;
+			int64_t peakLive = 0; // highest process wide live bytes seen while active
+		};
+	private:
+		static std::atomic<bool> enabled;
+	public:
+		static void Enable();
+		static void Disable();
+		static bool IsEnabled()
+		{
+			return enabled.load(std::memory_order_relaxed);
+		}
+		static void OnAllocate(size_t size);
+		static void OnFree(size_t size);
+
+		static int64_t GetLiveBytes();
+		static Totals GetTotals();
+		static Totals GetPhaseTotals(AllocationPhase phase);
+		// restart the peak of GetTotals from the current live bytes
+		static void ResetPeak();
+		// per phase, then per statement ordered by line
+		static void PrintReport();
+	};
+
+	// Attributes allocations of the current thread to phase during its lifetime
+	class AllocationPhaseScope
+	{
+	private:
+		AllocationPhase previous;
+		bool active;
+	public:
+		explicit AllocationPhaseScope(AllocationPhase phase);
+		~AllocationPhaseScope();
+		AllocationPhaseScope(const AllocationPhaseScope&) = delete;
+		AllocationPhaseScope& operator=(const AllocationPhaseScope&) = delete;
+	};
+
+	// Attributes allocations of the current thread to the statement at line, kind must be a string literal
+	class AllocationStatementScope
+	{
+	private:
+		int previous;
+		bool active;
+	public:
+		AllocationStatementScope(size_t line, const char* kind);
+		~AllocationStatementScope();
+		AllocationStatementScope(const AllocationStatementScope&) = delete;
+		AllocationStatementScope& operator=(const AllocationStatementScope&) = delete;
+	};
+}
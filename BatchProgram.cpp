@@ -0,0 +1,183 @@
+
+#include "BatchProgram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cwctype>
+
+namespace
+{
+	// in the order of BatchProgram::Builtin
+	const wchar_t* const BuiltinNames[] = { L"SIN", L"COS", L"TAN", L"SQRT", L"EXP", L"LN" };
+
+	template<class T>
+	T ApplyBuiltin(int function, T x)
+	{
+		switch (function)
+		{
+		case gi::BatchProgram::Sin:
+			return std::sin(x);
+		case gi::BatchProgram::Cos:
+			return std::cos(x);
+		case gi::BatchProgram::Tan:
+			return std::tan(x);
+		case gi::BatchProgram::Sqrt:
+			return std::sqrt(x);
+		case gi::BatchProgram::Exp:
+			return std::exp(x);
+		default:
+			return std::log(x);
+		}
+	}
+
+	template<class T>
+	void Run(const std::vector<gi::BatchProgram::Instruction>& code, size_t maxDepth,
+		const T* variable, T* out, size_t count, std::vector<T>& workspace)
+	{
+		using Op = gi::BatchProgram::Op;
+		constexpr size_t N = gi::BatchProgram::BlockSize;
+		workspace.resize(std::max<size_t>(maxDepth, 1) * N);
+		// block k of the workspace holds stack entry k
+		T* top = workspace.data() - N;
+		for (auto& instruction : code)
+		{
+			T* a = top;
+			T* b = top;
+			switch (instruction.op)
+			{
+			case Op::Constant:
+				top += N;
+				std::fill(top, top + count, static_cast<T>(instruction.constant));
+				break;
+			case Op::Variable:
+				top += N;
+				std::copy(variable, variable + count, top);
+				break;
+			case Op::Negate:
+				for (size_t i = 0; i < count; ++i)
+					a[i] = -a[i];
+				break;
+			case Op::Call:
+				for (size_t i = 0; i < count; ++i)
+					a[i] = ApplyBuiltin(instruction.function, a[i]);
+				break;
+			default:
+				a = top - N;
+				top = a;
+				switch (instruction.op)
+				{
+				case Op::Add:
+					for (size_t i = 0; i < count; ++i)
+						a[i] += b[i];
+					break;
+				case Op::Subtract:
+					for (size_t i = 0; i < count; ++i)
+						a[i] -= b[i];
+					break;
+				case Op::Multiply:
+					for (size_t i = 0; i < count; ++i)
+						a[i] *= b[i];
+					break;
+				case Op::Divide:
+					for (size_t i = 0; i < count; ++i)
+						a[i] /= b[i];
+					break;
+				default:
+					for (size_t i = 0; i < count; ++i)
+						a[i] = std::pow(a[i], b[i]);
+				}
+			}
+		}
+		std::copy(workspace.data(), workspace.data() + count, out);
+	}
+}
+
+void gi::BatchProgram::PushConstant(double value)
+{
+	code.push_back({ Op::Constant, value, -1 });
+	maxDepth = std::max(maxDepth, ++depth);
+}
+
+void gi::BatchProgram::PushVariable()
+{
+	code.push_back({ Op::Variable, 0.0, -1 });
+	maxDepth = std::max(maxDepth, ++depth);
+}
+
+void gi::BatchProgram::Push(Op op)
+{
+	size_t n = code.size();
+	if (op == Op::Negate)
+	{
+		if (n >= 1 && code[n - 1].op == Op::Constant)
+			code[n - 1].constant = -code[n - 1].constant;
+		else
+			code.push_back({ op, 0.0, -1 });
+		return;
+	}
+	--depth;
+	if (n >= 2 && code[n - 2].op == Op::Constant && code[n - 1].op == Op::Constant)
+	{
+		double a = code[n - 2].constant;
+		double b = code[n - 1].constant;
+		code.pop_back();
+		switch (op)
+		{
+		case Op::Add:
+			a += b;
+			break;
+		case Op::Subtract:
+			a -= b;
+			break;
+		case Op::Multiply:
+			a *= b;
+			break;
+		case Op::Divide:
+			a /= b;
+			break;
+		default:
+			a = std::pow(a, b);
+		}
+		code.back().constant = a;
+		return;
+	}
+	code.push_back({ op, 0.0, -1 });
+}
+
+void gi::BatchProgram::PushCall(const std::wstring& name)
+{
+	std::wstring upper = name;
+	for (auto& c : upper)
+		c = static_cast<wchar_t>(std::towupper(c));
+	auto it = std::find(std::begin(BuiltinNames), std::end(BuiltinNames), upper);
+	if (it == std::end(BuiltinNames))
+	{
+		valid = false;
+		return;
+	}
+	int function = static_cast<int>(it - std::begin(BuiltinNames));
+	if (!code.empty() && code.back().op == Op::Constant)
+		code.back().constant = ApplyBuiltin(function, code.back().constant);
+	else
+		code.push_back({ Op::Call, 0.0, function });
+}
+
+bool gi::BatchProgram::IsValid() const
+{
+	return valid && depth == 1;
+}
+
+const std::vector<gi::BatchProgram::Instruction>& gi::BatchProgram::GetCode() const
+{
+	return code;
+}
+
+void gi::BatchProgram::Evaluate(const float* variable, float* out, size_t count, std::vector<float>& workspace) const
+{
+	Run(code, maxDepth, variable, out, count, workspace);
+}
+
+void gi::BatchProgram::Evaluate(const double* variable, double* out, size_t count, std::vector<double>& workspace) const
+{
+	Run(code, maxDepth, variable, out, count, workspace);
+}
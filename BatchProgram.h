@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gi
+{
+	// Postfix form of an expression in the loop variable, evaluated for a block of loop values
+	// at once. Every instruction is a loop over the block, which compilers vectorize: twice the
+	// lanes per register in float as in double. Constant subexpressions are folded in double
+	// while the program is built.
+	class BatchProgram
+	{
+	public:
+		static constexpr size_t BlockSize = 256;
+
+		enum class Op { Constant, Variable, Negate, Add, Subtract, Multiply, Divide, Power, Call };
+		enum Builtin { Sin, Cos, Tan, Sqrt, Exp, Ln };
+		struct Instruction
+		{
+			Op op;
+			double constant;
+			int function; // Builtin for Call
+		};
+	private:
+		std::vector<Instruction> code;
+		size_t depth = 0;
+		size_t maxDepth = 0;
+		bool valid = true;
+	public:
+		void PushConstant(double value);
+		void PushVariable();
+		// Negate or a binary operation on the values pushed before
+		void Push(Op op);
+		// built-in function by name (SIN, COS, TAN, SQRT, EXP, LN), others make the program invalid
+		void PushCall(const std::wstring& name);
+
+		// false if something could not be compiled, evaluate such expressions directly
+		bool IsValid()const;
+		const std::vector<Instruction>& GetCode()const;
+
+		// out[i] = expression at variable[i] for count <= BlockSize values.
+		// workspace is resized as needed and can be reused across calls.
+		void Evaluate(const float* variable, float* out, size_t count, std::vector<float>& workspace)const;
+		void Evaluate(const double* variable, double* out, size_t count, std::vector<double>& workspace)const;
+	};
+}
@@ -1,5 +1,8 @@
 
 #include "Canvas.h"
+#include "AllocationTracker.h"
+#include "PerfCounters.h"
+#include "Trace.h"
 #include "Utils.h"
 
 #include <cstring>
@@ -64,31 +67,54 @@ LRESULT gi::Canvas::OnPaintWindow(HWND hWnd)
 {
 	HRESULT hr = S_OK;
 	PAINTSTRUCT ps;
+	TraceSpan span("Canvas::Paint", "paint");
+	PerfScope perf("Canvas::Paint");
+	AllocationPhaseScope allocations(AllocationPhase::Render);
 	auto mouseString = JoinAsWideString(mouseX, L", ", mouseY);
 	HDC hDC = BeginPaint(hWnd, &ps);
 	FillRect(hDC, &ps.rcPaint, brushBackground.get());
 	mouseTipRect.bottom = mouseTipRect.top + DrawTextW(hDC, mouseString.c_str(), -1, &mouseTipRect, DT_CALCRECT | DT_SINGLELINE | DT_LEFT);
 	DrawTextW(hDC, mouseString.c_str(), -1, &mouseTipRect, DT_SINGLELINE | DT_LEFT);
-	for (auto& point : points) {
-		if (point.pointSize > 0) {
-			SelectObject(hDC, colors[point.colorIndex].brushFill.get());
-			SelectObject(hDC, colors[point.colorIndex].penBorder.get());
-			Ellipse(
-				hDC,
-				static_cast<int>(point.x - point.pointSize),
-				static_cast<int>(point.y - point.pointSize),
-				static_cast<int>(point.x + point.pointSize + 1),
-				static_cast<int>(point.y + point.pointSize + 1));
-		}
-		else
-		{
-			SetPixel(
-				hDC,
-				static_cast<int>(point.x),
-				static_cast<int>(point.y),
-				colors[point.colorIndex].pointColor);
+	// the DC pen and brush take any color without creating GDI objects
+	HGDIOBJ oldPen = SelectObject(hDC, GetStockObject(DC_PEN));
+	HGDIOBJ oldBrush = SelectObject(hDC, GetStockObject(DC_BRUSH));
+	COLORREF selected = RGB(0, 0, 0);
+	SetDCPenColor(hDC, selected);
+	SetDCBrushColor(hDC, selected);
+	points.ForEachChunk([&](const PointSpool::Record* records, size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			auto& point = records[i];
+			if (point.pointSize != LineMoveTo && point.color != selected) {
+				selected = point.color;
+				SetDCPenColor(hDC, selected);
+				SetDCBrushColor(hDC, selected);
+			}
+			if (point.pointSize == LineMoveTo) {
+				MoveToEx(hDC, static_cast<int>(point.x), static_cast<int>(point.y), NULL);
+			}
+			else if (point.pointSize == LineDrawTo) {
+				LineTo(hDC, static_cast<int>(point.x), static_cast<int>(point.y));
+			}
+			else if (point.pointSize > 0) {
+				Ellipse(
+					hDC,
+					static_cast<int>(point.x - point.pointSize),
+					static_cast<int>(point.y - point.pointSize),
+					static_cast<int>(point.x + point.pointSize + 1),
+					static_cast<int>(point.y + point.pointSize + 1));
+			}
+			else
+			{
+				SetPixel(
+					hDC,
+					static_cast<int>(point.x),
+					static_cast<int>(point.y),
+					point.color);
+			}
 		}
-	}
+	});
+	SelectObject(hDC, oldBrush);
+	SelectObject(hDC, oldPen);
 	EndPaint(hWnd, &ps);
 	return 0;
 }
@@ -159,7 +185,6 @@ void gi::Canvas::MultiplyVectorMatrix(double(&a)[3], const double(&b)[3][3])
 
 gi::Canvas::Canvas()
 {
-	colors.emplace_back(ColorInfo::MakeColor(RGB(0, 0, 0)));
 }
 
 gi::Canvas::~Canvas()
@@ -212,6 +237,44 @@ void gi::Canvas::ShowWindow()
 	}
 }
 
+void gi::Canvas::ShowWindow(HANDLE hWait, const std::function<void()>& onSignaled)
+{
+	::ShowWindow(hWnd, SW_NORMAL);
+	MSG msg = { };
+	while (true)
+	{
+		DWORD result = ::MsgWaitForMultipleObjects(1, &hWait, FALSE, INFINITE, QS_ALLINPUT);
+		if (result == WAIT_OBJECT_0)
+		{
+			onSignaled();
+			continue;
+		}
+		if (result != WAIT_OBJECT_0 + 1)
+			return;
+		while (::PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE))
+		{
+			if (msg.message == WM_QUIT)
+				return;
+			::TranslateMessage(&msg);
+			::DispatchMessageW(&msg);
+		}
+	}
+}
+
+void gi::Canvas::Redraw()
+{
+	if (!hWnd)
+		return;
+	::InvalidateRect(hWnd, NULL, TRUE);
+	::UpdateWindow(hWnd);
+}
+
+void gi::Canvas::GetMaximumViewportSize(int& width, int& height)
+{
+	width = ::GetSystemMetrics(SM_CXVIRTUALSCREEN);
+	height = ::GetSystemMetrics(SM_CYVIRTUALSCREEN);
+}
+
 void gi::Canvas::CloseWindow()
 {
 	::SendMessageW(hWnd, WM_CLOSE, 0, 0);
@@ -245,16 +308,35 @@ void gi::Canvas::SetDrawPointSize(int size)
 
 void gi::Canvas::SetDrawPointColor(uint8_t r, uint8_t g, uint8_t b)
 {
-	colors.push_back(ColorInfo::MakeColor(RGB(r, g, b)));
+	pointColor = RGB(r, g, b);
 }
 
 void gi::Canvas::DrawPoint(double x, double y)
 {
+	AllocationPhaseScope allocations(AllocationPhase::Render);
 	double coord[3] = { x,y,1.0 };
 	MultiplyVectorMatrix(coord, transformMatrix);
 	coord[0] /= coord[2];
 	coord[1] /= coord[2];
-	points.push_back({ coord[0], coord[1], pointSize, colors.size() - 1 });
+	points.Push({ coord[0], coord[1], pointSize, pointColor });
+}
+
+void gi::Canvas::DrawLine(double x0, double y0, double x1, double y1)
+{
+	AllocationPhaseScope allocations(AllocationPhase::Render);
+	double from[3] = { x0,y0,1.0 };
+	double to[3] = { x1,y1,1.0 };
+	MultiplyVectorMatrix(from, transformMatrix);
+	MultiplyVectorMatrix(to, transformMatrix);
+	// GDI leaves out the last pixel of LineTo, a zero length segment is drawn as a pixel
+	if (from[0] == to[0] && from[1] == to[1])
+		points.Push({ to[0], to[1], 0, pointColor });
+	if (!hasLineEnd || from[0] != lineEndX || from[1] != lineEndY)
+		points.Push({ from[0], from[1], LineMoveTo, pointColor });
+	points.Push({ to[0], to[1], LineDrawTo, pointColor });
+	hasLineEnd = true;
+	lineEndX = to[0];
+	lineEndY = to[1];
 }
 
 void gi::Canvas::SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b)
@@ -264,5 +346,11 @@ void gi::Canvas::SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b)
 
 void gi::Canvas::Clear()
 {
-	points.clear();
+	points.Clear();
+	hasLineEnd = false;
+}
+
+void gi::Canvas::SetPointMemoryBudget(size_t bytes)
+{
+	points.SetMemoryBudget(bytes);
 }
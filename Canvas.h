@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ICanvas.h"
+#include "PointSpool.h"
 
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
@@ -10,6 +11,7 @@
 #include <wil/resource.h>
 #include <wil/com.h>
 
+#include <functional>
 #include <vector>
 
 namespace gi
@@ -37,25 +39,21 @@ namespace gi
 			int pointSize;
 			size_t colorIndex;
 		};
-
-		struct ColorInfo
-		{
-			COLORREF pointColor;
-			wil::unique_hbrush brushFill;
-			wil::unique_hpen penBorder;
-			static ColorInfo MakeColor(COLORREF color) {
-				return { color,
-					wil::unique_hbrush(::CreateSolidBrush(color)),
-					wil::unique_hpen(::CreatePen(PS_SOLID, 0, color))
-				};
-			}
-		};
 	private:
 		wil::unique_hbrush brushBackground{ reinterpret_cast<HBRUSH>(COLOR_WINDOWTEXT + 1) };
-		std::vector<ColorInfo> colors;
+		// spooled with every point, so a color per point does not grow anything else
+		COLORREF pointColor = RGB(0, 0, 0);
 		int pointSize = 4;
 
-		std::vector<PointInfo> points;
+		// point sizes marking line records in the spool, the pen moves to or draws to the record
+		static constexpr int32_t LineMoveTo = -1;
+		static constexpr int32_t LineDrawTo = -2;
+
+		PointSpool points;
+		// device space end of the last line, a segment starting there continues it
+		bool hasLineEnd = false;
+		double lineEndX = 0.0;
+		double lineEndY = 0.0;
 
 		PointInfo origin{ 0,0 };
 		double scaleFactorX = 1.0;
@@ -82,9 +80,18 @@ namespace gi
 
 		bool InitializeWindow();
 		void ShowWindow();
+		// show window and call onSignaled from the message loop whenever hWait is signaled
+		void ShowWindow(HANDLE hWait, const std::function<void()>& onSignaled);
+		// repaint the whole window synchronously
+		void Redraw();
+		// upper bound of the client area, no point outside [0, width) x [0, height) can become visible
+		static void GetMaximumViewportSize(int& width, int& height);
 
 		void CloseWindow();
 
+		// bytes of points kept in memory, the rest is spilled to a temporary file
+		void SetPointMemoryBudget(size_t bytes);
+
 		void SetDrawOrigin(double x, double y) override;
 		void SetDrawRotation(double r) override;
 		void SetDrawScale(double x, double y) override;
@@ -92,6 +99,7 @@ namespace gi
 		void SetDrawPointColor(uint8_t r, uint8_t g, uint8_t b) override;
 		void SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b) override;
 		void DrawPoint(double x, double y) override;
+		void DrawLine(double x0, double y0, double x1, double y1) override;
 		void Clear() override;
 	};
 
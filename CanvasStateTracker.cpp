@@ -0,0 +1,163 @@
+
+#include "CanvasStateTracker.h"
+
+#include <cmath>
+
+gi::CanvasTransform gi::CanvasTransform::FromState(const CanvasState& state)
+{
+	double c = std::cos(state.rotation);
+	double s = std::sin(state.rotation);
+	return {
+		state.scaleX * c, -state.scaleX * s,
+		state.scaleY * s, state.scaleY * c,
+		state.originX, state.originY
+	};
+}
+
+gi::TransformingCanvas::TransformingCanvas()
+	: transform(CanvasTransform::FromState(state))
+{
+}
+
+void gi::TransformingCanvas::ResetState()
+{
+	state = CanvasState();
+	transform = CanvasTransform::FromState(state);
+}
+
+const gi::CanvasState& gi::TransformingCanvas::GetState() const
+{
+	return state;
+}
+
+void gi::TransformingCanvas::SetDrawOrigin(double x, double y)
+{
+	state.originX = x;
+	state.originY = y;
+	transform = CanvasTransform::FromState(state);
+}
+
+void gi::TransformingCanvas::SetDrawRotation(double r)
+{
+	state.rotation = r;
+	transform = CanvasTransform::FromState(state);
+}
+
+void gi::TransformingCanvas::SetDrawScale(double x, double y)
+{
+	state.scaleX = x;
+	state.scaleY = y;
+	transform = CanvasTransform::FromState(state);
+}
+
+void gi::TransformingCanvas::SetDrawPointSize(int size)
+{
+	// same rule as Canvas: negative sizes are ignored
+	if (size >= 0)
+		state.pointSize = size;
+}
+
+void gi::TransformingCanvas::SetDrawPointColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	state.colorR = r;
+	state.colorG = g;
+	state.colorB = b;
+}
+
+void gi::TransformingCanvas::SetDrawBackgroundColor(uint8_t, uint8_t, uint8_t)
+{
+}
+
+void gi::DrawPolyline(ICanvas& canvas, const std::vector<ModelPoint>& vertices)
+{
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		const ModelPoint& from = vertices[i == 0 ? 0 : i - 1];
+		canvas.DrawLine(from.x, from.y, vertices[i].x, vertices[i].y);
+	}
+}
+
+gi::CanvasStateTracker::CanvasStateTracker(ICanvas* target)
+	: target(target)
+{
+}
+
+const gi::CanvasState& gi::CanvasStateTracker::GetState() const
+{
+	return state;
+}
+
+void gi::CanvasStateTracker::ApplyState(const CanvasState& newState)
+{
+	SetDrawOrigin(newState.originX, newState.originY);
+	SetDrawScale(newState.scaleX, newState.scaleY);
+	SetDrawRotation(newState.rotation);
+	SetDrawPointSize(newState.pointSize);
+	SetDrawPointColor(newState.colorR, newState.colorG, newState.colorB);
+}
+
+void gi::CanvasStateTracker::SetCapture(std::vector<ModelPoint>* buffer)
+{
+	capture = buffer;
+}
+
+void gi::CanvasStateTracker::SetDrawOrigin(double x, double y)
+{
+	state.originX = x;
+	state.originY = y;
+	target->SetDrawOrigin(x, y);
+}
+
+void gi::CanvasStateTracker::SetDrawRotation(double r)
+{
+	state.rotation = r;
+	target->SetDrawRotation(r);
+}
+
+void gi::CanvasStateTracker::SetDrawScale(double x, double y)
+{
+	state.scaleX = x;
+	state.scaleY = y;
+	target->SetDrawScale(x, y);
+}
+
+void gi::CanvasStateTracker::SetDrawPointSize(int size)
+{
+	// negative sizes are ignored by Canvas as well
+	if (size >= 0)
+		state.pointSize = size;
+	target->SetDrawPointSize(size);
+}
+
+void gi::CanvasStateTracker::SetDrawPointColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	state.colorR = r;
+	state.colorG = g;
+	state.colorB = b;
+	target->SetDrawPointColor(r, g, b);
+}
+
+void gi::CanvasStateTracker::SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	target->SetDrawBackgroundColor(r, g, b);
+}
+
+void gi::CanvasStateTracker::DrawPoint(double x, double y)
+{
+	if (capture)
+		capture->push_back({ x, y });
+	target->DrawPoint(x, y);
+}
+
+void gi::CanvasStateTracker::DrawLine(double x0, double y0, double x1, double y1)
+{
+	// segments of a polyline share their ends, the captured vertex is the end
+	if (capture)
+		capture->push_back({ x1, y1 });
+	target->DrawLine(x0, y0, x1, y1);
+}
+
+void gi::CanvasStateTracker::Clear()
+{
+	target->Clear();
+}
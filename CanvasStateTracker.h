@@ -0,0 +1,105 @@
+#pragma once
+
+#include "ICanvas.h"
+
+#include <vector>
+
+namespace gi
+{
+	// Draw state in effect for following DrawPoint calls.
+	// Defaults match a freshly constructed Canvas.
+	struct CanvasState
+	{
+		double originX = 0.0;
+		double originY = 0.0;
+		double scaleX = 1.0;
+		double scaleY = 1.0;
+		double rotation = 0.0;
+		int pointSize = 4;
+		uint8_t colorR = 0;
+		uint8_t colorG = 0;
+		uint8_t colorB = 0;
+
+		bool operator==(const CanvasState& rhs)const
+		{
+			return originX == rhs.originX && originY == rhs.originY &&
+				scaleX == rhs.scaleX && scaleY == rhs.scaleY &&
+				rotation == rhs.rotation && pointSize == rhs.pointSize &&
+				colorR == rhs.colorR && colorG == rhs.colorG && colorB == rhs.colorB;
+		}
+		bool operator!=(const CanvasState& rhs)const
+		{
+			return !(*this == rhs);
+		}
+	};
+
+	// Model to device mapping of a CanvasState, same math as Canvas::RegenerateTransformMatrix:
+	// scale, then rotate, then move to origin.
+	struct CanvasTransform
+	{
+		double m00, m01;
+		double m10, m11;
+		double tx, ty;
+
+		static CanvasTransform FromState(const CanvasState& state);
+
+		ModelPoint Apply(const ModelPoint& p)const
+		{
+			return { p.x * m00 + p.y * m10 + tx, p.x * m01 + p.y * m11 + ty };
+		}
+	};
+
+	// Base of the headless canvases that map points themselves: keeps the draw state and its
+	// transform and implements the state setters. The background color is ignored unless overridden.
+	class TransformingCanvas : public ICanvas
+	{
+	protected:
+		CanvasState state;
+		CanvasTransform transform;
+
+		TransformingCanvas();
+		// back to the default draw state
+		void ResetState();
+	public:
+		const CanvasState& GetState()const;
+
+		void SetDrawOrigin(double x, double y) override;
+		void SetDrawRotation(double r) override;
+		void SetDrawScale(double x, double y) override;
+		void SetDrawPointSize(int size) override;
+		void SetDrawPointColor(uint8_t r, uint8_t g, uint8_t b) override;
+		void SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b) override;
+	};
+
+	// Draw vertices the way a DRAW LINE statement does: a zero length segment at the first vertex,
+	// then one segment per following vertex
+	void DrawPolyline(ICanvas& canvas, const std::vector<ModelPoint>& vertices);
+
+	// Forwards every call to another canvas and keeps a copy of the current draw state.
+	// Optionally captures the untransformed points passing through.
+	class CanvasStateTracker : public ICanvas
+	{
+	private:
+		ICanvas* target;
+		CanvasState state;
+		std::vector<ModelPoint>* capture = nullptr;
+	public:
+		explicit CanvasStateTracker(ICanvas* target);
+
+		const CanvasState& GetState()const;
+		// Set every state field of the target canvas
+		void ApplyState(const CanvasState& newState);
+		// Append following DrawPoint arguments and DrawLine ends to buffer, nullptr to stop capturing
+		void SetCapture(std::vector<ModelPoint>* buffer);
+
+		void SetDrawOrigin(double x, double y) override;
+		void SetDrawRotation(double r) override;
+		void SetDrawScale(double x, double y) override;
+		void SetDrawPointSize(int size) override;
+		void SetDrawPointColor(uint8_t r, uint8_t g, uint8_t b) override;
+		void SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b) override;
+		void DrawPoint(double x, double y) override;
+		void DrawLine(double x0, double y0, double x1, double y1) override;
+		void Clear() override;
+	};
+}
@@ -0,0 +1,37 @@
+
+#include "CountingCanvas.h"
+
+gi::CountingCanvas::CountingCanvas()
+{
+}
+
+size_t gi::CountingCanvas::GetPointCount() const
+{
+	return pointCount;
+}
+
+double gi::CountingCanvas::GetChecksum() const
+{
+	return sumX + sumY;
+}
+
+void gi::CountingCanvas::DrawPoint(double x, double y)
+{
+	ModelPoint p = transform.Apply({ x, y });
+	sumX += p.x;
+	sumY += p.y;
+	++pointCount;
+}
+
+void gi::CountingCanvas::DrawLine(double, double, double x1, double y1)
+{
+	// a polyline counts its vertices, the segment end is the vertex
+	DrawPoint(x1, y1);
+}
+
+void gi::CountingCanvas::Clear()
+{
+	pointCount = 0;
+	sumX = 0.0;
+	sumY = 0.0;
+}
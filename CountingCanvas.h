@@ -0,0 +1,27 @@
+#pragma once
+
+#include "CanvasStateTracker.h"
+
+#include <cstddef>
+
+namespace gi
+{
+	// Headless canvas that only transforms and counts points, for runs without a window.
+	// Coordinates are summed so the transform cannot be optimized away.
+	class CountingCanvas : public TransformingCanvas
+	{
+	private:
+		size_t pointCount = 0;
+		double sumX = 0.0;
+		double sumY = 0.0;
+	public:
+		CountingCanvas();
+
+		size_t GetPointCount()const;
+		double GetChecksum()const;
+
+		void DrawPoint(double x, double y) override;
+		void DrawLine(double x0, double y0, double x1, double y1) override;
+		void Clear() override;
+	};
+}
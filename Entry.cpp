@@ -1,11 +1,17 @@
 
 #define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING 1
 
+#include "AllocationTracker.h"
 #include "Canvas.h"
+#include "FileWatcher.h"
+#include "IncrementalRunner.h"
 #include "Lexer.h"
 #include "Parser.h"
 #include "Interpreter.h"
+#include "PerfCounters.h"
+#include "Trace.h"
 
+#include <chrono>
 #include <fstream>
 #include <codecvt>
 
@@ -13,40 +19,207 @@
 
 using namespace gi;
 
-int main()
+// command line switches, see the usage message in main
+struct Options
 {
-	LPCWSTR lpCmdline = GetCommandLineW();
-	int nArgs;
-	LPWSTR* pArgv = CommandLineToArgvW(lpCmdline, &nArgs);
-
-	if (nArgs != 2)
-	{
-		PrintMessage(JoinAsWideString("Usage: ", pArgv[0], L" FILENAME"));
-		return 1;
-	}
+	bool watch = false;
+	LPCWSTR cacheDirectory = nullptr;
+	double adaptiveTolerance = 0.0;
+	size_t cullGranularity = 0;
+	size_t memoryBudget = SIZE_MAX;
+	LPCWSTR metricsFile = nullptr;
+	LPCWSTR traceFile = nullptr;
+	bool perfCounters = false;
+	bool allocations = false;
+	unsigned jobs = 0;
+	double fastMathTolerance = 0.0;
+	size_t trigRecurrence = 0;
+	double singlePrecisionTolerance = 0.0;
+	bool periodClamping = false;
+	LPCWSTR fileName = nullptr;
+};
 
+static bool ReadSourceFile(LPCWSTR path, std::wstring& content)
+{
 	std::ifstream fs;
 	std::string utf8content;
 	{
+		TraceSpan span("ReadFile", "io");
+		PerfScope perf("ReadFile");
+		AllocationPhaseScope allocations(AllocationPhase::Read);
 		std::ostringstream oss;
 
-		fs.open(pArgv[1], std::ios::binary);
+		fs.open(path, std::ios::binary);
 		if (!fs.good())
 		{
 			PrintMessage(L"Failed to open file!");
-			return 1;
+			return false;
 		}
 
 		oss << fs.rdbuf();
 		utf8content = oss.str();
 	}
+	TraceSpan span("Utf8Decode", "io");
+	PerfScope perf("Utf8Decode");
+	AllocationPhaseScope allocations(AllocationPhase::Read);
+	std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+	content = converter.from_bytes(utf8content);
+	return true;
+}
+
+// write the timeline and counters collected so far, if requested
+static void WriteDiagnostics(const Options& options)
+{
+	if (options.perfCounters)
+		PerfCounters::PrintReport();
+	if (options.allocations)
+		AllocationTracker::PrintReport();
+	if (!options.traceFile)
+		return;
+	std::ofstream fs(options.traceFile);
+	Trace::WriteJson(fs);
+	if (!fs.good())
+		PrintMessage(L"Failed to write trace file!");
+}
+
+// re-render whenever the file changes, until the window is closed
+static int RunWatchMode(const Options& options, PointCache* pointCache)
+{
+	LPCWSTR path = options.fileName;
+	std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+	Canvas canvas;
+	canvas.InitializeWindow();
+	canvas.SetDrawBackgroundColor(0x66, 0xCC, 0xFF);
+	canvas.SetPointMemoryBudget(options.memoryBudget);
+
+	FileWatcher watcher;
+	if (!watcher.Watch(path))
+		return 1;
+
+	IncrementalRunner runner;
+	runner.SetPointCache(pointCache);
+	runner.SetAdaptiveSampling(options.adaptiveTolerance);
+	runner.SetFastMath(options.fastMathTolerance);
+	runner.SetTrigRecurrenceInterval(options.trigRecurrence);
+	runner.SetSinglePrecision(options.singlePrecisionTolerance);
+	runner.SetPeriodClamping(options.periodClamping);
+	if (options.cullGranularity > 0)
+	{
+		int width, height;
+		Canvas::GetMaximumViewportSize(width, height);
+		runner.SetViewportCulling(width, height, options.cullGranularity);
+	}
+	auto render = [&]() {
+		auto start = std::chrono::steady_clock::now();
+		std::wstring content;
+		if (!ReadSourceFile(path, content))
+			return;
+		try {
+			Lexer lexer;
+			Parser parser;
+			lexer.Init(content);
+			parser.Parse(lexer);
+			std::unique_ptr<NTProgram> ast = parser.GetASTRoot();
+			TraceSpan span("IncrementalRunner::Run", "evaluate");
+			auto report = runner.Run(ast.get(), parser.GetStatementSources(), &canvas);
+			canvas.Redraw();
+			auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+			PrintMessage(JoinAsWideString(
+				L"rendered ", report.statements, L" statements: ",
+				report.evaluated, L" FOR evaluated, ",
+				report.reused, L" FOR reused (", report.retransformed, L" re-transformed), ",
+				L"edit-to-image ", elapsed.count(), L" ms"));
+		}
+		catch (std::exception& e)
+		{
+			PrintMessage(L"encountered an error, keep previous image.");
+			PrintMessage(converter.from_bytes(e.what()));
+		}
+	};
+
+	render();
+	canvas.ShowWindow(watcher.GetNativeHandle(), [&]() {
+		if (watcher.Poll())
+			render();
+	});
+	WriteDiagnostics(options);
+	return 0;
+}
+
+int main()
+{
+	LPCWSTR lpCmdline = GetCommandLineW();
+	int nArgs;
+	LPWSTR* pArgv = CommandLineToArgvW(lpCmdline, &nArgs);
+
+	Options options;
+	bool badArgs = false;
+	for (int i = 1; i < nArgs; ++i)
+	{
+		std::wstring arg = pArgv[i];
+		if (arg == L"--watch")
+			options.watch = true;
+		else if (arg == L"--cache" && i + 1 < nArgs)
+			options.cacheDirectory = pArgv[++i];
+		else if (arg == L"--adaptive" && i + 1 < nArgs)
+			options.adaptiveTolerance = _wtof(pArgv[++i]);
+		else if (arg == L"--cull" && i + 1 < nArgs)
+			options.cullGranularity = static_cast<size_t>(_wtoi(pArgv[++i]));
+		else if (arg == L"--memory-budget" && i + 1 < nArgs)
+			options.memoryBudget = static_cast<size_t>(_wtoi64(pArgv[++i])) * 1024 * 1024;
+		else if (arg == L"--metrics" && i + 1 < nArgs)
+			options.metricsFile = pArgv[++i];
+		else if (arg == L"--trace" && i + 1 < nArgs)
+			options.traceFile = pArgv[++i];
+		else if (arg == L"--perf")
+			options.perfCounters = true;
+		else if (arg == L"--alloc")
+			options.allocations = true;
+		else if (arg == L"--fast-math" && i + 1 < nArgs)
+			options.fastMathTolerance = _wtof(pArgv[++i]);
+		else if (arg == L"--trig-recurrence" && i + 1 < nArgs)
+			options.trigRecurrence = static_cast<size_t>(_wtoi(pArgv[++i]));
+		else if (arg == L"--single-precision" && i + 1 < nArgs)
+			options.singlePrecisionTolerance = _wtof(pArgv[++i]);
+		else if (arg == L"--period-clamp")
+			options.periodClamping = true;
+		else if (arg == L"--jobs" && i + 1 < nArgs)
+			options.jobs = static_cast<unsigned>(_wtoi(pArgv[++i]));
+		else if (!options.fileName)
+			options.fileName = pArgv[i];
+		else
+			badArgs = true;
+	}
+
+	if (badArgs || !options.fileName)
+	{
+		PrintMessage(JoinAsWideString("Usage: ", pArgv[0],
+			L" [--watch] [--cache DIRECTORY] [--adaptive PIXELS] [--cull STEPS] [--memory-budget MB] [--metrics JSONFILE] [--trace JSONFILE] [--perf] [--alloc] [--jobs N] [--fast-math PIXELS] [--trig-recurrence STEPS] [--single-precision PIXELS] [--period-clamp] FILENAME"));
+		return 1;
+	}
+	Trace::Enable(options.traceFile != nullptr);
+	if (options.perfCounters)
+		PerfCounters::Enable();
+	if (options.allocations)
+		AllocationTracker::Enable();
+
+	PointCache pointCache(4 * 1024 * 1024);
+	if (options.cacheDirectory && !pointCache.SetDiskDirectory(options.cacheDirectory))
+		return 1;
+
+	if (options.watch)
+		return RunWatchMode(options, options.cacheDirectory ? &pointCache : nullptr);
+
+	std::wstring content;
+	if (!ReadSourceFile(options.fileName, content))
+		return 1;
 	std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-	std::wstring content = converter.from_bytes(utf8content);
 
 	std::unique_ptr<NTProgram> ast;
 	Canvas canvas;
 	canvas.InitializeWindow();
 	canvas.SetDrawBackgroundColor(0x66, 0xCC, 0xFF);
+	canvas.SetPointMemoryBudget(options.memoryBudget);
 
 	try {
 		Lexer lexer;
@@ -55,17 +228,58 @@ int main()
 		lexer.Init(content);
 		parser.Parse(lexer);
 		ast = parser.GetASTRoot();
-		ast->Print(0);
+		{
+			TraceSpan span("NTProgram::Print", "print");
+			ast->Print(0);
+		}
 		interpreter.SetCanvas(&canvas);
+		if (options.cacheDirectory)
+			interpreter.SetPointCache(&pointCache);
+		interpreter.SetAdaptiveSampling(options.adaptiveTolerance);
+		interpreter.SetFastMath(options.fastMathTolerance);
+		interpreter.SetTrigRecurrenceInterval(options.trigRecurrence);
+		interpreter.SetSinglePrecision(options.singlePrecisionTolerance);
+		interpreter.SetPeriodClamping(options.periodClamping);
+		if (options.cullGranularity > 0)
+		{
+			int width, height;
+			Canvas::GetMaximumViewportSize(width, height);
+			interpreter.SetViewportCulling(width, height, options.cullGranularity);
+		}
+		ExecutionMetrics metrics;
+		if (options.metricsFile)
+			interpreter.SetMetrics(&metrics);
+		std::unique_ptr<WorkStealingPool> pool;
+		if (options.jobs > 1)
+		{
+			pool = std::make_unique<WorkStealingPool>(options.jobs);
+			interpreter.SetWorkerPool(pool.get());
+		}
 		interpreter.Run(ast.get());
+		if (options.metricsFile)
+		{
+			std::ofstream metricsStream(options.metricsFile);
+			metrics.WriteJson(metricsStream);
+			if (!metricsStream.good())
+				PrintMessage(L"Failed to write metrics file!");
+		}
+		if (options.cacheDirectory)
+		{
+			auto& statistics = pointCache.GetStatistics();
+			PrintMessage(JoinAsWideString(
+				L"point cache: ", statistics.memoryHits, L" memory hits, ",
+				statistics.diskHits, L" disk hits, ", statistics.misses, L" misses"));
+		}
 	}
 	catch (std::exception& e)
 	{
 		PrintMessage(L"encountered an error, stop processing.");
 		PrintMessage(converter.from_bytes(e.what()));
+		WriteDiagnostics(options);
 		return 1;
 	}
 
 	canvas.ShowWindow();
+	WriteDiagnostics(options);
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,168 @@
+
+#include "ExecutionMetrics.h"
+
+#include <algorithm>
+#include <cwctype>
+
+namespace
+{
+	void WriteJsonString(std::ostream& os, const std::wstring& s)
+	{
+		static const char hex[] = "0123456789abcdef";
+		os << '"';
+		for (wchar_t c : s)
+		{
+			if (c == L'"' || c == L'\\')
+				os << '\\' << static_cast<char>(c);
+			else if (c >= 0x20 && c < 0x7f)
+				os << static_cast<char>(c);
+			else
+			{
+				unsigned v = static_cast<unsigned>(c) & 0xffff;
+				os << "\\u" << hex[v >> 12] << hex[(v >> 8) & 0xf] << hex[(v >> 4) & 0xf] << hex[v & 0xf];
+			}
+		}
+		os << '"';
+	}
+}
+
+void gi::ExecutionMetrics::PointCounter::SetDrawOrigin(double x, double y)
+{
+	target->SetDrawOrigin(x, y);
+}
+
+void gi::ExecutionMetrics::PointCounter::SetDrawRotation(double r)
+{
+	target->SetDrawRotation(r);
+}
+
+void gi::ExecutionMetrics::PointCounter::SetDrawScale(double x, double y)
+{
+	target->SetDrawScale(x, y);
+}
+
+void gi::ExecutionMetrics::PointCounter::SetDrawPointSize(int size)
+{
+	target->SetDrawPointSize(size);
+}
+
+void gi::ExecutionMetrics::PointCounter::SetDrawPointColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	target->SetDrawPointColor(r, g, b);
+}
+
+void gi::ExecutionMetrics::PointCounter::SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	target->SetDrawBackgroundColor(r, g, b);
+}
+
+void gi::ExecutionMetrics::PointCounter::DrawPoint(double x, double y)
+{
+	if (owner->current)
+		++owner->current->points;
+	target->DrawPoint(x, y);
+}
+
+void gi::ExecutionMetrics::PointCounter::DrawLine(double x0, double y0, double x1, double y1)
+{
+	if (owner->current)
+		++owner->current->points;
+	target->DrawLine(x0, y0, x1, y1);
+}
+
+void gi::ExecutionMetrics::PointCounter::Clear()
+{
+	target->Clear();
+}
+
+gi::ExecutionMetrics::ExecutionMetrics()
+{
+	counter.owner = this;
+}
+
+gi::ICanvas* gi::ExecutionMetrics::WrapCanvas(ICanvas* target)
+{
+	if (!target)
+		return nullptr;
+	counter.target = target;
+	return &counter;
+}
+
+void gi::ExecutionMetrics::BeginStatement(size_t line, const wchar_t* kind)
+{
+	statements.emplace_back();
+	current = &statements.back();
+	current->line = line;
+	current->kind = kind;
+	start = std::chrono::steady_clock::now();
+}
+
+void gi::ExecutionMetrics::EndStatement()
+{
+	if (!current)
+		return;
+	current->wallMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	current = nullptr;
+}
+
+void gi::ExecutionMetrics::CountFunctionCall(const std::wstring& name)
+{
+	if (!current)
+		return;
+	std::wstring upper = name;
+	for (auto& c : upper)
+		c = static_cast<wchar_t>(std::towupper(c));
+	++current->functionCalls[upper];
+}
+
+const std::vector<gi::ExecutionMetrics::StatementMetrics>& gi::ExecutionMetrics::GetStatements() const
+{
+	return statements;
+}
+
+void gi::ExecutionMetrics::Clear()
+{
+	statements.clear();
+	current = nullptr;
+}
+
+void gi::ExecutionMetrics::WriteJson(std::ostream& os) const
+{
+	os << "{\n  \"statements\": [";
+	for (size_t i = 0; i < statements.size(); ++i)
+	{
+		auto& s = statements[i];
+		os << (i ? ",\n" : "\n") << "    {\"index\": " << i << ", \"line\": " << s.line << ", \"kind\": ";
+		WriteJsonString(os, s.kind);
+		os << ", \"wall_ms\": " << s.wallMilliseconds
+			<< ", \"iterations\": " << s.iterations
+			<< ", \"points\": " << s.points
+			<< ", \"operand_high_water\": " << s.operandHighWater
+			<< ", \"function_calls\": {";
+		bool first = true;
+		for (auto& call : s.functionCalls)
+		{
+			os << (first ? "" : ", ");
+			WriteJsonString(os, call.first);
+			os << ": " << call.second;
+			first = false;
+		}
+		os << "}}";
+	}
+	os << "\n  ],\n";
+
+	// indices of FOR statements, hottest first
+	std::vector<size_t> ranking;
+	for (size_t i = 0; i < statements.size(); ++i)
+	{
+		if (std::wstring(statements[i].kind) == L"FOR")
+			ranking.push_back(i);
+	}
+	std::stable_sort(ranking.begin(), ranking.end(), [this](size_t a, size_t b) {
+		return statements[a].wallMilliseconds > statements[b].wallMilliseconds;
+	});
+	os << "  \"hottest_for\": [";
+	for (size_t i = 0; i < ranking.size(); ++i)
+		os << (i ? ", " : "") << ranking[i];
+	os << "]\n}\n";
+}
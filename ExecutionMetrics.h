@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ICanvas.h"
+
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace gi
+{
+	// Per-statement counters collected by EvaluateContext when a metrics sink is set.
+	// Without one the interpreter only pays a null pointer test per probe.
+	class ExecutionMetrics
+	{
+	public:
+		struct StatementMetrics
+		{
+			size_t line = 0;
+			const wchar_t* kind = L"";
+			double wallMilliseconds = 0.0;
+			size_t iterations = 0;        // FOR loop variable values evaluated
+			size_t points = 0;            // DrawPoint and DrawLine calls reaching the canvas
+			size_t operandHighWater = 0;  // deepest operand stack seen
+			std::map<std::wstring, size_t> functionCalls; // built-in name in upper case -> calls
+		};
+	private:
+		// Counts points on their way to the real canvas
+		class PointCounter : public ICanvas
+		{
+		public:
+			ICanvas* target = nullptr;
+			ExecutionMetrics* owner = nullptr;
+
+			void SetDrawOrigin(double x, double y) override;
+			void SetDrawRotation(double r) override;
+			void SetDrawScale(double x, double y) override;
+			void SetDrawPointSize(int size) override;
+			void SetDrawPointColor(uint8_t r, uint8_t g, uint8_t b) override;
+			void SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b) override;
+			void DrawPoint(double x, double y) override;
+			void DrawLine(double x0, double y0, double x1, double y1) override;
+			void Clear() override;
+		};
+
+		std::vector<StatementMetrics> statements;
+		StatementMetrics* current = nullptr;
+		std::chrono::steady_clock::time_point start;
+		PointCounter counter;
+	public:
+		ExecutionMetrics();
+		ExecutionMetrics(const ExecutionMetrics&) = delete;
+		ExecutionMetrics& operator=(const ExecutionMetrics&) = delete;
+
+		// canvas forwarding to target that attributes points to the running statement
+		ICanvas* WrapCanvas(ICanvas* target);
+
+		void BeginStatement(size_t line, const wchar_t* kind);
+		void EndStatement();
+		void CountIteration()
+		{
+			if (current)
+				++current->iterations;
+		}
+		void CountFunctionCall(const std::wstring& name);
+		void NoteOperandDepth(size_t depth)
+		{
+			if (current && depth > current->operandHighWater)
+				current->operandHighWater = depth;
+		}
+
+		const std::vector<StatementMetrics>& GetStatements()const;
+		void Clear();
+
+		// statements in source order, then FOR statements ranked by wall time
+		void WriteJson(std::ostream& os)const;
+	};
+}
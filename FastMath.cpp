@@ -0,0 +1,427 @@
+#include "FastMath.h"
+#include "Utils.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GI_FASTMATH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// adding 1.5 * 2^52 rounds to the nearest integer, which is left in the low mantissa bits
+	constexpr double RoundMagic = 6755399441055744.0;
+
+	// pi/2 in three parts (fdlibm), k * PiOver2Hi is exact while |k| < 2^20
+	constexpr double TwoOverPi = 6.36619772367581382433e-01;
+	constexpr double PiOver2Hi = 1.57079632673412561417e+00;
+	constexpr double PiOver2Mid = 6.07710050630396597660e-11;
+	constexpr double PiOver2Lo = 2.02226624879595063154e-21;
+	constexpr double TrigLimit = 1e6;
+
+	// fdlibm kernel coefficients on [-pi/4, pi/4], the tiers use a prefix
+	constexpr double SinCoefficients[] = {
+		-1.66666666666666324348e-01, 8.33333333332248946124e-03, -1.98412698298579493134e-04,
+		2.75573137070700676789e-06, -2.50507602534068634195e-08, 1.58969099521155010221e-10 };
+	constexpr double CosCoefficients[] = {
+		4.16666666666666019037e-02, -1.38888888888741095749e-03, 2.48015872894767294178e-05,
+		-2.75573143513906633035e-07, 2.08757232129817482790e-09, -1.13596475577881948265e-11 };
+
+	// ln 2 with trailing zero bits in the high part, so k * Ln2Hi is exact
+	constexpr double InvLn2 = 1.44269504088896338700e+00;
+	constexpr double Ln2Hi = 6.93147180369123816490e-01;
+	constexpr double Ln2Lo = 1.90821492927058770002e-10;
+	constexpr double ExpLimit = 708.0;
+	constexpr double InvFactorial[] = {
+		1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040,
+		1.0 / 40320, 1.0 / 362880, 1.0 / 3628800 };
+
+	// ln m = 2 atanh f, f = (m - 1) / (m + 1), |f| <= 0.1716 for m in [sqrt(1/2), sqrt(2)]
+	constexpr double Sqrt2 = 1.41421356237309504880;
+	constexpr double LnCoefficients[] = {
+		1.0, 1.0 / 3, 1.0 / 5, 1.0 / 7, 1.0 / 9, 1.0 / 11, 1.0 / 13, 1.0 / 15 };
+
+	// polynomial sizes per tier, see the error table in FastMath.h
+	constexpr int CoarseTrigTerms = 4;
+	constexpr int FineTrigTerms = 5;
+	constexpr int CoarseExpDegree = 7;
+	constexpr int FineExpDegree = 10;
+	constexpr int CoarseLnTerms = 5;
+	constexpr int FineLnTerms = 8;
+
+	constexpr uint64_t MantissaMask = 0x000FFFFFFFFFFFFFull;
+	constexpr uint64_t OneBits = 0x3FF0000000000000ull;
+
+	enum class Trig { Sin, Cos, Tan };
+
+	uint64_t BitsOf(double x)
+	{
+		uint64_t bits;
+		std::memcpy(&bits, &x, sizeof(bits));
+		return bits;
+	}
+
+	double FromBits(uint64_t bits)
+	{
+		double x;
+		std::memcpy(&x, &bits, sizeof(x));
+		return x;
+	}
+
+	template<int Terms>
+	double SinKernel(double r)
+	{
+		double z = r * r;
+		double p = SinCoefficients[Terms - 1];
+		for (int i = Terms - 2; i >= 0; --i)
+			p = p * z + SinCoefficients[i];
+		return r + r * z * p;
+	}
+
+	template<int Terms>
+	double CosKernel(double r)
+	{
+		double z = r * r;
+		double p = CosCoefficients[Terms - 1];
+		for (int i = Terms - 2; i >= 0; --i)
+			p = p * z + CosCoefficients[i];
+		return 1.0 - 0.5 * z + z * z * p;
+	}
+
+	// x = k * pi/2 + r with |r| <= pi/4, k mod 4 is the quadrant
+	unsigned ReducePiOver2(double x, double& r)
+	{
+		double shifted = x * TwoOverPi + RoundMagic;
+		double k = shifted - RoundMagic;
+		r = ((x - k * PiOver2Hi) - k * PiOver2Mid) - k * PiOver2Lo;
+		return static_cast<unsigned>(BitsOf(shifted)) & 3;
+	}
+
+	template<Trig F, int Terms>
+	double TrigScalar(double x)
+	{
+		if (!(std::fabs(x) <= TrigLimit))
+			return F == Trig::Sin ? std::sin(x) : F == Trig::Cos ? std::cos(x) : std::tan(x);
+		double r;
+		unsigned q = ReducePiOver2(x, r) + (F == Trig::Cos ? 1 : 0);
+		double s = SinKernel<Terms>(r);
+		double c = CosKernel<Terms>(r);
+		if (F == Trig::Tan)
+			return (q & 1) ? -c / s : s / c;
+		double v = (q & 1) ? c : s;
+		return (q & 2) ? -v : v;
+	}
+
+	template<int Degree>
+	double ExpScalar(double x)
+	{
+		if (!(std::fabs(x) <= ExpLimit))
+			return std::exp(x);
+		double shifted = x * InvLn2 + RoundMagic;
+		double k = shifted - RoundMagic;
+		double r = (x - k * Ln2Hi) - k * Ln2Lo;
+		double p = InvFactorial[Degree];
+		for (int i = Degree - 1; i >= 0; --i)
+			p = p * r + InvFactorial[i];
+		// 2^k from the biased exponent, k + 1023 fits the 11 exponent bits within the limit
+		return p * FromBits((BitsOf(shifted) + 1023) << 52);
+	}
+
+	template<int Terms>
+	double LnScalar(double x)
+	{
+		if (!(x >= DBL_MIN && x <= DBL_MAX))
+			return std::log(x);
+		uint64_t bits = BitsOf(x);
+		double e = static_cast<double>(static_cast<int>(bits >> 52) - 1023);
+		double m = FromBits((bits & MantissaMask) | OneBits);
+		// select instead of branch, the comparison is a coin flip for plotted arguments
+		double big = m > Sqrt2 ? 1.0 : 0.0;
+		m *= 1.0 - 0.5 * big;
+		e += big;
+		double f = (m - 1.0) / (m + 1.0);
+		double s = f * f;
+		double p = LnCoefficients[Terms - 1];
+		for (int i = Terms - 2; i >= 0; --i)
+			p = p * s + LnCoefficients[i];
+		return e * Ln2Hi + (2.0 * f * p + e * Ln2Lo);
+	}
+
+	double CoarseSin(double x) { return TrigScalar<Trig::Sin, CoarseTrigTerms>(x); }
+	double FineSin(double x) { return TrigScalar<Trig::Sin, FineTrigTerms>(x); }
+	double CoarseCos(double x) { return TrigScalar<Trig::Cos, CoarseTrigTerms>(x); }
+	double FineCos(double x) { return TrigScalar<Trig::Cos, FineTrigTerms>(x); }
+	double CoarseTan(double x) { return TrigScalar<Trig::Tan, CoarseTrigTerms>(x); }
+	double FineTan(double x) { return TrigScalar<Trig::Tan, FineTrigTerms>(x); }
+	double CoarseExp(double x) { return ExpScalar<CoarseExpDegree>(x); }
+	double FineExp(double x) { return ExpScalar<FineExpDegree>(x); }
+	double CoarseLn(double x) { return LnScalar<CoarseLnTerms>(x); }
+	double FineLn(double x) { return LnScalar<FineLnTerms>(x); }
+
+	struct Replacement
+	{
+		const wchar_t* name;
+		gi::FastMath::Function coarse;
+		double coarseError;
+		gi::FastMath::Function fine;
+		double fineError;
+	};
+
+	// error bounds from the table in FastMath.h. nullptr keeps libm where a scalar call
+	// of the approximation is not faster than glibc (BM_Libm against BM_FastMath).
+	const Replacement Replacements[] = {
+		{ L"SIN", CoarseSin, 2e-9, FineSin, 1e-11 },
+		{ L"COS", CoarseCos, 2e-9, FineCos, 1e-11 },
+		{ L"TAN", CoarseTan, 3e-9, FineTan, 2e-11 },
+		{ L"EXP", CoarseExp, 8e-9, nullptr, 3e-13 },
+		{ L"LN", nullptr, 8e-10, nullptr, 2e-14 },
+	};
+
+#ifdef GI_FASTMATH_SSE2
+	__m128d Blend(__m128d mask, __m128d a, __m128d b)
+	{
+		return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+	}
+
+	bool AllLanes(__m128d mask)
+	{
+		return _mm_movemask_pd(mask) == 3;
+	}
+
+	template<int Terms>
+	__m128d SinKernel(__m128d r)
+	{
+		__m128d z = _mm_mul_pd(r, r);
+		__m128d p = _mm_set1_pd(SinCoefficients[Terms - 1]);
+		for (int i = Terms - 2; i >= 0; --i)
+			p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(SinCoefficients[i]));
+		return _mm_add_pd(r, _mm_mul_pd(_mm_mul_pd(r, z), p));
+	}
+
+	template<int Terms>
+	__m128d CosKernel(__m128d r)
+	{
+		__m128d z = _mm_mul_pd(r, r);
+		__m128d p = _mm_set1_pd(CosCoefficients[Terms - 1]);
+		for (int i = Terms - 2; i >= 0; --i)
+			p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(CosCoefficients[i]));
+		__m128d head = _mm_sub_pd(_mm_set1_pd(1.0), _mm_mul_pd(_mm_set1_pd(0.5), z));
+		return _mm_add_pd(head, _mm_mul_pd(_mm_mul_pd(z, z), p));
+	}
+
+	template<Trig F, int Terms>
+	void TrigBatch(const double* in, double* out, size_t count)
+	{
+		const __m128d absMask = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFll));
+		const __m128i one = _mm_set1_epi64x(1);
+		const __m128i two = _mm_set1_epi64x(2);
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2)
+		{
+			__m128d x = _mm_loadu_pd(in + i);
+			if (!AllLanes(_mm_cmple_pd(_mm_and_pd(x, absMask), _mm_set1_pd(TrigLimit))))
+			{
+				out[i] = TrigScalar<F, Terms>(in[i]);
+				out[i + 1] = TrigScalar<F, Terms>(in[i + 1]);
+				continue;
+			}
+			__m128d shifted = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(TwoOverPi)), _mm_set1_pd(RoundMagic));
+			__m128d k = _mm_sub_pd(shifted, _mm_set1_pd(RoundMagic));
+			__m128d r = _mm_sub_pd(x, _mm_mul_pd(k, _mm_set1_pd(PiOver2Hi)));
+			r = _mm_sub_pd(r, _mm_mul_pd(k, _mm_set1_pd(PiOver2Mid)));
+			r = _mm_sub_pd(r, _mm_mul_pd(k, _mm_set1_pd(PiOver2Lo)));
+			__m128i q = _mm_castpd_si128(shifted);
+			if (F == Trig::Cos)
+				q = _mm_add_epi64(q, one);
+
+			__m128d s = SinKernel<Terms>(r);
+			__m128d c = CosKernel<Terms>(r);
+			// all ones in lanes of an odd quadrant, the sign bit in lanes of quadrants 2 and 3
+			__m128d odd = _mm_castsi128_pd(_mm_sub_epi64(_mm_setzero_si128(), _mm_and_si128(q, one)));
+			__m128d v;
+			if (F == Trig::Tan)
+			{
+				v = _mm_div_pd(Blend(odd, c, s), Blend(odd, s, c));
+				v = _mm_xor_pd(v, _mm_and_pd(odd, _mm_set1_pd(-0.0)));
+			}
+			else
+			{
+				__m128d sign = _mm_castsi128_pd(_mm_slli_epi64(_mm_and_si128(q, two), 62));
+				v = _mm_xor_pd(Blend(odd, c, s), sign);
+			}
+			_mm_storeu_pd(out + i, v);
+		}
+		for (; i < count; ++i)
+			out[i] = TrigScalar<F, Terms>(in[i]);
+	}
+
+	template<int Degree>
+	void ExpBatch(const double* in, double* out, size_t count)
+	{
+		const __m128d absMask = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFll));
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2)
+		{
+			__m128d x = _mm_loadu_pd(in + i);
+			if (!AllLanes(_mm_cmple_pd(_mm_and_pd(x, absMask), _mm_set1_pd(ExpLimit))))
+			{
+				out[i] = ExpScalar<Degree>(in[i]);
+				out[i + 1] = ExpScalar<Degree>(in[i + 1]);
+				continue;
+			}
+			__m128d shifted = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(InvLn2)), _mm_set1_pd(RoundMagic));
+			__m128d k = _mm_sub_pd(shifted, _mm_set1_pd(RoundMagic));
+			__m128d r = _mm_sub_pd(x, _mm_mul_pd(k, _mm_set1_pd(Ln2Hi)));
+			r = _mm_sub_pd(r, _mm_mul_pd(k, _mm_set1_pd(Ln2Lo)));
+			__m128d p = _mm_set1_pd(InvFactorial[Degree]);
+			for (int j = Degree - 1; j >= 0; --j)
+				p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(InvFactorial[j]));
+			__m128i scale = _mm_slli_epi64(_mm_add_epi64(_mm_castpd_si128(shifted), _mm_set1_epi64x(1023)), 52);
+			_mm_storeu_pd(out + i, _mm_mul_pd(p, _mm_castsi128_pd(scale)));
+		}
+		for (; i < count; ++i)
+			out[i] = ExpScalar<Degree>(in[i]);
+	}
+
+	template<int Terms>
+	void LnBatch(const double* in, double* out, size_t count)
+	{
+		// or-ing a small integer into the mantissa of 2^52 gives 2^52 + n
+		const __m128d twoTo52 = _mm_set1_pd(4503599627370496.0);
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2)
+		{
+			__m128d x = _mm_loadu_pd(in + i);
+			if (!AllLanes(_mm_and_pd(_mm_cmpge_pd(x, _mm_set1_pd(DBL_MIN)), _mm_cmple_pd(x, _mm_set1_pd(DBL_MAX)))))
+			{
+				out[i] = LnScalar<Terms>(in[i]);
+				out[i + 1] = LnScalar<Terms>(in[i + 1]);
+				continue;
+			}
+			__m128i bits = _mm_castpd_si128(x);
+			__m128d biased = _mm_or_pd(_mm_castsi128_pd(_mm_srli_epi64(bits, 52)), twoTo52);
+			__m128d e = _mm_sub_pd(biased, _mm_set1_pd(4503599627370496.0 + 1023.0));
+			__m128d m = _mm_castsi128_pd(_mm_or_si128(
+				_mm_and_si128(bits, _mm_set1_epi64x(static_cast<long long>(MantissaMask))),
+				_mm_set1_epi64x(static_cast<long long>(OneBits))));
+			__m128d big = _mm_cmpgt_pd(m, _mm_set1_pd(Sqrt2));
+			m = Blend(big, _mm_mul_pd(m, _mm_set1_pd(0.5)), m);
+			e = _mm_add_pd(e, _mm_and_pd(big, _mm_set1_pd(1.0)));
+			__m128d f = _mm_div_pd(_mm_sub_pd(m, _mm_set1_pd(1.0)), _mm_add_pd(m, _mm_set1_pd(1.0)));
+			__m128d s = _mm_mul_pd(f, f);
+			__m128d p = _mm_set1_pd(LnCoefficients[Terms - 1]);
+			for (int j = Terms - 2; j >= 0; --j)
+				p = _mm_add_pd(_mm_mul_pd(p, s), _mm_set1_pd(LnCoefficients[j]));
+			__m128d tail = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(_mm_set1_pd(2.0), f), p), _mm_mul_pd(e, _mm_set1_pd(Ln2Lo)));
+			_mm_storeu_pd(out + i, _mm_add_pd(_mm_mul_pd(e, _mm_set1_pd(Ln2Hi)), tail));
+		}
+		for (; i < count; ++i)
+			out[i] = LnScalar<Terms>(in[i]);
+	}
+#else
+	template<Trig F, int Terms>
+	void TrigBatch(const double* in, double* out, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+			out[i] = TrigScalar<F, Terms>(in[i]);
+	}
+
+	template<int Degree>
+	void ExpBatch(const double* in, double* out, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+			out[i] = ExpScalar<Degree>(in[i]);
+	}
+
+	template<int Terms>
+	void LnBatch(const double* in, double* out, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+			out[i] = LnScalar<Terms>(in[i]);
+	}
+#endif
+}
+
+gi::FastMath::Function gi::FastMath::Select(const std::wstring& name, double maxError)
+{
+	for (auto& replacement : Replacements)
+	{
+		if (!MatchBuiltinName(name, replacement.name))
+			continue;
+		if (replacement.coarseError <= maxError)
+			return replacement.coarse;
+		if (replacement.fineError <= maxError)
+			return replacement.fine;
+		return nullptr;
+	}
+	return nullptr;
+}
+
+double gi::FastMath::Sin(Tier tier, double x)
+{
+	return tier == Tier::Coarse ? CoarseSin(x) : FineSin(x);
+}
+
+double gi::FastMath::Cos(Tier tier, double x)
+{
+	return tier == Tier::Coarse ? CoarseCos(x) : FineCos(x);
+}
+
+double gi::FastMath::Tan(Tier tier, double x)
+{
+	return tier == Tier::Coarse ? CoarseTan(x) : FineTan(x);
+}
+
+double gi::FastMath::Exp(Tier tier, double x)
+{
+	return tier == Tier::Coarse ? CoarseExp(x) : FineExp(x);
+}
+
+double gi::FastMath::Ln(Tier tier, double x)
+{
+	return tier == Tier::Coarse ? CoarseLn(x) : FineLn(x);
+}
+
+void gi::FastMath::Sin(Tier tier, const double* in, double* out, size_t count)
+{
+	if (tier == Tier::Coarse)
+		TrigBatch<Trig::Sin, CoarseTrigTerms>(in, out, count);
+	else
+		TrigBatch<Trig::Sin, FineTrigTerms>(in, out, count);
+}
+
+void gi::FastMath::Cos(Tier tier, const double* in, double* out, size_t count)
+{
+	if (tier == Tier::Coarse)
+		TrigBatch<Trig::Cos, CoarseTrigTerms>(in, out, count);
+	else
+		TrigBatch<Trig::Cos, FineTrigTerms>(in, out, count);
+}
+
+void gi::FastMath::Tan(Tier tier, const double* in, double* out, size_t count)
+{
+	if (tier == Tier::Coarse)
+		TrigBatch<Trig::Tan, CoarseTrigTerms>(in, out, count);
+	else
+		TrigBatch<Trig::Tan, FineTrigTerms>(in, out, count);
+}
+
+void gi::FastMath::Exp(Tier tier, const double* in, double* out, size_t count)
+{
+	if (tier == Tier::Coarse)
+		ExpBatch<CoarseExpDegree>(in, out, count);
+	else
+		ExpBatch<FineExpDegree>(in, out, count);
+}
+
+void gi::FastMath::Ln(Tier tier, const double* in, double* out, size_t count)
+{
+	if (tier == Tier::Coarse)
+		LnBatch<CoarseLnTerms>(in, out, count);
+	else
+		LnBatch<FineLnTerms>(in, out, count);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace gi
+{
+	// Range-reduced polynomial replacements for the libm built-ins, in two tiers.
+	// Measured worst-case errors against libm (absolute for SIN, COS, LN; relative for TAN,
+	// EXP) over the fast domain, BM_FastMath reports them as max_error:
+	//
+	//   function  domain                    Coarse    Fine
+	//   SIN, COS  |x| <= 1e6                2e-9      1e-11
+	//   TAN       |x| <= 1e6, off the poles 3e-9      2e-11
+	//   EXP       |x| <= 708                8e-9      3e-13
+	//   LN        normal x > 0              8e-10     2e-14
+	//
+	// Arguments outside the domain (including NaN, infinities, denormals) go to libm.
+	// SQRT is left to std::sqrt, which is already a single instruction.
+	class FastMath
+	{
+	public:
+		enum class Tier { Coarse, Fine };
+		using Function = double(*)(double);
+
+		// fastest replacement for the built-in name whose error bound is at most maxError,
+		// nullptr if libm is needed for that accuracy or is faster anyway (LN)
+		static Function Select(const std::wstring& name, double maxError);
+
+		static double Sin(Tier tier, double x);
+		static double Cos(Tier tier, double x);
+		static double Tan(Tier tier, double x);
+		static double Exp(Tier tier, double x);
+		static double Ln(Tier tier, double x);
+
+		// out[i] = f(in[i]), two lanes at a time with SSE2 where available. in and out may alias.
+		static void Sin(Tier tier, const double* in, double* out, size_t count);
+		static void Cos(Tier tier, const double* in, double* out, size_t count);
+		static void Tan(Tier tier, const double* in, double* out, size_t count);
+		static void Exp(Tier tier, const double* in, double* out, size_t count);
+		static void Ln(Tier tier, const double* in, double* out, size_t count);
+	};
+}
@@ -0,0 +1,143 @@
+
+#include "FileWatcher.h"
+#include "Utils.h"
+
+#ifndef _WIN32
+#include <codecvt>
+#include <locale>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	void SplitPath(const std::wstring& path, std::wstring& directory, std::wstring& fileName)
+	{
+		size_t pos = path.find_last_of(L"\\/");
+		if (pos == std::wstring::npos)
+		{
+			directory = L".";
+			fileName = path;
+		}
+		else
+		{
+			directory = path.substr(0, pos + 1);
+			fileName = path.substr(pos + 1);
+		}
+	}
+}
+
+#ifdef _WIN32
+
+gi::FileWatcher::~FileWatcher()
+{
+	if (hChange != INVALID_HANDLE_VALUE)
+		::FindCloseChangeNotification(hChange);
+}
+
+bool gi::FileWatcher::Watch(const std::wstring& path)
+{
+	SplitPath(path, directory, fileName);
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (::GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data))
+		lastWriteTime = data.ftLastWriteTime;
+	hChange = ::FindFirstChangeNotificationW(
+		directory.c_str(),
+		FALSE,
+		FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+	if (hChange == INVALID_HANDLE_VALUE)
+	{
+		PrintMessage(JoinAsWideString(L"failed to watch directory \'", directory, L"\'"));
+		return false;
+	}
+	return true;
+}
+
+gi::FileWatcher::NativeHandle gi::FileWatcher::GetNativeHandle() const
+{
+	return hChange;
+}
+
+bool gi::FileWatcher::Poll()
+{
+	if (::WaitForSingleObject(hChange, 0) != WAIT_OBJECT_0)
+		return false;
+	::FindNextChangeNotification(hChange);
+
+	// the notification covers the whole directory, compare timestamps of our file
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	std::wstring path = directory == L"." ? fileName : directory + fileName;
+	if (!::GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data))
+		return false;
+	if (::CompareFileTime(&data.ftLastWriteTime, &lastWriteTime) == 0)
+		return false;
+	lastWriteTime = data.ftLastWriteTime;
+	return true;
+}
+
+void gi::FileWatcher::Wait()
+{
+	do
+	{
+		::WaitForSingleObject(hChange, INFINITE);
+	} while (!Poll());
+}
+
+#else
+
+gi::FileWatcher::~FileWatcher()
+{
+	if (inotifyFd >= 0)
+		::close(inotifyFd);
+}
+
+bool gi::FileWatcher::Watch(const std::wstring& path)
+{
+	SplitPath(path, directory, fileName);
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+	inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd >= 0)
+		watchFd = ::inotify_add_watch(inotifyFd, converter.to_bytes(directory).c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (watchFd < 0)
+	{
+		PrintMessage(JoinAsWideString(L"failed to watch directory \'", directory, L"\'"));
+		return false;
+	}
+	return true;
+}
+
+gi::FileWatcher::NativeHandle gi::FileWatcher::GetNativeHandle() const
+{
+	return inotifyFd;
+}
+
+bool gi::FileWatcher::Poll()
+{
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+	std::string name = converter.to_bytes(fileName);
+	alignas(inotify_event) char buffer[4096];
+	bool modified = false;
+	ssize_t length;
+	while ((length = ::read(inotifyFd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char* p = buffer; p < buffer + length; p += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(p)->len)
+		{
+			auto* event = reinterpret_cast<inotify_event*>(p);
+			if (event->len > 0 && name == event->name)
+				modified = true;
+		}
+	}
+	return modified;
+}
+
+void gi::FileWatcher::Wait()
+{
+	pollfd pfd = { inotifyFd, POLLIN, 0 };
+	do
+	{
+		::poll(&pfd, 1, -1);
+	} while (!Poll());
+}
+
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+namespace gi
+{
+	// Watches a single file for modifications.
+	// The containing directory is watched so editors that replace the file on save are handled.
+	class FileWatcher
+	{
+	public:
+#ifdef _WIN32
+		using NativeHandle = HANDLE;
+#else
+		using NativeHandle = int;
+#endif
+	private:
+		std::wstring directory;
+		std::wstring fileName;
+#ifdef _WIN32
+		HANDLE hChange = INVALID_HANDLE_VALUE;
+		FILETIME lastWriteTime = {};
+#else
+		int inotifyFd = -1;
+		int watchFd = -1;
+#endif
+	public:
+		FileWatcher() = default;
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+		~FileWatcher();
+
+		bool Watch(const std::wstring& path);
+
+		// handle that becomes signaled(Windows) or readable(Linux) when the directory changes
+		NativeHandle GetNativeHandle()const;
+
+		// consume pending notifications, return true if the watched file was modified
+		bool Poll();
+
+		// block until the watched file is modified
+		void Wait();
+	};
+}
@@ -4,6 +4,13 @@
 
 namespace gi
 {
+	// Point as passed to DrawPoint, before the canvas transform is applied
+	struct ModelPoint
+	{
+		double x;
+		double y;
+	};
+
 	// Canvas World Coordinate System:
 	// +------------> X
 	// |
@@ -30,6 +37,9 @@ namespace gi
 		virtual void SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b) = 0;
 		// Draw a point
 		virtual void DrawPoint(double x, double y) = 0;
+		// Draw a line segment, one pixel wide. A polyline arrives as segments sharing their
+		// ends, starting with a segment of zero length at its first vertex.
+		virtual void DrawLine(double x0, double y0, double x1, double y1) = 0;
 		// Clear Canvas
 		virtual void Clear() = 0;
 	};
@@ -17,6 +17,9 @@ namespace gi
 	   L"To",
 	   L"Step",
 	   L"Draw",
+	   L"Size",
+	   L"Color",
+	   L"Line",
 	   L"Plus",
 	   L"Minus",
 	   L"Multiply",
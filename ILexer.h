@@ -21,6 +21,7 @@ namespace gi
 		KeywordDraw,
 		KeywordSize,
 		KeywordColor,
+		KeywordLine,
 		OperatorPlus,
 		OperatorMinus,
 		OperatorMultiply,
@@ -0,0 +1,742 @@
+
+#include "ImageEncoder.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <queue>
+
+namespace
+{
+	constexpr size_t WindowSize = 32768;
+	constexpr size_t MaxMatch = 258;
+	constexpr size_t MinMatch = 3;
+	constexpr int HashBits = 15;
+	// literals and matches buffered before a dynamic block is written
+	constexpr size_t BlockSymbols = 64 * 1024;
+	constexpr size_t MaxStoredBlock = 65535;
+
+	const uint16_t LengthBase[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const uint8_t LengthExtra[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const uint16_t DistanceBase[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const uint8_t DistanceExtra[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	// order the code length code lengths are sent in
+	const uint8_t CodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	struct LevelConfig
+	{
+		int maxChain;  // candidates tried per position
+		size_t nice;   // a match this long ends the search
+	};
+	const LevelConfig Levels[gi::ImageEncoder::MaxPngLevel + 1] = {
+		{ 0, 0 }, { 4, 16 }, { 8, 32 }, { 16, 64 }, { 32, 128 },
+		{ 64, 258 }, { 128, 258 }, { 256, 258 }, { 1024, 258 }, { 4096, 258 } };
+
+	// a literal when distance is 0, otherwise a match of length bytes
+	struct Symbol
+	{
+		uint16_t value;
+		uint16_t distance;
+	};
+
+	class BitWriter
+	{
+	private:
+		std::vector<uint8_t>& out;
+		uint64_t bits = 0;
+		int count = 0;
+	public:
+		explicit BitWriter(std::vector<uint8_t>& out)
+			: out(out)
+		{
+		}
+
+		// length up to 32 bits, least significant first
+		void Put(uint32_t value, int length)
+		{
+			bits |= static_cast<uint64_t>(value) << count;
+			count += length;
+			while (count >= 8)
+			{
+				out.push_back(static_cast<uint8_t>(bits));
+				bits >>= 8;
+				count -= 8;
+			}
+		}
+
+		void Align()
+		{
+			if (count > 0)
+				out.push_back(static_cast<uint8_t>(bits));
+			bits = 0;
+			count = 0;
+		}
+	};
+
+	int LengthSymbol(size_t length)
+	{
+		return static_cast<int>(std::upper_bound(LengthBase, LengthBase + 29, length) - LengthBase) - 1;
+	}
+
+	int DistanceSymbol(size_t distance)
+	{
+		return static_cast<int>(std::upper_bound(DistanceBase, DistanceBase + 30, distance) - DistanceBase) - 1;
+	}
+
+	// Huffman code lengths of at most limit bits. Frequencies are halved until the tree is
+	// shallow enough, which ends at a balanced tree at the latest.
+	std::vector<uint8_t> CodeLengths(std::vector<uint32_t> freq, int limit)
+	{
+		std::vector<uint8_t> lengths(freq.size(), 0);
+		while (true)
+		{
+			// nodes below freq.size() are the leaves
+			std::vector<uint64_t> weight(freq.begin(), freq.end());
+			std::vector<int> parent(freq.size(), -1);
+			using Entry = std::pair<uint64_t, int>;
+			std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+			for (size_t i = 0; i < freq.size(); ++i)
+			{
+				if (freq[i] > 0)
+					heap.push({ freq[i], static_cast<int>(i) });
+			}
+			if (heap.empty())
+				return lengths;
+			if (heap.size() == 1)
+			{
+				lengths[heap.top().second] = 1;
+				return lengths;
+			}
+			while (heap.size() > 1)
+			{
+				Entry a = heap.top();
+				heap.pop();
+				Entry b = heap.top();
+				heap.pop();
+				int node = static_cast<int>(weight.size());
+				weight.push_back(a.first + b.first);
+				parent.push_back(-1);
+				parent[a.second] = node;
+				parent[b.second] = node;
+				heap.push({ a.first + b.first, node });
+			}
+			// parents are created after their children, walk down from the root
+			std::vector<int> depth(weight.size(), 0);
+			for (int node = static_cast<int>(weight.size()) - 2; node >= 0; --node)
+				depth[node] = parent[node] < 0 ? 0 : depth[parent[node]] + 1;
+			int deepest = 0;
+			for (size_t i = 0; i < freq.size(); ++i)
+			{
+				if (freq[i] > 0)
+					deepest = std::max(deepest, depth[i]);
+			}
+			if (deepest <= limit)
+			{
+				for (size_t i = 0; i < freq.size(); ++i)
+					lengths[i] = freq[i] > 0 ? static_cast<uint8_t>(depth[i]) : 0;
+				return lengths;
+			}
+			for (auto& f : freq)
+			{
+				if (f > 0)
+					f = (f + 1) / 2;
+			}
+		}
+	}
+
+	// canonical codes, bit reversed for the least significant first bit order of deflate
+	std::vector<uint16_t> CanonicalCodes(const std::vector<uint8_t>& lengths)
+	{
+		uint16_t count[16] = {};
+		for (uint8_t length : lengths)
+			++count[length];
+		count[0] = 0;
+		uint16_t next[16] = {};
+		uint16_t code = 0;
+		for (int bits = 1; bits < 16; ++bits)
+		{
+			code = static_cast<uint16_t>((code + count[bits - 1]) << 1);
+			next[bits] = code;
+		}
+		std::vector<uint16_t> codes(lengths.size(), 0);
+		for (size_t i = 0; i < lengths.size(); ++i)
+		{
+			int length = lengths[i];
+			if (length == 0)
+				continue;
+			uint16_t value = next[length]++;
+			uint16_t reversed = 0;
+			for (int bit = 0; bit < length; ++bit)
+				reversed |= ((value >> bit) & 1) << (length - 1 - bit);
+			codes[i] = reversed;
+		}
+		return codes;
+	}
+
+	void WriteDynamicBlock(BitWriter& writer, const std::vector<Symbol>& symbols, bool final)
+	{
+		std::vector<uint32_t> literalFreq(286, 0), distanceFreq(30, 0);
+		for (const Symbol& s : symbols)
+		{
+			if (s.distance == 0)
+				++literalFreq[s.value];
+			else
+			{
+				++literalFreq[257 + LengthSymbol(s.value)];
+				++distanceFreq[DistanceSymbol(s.distance)];
+			}
+		}
+		++literalFreq[256];
+		std::vector<uint8_t> literalLengths = CodeLengths(literalFreq, 15);
+		std::vector<uint8_t> distanceLengths = CodeLengths(distanceFreq, 15);
+		// a block without matches still sends one distance code
+		if (std::all_of(distanceLengths.begin(), distanceLengths.end(), [](uint8_t l) { return l == 0; }))
+			distanceLengths[0] = 1;
+		size_t literalCount = 286, distanceCount = 30;
+		while (literalCount > 257 && literalLengths[literalCount - 1] == 0)
+			--literalCount;
+		while (distanceCount > 1 && distanceLengths[distanceCount - 1] == 0)
+			--distanceCount;
+
+		// both length lists run length encoded as one sequence: (symbol, extra bits value)
+		std::vector<uint8_t> sequence(literalLengths.begin(), literalLengths.begin() + literalCount);
+		sequence.insert(sequence.end(), distanceLengths.begin(), distanceLengths.begin() + distanceCount);
+		std::vector<std::pair<uint8_t, uint8_t>> runs;
+		for (size_t i = 0; i < sequence.size();)
+		{
+			uint8_t value = sequence[i];
+			size_t run = 1;
+			while (i + run < sequence.size() && sequence[i + run] == value)
+				++run;
+			i += run;
+			if (value == 0)
+			{
+				while (run >= 11)
+				{
+					size_t n = std::min<size_t>(run, 138);
+					runs.push_back({ 18, static_cast<uint8_t>(n - 11) });
+					run -= n;
+				}
+				if (run >= 3)
+				{
+					runs.push_back({ 17, static_cast<uint8_t>(run - 3) });
+					run = 0;
+				}
+			}
+			else
+			{
+				runs.push_back({ value, 0 });
+				--run;
+				while (run >= 3)
+				{
+					size_t n = std::min<size_t>(run, 6);
+					runs.push_back({ 16, static_cast<uint8_t>(n - 3) });
+					run -= n;
+				}
+			}
+			for (; run > 0; --run)
+				runs.push_back({ value, 0 });
+		}
+		std::vector<uint32_t> codeLengthFreq(19, 0);
+		for (auto& run : runs)
+			++codeLengthFreq[run.first];
+		// inflate rejects an incomplete code length code, a single used symbol gets a partner
+		if (std::count_if(codeLengthFreq.begin(), codeLengthFreq.end(), [](uint32_t f) { return f > 0; }) < 2)
+			++codeLengthFreq[codeLengthFreq[0] > 0 ? 1 : 0];
+		std::vector<uint8_t> codeLengthLengths = CodeLengths(codeLengthFreq, 7);
+		std::vector<uint16_t> codeLengthCodes = CanonicalCodes(codeLengthLengths);
+		size_t codeLengthCount = 19;
+		while (codeLengthCount > 4 && codeLengthLengths[CodeLengthOrder[codeLengthCount - 1]] == 0)
+			--codeLengthCount;
+
+		writer.Put(final ? 1 : 0, 1);
+		writer.Put(2, 2);
+		writer.Put(static_cast<uint32_t>(literalCount - 257), 5);
+		writer.Put(static_cast<uint32_t>(distanceCount - 1), 5);
+		writer.Put(static_cast<uint32_t>(codeLengthCount - 4), 4);
+		for (size_t i = 0; i < codeLengthCount; ++i)
+			writer.Put(codeLengthLengths[CodeLengthOrder[i]], 3);
+		static const int RunExtraBits[3] = { 2, 3, 7 };
+		for (auto& run : runs)
+		{
+			writer.Put(codeLengthCodes[run.first], codeLengthLengths[run.first]);
+			if (run.first >= 16)
+				writer.Put(run.second, RunExtraBits[run.first - 16]);
+		}
+
+		std::vector<uint16_t> literalCodes = CanonicalCodes(literalLengths);
+		std::vector<uint16_t> distanceCodes = CanonicalCodes(distanceLengths);
+		for (const Symbol& s : symbols)
+		{
+			if (s.distance == 0)
+			{
+				writer.Put(literalCodes[s.value], literalLengths[s.value]);
+				continue;
+			}
+			int length = LengthSymbol(s.value);
+			writer.Put(literalCodes[257 + length], literalLengths[257 + length]);
+			writer.Put(s.value - LengthBase[length], LengthExtra[length]);
+			int distance = DistanceSymbol(s.distance);
+			writer.Put(distanceCodes[distance], distanceLengths[distance]);
+			writer.Put(s.distance - DistanceBase[distance], DistanceExtra[distance]);
+		}
+		writer.Put(literalCodes[256], literalLengths[256]);
+	}
+
+	uint32_t ReadHash(const uint8_t* p)
+	{
+		uint32_t v = static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16);
+		return (v * 2654435761u) >> (32 - HashBits);
+	}
+
+	// slicing by 8: table[k][n] is the CRC of byte n followed by k zero bytes
+	const std::array<std::array<uint32_t, 256>, 8>& CrcTables()
+	{
+		static const std::array<std::array<uint32_t, 256>, 8> tables = []() {
+			std::array<std::array<uint32_t, 256>, 8> t{};
+			for (uint32_t n = 0; n < 256; ++n)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; ++k)
+					c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				t[0][n] = c;
+			}
+			for (int k = 1; k < 8; ++k)
+			{
+				for (uint32_t n = 0; n < 256; ++n)
+					t[k][n] = t[0][t[k - 1][n] & 0xFF] ^ (t[k - 1][n] >> 8);
+			}
+			return t;
+		}();
+		return tables;
+	}
+
+	void PutBigEndian(std::vector<uint8_t>& out, uint32_t v)
+	{
+		out.push_back(static_cast<uint8_t>(v >> 24));
+		out.push_back(static_cast<uint8_t>(v >> 16));
+		out.push_back(static_cast<uint8_t>(v >> 8));
+		out.push_back(static_cast<uint8_t>(v));
+	}
+
+	void WriteChunk(std::ostream& os, const char* type, const uint8_t* data, size_t size, uint32_t crc)
+	{
+		std::vector<uint8_t> head;
+		PutBigEndian(head, static_cast<uint32_t>(size));
+		head.insert(head.end(), type, type + 4);
+		os.write(reinterpret_cast<const char*>(head.data()), static_cast<std::streamsize>(head.size()));
+		os.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+		std::vector<uint8_t> tail;
+		PutBigEndian(tail, crc);
+		os.write(reinterpret_cast<const char*>(tail.data()), static_cast<std::streamsize>(tail.size()));
+	}
+
+	void WriteChunk(std::ostream& os, const char* type, const std::vector<uint8_t>& data)
+	{
+		uint32_t crc = gi::ImageEncoder::Crc32(0, reinterpret_cast<const uint8_t*>(type), 4);
+		WriteChunk(os, type, data.data(), data.size(), gi::ImageEncoder::Crc32(crc, data.data(), data.size()));
+	}
+
+	uint8_t Paeth(int a, int b, int c)
+	{
+		int p = a + b - c;
+		int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc)
+			return static_cast<uint8_t>(a);
+		return static_cast<uint8_t>(pb <= pc ? b : c);
+	}
+
+	// filter type byte and filtered bytes of row into out, previous is nullptr on the first row
+	void FilterRow(int type, const uint8_t* row, const uint8_t* previous, size_t rowBytes, uint8_t* out)
+	{
+		const size_t bpp = 3;
+		out[0] = static_cast<uint8_t>(type);
+		++out;
+		if (!previous && (type == 2 || type == 4))
+			type = type == 2 ? 0 : 1; // Paeth of a zero row above picks the left byte
+		switch (type)
+		{
+		case 0:
+			std::memcpy(out, row, rowBytes);
+			break;
+		case 1:
+			for (size_t i = 0; i < rowBytes; ++i)
+				out[i] = static_cast<uint8_t>(row[i] - (i >= bpp ? row[i - bpp] : 0));
+			break;
+		case 2:
+			for (size_t i = 0; i < rowBytes; ++i)
+				out[i] = static_cast<uint8_t>(row[i] - previous[i]);
+			break;
+		case 3:
+			for (size_t i = 0; i < rowBytes; ++i)
+				out[i] = static_cast<uint8_t>(row[i] - ((i >= bpp ? row[i - bpp] : 0) + (previous ? previous[i] : 0)) / 2);
+			break;
+		case 4:
+			for (size_t i = 0; i < rowBytes; ++i)
+			{
+				int left = i >= bpp ? row[i - bpp] : 0;
+				int upLeft = i >= bpp ? previous[i - bpp] : 0;
+				out[i] = static_cast<uint8_t>(row[i] - Paeth(left, previous[i], upLeft));
+			}
+			break;
+		}
+	}
+
+	// Level 0 keeps rows as they are, low levels predict from the row above which suits
+	// rendered images, higher levels pick the filter with the smallest sum of residuals.
+	void FilterRows(const uint8_t* rgb, size_t rowBytes, int firstRow, int lastRow, int level, std::vector<uint8_t>& out)
+	{
+		out.resize((rowBytes + 1) * static_cast<size_t>(lastRow - firstRow));
+		std::vector<uint8_t> candidate(rowBytes + 1);
+		for (int y = firstRow; y < lastRow; ++y)
+		{
+			const uint8_t* row = rgb + static_cast<size_t>(y) * rowBytes;
+			const uint8_t* previous = y > 0 ? row - rowBytes : nullptr;
+			uint8_t* target = out.data() + (rowBytes + 1) * static_cast<size_t>(y - firstRow);
+			if (level == 0)
+			{
+				FilterRow(0, row, previous, rowBytes, target);
+				continue;
+			}
+			if (level < 4)
+			{
+				FilterRow(previous ? 2 : 1, row, previous, rowBytes, target);
+				continue;
+			}
+			uint64_t best = UINT64_MAX;
+			for (int type = 0; type <= 4; ++type)
+			{
+				FilterRow(type, row, previous, rowBytes, candidate.data());
+				uint64_t sum = 0;
+				for (size_t i = 1; i <= rowBytes; ++i)
+					sum += static_cast<uint64_t>(std::abs(static_cast<int8_t>(candidate[i])));
+				if (sum < best)
+				{
+					best = sum;
+					std::copy(candidate.begin(), candidate.end(), target);
+				}
+			}
+		}
+	}
+}
+
+void gi::ImageEncoder::Deflate(const uint8_t* data, size_t size, int level, bool final, std::vector<uint8_t>& out)
+{
+	level = std::clamp(level, 0, MaxPngLevel);
+	BitWriter writer(out);
+	if (level == 0)
+	{
+		size_t offset = 0;
+		do
+		{
+			size_t count = std::min(MaxStoredBlock, size - offset);
+			bool last = offset + count == size;
+			writer.Put(final && last ? 1 : 0, 1);
+			writer.Put(0, 2);
+			writer.Align();
+			out.push_back(static_cast<uint8_t>(count));
+			out.push_back(static_cast<uint8_t>(count >> 8));
+			out.push_back(static_cast<uint8_t>(~count));
+			out.push_back(static_cast<uint8_t>(~count >> 8));
+			out.insert(out.end(), data + offset, data + offset + count);
+			offset += count;
+		} while (offset < size);
+		return;
+	}
+
+	const LevelConfig& config = Levels[level];
+	std::vector<int32_t> head(size_t(1) << HashBits, -1);
+	std::vector<int32_t> previous(WindowSize, -1);
+	std::vector<Symbol> symbols;
+	symbols.reserve(BlockSymbols);
+	auto insert = [&](size_t position) {
+		uint32_t hash = ReadHash(data + position);
+		previous[position & (WindowSize - 1)] = head[hash];
+		head[hash] = static_cast<int32_t>(position);
+	};
+
+	// greedy matching, the positions inside a match are still entered into the hash chains
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t bestLength = 0, bestDistance = 0;
+		if (i + MinMatch <= size)
+		{
+			size_t maxLength = std::min(MaxMatch, size - i);
+			int32_t candidate = head[ReadHash(data + i)];
+			for (int chain = config.maxChain; candidate >= 0 && chain > 0; --chain)
+			{
+				size_t distance = i - static_cast<size_t>(candidate);
+				if (distance > WindowSize)
+					break;
+				const uint8_t* match = data + candidate;
+				if (match[bestLength] == data[i + bestLength])
+				{
+					size_t length = 0;
+					while (length < maxLength && match[length] == data[i + length])
+						++length;
+					if (length > bestLength)
+					{
+						bestLength = length;
+						bestDistance = distance;
+						if (length >= config.nice || length == maxLength)
+							break;
+					}
+				}
+				int32_t next = previous[static_cast<size_t>(candidate) & (WindowSize - 1)];
+				if (next >= candidate)
+					break;
+				candidate = next;
+			}
+			insert(i);
+		}
+		if (bestLength >= MinMatch)
+		{
+			symbols.push_back({ static_cast<uint16_t>(bestLength), static_cast<uint16_t>(bestDistance) });
+			for (size_t k = 1; k < bestLength; ++k)
+			{
+				if (i + k + MinMatch <= size)
+					insert(i + k);
+			}
+			i += bestLength;
+		}
+		else
+		{
+			symbols.push_back({ data[i], 0 });
+			++i;
+		}
+		if (symbols.size() >= BlockSymbols && i < size)
+		{
+			WriteDynamicBlock(writer, symbols, false);
+			symbols.clear();
+		}
+	}
+	WriteDynamicBlock(writer, symbols, final);
+	if (!final)
+	{
+		// empty stored block: byte aligned end, like a zlib sync flush
+		writer.Put(0, 3);
+		writer.Align();
+		const uint8_t sync[4] = { 0x00, 0x00, 0xFF, 0xFF };
+		out.insert(out.end(), sync, sync + 4);
+	}
+	writer.Align();
+}
+
+uint32_t gi::ImageEncoder::Crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+	const auto& t = CrcTables();
+	crc = ~crc;
+	for (; size >= 8; size -= 8, data += 8)
+	{
+		uint32_t low = crc ^ (static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+			(static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24));
+		crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+			t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+	}
+	for (; size > 0; --size, ++data)
+		crc = t[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+uint32_t gi::ImageEncoder::Adler32(uint32_t adler, const uint8_t* data, size_t size)
+{
+	const uint32_t Base = 65521;
+	// largest run before the sums can overflow 32 bits
+	const size_t MaxRun = 5552;
+	uint32_t a = adler & 0xFFFF, b = adler >> 16;
+	while (size > 0)
+	{
+		size_t run = std::min(size, MaxRun);
+		size -= run;
+		for (size_t i = 0; i < run; ++i)
+		{
+			a += data[i];
+			b += a;
+		}
+		data += run;
+		a %= Base;
+		b %= Base;
+	}
+	return a | (b << 16);
+}
+
+uint32_t gi::ImageEncoder::Adler32Combine(uint32_t first, uint32_t second, size_t secondSize)
+{
+	const uint64_t Base = 65521;
+	uint64_t remainder = secondSize % Base;
+	uint64_t a1 = first & 0xFFFF, b1 = first >> 16;
+	uint64_t a2 = second & 0xFFFF, b2 = second >> 16;
+	// every byte of the second part adds a1 to its b sum once more
+	uint64_t a = (a1 + a2 + Base - 1) % Base;
+	uint64_t b = (b1 + b2 + remainder * a1 + Base - remainder) % Base;
+	return static_cast<uint32_t>(a | (b << 16));
+}
+
+bool gi::ImageEncoder::WritePng(std::ostream& os, const uint8_t* rgb, int width, int height, int level, WorkStealingPool* pool)
+{
+	if (width <= 0 || height <= 0)
+		return false;
+	level = std::clamp(level, 0, MaxPngLevel);
+	size_t rowBytes = static_cast<size_t>(width) * 3;
+	int stripRows = static_cast<int>(std::max<size_t>(1, PngStripBytes / (rowBytes + 1)));
+	size_t stripCount = (static_cast<size_t>(height) + stripRows - 1) / stripRows;
+
+	struct Strip
+	{
+		std::vector<uint8_t> data; // deflate output
+		uint32_t crc = 0;          // of "IDAT" and data
+		uint32_t adler = 1;        // of the filtered rows
+		size_t filteredSize = 0;
+		bool done = false;
+	};
+	std::vector<Strip> strips(stripCount);
+	std::mutex mutex;
+	std::condition_variable stripDone;
+	auto encode = [&](size_t index) {
+		Strip& strip = strips[index];
+		int first = static_cast<int>(index) * stripRows;
+		int last = std::min(height, first + stripRows);
+		std::vector<uint8_t> filtered;
+		FilterRows(rgb, rowBytes, first, last, level, filtered);
+		strip.filteredSize = filtered.size();
+		strip.adler = Adler32(1, filtered.data(), filtered.size());
+		Deflate(filtered.data(), filtered.size(), level, index + 1 == strips.size(), strip.data);
+		strip.crc = Crc32(Crc32(0, reinterpret_cast<const uint8_t*>("IDAT"), 4), strip.data.data(), strip.data.size());
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			strip.done = true;
+		}
+		stripDone.notify_all();
+	};
+	if (pool)
+	{
+		for (size_t i = 0; i < stripCount; ++i)
+			pool->Submit([&encode, i](unsigned) { encode(i); });
+	}
+
+	const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	os.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+	std::vector<uint8_t> header;
+	PutBigEndian(header, static_cast<uint32_t>(width));
+	PutBigEndian(header, static_cast<uint32_t>(height));
+	// 8 bit RGB, deflate, adaptive filtering, no interlace
+	const uint8_t format[5] = { 8, 2, 0, 0, 0 };
+	header.insert(header.end(), format, format + 5);
+	WriteChunk(os, "IHDR", header);
+	// zlib header, FLEVEL only tells what the encoder tried
+	const uint8_t zlibHeader[4][2] = { { 0x78, 0x01 }, { 0x78, 0x5E }, { 0x78, 0x9C }, { 0x78, 0xDA } };
+	int flevel = level <= 1 ? 0 : level <= 5 ? 1 : level == 6 ? 2 : 3;
+	WriteChunk(os, "IDAT", std::vector<uint8_t>(zlibHeader[flevel], zlibHeader[flevel] + 2));
+
+	// strips go out in order as they finish
+	uint32_t adler = 1;
+	for (size_t i = 0; i < stripCount; ++i)
+	{
+		if (pool)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stripDone.wait(lock, [&]() { return strips[i].done; });
+		}
+		else
+			encode(i);
+		Strip& strip = strips[i];
+		WriteChunk(os, "IDAT", strip.data.data(), strip.data.size(), strip.crc);
+		adler = Adler32Combine(adler, strip.adler, strip.filteredSize);
+		std::vector<uint8_t>().swap(strip.data);
+	}
+	std::vector<uint8_t> trailer;
+	PutBigEndian(trailer, adler);
+	WriteChunk(os, "IDAT", trailer);
+	WriteChunk(os, "IEND", {});
+	return !os.fail();
+}
+
+bool gi::ImageEncoder::WriteQoi(std::ostream& os, const uint8_t* rgb, int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return false;
+	std::vector<uint8_t> out;
+	out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+	PutBigEndian(out, static_cast<uint32_t>(width));
+	PutBigEndian(out, static_cast<uint32_t>(height));
+	// 3 channels, sRGB with linear alpha
+	out.push_back(3);
+	out.push_back(0);
+
+	struct Pixel
+	{
+		uint8_t r, g, b;
+		bool operator==(const Pixel& rhs)const { return r == rhs.r && g == rhs.g && b == rhs.b; }
+	};
+	// alpha is always 255, its 255 * 11 is part of the index hash
+	Pixel index[64] = {};
+	bool indexed[64] = {};
+	Pixel previous{ 0, 0, 0 };
+	size_t run = 0;
+	size_t pixelCount = static_cast<size_t>(width) * height;
+	for (size_t i = 0; i < pixelCount; ++i)
+	{
+		Pixel pixel{ rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2] };
+		if (pixel == previous)
+		{
+			++run;
+			if (run == 62 || i + 1 == pixelCount)
+			{
+				out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+				run = 0;
+			}
+		}
+		else
+		{
+			if (run > 0)
+			{
+				out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+				run = 0;
+			}
+			int hash = (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + 255 * 11) % 64;
+			// the decoder starts with an index of zeros, including alpha, so no entry matches until set
+			if (indexed[hash] && index[hash] == pixel)
+				out.push_back(static_cast<uint8_t>(hash));
+			else
+			{
+				index[hash] = pixel;
+				indexed[hash] = true;
+				int dr = static_cast<int8_t>(pixel.r - previous.r);
+				int dg = static_cast<int8_t>(pixel.g - previous.g);
+				int db = static_cast<int8_t>(pixel.b - previous.b);
+				int drg = dr - dg, dbg = db - dg;
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+					out.push_back(static_cast<uint8_t>(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+				else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+				{
+					out.push_back(static_cast<uint8_t>(0x80 | (dg + 32)));
+					out.push_back(static_cast<uint8_t>(((drg + 8) << 4) | (dbg + 8)));
+				}
+				else
+					out.insert(out.end(), { 0xFE, pixel.r, pixel.g, pixel.b });
+			}
+		}
+		previous = pixel;
+		if (out.size() >= PngStripBytes)
+		{
+			os.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+			out.clear();
+		}
+	}
+	out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+	os.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+	return !os.fail();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace gi
+{
+	class WorkStealingPool;
+
+	// Encoders for 8 bit RGB framebuffers, rows top to bottom as in RasterCanvas::GetPixels.
+	// Everything including deflate is built in, there is no library to link.
+	class ImageEncoder
+	{
+	public:
+		static constexpr int MaxPngLevel = 9;
+		// rows are filtered and deflated in strips of about this many bytes
+		static constexpr size_t PngStripBytes = 1024 * 1024;
+
+		// PNG, level 0 stores, 1 to 9 search longer match chains and choose row filters more
+		// carefully. Strips of rows are compressed independently on pool, or one after the other
+		// without one, and stitched into a single zlib stream with an IDAT chunk per strip.
+		// False for an empty image or a failed stream.
+		static bool WritePng(std::ostream& os, const uint8_t* rgb, int width, int height, int level, WorkStealingPool* pool);
+		// QOI ("Quite OK Image"), a single fast pass. False for an empty image or a failed stream.
+		static bool WriteQoi(std::ostream& os, const uint8_t* rgb, int width, int height);
+
+		// Raw deflate of data appended to out. A final stream sets BFINAL on its last block, otherwise
+		// it ends byte aligned on an empty stored block so another stream can follow.
+		static void Deflate(const uint8_t* data, size_t size, int level, bool final, std::vector<uint8_t>& out);
+		static uint32_t Crc32(uint32_t crc, const uint8_t* data, size_t size);
+		static uint32_t Adler32(uint32_t adler, const uint8_t* data, size_t size);
+		// Adler-32 of two parts concatenated, from their checksums and the size of the second
+		static uint32_t Adler32Combine(uint32_t first, uint32_t second, size_t secondSize);
+	};
+}
@@ -0,0 +1,107 @@
+
+#include "IncrementalRunner.h"
+#include "Interpreter.h"
+
+#include <cassert>
+
+void gi::IncrementalRunner::SetPointCache(PointCache* cache)
+{
+	pointCache = cache;
+}
+
+void gi::IncrementalRunner::SetAdaptiveSampling(double tolerance)
+{
+	adaptiveTolerance = tolerance;
+}
+
+void gi::IncrementalRunner::SetFastMath(double tolerance)
+{
+	fastMathTolerance = tolerance;
+}
+
+void gi::IncrementalRunner::SetTrigRecurrenceInterval(size_t resyncInterval)
+{
+	trigResyncInterval = resyncInterval;
+}
+
+void gi::IncrementalRunner::SetSinglePrecision(double tolerance)
+{
+	singlePrecisionTolerance = tolerance;
+}
+
+void gi::IncrementalRunner::SetPeriodClamping(bool enable)
+{
+	periodClamping = enable;
+}
+
+void gi::IncrementalRunner::SetViewportCulling(double width, double height, size_t granularity)
+{
+	viewportWidth = width;
+	viewportHeight = height;
+	cullGranularity = granularity;
+}
+
+gi::IncrementalRunner::RunReport gi::IncrementalRunner::Run(NTProgram* program,
+	const std::vector<StatementSource>& sources, ICanvas* canvas)
+{
+	RunReport report;
+	std::vector<NTStatement*> statements;
+	program->CollectStatements(statements);
+	assert(statements.size() == sources.size());
+
+	CanvasStateTracker tracker(canvas);
+	tracker.Clear();
+	tracker.ApplyState(CanvasState());
+
+	EvaluateContext context;
+	context.SetCanvas(&tracker);
+	context.SetPointCache(pointCache);
+	context.SetAdaptiveSampling(adaptiveTolerance);
+	context.SetFastMath(fastMathTolerance);
+	context.SetTrigRecurrenceInterval(trigResyncInterval);
+	context.SetSinglePrecision(singlePrecisionTolerance);
+	context.SetPeriodClamping(periodClamping);
+	context.SetViewportCulling(viewportWidth, viewportHeight, cullGranularity);
+
+	std::unordered_map<std::wstring, CachedStatement> nextCache;
+	for (size_t i = 0; i < statements.size(); ++i)
+	{
+		++report.statements;
+		if (!statements[i]->IsForStatement())
+		{
+			statements[i]->Evaluate(context);
+			continue;
+		}
+
+		const std::wstring& text = sources[i].text;
+		auto cached = cache.find(text);
+		// adaptive samples, fast math tiers, float evaluation and culled ranges were picked for the transform they were drawn with
+		if (cached != cache.end() && (adaptiveTolerance > 0 || fastMathTolerance > 0 || singlePrecisionTolerance > 0 || cullGranularity > 0) &&
+			cached->second.state != tracker.GetState())
+			cached = cache.end();
+		if (cached != cache.end())
+		{
+			++report.reused;
+			if (cached->second.state != tracker.GetState())
+				++report.retransformed;
+			if (statements[i]->DrawsLines())
+				DrawPolyline(tracker, cached->second.points);
+			else
+				for (auto& point : cached->second.points)
+					tracker.DrawPoint(point.x, point.y);
+			cached->second.state = tracker.GetState();
+			nextCache.insert(*cached);
+			continue;
+		}
+
+		++report.evaluated;
+		CachedStatement entry{ tracker.GetState(), {} };
+		tracker.SetCapture(&entry.points);
+		statements[i]->Evaluate(context);
+		tracker.SetCapture(nullptr);
+		nextCache.emplace(text, std::move(entry));
+	}
+
+	cache = std::move(nextCache);
+	return report;
+}
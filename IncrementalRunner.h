@@ -0,0 +1,64 @@
+#pragma once
+
+#include "CanvasStateTracker.h"
+#include "Parser.h"
+#include "PointCache.h"
+#include "Syntax.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gi
+{
+	// Re-runs a program after an edit, evaluating only FOR statements whose source changed.
+	// Points of unchanged FOR statements are kept in model space and replayed through the
+	// canvas, so a changed ORIGIN/SCALE/ROT/SIZE/COLOR only costs the transform.
+	class IncrementalRunner
+	{
+	public:
+		struct RunReport
+		{
+			size_t statements = 0;
+			size_t evaluated = 0;     // FOR statements evaluated from scratch
+			size_t reused = 0;        // FOR statements replayed from the cache
+			size_t retransformed = 0; // replayed under a different inherited canvas state
+		};
+	private:
+		struct CachedStatement
+		{
+			CanvasState state;
+			std::vector<ModelPoint> points;
+		};
+
+		// FOR statements of the last successful run, keyed by source text
+		std::unordered_map<std::wstring, CachedStatement> cache;
+		PointCache* pointCache = nullptr;
+		double adaptiveTolerance = 0.0;
+		double fastMathTolerance = 0.0;
+		size_t trigResyncInterval = 0;
+		double singlePrecisionTolerance = 0.0;
+		bool periodClamping = false;
+		double viewportWidth = 0.0;
+		double viewportHeight = 0.0;
+		size_t cullGranularity = 0;
+	public:
+		// forwarded to EvaluateContext::SetPointCache for statements that miss the text cache
+		void SetPointCache(PointCache* cache);
+		// forwarded to EvaluateContext::SetAdaptiveSampling
+		void SetAdaptiveSampling(double tolerance);
+		// forwarded to EvaluateContext::SetFastMath
+		void SetFastMath(double tolerance);
+		// forwarded to EvaluateContext::SetTrigRecurrenceInterval
+		void SetTrigRecurrenceInterval(size_t resyncInterval);
+		// forwarded to EvaluateContext::SetSinglePrecision
+		void SetSinglePrecision(double tolerance);
+		// forwarded to EvaluateContext::SetPeriodClamping
+		void SetPeriodClamping(bool enable);
+		// forwarded to EvaluateContext::SetViewportCulling
+		void SetViewportCulling(double width, double height, size_t granularity);
+
+		// Clear canvas and run program on it. Throws like EvaluateContext::Run, the cache is kept on failure.
+		RunReport Run(NTProgram* program, const std::vector<StatementSource>& sources, ICanvas* canvas);
+	};
+}
@@ -1,7 +1,33 @@
 
 #include "Interpreter.h"
+#include "AllocationTracker.h"
+#include "FastMath.h"
+#include "PerfCounters.h"
+#include "Trace.h"
 
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+
+namespace
+{
+	// draw state is kept by the tracker in front of it, the points by its capture buffer
+	class DiscardCanvas : public gi::ICanvas
+	{
+	public:
+		void SetDrawOrigin(double, double) override {}
+		void SetDrawRotation(double) override {}
+		void SetDrawScale(double, double) override {}
+		void SetDrawPointSize(int) override {}
+		void SetDrawPointColor(uint8_t, uint8_t, uint8_t) override {}
+		void SetDrawBackgroundColor(uint8_t, uint8_t, uint8_t) override {}
+		void DrawPoint(double, double) override {}
+		void DrawLine(double, double, double, double) override {}
+		void Clear() override {}
+	};
+}
 
 double& gi::EvaluateContext::Lookup(const std::wstring& name)
 {
@@ -25,6 +51,22 @@ double& gi::EvaluateContext::Lookup(const std::wstring& name)
 
 double(* gi::EvaluateContext::LookupFunction(const std::wstring& name))(double)
 {
+	if (fastMathTolerance > 0)
+	{
+		// the replacements only change with the scale, not per call
+		const CanvasState& state = GetCanvasState();
+		double scale = std::max(std::fabs(state.scaleX), std::fabs(state.scaleY));
+		double maxError = scale > 0 ? fastMathTolerance / scale : fastMathTolerance;
+		if (maxError != fastMathMaxError)
+			ResolveFastMath(maxError);
+		for (auto& sym : fastSymbols)
+		{
+			if (sym.MatchName(name))
+			{
+				return sym.function;
+			}
+		}
+	}
 	for (auto& sym : staticSymbols)
 	{
 		if (sym.MatchName(name) && sym.type == Symbol::Type::Function)
@@ -56,6 +98,19 @@ void gi::EvaluateContext::NewExpression()
 	dynamicSymbols.clear();
 }
 
+void gi::EvaluateContext::ResolveFastMath(double maxError)
+{
+	fastSymbols.clear();
+	fastMathMaxError = maxError;
+	for (auto& sym : staticSymbols)
+	{
+		if (sym.type != Symbol::Type::Function)
+			continue;
+		if (auto function = FastMath::Select(sym.name, maxError))
+			fastSymbols.push_back({ sym.name, Symbol::Type::Function, 0.0, function });
+	}
+}
+
 void gi::EvaluateContext::AddVariableSymbol(const std::wstring& name, double value)
 {
 	for (auto& sym : staticSymbols)
@@ -79,7 +134,9 @@ void gi::EvaluateContext::AddVariableSymbol(const std::wstring& name, double val
 
 void gi::EvaluateContext::SetCanvas(ICanvas* canvas)
 {
-	this->canvas = canvas;
+	targetCanvas = canvas;
+	canvasTracker = CanvasStateTracker(metrics ? metrics->WrapCanvas(canvas) : canvas);
+	this->canvas = canvas ? &canvasTracker : nullptr;
 }
 
 gi::ICanvas* gi::EvaluateContext::GetCanvas()const
@@ -87,7 +144,247 @@ gi::ICanvas* gi::EvaluateContext::GetCanvas()const
 	return canvas;
 }
 
+const gi::CanvasState& gi::EvaluateContext::GetCanvasState() const
+{
+	return canvasTracker.GetState();
+}
+
+void gi::EvaluateContext::SetPointCache(PointCache* cache)
+{
+	this->pointCache = cache;
+}
+
+gi::PointCache* gi::EvaluateContext::GetPointCache()const
+{
+	return pointCache;
+}
+
+void gi::EvaluateContext::SetAdaptiveSampling(double tolerance)
+{
+	adaptiveTolerance = tolerance;
+}
+
+double gi::EvaluateContext::GetAdaptiveSampling() const
+{
+	return adaptiveTolerance;
+}
+
+void gi::EvaluateContext::SetFastMath(double tolerance)
+{
+	fastMathTolerance = tolerance;
+	fastMathMaxError = 0.0;
+	fastSymbols.clear();
+}
+
+double gi::EvaluateContext::GetFastMath() const
+{
+	return fastMathTolerance;
+}
+
+void gi::EvaluateContext::SetSinglePrecision(double tolerance)
+{
+	singlePrecisionTolerance = tolerance;
+}
+
+double gi::EvaluateContext::GetSinglePrecision() const
+{
+	return singlePrecisionTolerance;
+}
+
+void gi::EvaluateContext::SetPeriodClamping(bool enable)
+{
+	periodClamping = enable;
+}
+
+bool gi::EvaluateContext::GetPeriodClamping() const
+{
+	return periodClamping;
+}
+
+void gi::EvaluateContext::SetTrigRecurrenceInterval(size_t resyncInterval)
+{
+	trigResyncInterval = resyncInterval;
+}
+
+size_t gi::EvaluateContext::GetTrigRecurrenceInterval() const
+{
+	return trigResyncInterval;
+}
+
+void gi::EvaluateContext::SetTrigRecurrence(TrigRecurrence* recurrence)
+{
+	trigRecurrence = recurrence;
+}
+
+void gi::EvaluateContext::SetViewportCulling(double width, double height, size_t granularity)
+{
+	viewportWidth = width;
+	viewportHeight = height;
+	cullGranularity = granularity;
+}
+
+size_t gi::EvaluateContext::GetCullGranularity() const
+{
+	return cullGranularity;
+}
+
+double gi::EvaluateContext::GetViewportWidth() const
+{
+	return viewportWidth;
+}
+
+double gi::EvaluateContext::GetViewportHeight() const
+{
+	return viewportHeight;
+}
+
+void gi::EvaluateContext::SetMetrics(ExecutionMetrics* metrics)
+{
+	this->metrics = metrics;
+	SetCanvas(targetCanvas);
+}
+
+void gi::EvaluateContext::SetWorkerPool(WorkStealingPool* pool)
+{
+	workerPool = pool;
+}
+
 void gi::EvaluateContext::Run(NTProgram* program)
 {
-	program->Evaluate(*this);
+	TraceSpan span("EvaluateContext::Run", "evaluate");
+	PerfScope perf("EvaluateContext::Run");
+	AllocationPhaseScope allocations(AllocationPhase::Evaluate);
+	if (workerPool && !metrics && canvas)
+		RunConcurrent(program);
+	else
+		program->Evaluate(*this);
+}
+
+void gi::EvaluateContext::RunConcurrent(NTProgram* program)
+{
+	struct ForSlot
+	{
+		std::vector<ModelPoint> points;
+		std::vector<std::wstring> messages; // printed when the slot is committed
+		std::exception_ptr error;
+		bool done = false;
+	};
+
+	std::vector<NTStatement*> statements;
+	program->CollectStatements(statements);
+	size_t forCount = 0;
+	for (auto* statement : statements)
+		forCount += statement->IsForStatement() ? 1 : 0;
+	std::vector<ForSlot> slots(forCount);
+	std::mutex slotMutex;
+	std::condition_variable slotDone;
+	size_t submitted = 0;
+	DiscardCanvas discard;
+	// FOR statements evaluated ahead of the commit, so buffered points stay bounded
+	const size_t maxInFlight = 2 * static_cast<size_t>(workerPool->GetThreadCount());
+
+	// the tasks reference slots, never leave before they are finished
+	auto waitFor = [&](size_t i) {
+		std::unique_lock<std::mutex> lock(slotMutex);
+		slotDone.wait(lock, [&]() { return slots[i].done; });
+	};
+	auto waitAll = [&]() {
+		for (size_t i = 0; i < submitted; ++i)
+			waitFor(i);
+	};
+
+	// Commit in program order up to and including the next FOR statement, state statements
+	// run again on the real canvas
+	size_t nextStatement = 0;
+	size_t committed = 0;
+	auto commitNext = [&]() {
+		while (nextStatement < statements.size())
+		{
+			NTStatement* statement = statements[nextStatement++];
+			if (!statement->IsForStatement() || committed >= submitted)
+			{
+				// state statements, and FOR statements after the plan stopped early:
+				// whatever stopped it has not failed here
+				statement->Evaluate(*this);
+				continue;
+			}
+			waitFor(committed);
+			ForSlot& slot = slots[committed++];
+			for (auto& message : slot.messages)
+				PrintMessage(message);
+			std::vector<std::wstring>().swap(slot.messages);
+			if (slot.error)
+				std::rethrow_exception(slot.error);
+			if (statement->DrawsLines())
+				DrawPolyline(*canvas, slot.points);
+			else
+				for (auto& point : slot.points)
+					canvas->DrawPoint(point.x, point.y);
+			std::vector<ModelPoint>().swap(slot.points);
+			return;
+		}
+	};
+
+	// Plan: run state statements on a scratch context to learn the state each FOR starts
+	// with, and hand the FOR statements to the pool. A failing state statement ends the
+	// plan, it throws again when it is committed.
+	try {
+		EvaluateContext planner;
+		planner.SetCanvas(&discard);
+		planner.canvasTracker.ApplyState(GetCanvasState());
+		// the commit prints them again
+		std::vector<std::wstring> plannerMessages;
+		for (auto* statement : statements)
+		{
+			if (!statement->IsForStatement())
+			{
+				try {
+					MessageCapture capture(plannerMessages);
+					statement->Evaluate(planner);
+				}
+				catch (...)
+				{
+					break;
+				}
+				plannerMessages.clear();
+				continue;
+			}
+			while (submitted - committed >= maxInFlight)
+				commitNext();
+			ForSlot* slot = &slots[submitted++];
+			CanvasState state = planner.GetCanvasState();
+			workerPool->Submit([&, statement, slot, state](unsigned) {
+				try {
+					MessageCapture capture(slot->messages);
+					EvaluateContext task;
+					task.SetCanvas(&discard);
+					task.canvasTracker.ApplyState(state);
+					task.canvasTracker.SetCapture(&slot->points);
+					task.SetAdaptiveSampling(adaptiveTolerance);
+					task.SetFastMath(fastMathTolerance);
+					task.SetTrigRecurrenceInterval(trigResyncInterval);
+					task.SetSinglePrecision(singlePrecisionTolerance);
+					task.SetPeriodClamping(periodClamping);
+					task.SetViewportCulling(viewportWidth, viewportHeight, cullGranularity);
+					statement->Evaluate(task);
+				}
+				catch (...)
+				{
+					slot->error = std::current_exception();
+				}
+				{
+					std::lock_guard<std::mutex> lock(slotMutex);
+					slot->done = true;
+				}
+				slotDone.notify_all();
+			});
+		}
+		while (nextStatement < statements.size())
+			commitNext();
+	}
+	catch (...)
+	{
+		waitAll();
+		throw;
+	}
 }
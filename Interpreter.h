@@ -1,11 +1,17 @@
 #pragma once
 
+#include <cmath>
 #include <string>
 #include <stack>
 #include <vector>
 
+#include "CanvasStateTracker.h"
+#include "ExecutionMetrics.h"
 #include "ICanvas.h"
+#include "PointCache.h"
 #include "Syntax.h"
+#include "TrigRecurrence.h"
+#include "WorkStealingPool.h"
 
 namespace gi
 {
@@ -24,8 +30,29 @@ namespace gi
 		};
 
 		std::vector<Symbol> dynamicSymbols;
+		// FastMath replacements of the built-ins, selected for fastMathMaxError
+		std::vector<Symbol> fastSymbols;
 
+		// statements draw through the tracker so the current transform is known
+		CanvasStateTracker canvasTracker{ nullptr };
 		ICanvas* canvas = nullptr;
+		ICanvas* targetCanvas = nullptr;
+		ExecutionMetrics* metrics = nullptr;
+		WorkStealingPool* workerPool = nullptr;
+		PointCache* pointCache = nullptr;
+		double adaptiveTolerance = 0.0;
+		double fastMathTolerance = 0.0;
+		double fastMathMaxError = 0.0;
+		size_t trigResyncInterval = 0;
+		double singlePrecisionTolerance = 0.0;
+		bool periodClamping = false;
+		TrigRecurrence* trigRecurrence = nullptr;
+		double viewportWidth = 0.0;
+		double viewportHeight = 0.0;
+		size_t cullGranularity = 0;
+
+		void RunConcurrent(NTProgram* program);
+		void ResolveFastMath(double maxError);
 	public:
 		std::stack<double> operands;
 		double& Lookup(const std::wstring& name);
@@ -37,6 +64,71 @@ namespace gi
 
 		void SetCanvas(ICanvas* canvas);
 		ICanvas* GetCanvas()const;
+		// draw state set by statements run so far, assuming the canvas started in the default state
+		const CanvasState& GetCanvasState()const;
+
+		// FOR statements look up and store their points here, nullptr disables caching
+		void SetPointCache(PointCache* cache);
+		PointCache* GetPointCache()const;
+
+		// FOR statements pick their own samples so consecutive points are at most
+		// tolerance pixels apart, STEP only sets the initial spacing. 0 disables.
+		void SetAdaptiveSampling(double tolerance);
+		double GetAdaptiveSampling()const;
+
+		// Built-in functions are replaced by FastMath approximations whose error, scaled by the
+		// larger canvas scale factor, stays below tolerance pixels. That holds for a function
+		// value that reaches a coordinate unchanged, expressions amplifying it amplify the
+		// error as well. Functions fall back to libm where no tier is accurate enough. 0 disables.
+		void SetFastMath(double tolerance);
+		double GetFastMath()const;
+
+		// FOR statements skip parameter ranges proven by interval evaluation to land outside
+		// [0, width) x [0, height) in device space. Ranges are bisected until they hold
+		// granularity steps or fewer. granularity 0 disables culling.
+		void SetViewportCulling(double width, double height, size_t granularity);
+		size_t GetCullGranularity()const;
+		double GetViewportWidth()const;
+		double GetViewportHeight()const;
+
+		// statements record their counters here, nullptr disables the probes.
+		// Draw state tracked so far is reset, set it before Run.
+		void SetMetrics(ExecutionMetrics* metrics);
+		// inline, it is tested on every atom evaluated
+		ExecutionMetrics* GetMetrics()const
+		{
+			return metrics;
+		}
+
+		// Uniform FOR loops evaluate their points in float, a block of loop values at a time,
+		// unless float would move a point by more than tolerance pixels from the double result.
+		// Interval bounds of the coordinates decide per statement, every block is then compared
+		// with its double result and drawn in double where it is off by more. 0 disables.
+		void SetSinglePrecision(double tolerance);
+		double GetSinglePrecision()const;
+
+		// Uniform FOR loops over more than one period of a periodic curve stop after the first,
+		// see PeriodAnalysis. The points drawn are the same, without the repeats.
+		void SetPeriodClamping(bool enable);
+		bool GetPeriodClamping()const;
+
+		// Uniform FOR loops step SIN, COS and TAN of arguments affine in the loop variable
+		// by rotation, recomputing them every resyncInterval steps, see TrigRecurrence.
+		// 0 disables.
+		void SetTrigRecurrenceInterval(size_t resyncInterval);
+		size_t GetTrigRecurrenceInterval()const;
+		// set by TrigRecurrence for the loop running, inline, it is tested on every function call
+		void SetTrigRecurrence(TrigRecurrence* recurrence);
+		TrigRecurrence* GetTrigRecurrence()const
+		{
+			return trigRecurrence;
+		}
+
+		// FOR statements run on pool threads, each from a snapshot of the draw state it starts
+		// with, and their points reach the canvas in program order. nullptr runs everything
+		// on the calling thread, as does a set metrics sink. The point cache is not used by
+		// FOR statements run on the pool.
+		void SetWorkerPool(WorkStealingPool* pool);
 
 		void Run(NTProgram* program);
 	};
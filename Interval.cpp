@@ -0,0 +1,171 @@
+
+#include "Interval.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cwctype>
+#include <limits>
+
+namespace
+{
+	constexpr double Infinity = std::numeric_limits<double>::infinity();
+	constexpr double Pi = 3.14159265358979323846;
+
+	gi::Interval Widen(double lo, double hi, int ulps = 1)
+	{
+		if (std::isnan(lo) || std::isnan(hi))
+			return gi::Interval::Entire();
+		for (int i = 0; i < ulps; ++i)
+		{
+			lo = std::nextafter(lo, -Infinity);
+			hi = std::nextafter(hi, Infinity);
+		}
+		return { lo, hi };
+	}
+
+	// libm is not correctly rounded, allow a few ulps
+	constexpr int FunctionUlps = 4;
+
+	gi::Interval Monotone(double(*f)(double), const gi::Interval& x)
+	{
+		return Widen(f(x.lo), f(x.hi), FunctionUlps);
+	}
+
+	// smallest k with offset + k * period >= lo, then test if that point is within hi
+	bool ContainsPeriodicPoint(const gi::Interval& x, double offset, double period)
+	{
+		double k = std::ceil((x.lo - offset) / period);
+		return offset + k * period <= x.hi;
+	}
+
+	gi::Interval Sin(const gi::Interval& x)
+	{
+		if (!(x.hi - x.lo < 2 * Pi))
+			return { -1.0, 1.0 };
+		double a = std::sin(x.lo);
+		double b = std::sin(x.hi);
+		gi::Interval r = Widen(std::min(a, b), std::max(a, b), FunctionUlps);
+		if (ContainsPeriodicPoint(x, Pi / 2, 2 * Pi))
+			r.hi = 1.0;
+		if (ContainsPeriodicPoint(x, -Pi / 2, 2 * Pi))
+			r.lo = -1.0;
+		r.lo = std::max(r.lo, -1.0);
+		r.hi = std::min(r.hi, 1.0);
+		return r;
+	}
+
+	gi::Interval Cos(const gi::Interval& x)
+	{
+		if (!(x.hi - x.lo < 2 * Pi))
+			return { -1.0, 1.0 };
+		double a = std::cos(x.lo);
+		double b = std::cos(x.hi);
+		gi::Interval r = Widen(std::min(a, b), std::max(a, b), FunctionUlps);
+		if (ContainsPeriodicPoint(x, 0.0, 2 * Pi))
+			r.hi = 1.0;
+		if (ContainsPeriodicPoint(x, Pi, 2 * Pi))
+			r.lo = -1.0;
+		r.lo = std::max(r.lo, -1.0);
+		r.hi = std::min(r.hi, 1.0);
+		return r;
+	}
+
+	gi::Interval Tan(const gi::Interval& x)
+	{
+		if (!(x.hi - x.lo < Pi) || ContainsPeriodicPoint(x, Pi / 2, Pi))
+			return gi::Interval::Entire();
+		return Monotone(std::tan, x);
+	}
+
+	gi::Interval IntegerPow(const gi::Interval& base, int n)
+	{
+		if (n == 0)
+			return gi::Interval::Point(1.0);
+		if (n < 0)
+			return gi::Interval::Point(1.0) / IntegerPow(base, -n);
+		double a = std::pow(base.lo, n);
+		double b = std::pow(base.hi, n);
+		if (n % 2 == 1)
+			return Widen(a, b, FunctionUlps);
+		if (base.lo <= 0.0 && base.hi >= 0.0)
+			return Widen(0.0, std::max(a, b), FunctionUlps);
+		return Widen(std::min(a, b), std::max(a, b), FunctionUlps);
+	}
+}
+
+gi::Interval gi::Interval::Point(double v)
+{
+	if (std::isnan(v))
+		return Entire();
+	return { v, v };
+}
+
+gi::Interval gi::Interval::Entire()
+{
+	return { -Infinity, Infinity };
+}
+
+gi::Interval gi::operator-(const Interval& a)
+{
+	return { -a.hi, -a.lo };
+}
+
+gi::Interval gi::operator+(const Interval& a, const Interval& b)
+{
+	return Widen(a.lo + b.lo, a.hi + b.hi);
+}
+
+gi::Interval gi::operator-(const Interval& a, const Interval& b)
+{
+	return Widen(a.lo - b.hi, a.hi - b.lo);
+}
+
+gi::Interval gi::operator*(const Interval& a, const Interval& b)
+{
+	double p[] = { a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi };
+	for (double v : p)
+	{
+		// 0 * inf
+		if (std::isnan(v))
+			return Interval::Entire();
+	}
+	return Widen(*std::min_element(std::begin(p), std::end(p)), *std::max_element(std::begin(p), std::end(p)));
+}
+
+gi::Interval gi::operator/(const Interval& a, const Interval& b)
+{
+	if (b.lo <= 0.0 && b.hi >= 0.0)
+		return Interval::Entire();
+	return a * Widen(1.0 / b.hi, 1.0 / b.lo);
+}
+
+gi::Interval gi::Pow(const Interval& base, const Interval& exponent)
+{
+	if (exponent.lo == exponent.hi && std::abs(exponent.lo) <= 64 && std::floor(exponent.lo) == exponent.lo)
+		return IntegerPow(base, static_cast<int>(exponent.lo));
+	if (base.lo > 0.0)
+		return ApplyFunction(L"EXP", exponent * ApplyFunction(L"LN", base));
+	// negative bases with fractional exponents are NaN
+	return Interval::Entire();
+}
+
+gi::Interval gi::ApplyFunction(const std::wstring& name, const Interval& x)
+{
+	std::wstring upper = name;
+	for (auto& c : upper)
+		c = static_cast<wchar_t>(std::towupper(c));
+
+	if (upper == L"SIN")
+		return Sin(x);
+	if (upper == L"COS")
+		return Cos(x);
+	if (upper == L"TAN")
+		return Tan(x);
+	if (upper == L"SQRT")
+		return x.lo < 0.0 ? Interval::Entire() : Monotone(std::sqrt, x);
+	if (upper == L"EXP")
+		return Monotone(std::exp, x);
+	if (upper == L"LN")
+		return x.lo <= 0.0 ? Interval::Entire() : Monotone(std::log, x);
+	return Interval::Entire();
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+namespace gi
+{
+	// Closed range [lo, hi]. Every operation widens its result by an ulp or so, enough to
+	// enclose what the double evaluation of the same expression produces.
+	// Operations that may produce NaN return Entire().
+	struct Interval
+	{
+		double lo;
+		double hi;
+
+		static Interval Point(double v);
+		static Interval Entire();
+	};
+
+	Interval operator-(const Interval& a);
+	Interval operator+(const Interval& a, const Interval& b);
+	Interval operator-(const Interval& a, const Interval& b);
+	Interval operator*(const Interval& a, const Interval& b);
+	Interval operator/(const Interval& a, const Interval& b);
+	Interval Pow(const Interval& base, const Interval& exponent);
+
+	// apply the built-in function of that name (SIN, COS, TAN, SQRT, EXP, LN), unknown names give Entire()
+	Interval ApplyFunction(const std::wstring& name, const Interval& x);
+}
@@ -1,9 +1,11 @@
 
 #include "Lexer.h"
+#include "AllocationTracker.h"
 
 #include <cwctype>
 
 int gi::Lexer::Init(const std::wstring& content) {
+	AllocationPhaseScope allocations(AllocationPhase::Lex);
 	input_code = content;
 	token_cursor = input_code.begin();
 	line = 0;
@@ -16,6 +18,7 @@ gi::Token& gi::Lexer::GetCurrentToken() {
 }
 
 void gi::Lexer::MoveToNext() {
+	AllocationPhaseScope allocations(AllocationPhase::Lex);
 	curr_token = getToken();
 }
 
@@ -84,7 +87,7 @@ gi::Token gi::Lexer::getToken() {
 	/* Comment */
 	{
 		// try match Comment
-		search_flag = std::regex_search(token_cursor, it_semicolon, regex_set.Comment, std::regex_constants::match_flag_type::match_continuous);
+		search_flag = std::regex_search(token_cursor, it_semicolon, regex_set.Comment, std::regex_constants::match_continuous);
 		// real search Comment
 		if (search_flag) {
 			std::regex_search(cit, cit_semicolon, search_res, regex_set.Comment);
@@ -100,7 +103,7 @@ gi::Token gi::Lexer::getToken() {
 	/* Splitter */
 	{
 		// try to match Splitter
-		search_flag = std::regex_search(token_cursor, it_semicolon, regex_set.Splitter, std::regex_constants::match_flag_type::match_continuous);
+		search_flag = std::regex_search(token_cursor, it_semicolon, regex_set.Splitter, std::regex_constants::match_continuous);
 		// real search Splitter
 		if (search_flag) {
 			std::regex_search(cit, cit_semicolon, search_res, regex_set.Splitter);
@@ -133,7 +136,7 @@ gi::Token gi::Lexer::getToken() {
 	/* Literal */
 	{
 		// try to match literal
-		search_flag = std::regex_search(token_cursor, it_semicolon, regex_set.Literal, std::regex_constants::match_flag_type::match_continuous);
+		search_flag = std::regex_search(token_cursor, it_semicolon, regex_set.Literal, std::regex_constants::match_continuous);
 		// real search literal
 		if (search_flag && curr_token.type != gi::TokenType::Literal) {
 			std::regex_search(cit, cit_semicolon, search_res, regex_set.Literal);
@@ -147,7 +150,7 @@ gi::Token gi::Lexer::getToken() {
 	/* Identifier */
 	{
 		// try to match Identifier
-		search_flag = std::regex_search(token_cursor, it_semicolon, regex_set.Identifier, std::regex_constants::match_flag_type::match_continuous);
+		search_flag = std::regex_search(token_cursor, it_semicolon, regex_set.Identifier, std::regex_constants::match_continuous);
 		// real search Identifier
 		if (search_flag) {
 			std::regex_search(cit, cit_semicolon, search_res, regex_set.Identifier);
@@ -175,7 +178,8 @@ gi::Token gi::Lexer::getToken() {
 				{L"step",TokenType::KeywordStep},
 				{L"is",TokenType::KeywordIs},
 				{L"size",TokenType::KeywordSize},
-				{L"color",TokenType::KeywordColor}
+				{L"color",TokenType::KeywordColor},
+				{L"line",TokenType::KeywordLine}
 			};
 			// identify keywork
 			for (auto& it : key_map) {
@@ -193,7 +197,7 @@ gi::Token gi::Lexer::getToken() {
 	/* Power */
 	{
 		// try match Power
-		search_flag = std::regex_search(token_cursor, it_semicolon, regex_set.Power, std::regex_constants::match_flag_type::match_continuous);
+		search_flag = std::regex_search(token_cursor, it_semicolon, regex_set.Power, std::regex_constants::match_continuous);
 		// real search Power
 		if (search_flag) {
 			res_token.type = gi::TokenType::OperatorPower;
@@ -205,7 +209,7 @@ gi::Token gi::Lexer::getToken() {
 	/* Operator */
 	{
 		// try match Operator
-		search_flag = std::regex_search(token_cursor, it_semicolon, regex_set.Operator, std::regex_constants::match_flag_type::match_continuous);
+		search_flag = std::regex_search(token_cursor, it_semicolon, regex_set.Operator, std::regex_constants::match_continuous);
 		// real search Operator
 		if (search_flag) {
 			std::regex_search(cit, cit_semicolon, search_res, regex_set.Operator);
@@ -1,43 +1,96 @@
 
 #include "Parser.h"
+#include "AllocationTracker.h"
+#include "PerfCounters.h"
+#include "Trace.h"
 
 void gi::Parser::Parse(ILexer& lexer)
 {
+	TraceSpan span("Parser::Parse", "parse");
+	PerfScope perf("Parser::Parse");
+	AllocationPhaseScope allocations(AllocationPhase::Parse);
 	std::stack<Nonterminal*> parseStack;
 	std::unique_ptr<NTProgram> root = std::make_unique<NTProgram>();
 
 	parseStack.push(root.get());
-	lexer.MoveToNext();
+	// lexed up front, so the lexing phase is timed by one scope instead of one per token
+	std::vector<Token> tokens;
+	{
+		TraceSpan lexSpan("Parser::Parse lex", "lex");
+		PerfScope lexPerf("Parser::Parse lex");
+		do
+		{
+			lexer.MoveToNext();
+			tokens.push_back(lexer.GetCurrentToken());
+		} while (tokens.back().type != TokenType::None && tokens.back().type != TokenType::Error);
+	}
+	size_t next = 0;
 	bool printToken = true;
+	StatementSource source{ L"", 0 };
+	statementSources.clear();
 
-	while (!parseStack.empty())
+	// a parse abandoned mid-FOR must not leave its loop variable bound for the next one
+	size_t boundSymbols = symbols.size();
+	try
 	{
-		Token& token = lexer.GetCurrentToken();
-		if(printToken)
+		while (!parseStack.empty())
 		{
-			PrintMessage(JoinAsWideString(L"Token: ", token.line, L',', token.col, L": ", token.string));
-			printToken = false;
-		}
-		if (token.type == TokenType::Error)
-		{
-			PrintMessage(JoinAsWideString(
-				token.line, L',', token.col, L": ",
-				L"error: characters in position cannot be identified as a token."
-			));
-			throw std::runtime_error("bad token");
-		}
-		if (parseStack.top()->Accept(token, parseStack, symbols))
-		{
-			
-			lexer.MoveToNext();
-			printToken = true;
+			Token& token = tokens[next];
+			if(printToken && traceTokens)
+			{
+				PrintMessage(JoinAsWideString(L"Token: ", token.line, L',', token.col, L": ", token.string));
+				printToken = false;
+			}
+			if (token.type == TokenType::Error)
+			{
+				PrintMessage(JoinAsWideString(
+					token.line, L',', token.col, L": ",
+					L"error: characters in position cannot be identified as a token."
+				));
+				throw std::runtime_error("bad token");
+			}
+			if (parseStack.top()->Accept(token, parseStack, symbols))
+			{
+				if (token.type == TokenType::SplitterSemicolon)
+				{
+					statementSources.push_back(std::move(source));
+					source = { L"", 0 };
+				}
+				else
+				{
+					if (source.text.empty())
+						source.line = token.line;
+					else
+						source.text += L' ';
+					source.text += token.string;
+				}
+				// the last token is the end or an error, it is never moved past
+				if (next + 1 < tokens.size())
+					++next;
+				printToken = true;
+			}
 		}
 	}
+	catch (...)
+	{
+		symbols.erase(symbols.begin() + static_cast<std::ptrdiff_t>(boundSymbols), symbols.end());
+		throw;
+	}
 
 	astRoot = std::move(root);
 }
 
+void gi::Parser::SetTraceTokens(bool enable)
+{
+	traceTokens = enable;
+}
+
 std::unique_ptr<gi::NTProgram> gi::Parser::GetASTRoot()
 {
 	return std::move(astRoot);
 }
+
+const std::vector<gi::StatementSource>& gi::Parser::GetStatementSources() const
+{
+	return statementSources;
+}
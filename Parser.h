@@ -9,15 +9,27 @@
 
 namespace gi
 {
+	// source of a top-level statement, tokens joined by a single space
+	struct StatementSource
+	{
+		std::wstring text;
+		size_t line;
+	};
 
 	class Parser
 	{
 	private:
 		std::unique_ptr<NTProgram> astRoot;
+		std::vector<StatementSource> statementSources;
+		bool traceTokens = true;
 	public:
 		Parser() = default;
 		void Parse(ILexer& lexer);
+		// print every token as it is consumed, on by default
+		void SetTraceTokens(bool enable);
 		std::unique_ptr<NTProgram> GetASTRoot();
+		// one entry per statement, in the same order as NTProgram::CollectStatements
+		const std::vector<StatementSource>& GetStatementSources()const;
 
 		std::vector<Symbol> symbols = {
 			{L"PI", Symbol::Type::Constant, 3.1415926535},
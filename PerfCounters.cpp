@@ -0,0 +1,208 @@
+
+#include "PerfCounters.h"
+#include "Utils.h"
+
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	struct PhaseTotals
+	{
+		const char* name = nullptr;
+		size_t line = 0;
+		size_t calls = 0;
+		bool hardware = true; // every call was counted, on whichever thread it ran
+		gi::PerfCounters::Values sum;
+	};
+
+	std::mutex totalsMutex;
+	std::vector<PhaseTotals> totals; // few phases, linear search keeps first-use order
+
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+#ifdef __linux__
+	// one counter group per thread, the first event leads
+	class CounterGroup
+	{
+	private:
+		static constexpr int EventCount = 4;
+		int fds[EventCount] = { -1, -1, -1, -1 };
+		int slot[EventCount] = { -1, -1, -1, -1 }; // position in the group read, -1 if not opened
+	public:
+		int error = 0;
+
+		CounterGroup()
+		{
+			static const uint64_t configs[EventCount] = {
+				PERF_COUNT_HW_CPU_CYCLES,
+				PERF_COUNT_HW_INSTRUCTIONS,
+				PERF_COUNT_HW_CACHE_MISSES,
+				PERF_COUNT_HW_BRANCH_MISSES
+			};
+			int opened = 0;
+			for (int i = 0; i < EventCount; ++i)
+			{
+				perf_event_attr attr;
+				std::memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = configs[i];
+				attr.disabled = fds[0] == -1 ? 1 : 0;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+				int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, fds[0], 0));
+				if (fd == -1)
+				{
+					// without the leader nothing can be read, missing members only lose their column
+					if (i == 0)
+					{
+						error = errno;
+						return;
+					}
+					continue;
+				}
+				fds[i] = fd;
+				slot[i] = opened++;
+			}
+			ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+		~CounterGroup()
+		{
+			for (int fd : fds)
+			{
+				if (fd != -1)
+					close(fd);
+			}
+		}
+
+		bool IsOpen()const
+		{
+			return fds[0] != -1;
+		}
+
+		void Read(gi::PerfCounters::Values& values)const
+		{
+			// nr, time_enabled, time_running, value[nr]
+			uint64_t buffer[3 + EventCount];
+			if (!IsOpen() || read(fds[0], buffer, sizeof(buffer)) < static_cast<ssize_t>(3 * sizeof(uint64_t)))
+				return;
+			// scale up if the kernel multiplexed the group
+			double scale = buffer[2] ? static_cast<double>(buffer[1]) / static_cast<double>(buffer[2]) : 1.0;
+			uint64_t* target[EventCount] = { &values.cycles, &values.instructions, &values.cacheMisses, &values.branchMisses };
+			for (int i = 0; i < EventCount; ++i)
+			{
+				if (slot[i] >= 0 && static_cast<uint64_t>(slot[i]) < buffer[0])
+					*target[i] = static_cast<uint64_t>(static_cast<double>(buffer[3 + slot[i]]) * scale);
+			}
+		}
+	};
+
+	CounterGroup& GetCounterGroup()
+	{
+		thread_local CounterGroup group;
+		return group;
+	}
+#endif
+
+	// whether the calling thread's counters could be opened, each thread opens its own
+	bool HasHardwareCounters()
+	{
+#ifdef __linux__
+		return GetCounterGroup().IsOpen();
+#else
+		return false;
+#endif
+	}
+
+	double Ratio(uint64_t a, uint64_t b)
+	{
+		return b ? static_cast<double>(a) / static_cast<double>(b) : 0.0;
+	}
+}
+
+std::atomic<bool> gi::PerfCounters::enabled{ false };
+
+void gi::PerfCounters::Enable()
+{
+#ifdef __linux__
+	CounterGroup& group = GetCounterGroup();
+	if (!group.IsOpen())
+		PrintMessage(JoinAsWideString(
+			L"hardware counters unavailable (perf_event_open: ", strerror(group.error),
+			L"), reporting wall time only"));
+#else
+	PrintMessage(L"hardware counters need Linux perf_event_open, reporting wall time only");
+#endif
+	enabled.store(true, std::memory_order_relaxed);
+}
+
+gi::PerfCounters::Values gi::PerfCounters::Read()
+{
+	Values values;
+#ifdef __linux__
+	GetCounterGroup().Read(values);
+#endif
+	values.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	return values;
+}
+
+void gi::PerfCounters::Accumulate(const char* phase, size_t line, const Values& begin, const Values& end)
+{
+	std::lock_guard<std::mutex> lock(totalsMutex);
+	PhaseTotals* entry = nullptr;
+	for (auto& t : totals)
+	{
+		if (t.line == line && std::strcmp(t.name, phase) == 0)
+		{
+			entry = &t;
+			break;
+		}
+	}
+	if (!entry)
+	{
+		entry = &totals.emplace_back();
+		entry->name = phase;
+		entry->line = line;
+	}
+	++entry->calls;
+	entry->hardware = entry->hardware && HasHardwareCounters();
+	entry->sum.cycles += end.cycles - begin.cycles;
+	entry->sum.instructions += end.instructions - begin.instructions;
+	entry->sum.cacheMisses += end.cacheMisses - begin.cacheMisses;
+	entry->sum.branchMisses += end.branchMisses - begin.branchMisses;
+	entry->sum.nanoseconds += end.nanoseconds - begin.nanoseconds;
+}
+
+void gi::PerfCounters::PrintReport()
+{
+	std::lock_guard<std::mutex> lock(totalsMutex);
+	PrintMessage(L"performance counters per phase (inclusive of nested phases):");
+	for (auto& t : totals)
+	{
+		std::wstring name = JoinAsWideString(t.name);
+		if (t.line)
+			name = JoinAsWideString(name, L" (line ", t.line, L')');
+		if (!t.hardware)
+		{
+			PrintMessage(JoinAsWideString(L"  ", name, L": ", t.calls, L" calls, ", t.sum.nanoseconds / 1e6, L" ms"));
+			continue;
+		}
+		PrintMessage(JoinAsWideString(
+			L"  ", name, L": ", t.calls, L" calls, ", t.sum.nanoseconds / 1e6, L" ms, ",
+			t.sum.cycles, L" cycles, ", t.sum.instructions, L" instructions, IPC ", Ratio(t.sum.instructions, t.sum.cycles), L", ",
+			t.sum.cacheMisses, L" cache misses, ", t.sum.branchMisses, L" branch misses (",
+			Ratio(t.sum.branchMisses * 1000, t.sum.instructions), L" per 1k instructions)"));
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace gi
+{
+	// Hardware counters (cycles, instructions, cache and branch misses) summed per pipeline phase.
+	// Uses Linux perf_event_open on the calling thread. Where counters cannot be opened
+	// (other platforms, containers without perf access, perf_event_paranoid) phases still
+	// report calls and wall time.
+	class PerfCounters
+	{
+	public:
+		struct Values
+		{
+			uint64_t cycles = 0;
+			uint64_t instructions = 0;
+			uint64_t cacheMisses = 0;
+			uint64_t branchMisses = 0;
+			int64_t nanoseconds = 0;
+		};
+	private:
+		static std::atomic<bool> enabled;
+	public:
+		// start collecting, prints why if hardware counters are not available
+		static void Enable();
+		static bool IsEnabled()
+		{
+			return enabled.load(std::memory_order_relaxed);
+		}
+		// counters of the calling thread since it first read them, zero if unavailable
+		static Values Read();
+		static void Accumulate(const char* phase, size_t line, const Values& begin, const Values& end);
+		// one line per phase, in order of first use
+		static void PrintReport();
+	};
+
+	// Adds the counters spent during its lifetime to a phase, does nothing while disabled.
+	// name must be a string literal, line tells apart phases of the same name, 0 for none.
+	class PerfScope
+	{
+	private:
+		const char* name;
+		size_t line;
+		PerfCounters::Values begin;
+	public:
+		explicit PerfScope(const char* name, size_t line = 0)
+			: name(PerfCounters::IsEnabled() ? name : nullptr), line(line)
+		{
+			if (this->name)
+				begin = PerfCounters::Read();
+		}
+		~PerfScope()
+		{
+			if (name)
+				PerfCounters::Accumulate(name, line, begin, PerfCounters::Read());
+		}
+		PerfScope(const PerfScope&) = delete;
+		PerfScope& operator=(const PerfScope&) = delete;
+	};
+}
@@ -0,0 +1,178 @@
+
+#include "PeriodAnalysis.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace
+{
+	constexpr double Pi = 3.14159265358979323846;
+	constexpr double Infinity = std::numeric_limits<double>::infinity();
+	// periods are computed in double, ratios this close to a fraction count as the fraction
+	constexpr double RatioTolerance = 1e-9;
+
+	// abstract value of a stack entry
+	struct Value
+	{
+		enum Kind { Constant, Affine, Periodic, None } kind = None;
+		double slope = 0.0;  // Affine
+		double period = 0.0; // Periodic
+	};
+
+	// n / d with d <= MaxDenominator within RatioTolerance of r > 0, by continued fractions
+	bool AsFraction(double r, long long& n, long long& d)
+	{
+		long long n0 = 0, d0 = 1, n1 = 1, d1 = 0;
+		double x = r;
+		for (int i = 0; i < 64; ++i)
+		{
+			double a = std::floor(x);
+			long long ai = static_cast<long long>(a);
+			long long n2 = ai * n1 + n0;
+			long long d2 = ai * d1 + d0;
+			if (d2 > gi::PeriodAnalysis::MaxDenominator)
+				return false;
+			if (std::fabs(static_cast<double>(n2) / static_cast<double>(d2) - r) <= RatioTolerance * r)
+			{
+				n = n2;
+				d = d2;
+				return true;
+			}
+			if (x - a == 0.0)
+				return false;
+			x = 1.0 / (x - a);
+			n0 = n1;
+			d0 = d1;
+			n1 = n2;
+			d1 = d2;
+		}
+		return false;
+	}
+
+	Value Combine(const Value& a, const Value& b, gi::BatchProgram::Op op)
+	{
+		using Op = gi::BatchProgram::Op;
+		if (a.kind == Value::None || b.kind == Value::None)
+			return { Value::None };
+		if (a.kind == Value::Constant && b.kind == Value::Constant)
+			return { Value::Constant };
+		if (a.kind == Value::Affine || b.kind == Value::Affine)
+		{
+			// affine stays affine under + and - with affine or constant, * and / by constants
+			if (a.kind == Value::Periodic || b.kind == Value::Periodic)
+				return { Value::None };
+			switch (op)
+			{
+			case Op::Add:
+			case Op::Subtract:
+				return { Value::Affine, 1.0 };
+			case Op::Multiply:
+				return a.kind == Value::Constant || b.kind == Value::Constant ? Value{ Value::Affine, 1.0 } : Value{ Value::None };
+			case Op::Divide:
+				return b.kind == Value::Constant ? Value{ Value::Affine, 1.0 } : Value{ Value::None };
+			default:
+				return { Value::None };
+			}
+		}
+		double period = gi::PeriodAnalysis::CommonPeriod(
+			a.kind == Value::Periodic ? a.period : Infinity,
+			b.kind == Value::Periodic ? b.period : Infinity);
+		return period > 0 ? Value{ Value::Periodic, 0.0, period } : Value{ Value::None };
+	}
+}
+
+double gi::PeriodAnalysis::FindPeriod(const BatchProgram& program)
+{
+	using Op = BatchProgram::Op;
+	if (!program.IsValid())
+		return 0.0;
+	// slopes are tracked exactly through the constants, the program folds them already
+	std::vector<Value> stack;
+	std::vector<double> constants;
+	for (auto& instruction : program.GetCode())
+	{
+		switch (instruction.op)
+		{
+		case Op::Constant:
+			stack.push_back({ Value::Constant, 0.0, 0.0 });
+			constants.push_back(instruction.constant);
+			break;
+		case Op::Variable:
+			stack.push_back({ Value::Affine, 1.0, 0.0 });
+			constants.push_back(0.0);
+			break;
+		case Op::Negate:
+			stack.back().slope = -stack.back().slope;
+			constants.back() = -constants.back();
+			break;
+		case Op::Call:
+		{
+			Value& v = stack.back();
+			if (v.kind == Value::Affine)
+			{
+				bool trig = instruction.function == BatchProgram::Sin || instruction.function == BatchProgram::Cos ||
+					instruction.function == BatchProgram::Tan;
+				if (trig && v.slope != 0.0 && std::isfinite(v.slope))
+					v = { Value::Periodic, 0.0, (instruction.function == BatchProgram::Tan ? Pi : 2 * Pi) / std::fabs(v.slope) };
+				else
+					v = { Value::None };
+			}
+			break;
+		}
+		default:
+		{
+			Value b = stack.back();
+			double cb = constants.back();
+			stack.pop_back();
+			constants.pop_back();
+			Value a = stack.back();
+			double ca = constants.back();
+			Value result = Combine(a, b, instruction.op);
+			if (result.kind == Value::Affine)
+			{
+				switch (instruction.op)
+				{
+				case Op::Add:
+					result.slope = a.slope + b.slope;
+					break;
+				case Op::Subtract:
+					result.slope = a.slope - b.slope;
+					break;
+				case Op::Multiply:
+					result.slope = a.kind == Value::Constant ? ca * b.slope : a.slope * cb;
+					break;
+				default:
+					result.slope = a.slope / cb;
+				}
+			}
+			stack.back() = result;
+			constants.back() = 0.0;
+		}
+		}
+	}
+	switch (stack.back().kind)
+	{
+	case Value::Constant:
+		return Infinity;
+	case Value::Periodic:
+		return stack.back().period;
+	default:
+		return 0.0;
+	}
+}
+
+double gi::PeriodAnalysis::CommonPeriod(double a, double b)
+{
+	if (a == 0.0 || b == 0.0)
+		return 0.0;
+	if (std::isinf(a))
+		return b;
+	if (std::isinf(b))
+		return a;
+	long long n, d;
+	if (!AsFraction(a / b, n, d))
+		return 0.0;
+	// a / b = n / d, so d periods of a span n periods of b
+	return a * static_cast<double>(d);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "BatchProgram.h"
+
+namespace gi
+{
+	// Periods of expressions in the loop variable T, read off their BatchProgram.
+	// SIN, COS of a*T + b repeat every 2 pi / |a|, TAN every pi / |a|. Any built-in of a periodic
+	// value, and sums, products, quotients and powers of periodic values and constants, repeat
+	// every common multiple of the periods if their ratio is rational with a denominator of
+	// at most MaxDenominator. Everything else, T itself included, is not periodic.
+	class PeriodAnalysis
+	{
+	public:
+		static constexpr long long MaxDenominator = 1000;
+
+		// a period p > 0 with f(T + p) = f(T) for all T, not necessarily the smallest.
+		// 0 if none was found, infinity for constants.
+		static double FindPeriod(const BatchProgram& program);
+		// common period of two such results, 0 if none was found
+		static double CommonPeriod(double a, double b);
+	};
+}
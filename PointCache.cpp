@@ -0,0 +1,198 @@
+
+#include "PointCache.h"
+#include "Utils.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	constexpr char FileMagic[4] = { 'G', 'I', 'P', 'C' };
+	constexpr uint32_t FileVersion = 1;
+
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		gi::PointCache::Key key;
+		uint64_t count;
+	};
+}
+
+size_t gi::PointCache::KeyHasher::operator()(const Key& key) const
+{
+	size_t h = static_cast<size_t>(key.expressionHash);
+	for (double v : { key.from, key.to, key.step })
+	{
+		uint64_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		h = h * 31 + static_cast<size_t>(bits ^ (bits >> 32));
+	}
+	return h;
+}
+
+gi::PointCache::PointCache(size_t capacity)
+	: capacity(capacity)
+{
+}
+
+bool gi::PointCache::SetDiskDirectory(const std::filesystem::path& path)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(path, ec);
+	if (!std::filesystem::is_directory(path, ec))
+	{
+		PrintMessage(JoinAsWideString(L"failed to use cache directory \'", path.wstring(), L"\'"));
+		return false;
+	}
+	directory = path;
+	return true;
+}
+
+std::filesystem::path gi::PointCache::GetFilePath(const Key& key) const
+{
+	wchar_t name[32];
+	swprintf(name, 32, L"%016llx.gipc", static_cast<unsigned long long>(KeyHasher()(key)));
+	return directory / name;
+}
+
+bool gi::PointCache::LoadFromDisk(const Key& key, std::vector<ModelPoint>& points) const
+{
+	std::ifstream fs(GetFilePath(key), std::ios::binary);
+	if (!fs.good())
+		return false;
+
+	FileHeader header;
+	if (!fs.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		memcmp(header.magic, FileMagic, sizeof(FileMagic)) != 0 ||
+		header.version != FileVersion ||
+		!(header.key == key))
+		return false;
+
+	points.resize(static_cast<size_t>(header.count));
+	if (!fs.read(reinterpret_cast<char*>(points.data()), points.size() * sizeof(ModelPoint)))
+	{
+		points.clear();
+		return false;
+	}
+	return true;
+}
+
+void gi::PointCache::SaveToDisk(const Key& key, const std::vector<ModelPoint>& points) const
+{
+	// write to a temporary name first so a concurrent reader never sees a partial file
+	auto path = GetFilePath(key);
+	auto tmpPath = path;
+	tmpPath += L".tmp";
+	{
+		std::ofstream fs(tmpPath, std::ios::binary | std::ios::trunc);
+		FileHeader header;
+		memcpy(header.magic, FileMagic, sizeof(FileMagic));
+		header.version = FileVersion;
+		header.key = key;
+		header.count = points.size();
+		fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		fs.write(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(ModelPoint));
+		if (!fs.good())
+		{
+			PrintMessage(JoinAsWideString(L"failed to write cache file \'", tmpPath.wstring(), L"\'"));
+			return;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmpPath, path, ec);
+}
+
+void gi::PointCache::Remember(const Key& key, std::vector<ModelPoint>&& points)
+{
+	auto found = index.find(key);
+	if (found != index.end())
+	{
+		size -= found->second->points.size();
+		entries.erase(found->second);
+		index.erase(found);
+	}
+	// an entry larger than the whole budget would only evict everything else
+	if (points.size() > capacity)
+		return;
+
+	size += points.size();
+	entries.push_front({ key, std::move(points) });
+	index[key] = entries.begin();
+	while (size > capacity)
+	{
+		size -= entries.back().points.size();
+		index.erase(entries.back().key);
+		entries.pop_back();
+	}
+}
+
+const std::vector<gi::ModelPoint>* gi::PointCache::Find(const Key& key)
+{
+	auto found = index.find(key);
+	if (found != index.end())
+	{
+		++statistics.memoryHits;
+		entries.splice(entries.begin(), entries, found->second);
+		return &found->second->points;
+	}
+	if (!directory.empty())
+	{
+		std::vector<ModelPoint> points;
+		if (LoadFromDisk(key, points))
+		{
+			++statistics.diskHits;
+			if (points.size() > capacity)
+			{
+				// too large for the memory tier, it is loaded again on the next hit
+				oversized = std::move(points);
+				return &oversized;
+			}
+			Remember(key, std::move(points));
+			return &entries.front().points;
+		}
+	}
+	++statistics.misses;
+	return nullptr;
+}
+
+void gi::PointCache::Insert(const Key& key, std::vector<ModelPoint>&& points)
+{
+	if (!directory.empty())
+		SaveToDisk(key, points);
+	Remember(key, std::move(points));
+}
+
+const gi::PointCache::Statistics& gi::PointCache::GetStatistics() const
+{
+	return statistics;
+}
+
+size_t gi::PointCache::GetCapacity() const
+{
+	return capacity;
+}
+
+gi::PointCacheRecorder::PointCacheRecorder(PointCache& cache, const PointCache::Key& key)
+	: cache(cache), key(key)
+{
+}
+
+void gi::PointCacheRecorder::Add(const ModelPoint& point)
+{
+	if (overflowed)
+		return;
+	if (points.size() >= cache.GetCapacity())
+	{
+		overflowed = true;
+		std::vector<ModelPoint>().swap(points);
+		return;
+	}
+	points.push_back(point);
+}
+
+void gi::PointCacheRecorder::Commit()
+{
+	if (!overflowed)
+		cache.Insert(key, std::move(points));
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "ICanvas.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace gi
+{
+	// Model-space points of FOR statements, shared across runs.
+	// First tier is an in-memory LRU bounded by point count, the optional second tier
+	// keeps one file per entry in a directory so later processes can reuse it.
+	class PointCache
+	{
+	public:
+		struct Key
+		{
+			uint64_t expressionHash; // StructuralHash of the x and y expressions
+			double from;
+			double to;
+			double step;
+
+			bool operator==(const Key& rhs)const
+			{
+				return expressionHash == rhs.expressionHash && from == rhs.from && to == rhs.to && step == rhs.step;
+			}
+		};
+
+		struct Statistics
+		{
+			size_t memoryHits = 0;
+			size_t diskHits = 0;
+			size_t misses = 0;
+		};
+	private:
+		struct KeyHasher
+		{
+			size_t operator()(const Key& key)const;
+		};
+
+		struct Entry
+		{
+			Key key;
+			std::vector<ModelPoint> points;
+		};
+
+		size_t capacity;
+		size_t size = 0;
+		std::list<Entry> entries; // most recently used first
+		std::unordered_map<Key, std::list<Entry>::iterator, KeyHasher> index;
+		std::vector<ModelPoint> oversized; // last disk hit that did not fit in memory
+
+		std::filesystem::path directory;
+		Statistics statistics;
+
+		std::filesystem::path GetFilePath(const Key& key)const;
+		bool LoadFromDisk(const Key& key, std::vector<ModelPoint>& points)const;
+		void SaveToDisk(const Key& key, const std::vector<ModelPoint>& points)const;
+		void Remember(const Key& key, std::vector<ModelPoint>&& points);
+	public:
+		// capacity is the number of points kept in memory
+		explicit PointCache(size_t capacity = 16 * 1024 * 1024);
+
+		// enable the on-disk tier, the directory is created if missing
+		bool SetDiskDirectory(const std::filesystem::path& path);
+
+		// Cached points or nullptr. The pointer is invalidated by the next Insert, which may
+		// evict or replace the entry.
+		const std::vector<ModelPoint>* Find(const Key& key);
+		void Insert(const Key& key, std::vector<ModelPoint>&& points);
+
+		const Statistics& GetStatistics()const;
+		size_t GetCapacity()const;
+	};
+
+	// Points of one FOR statement on their way into the cache. Collecting stops once they
+	// outgrow the cache, which would drop them anyway.
+	class PointCacheRecorder
+	{
+	private:
+		PointCache& cache;
+		PointCache::Key key;
+		std::vector<ModelPoint> points;
+		bool overflowed = false;
+	public:
+		PointCacheRecorder(PointCache& cache, const PointCache::Key& key);
+
+		void Add(const ModelPoint& point);
+		// insert the points unless they overflowed
+		void Commit();
+	};
+}
@@ -0,0 +1,81 @@
+
+#include "PointRecord.h"
+
+#include <cstring>
+
+namespace
+{
+	constexpr char PointFileMagic[4] = { 'G', 'I', 'G', 'P' };
+	constexpr uint32_t PointFileVersion = 1;
+	// the count follows magic and version
+	constexpr std::streamoff CountOffset = sizeof(PointFileMagic) + sizeof(PointFileVersion);
+}
+
+gi::PointFileWriter::PointFileWriter(const std::filesystem::path& path)
+	: os(path, std::ios::binary)
+{
+	os.write(PointFileMagic, sizeof(PointFileMagic));
+	os.write(reinterpret_cast<const char*>(&PointFileVersion), sizeof(PointFileVersion));
+	os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+}
+
+void gi::PointFileWriter::Write(const PointRecord& record)
+{
+	os.write(reinterpret_cast<const char*>(&record), sizeof(record));
+	++count;
+}
+
+void gi::PointFileWriter::Write(const std::vector<PointRecord>& records)
+{
+	os.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(PointRecord)));
+	count += records.size();
+}
+
+bool gi::PointFileWriter::Finish()
+{
+	os.seekp(CountOffset);
+	os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	os.close();
+	return !os.fail();
+}
+
+uint64_t gi::PointFileWriter::GetCount() const
+{
+	return count;
+}
+
+uint8_t gi::LineVertexFlags::Segment(const ModelPoint& from, const ModelPoint& to)
+{
+	bool joined = hasEnd && from.x == end.x && from.y == end.y;
+	end = to;
+	hasEnd = true;
+	return joined ? PointRecord::LineVertex : PointRecord::LineVertex | PointRecord::LineStart;
+}
+
+void gi::LineVertexFlags::Break()
+{
+	hasEnd = false;
+}
+
+bool gi::ReadPointFile(const std::filesystem::path& path, std::vector<PointRecord>& records)
+{
+	std::ifstream is(path, std::ios::binary);
+	char magic[4];
+	uint32_t version;
+	uint64_t count;
+	is.read(magic, sizeof(magic));
+	is.read(reinterpret_cast<char*>(&version), sizeof(version));
+	is.read(reinterpret_cast<char*>(&count), sizeof(count));
+	if (!is.good() || std::memcmp(magic, PointFileMagic, sizeof(magic)) != 0 || version != PointFileVersion)
+		return false;
+	// a corrupt count must not allocate more than the file holds
+	std::streampos start = is.tellg();
+	is.seekg(0, std::ios::end);
+	uint64_t available = static_cast<uint64_t>(is.tellg() - start) / sizeof(PointRecord);
+	is.seekg(start);
+	if (count > available)
+		return false;
+	records.resize(static_cast<size_t>(count));
+	is.read(reinterpret_cast<char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(PointRecord)));
+	return is.good();
+}
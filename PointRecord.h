@@ -0,0 +1,61 @@
+#pragma once
+
+#include "ICanvas.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace gi
+{
+	// A device-space point as recorded by RecordingCanvas and exchanged in regression goldens,
+	// batch point files, render server replies and the shared-memory ring. 24 bytes without
+	// padding, written to files and sockets as is.
+	struct PointRecord
+	{
+		// flags: a DRAW LINE vertex, joined to the record before unless it is a LineStart too
+		static constexpr uint8_t LineVertex = 1;
+		static constexpr uint8_t LineStart = 2;
+
+		double x;
+		double y;
+		int32_t pointSize;
+		uint8_t colorR, colorG, colorB;
+		uint8_t flags;
+	};
+	static_assert(sizeof(PointRecord) == 24, "point records are written without padding");
+
+	// Flags of the records canvases keep for the ends of DrawLine segments, in device space.
+	// A segment not starting where the one before ended starts a new polyline.
+	class LineVertexFlags
+	{
+	private:
+		ModelPoint end = { 0.0, 0.0 };
+		bool hasEnd = false;
+	public:
+		uint8_t Segment(const ModelPoint& from, const ModelPoint& to);
+		// a point or a clear in between ends the polyline
+		void Break();
+	};
+
+	// Point file: "GIGP", uint32 version, uint64 count, then count records.
+	// Records are streamed, the count is patched into the header by Finish.
+	class PointFileWriter
+	{
+	private:
+		std::ofstream os;
+		uint64_t count = 0;
+	public:
+		explicit PointFileWriter(const std::filesystem::path& path);
+
+		void Write(const PointRecord& record);
+		void Write(const std::vector<PointRecord>& records);
+		// false if anything failed to write
+		bool Finish();
+		uint64_t GetCount()const;
+	};
+
+	// false if the file is missing, truncated or not a point file
+	bool ReadPointFile(const std::filesystem::path& path, std::vector<PointRecord>& records);
+}
@@ -0,0 +1,202 @@
+
+#include "PointSpool.h"
+#include "Utils.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// spilled chunks are mapped at multiples of ChunkBytes, which must respect the
+// allocation granularity of MapViewOfFile (64K) and the page size of mmap
+static_assert(gi::PointSpool::ChunkBytes % 65536 == 0, "chunk size must be a multiple of the mapping granularity");
+
+gi::PointSpool::PointSpool(size_t memoryBudget)
+	: memoryBudget(memoryBudget)
+{
+}
+
+gi::PointSpool::~PointSpool()
+{
+	CloseSpillFile();
+}
+
+void gi::PointSpool::SetMemoryBudget(size_t bytes)
+{
+	memoryBudget = bytes;
+	while (memoryChunks.size() > 1 && memoryChunks.size() * ChunkBytes > memoryBudget)
+		SpillOldestChunk();
+}
+
+void gi::PointSpool::Push(const Record& record)
+{
+	if (memoryChunks.empty() || tailCount == ChunkRecords)
+	{
+		if (!memoryChunks.empty() && (memoryChunks.size() + 1) * ChunkBytes > memoryBudget)
+			SpillOldestChunk();
+		memoryChunks.emplace_back(new Record[ChunkRecords]);
+		tailCount = 0;
+	}
+	memoryChunks.back()[tailCount++] = record;
+}
+
+void gi::PointSpool::Clear()
+{
+	memoryChunks.clear();
+	tailCount = 0;
+	spilledChunks = 0;
+	CloseSpillFile();
+}
+
+size_t gi::PointSpool::Size() const
+{
+	if (memoryChunks.empty())
+		return spilledChunks * ChunkRecords;
+	return (spilledChunks + memoryChunks.size() - 1) * ChunkRecords + tailCount;
+}
+
+size_t gi::PointSpool::GetSpilledChunkCount() const
+{
+	return spilledChunks;
+}
+
+void gi::PointSpool::ForEachChunk(const std::function<void(const Record* records, size_t count)>& f) const
+{
+	for (size_t i = 0; i < spilledChunks; ++i)
+	{
+		void* view = MapChunk(i, false);
+		f(static_cast<const Record*>(view), ChunkRecords);
+		UnmapChunk(view);
+	}
+	for (size_t i = 0; i < memoryChunks.size(); ++i)
+	{
+		f(memoryChunks[i].get(), i + 1 == memoryChunks.size() ? tailCount : ChunkRecords);
+	}
+}
+
+void gi::PointSpool::SpillOldestChunk()
+{
+	OpenSpillFile();
+	void* view = MapChunk(spilledChunks, true);
+	memcpy(view, memoryChunks.front().get(), ChunkBytes);
+	UnmapChunk(view);
+	memoryChunks.pop_front();
+	++spilledChunks;
+}
+
+#ifdef _WIN32
+
+void gi::PointSpool::OpenSpillFile()
+{
+	if (hFile != INVALID_HANDLE_VALUE)
+		return;
+	wchar_t directory[MAX_PATH + 1];
+	wchar_t path[MAX_PATH + 1];
+	if (!::GetTempPathW(MAX_PATH + 1, directory) || !::GetTempFileNameW(directory, L"gip", 0, path))
+	{
+		PrintMessage(L"failed to create temporary point file");
+		throw std::runtime_error("spool failure");
+	}
+	hFile = ::CreateFileW(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		PrintMessage(JoinAsWideString(L"failed to open temporary point file \'", path, L"\'"));
+		throw std::runtime_error("spool failure");
+	}
+}
+
+void gi::PointSpool::CloseSpillFile()
+{
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		::CloseHandle(hFile);
+		hFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+void* gi::PointSpool::MapChunk(size_t index, bool writable) const
+{
+	ULARGE_INTEGER offset, end;
+	offset.QuadPart = static_cast<ULONGLONG>(index) * ChunkBytes;
+	end.QuadPart = offset.QuadPart + ChunkBytes;
+	// the mapping object grows the file when writable
+	HANDLE hMapping = ::CreateFileMappingW(hFile, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+		end.HighPart, end.LowPart, nullptr);
+	void* view = nullptr;
+	if (hMapping)
+	{
+		view = ::MapViewOfFile(hMapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+			offset.HighPart, offset.LowPart, ChunkBytes);
+		// the view keeps the mapping alive
+		::CloseHandle(hMapping);
+	}
+	if (!view)
+	{
+		PrintMessage(L"failed to map temporary point file");
+		throw std::runtime_error("spool failure");
+	}
+	return view;
+}
+
+void gi::PointSpool::UnmapChunk(void* view) const
+{
+	::UnmapViewOfFile(view);
+}
+
+#else
+
+void gi::PointSpool::OpenSpillFile()
+{
+	if (fd >= 0)
+		return;
+	const char* directory = std::getenv("TMPDIR");
+	std::string path = std::string(directory ? directory : "/tmp") + "/gipXXXXXX";
+	fd = ::mkstemp(&path[0]);
+	if (fd < 0)
+	{
+		PrintMessage(L"failed to create temporary point file");
+		throw std::runtime_error("spool failure");
+	}
+	// the file lives as long as the descriptor
+	::unlink(path.c_str());
+}
+
+void gi::PointSpool::CloseSpillFile()
+{
+	if (fd >= 0)
+	{
+		::close(fd);
+		fd = -1;
+	}
+}
+
+void* gi::PointSpool::MapChunk(size_t index, bool writable) const
+{
+	off_t offset = static_cast<off_t>(index) * ChunkBytes;
+	if (writable && ::ftruncate(fd, offset + ChunkBytes) != 0)
+	{
+		PrintMessage(L"failed to grow temporary point file");
+		throw std::runtime_error("spool failure");
+	}
+	void* view = ::mmap(nullptr, ChunkBytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, offset);
+	if (view == MAP_FAILED)
+	{
+		PrintMessage(L"failed to map temporary point file");
+		throw std::runtime_error("spool failure");
+	}
+	if (!writable)
+		::madvise(view, ChunkBytes, MADV_SEQUENTIAL);
+	return view;
+}
+
+void gi::PointSpool::UnmapChunk(void* view) const
+{
+	::munmap(view, ChunkBytes);
+}
+
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+namespace gi
+{
+	// Append-only store of device-space points in fixed-size chunks.
+	// Chunks stay in memory up to the memory budget, older chunks are then moved into a
+	// memory-mapped temporary file. Readers stream the chunks back in insertion order,
+	// mapping one spilled chunk at a time.
+	class PointSpool
+	{
+	public:
+		struct Record
+		{
+			double x;
+			double y;
+			int32_t pointSize;
+			uint32_t color; // 0x00BBGGRR, as a COLORREF
+		};
+
+		static constexpr size_t ChunkRecords = 64 * 1024;
+		static constexpr size_t ChunkBytes = ChunkRecords * sizeof(Record);
+	private:
+		size_t memoryBudget;
+		std::deque<std::unique_ptr<Record[]>> memoryChunks;
+		size_t tailCount = 0; // records used in memoryChunks.back()
+		size_t spilledChunks = 0;
+
+#ifdef _WIN32
+		HANDLE hFile = INVALID_HANDLE_VALUE;
+#else
+		int fd = -1;
+#endif
+
+		void OpenSpillFile();
+		void CloseSpillFile();
+		void SpillOldestChunk();
+		// map spilled chunk index, writable to fill it
+		void* MapChunk(size_t index, bool writable)const;
+		void UnmapChunk(void* view)const;
+	public:
+		// memoryBudget in bytes, at least one chunk is always kept in memory
+		explicit PointSpool(size_t memoryBudget = SIZE_MAX);
+		PointSpool(const PointSpool&) = delete;
+		PointSpool& operator=(const PointSpool&) = delete;
+		~PointSpool();
+
+		void SetMemoryBudget(size_t bytes);
+
+		void Push(const Record& record);
+		void Clear();
+		size_t Size()const;
+		// chunks moved to the temporary file so far
+		size_t GetSpilledChunkCount()const;
+
+		// call f for every chunk in insertion order
+		void ForEachChunk(const std::function<void(const Record* records, size_t count)>& f)const;
+	};
+}
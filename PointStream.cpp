@@ -0,0 +1,497 @@
+
+#include "PointStream.h"
+#include "RasterCanvas.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+	constexpr uint8_t Version = 1;
+	// same limit as RasterCanvas::DrawPoint, far enough out that nothing visible changes
+	constexpr double Limit = 1e9;
+	// larger payloads are taken as corrupt rather than allocated
+	constexpr size_t MaxPayload = 4 * gi::PointStreamWriter::BlockBytes;
+
+	enum Kind : uint64_t { KindPoint = 0, KindLineTo = 1, KindLine = 2, KindState = 3 };
+	enum StateType : uint64_t { StateSize = 0, StateColor = 1, StateBackground = 2, StateClear = 3 };
+
+	uint64_t ZigZag(int64_t v)
+	{
+		return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+	}
+
+	int64_t UnZigZag(uint64_t v)
+	{
+		return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+	}
+
+	void PutVarint(std::vector<uint8_t>& out, uint64_t v)
+	{
+		while (v >= 0x80)
+		{
+			out.push_back(static_cast<uint8_t>(v) | 0x80);
+			v >>= 7;
+		}
+		out.push_back(static_cast<uint8_t>(v));
+	}
+
+	bool GetVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v)
+	{
+		v = 0;
+		for (int shift = 0; shift < 64 && p != end; shift += 7)
+		{
+			uint8_t byte = *p++;
+			v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	bool GetDelta(const uint8_t*& p, const uint8_t* end, int64_t& v)
+	{
+		uint64_t raw;
+		if (!GetVarint(p, end, raw))
+			return false;
+		v += UnZigZag(raw);
+		return true;
+	}
+
+	bool GetColor(const uint8_t*& p, const uint8_t* end, uint8_t(&color)[3])
+	{
+		if (end - p < 3)
+			return false;
+		std::copy(p, p + 3, color);
+		p += 3;
+		return true;
+	}
+
+	void PutU32(std::ostream& os, uint32_t v)
+	{
+		const char bytes[4] = { static_cast<char>(v), static_cast<char>(v >> 8), static_cast<char>(v >> 16), static_cast<char>(v >> 24) };
+		os.write(bytes, 4);
+	}
+
+	bool GetU32(std::istream& is, uint32_t& v)
+	{
+		uint8_t bytes[4];
+		if (!is.read(reinterpret_cast<char*>(bytes), 4))
+			return false;
+		v = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+		return true;
+	}
+}
+
+gi::PointStreamWriter::PointStreamWriter(std::ostream& os, int fractionBits)
+	: os(os), fractionBits(std::clamp(fractionBits, 0, MaxFractionBits)),
+	quantum(std::ldexp(1.0, this->fractionBits))
+{
+	const char header[8] = { 'G', 'I', 'P', 'S', static_cast<char>(Version), static_cast<char>(this->fractionBits), 0, 0 };
+	os.write(header, sizeof(header));
+	bytesWritten = sizeof(header);
+}
+
+bool gi::PointStreamWriter::Finish()
+{
+	WriteBlock();
+	PutU32(os, 0);
+	bytesWritten += 4;
+	os.flush();
+	return !os.fail();
+}
+
+uint64_t gi::PointStreamWriter::GetDrawCount() const
+{
+	return drawCount;
+}
+
+uint64_t gi::PointStreamWriter::GetDroppedCount() const
+{
+	return droppedCount;
+}
+
+uint64_t gi::PointStreamWriter::GetBytesWritten() const
+{
+	return bytesWritten;
+}
+
+int64_t gi::PointStreamWriter::Quantize(double v) const
+{
+	// toward zero, so the integer part is kept for either sign
+	return static_cast<int64_t>(v * quantum);
+}
+
+void gi::PointStreamWriter::BeginRecord()
+{
+	if (!payload.empty())
+		return;
+	PutVarint(payload, ZigZag(penX));
+	PutVarint(payload, ZigZag(penY));
+	PutVarint(payload, static_cast<uint64_t>(state.pointSize));
+	payload.push_back(state.colorR);
+	payload.push_back(state.colorG);
+	payload.push_back(state.colorB);
+}
+
+void gi::PointStreamWriter::PutState(uint64_t type)
+{
+	BeginRecord();
+	PutVarint(payload, (type << 2) | KindState);
+}
+
+void gi::PointStreamWriter::EndRecord(bool draw)
+{
+	if (draw)
+	{
+		++blockDraws;
+		++drawCount;
+	}
+	if (payload.size() >= BlockBytes)
+		WriteBlock();
+}
+
+void gi::PointStreamWriter::WriteBlock()
+{
+	if (payload.empty())
+		return;
+	PutU32(os, static_cast<uint32_t>(payload.size()));
+	PutU32(os, blockDraws);
+	os.write(reinterpret_cast<const char*>(payload.data()), static_cast<std::streamsize>(payload.size()));
+	bytesWritten += 8 + payload.size();
+	payload.clear();
+	blockDraws = 0;
+}
+
+void gi::PointStreamWriter::SetDrawPointSize(int size)
+{
+	if (size < 0 || size == state.pointSize)
+		return;
+	state.pointSize = size;
+	// an empty block takes it from its snapshot
+	if (payload.empty())
+		return;
+	PutState(StateSize);
+	PutVarint(payload, static_cast<uint64_t>(size));
+	EndRecord(false);
+}
+
+void gi::PointStreamWriter::SetDrawPointColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	if (state.colorR == r && state.colorG == g && state.colorB == b)
+		return;
+	state.colorR = r;
+	state.colorG = g;
+	state.colorB = b;
+	if (payload.empty())
+		return;
+	PutState(StateColor);
+	payload.insert(payload.end(), { r, g, b });
+	EndRecord(false);
+}
+
+void gi::PointStreamWriter::SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	PutState(StateBackground);
+	payload.insert(payload.end(), { r, g, b });
+	EndRecord(false);
+}
+
+void gi::PointStreamWriter::DrawPoint(double x, double y)
+{
+	ModelPoint p = transform.Apply({ x, y });
+	// the raster canvases skip these as well
+	if (!(std::fabs(p.x) < Limit && std::fabs(p.y) < Limit))
+	{
+		++droppedCount;
+		return;
+	}
+	int64_t qx = Quantize(p.x), qy = Quantize(p.y);
+	BeginRecord();
+	PutVarint(payload, (ZigZag(qx - penX) << 2) | KindPoint);
+	PutVarint(payload, ZigZag(qy - penY));
+	penX = qx;
+	penY = qy;
+	EndRecord(true);
+}
+
+void gi::PointStreamWriter::DrawLine(double x0, double y0, double x1, double y1)
+{
+	ModelPoint a = transform.Apply({ x0, y0 });
+	ModelPoint b = transform.Apply({ x1, y1 });
+	if (!(std::isfinite(a.x) && std::isfinite(a.y) && std::isfinite(b.x) && std::isfinite(b.y)))
+	{
+		++droppedCount;
+		return;
+	}
+	if (!(std::fabs(a.x) < Limit && std::fabs(a.y) < Limit && std::fabs(b.x) < Limit && std::fabs(b.y) < Limit))
+	{
+		// keep the part within [-Limit - 1, Limit - 1], ClipSegment's box shifted by Limit
+		a = { a.x + Limit, a.y + Limit };
+		b = { b.x + Limit, b.y + Limit };
+		if (!ClipSegment(a, b, 2 * Limit - 2, 2 * Limit - 2))
+		{
+			++droppedCount;
+			return;
+		}
+		a = { a.x - Limit, a.y - Limit };
+		b = { b.x - Limit, b.y - Limit };
+	}
+	int64_t ax = Quantize(a.x), ay = Quantize(a.y);
+	int64_t bx = Quantize(b.x), by = Quantize(b.y);
+	BeginRecord();
+	if (ax == penX && ay == penY)
+		PutVarint(payload, (ZigZag(bx - ax) << 2) | KindLineTo);
+	else
+	{
+		PutVarint(payload, (ZigZag(ax - penX) << 2) | KindLine);
+		PutVarint(payload, ZigZag(ay - penY));
+		PutVarint(payload, ZigZag(bx - ax));
+	}
+	PutVarint(payload, ZigZag(by - ay));
+	penX = bx;
+	penY = by;
+	EndRecord(true);
+}
+
+void gi::PointStreamWriter::Clear()
+{
+	PutState(StateClear);
+	EndRecord(false);
+}
+
+gi::PointStreamReader::PointStreamReader(std::istream& is)
+	: is(is)
+{
+	char header[8];
+	if (is.read(header, sizeof(header)) && memcmp(header, "GIPS", 4) == 0 &&
+		header[4] == Version && header[5] >= 0 && header[5] <= PointStreamWriter::MaxFractionBits)
+		fractionBits = header[5];
+}
+
+bool gi::PointStreamReader::IsValid() const
+{
+	return fractionBits >= 0;
+}
+
+int gi::PointStreamReader::GetFractionBits() const
+{
+	return fractionBits;
+}
+
+uint64_t gi::PointStreamReader::GetDrawCount() const
+{
+	return drawCount;
+}
+
+uint64_t gi::PointStreamReader::GetBlockCount() const
+{
+	return blockCount;
+}
+
+bool gi::PointStreamReader::ReadBlock(std::vector<uint8_t>& payload, uint32_t& draws, bool& end)
+{
+	uint32_t size;
+	if (!GetU32(is, size))
+		return false;
+	end = size == 0;
+	if (end)
+		return true;
+	if (size > MaxPayload || !GetU32(is, draws))
+		return false;
+	payload.resize(size);
+	return static_cast<bool>(is.read(reinterpret_cast<char*>(payload.data()), size));
+}
+
+bool gi::PointStreamReader::DecodeBlock(const uint8_t* payload, size_t size, int fractionBits, std::vector<Op>& ops)
+{
+	ops.clear();
+	const uint8_t* p = payload;
+	const uint8_t* end = payload + size;
+	double scale = std::ldexp(1.0, -fractionBits);
+	int64_t x = 0, y = 0;
+	uint64_t value;
+	Op op{};
+	if (!GetDelta(p, end, x) || !GetDelta(p, end, y) || !GetVarint(p, end, value) || value > INT32_MAX || !GetColor(p, end, op.color))
+		return false;
+	op.kind = Op::Kind::Size;
+	op.size = static_cast<int32_t>(value);
+	ops.push_back(op);
+	op.kind = Op::Kind::Color;
+	ops.push_back(op);
+	while (p != end)
+	{
+		if (!GetVarint(p, end, value))
+			return false;
+		switch (value & 3)
+		{
+		case KindPoint:
+			x += UnZigZag(value >> 2);
+			if (!GetDelta(p, end, y))
+				return false;
+			op.kind = Op::Kind::Point;
+			op.x0 = static_cast<double>(x) * scale;
+			op.y0 = static_cast<double>(y) * scale;
+			break;
+		case KindLineTo:
+		case KindLine:
+		{
+			uint64_t dx = value >> 2;
+			if ((value & 3) == KindLine)
+			{
+				x += UnZigZag(dx);
+				if (!GetDelta(p, end, y) || !GetVarint(p, end, dx))
+					return false;
+			}
+			op.kind = Op::Kind::Line;
+			op.x0 = static_cast<double>(x) * scale;
+			op.y0 = static_cast<double>(y) * scale;
+			x += UnZigZag(dx);
+			if (!GetDelta(p, end, y))
+				return false;
+			op.x1 = static_cast<double>(x) * scale;
+			op.y1 = static_cast<double>(y) * scale;
+			break;
+		}
+		default:
+			switch (value >> 2)
+			{
+			case StateSize:
+				if (!GetVarint(p, end, value) || value > INT32_MAX)
+					return false;
+				op.kind = Op::Kind::Size;
+				op.size = static_cast<int32_t>(value);
+				break;
+			case StateColor:
+			case StateBackground:
+				op.kind = value >> 2 == StateColor ? Op::Kind::Color : Op::Kind::Background;
+				if (!GetColor(p, end, op.color))
+					return false;
+				break;
+			case StateClear:
+				op.kind = Op::Kind::Clear;
+				break;
+			default:
+				return false;
+			}
+			break;
+		}
+		ops.push_back(op);
+	}
+	return true;
+}
+
+bool gi::PointStreamReader::Replay(ICanvas& canvas, WorkStealingPool* pool)
+{
+	if (!IsValid())
+		return false;
+	canvas.SetDrawOrigin(0, 0);
+	canvas.SetDrawScale(1, 1);
+	canvas.SetDrawRotation(0);
+	auto replay = [&](const std::vector<Op>& ops) {
+		for (const Op& op : ops)
+		{
+			switch (op.kind)
+			{
+			case Op::Kind::Point:
+				canvas.DrawPoint(op.x0, op.y0);
+				++drawCount;
+				break;
+			case Op::Kind::Line:
+				canvas.DrawLine(op.x0, op.y0, op.x1, op.y1);
+				++drawCount;
+				break;
+			case Op::Kind::Size:
+				canvas.SetDrawPointSize(op.size);
+				break;
+			case Op::Kind::Color:
+				canvas.SetDrawPointColor(op.color[0], op.color[1], op.color[2]);
+				break;
+			case Op::Kind::Background:
+				canvas.SetDrawBackgroundColor(op.color[0], op.color[1], op.color[2]);
+				break;
+			case Op::Kind::Clear:
+				canvas.Clear();
+				break;
+			}
+		}
+		++blockCount;
+	};
+
+	uint32_t draws;
+	bool end = false;
+	if (!pool)
+	{
+		std::vector<uint8_t> payload;
+		std::vector<Op> ops;
+		while (true)
+		{
+			if (!ReadBlock(payload, draws, end))
+				return false;
+			if (end)
+				return true;
+			if (!DecodeBlock(payload.data(), payload.size(), fractionBits, ops))
+				return false;
+			replay(ops);
+		}
+	}
+
+	// blocks decoded ahead, replayed in order from the front
+	struct Slot
+	{
+		std::vector<uint8_t> payload;
+		std::vector<Op> ops;
+		bool done = false;
+		bool ok = false;
+	};
+	std::deque<std::unique_ptr<Slot>> window;
+	const size_t ahead = 2 * static_cast<size_t>(std::max(pool->GetThreadCount(), 1u));
+	std::mutex mutex;
+	std::condition_variable decoded;
+	bool ok = true;
+	while (true)
+	{
+		while (ok && !end && window.size() < ahead)
+		{
+			auto slot = std::make_unique<Slot>();
+			if (!ReadBlock(slot->payload, draws, end))
+			{
+				ok = false;
+				break;
+			}
+			if (end)
+				break;
+			Slot* s = slot.get();
+			window.push_back(std::move(slot));
+			pool->Submit([&, s](unsigned) {
+				bool good = DecodeBlock(s->payload.data(), s->payload.size(), fractionBits, s->ops);
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					s->ok = good;
+					s->done = true;
+				}
+				decoded.notify_all();
+			});
+		}
+		if (window.empty())
+			break;
+		Slot& front = *window.front();
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			decoded.wait(lock, [&]() { return front.done; });
+		}
+		// after a failure the window only drains, its slots are still in use
+		if (ok && front.ok)
+			replay(front.ops);
+		else
+			ok = false;
+		window.pop_front();
+	}
+	return ok;
+}
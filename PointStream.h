@@ -0,0 +1,112 @@
+#pragma once
+
+#include "CanvasStateTracker.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace gi
+{
+	class WorkStealingPool;
+
+	// Compact archive of the draw calls reaching a canvas, in device space ("GIPS"):
+	//
+	//   header  "GIPS", version (u8), fraction bits (u8), 2 reserved bytes
+	//   block   payload bytes (u32 LE, 0 ends the stream), draw calls (u32 LE), payload
+	//
+	// Coordinates are fixed point with fraction bits below the pixel, rounded toward zero so a
+	// point still truncates to the same pixel. A payload starts with the pen position (zigzag
+	// varints), point size (varint) and color (3 bytes), so every block decodes on its own.
+	// Records follow, each led by a zigzag varint with the kind in its two low bits:
+	//   0 point at pen + (dx, dy), 1 line from pen to pen + (dx, dy),
+	//   2 line from pen + (dx, dy) to there + (dx2, dy2), 3 state change, the rest of the value
+	//   picking size (varint), color or background (3 bytes) or clear.
+	// The pen moves to the last position of every point and line.
+	class PointStreamWriter : public TransformingCanvas
+	{
+	public:
+		static constexpr int MaxFractionBits = 16;
+		// a block is written once its payload reaches this size
+		static constexpr size_t BlockBytes = 256 * 1024;
+	private:
+		std::ostream& os;
+		int fractionBits;
+		double quantum; // 2^fractionBits
+
+		std::vector<uint8_t> payload; // block being filled
+		uint32_t blockDraws = 0;
+		int64_t penX = 0;
+		int64_t penY = 0;
+
+		uint64_t drawCount = 0;
+		uint64_t droppedCount = 0;
+		uint64_t bytesWritten = 0;
+
+		int64_t Quantize(double v)const;
+		// the snapshot starting a block, before its first record
+		void BeginRecord();
+		void PutState(uint64_t type);
+		void EndRecord(bool draw);
+		void WriteBlock();
+	public:
+		// writes the header right away, fractionBits is clamped to [0, MaxFractionBits]
+		PointStreamWriter(std::ostream& os, int fractionBits);
+
+		// write the last block and the end marker, false if the stream failed
+		bool Finish();
+
+		// points and lines recorded
+		uint64_t GetDrawCount()const;
+		// points too far out to draw and lines with an end that is not finite
+		uint64_t GetDroppedCount()const;
+		uint64_t GetBytesWritten()const;
+
+		void SetDrawPointSize(int size) override;
+		void SetDrawPointColor(uint8_t r, uint8_t g, uint8_t b) override;
+		void SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b) override;
+		void DrawPoint(double x, double y) override;
+		void DrawLine(double x0, double y0, double x1, double y1) override;
+		void Clear() override;
+	};
+
+	class PointStreamReader
+	{
+	public:
+		// a decoded record, ready to replay
+		struct Op
+		{
+			enum class Kind : uint8_t { Point, Line, Size, Color, Background, Clear };
+			Kind kind;
+			uint8_t color[3];
+			int32_t size;
+			double x0, y0, x1, y1;
+		};
+	private:
+		std::istream& is;
+		int fractionBits = -1;
+		uint64_t drawCount = 0;
+		uint64_t blockCount = 0;
+
+		// false at the end marker or a truncated block
+		bool ReadBlock(std::vector<uint8_t>& payload, uint32_t& draws, bool& end);
+	public:
+		// reads the header, see IsValid
+		explicit PointStreamReader(std::istream& is);
+
+		bool IsValid()const;
+		int GetFractionBits()const;
+		// totals of what Replay went through
+		uint64_t GetDrawCount()const;
+		uint64_t GetBlockCount()const;
+
+		// decode one payload, false if it is malformed
+		static bool DecodeBlock(const uint8_t* payload, size_t size, int fractionBits, std::vector<Op>& ops);
+
+		// Puts canvas into device space and replays every block in order. With a pool, blocks are
+		// decoded up to two per thread ahead of the one replaying. False on a corrupt stream.
+		bool Replay(ICanvas& canvas, WorkStealingPool* pool);
+	};
+}
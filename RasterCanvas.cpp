@@ -0,0 +1,167 @@
+
+#include "RasterCanvas.h"
+#include "ImageEncoder.h"
+
+#include <algorithm>
+#include <cmath>
+
+gi::RasterCanvas::RasterCanvas(int width, int height)
+	: width(std::max(width, 0)), height(std::max(height, 0))
+{
+	pixels.resize(static_cast<size_t>(this->width) * this->height * 3);
+	covered.resize(static_cast<size_t>(this->width) * this->height);
+	Clear();
+}
+
+int gi::RasterCanvas::GetWidth() const
+{
+	return width;
+}
+
+int gi::RasterCanvas::GetHeight() const
+{
+	return height;
+}
+
+const std::vector<uint8_t>& gi::RasterCanvas::GetPixels() const
+{
+	return pixels;
+}
+
+void gi::RasterCanvas::WritePpm(std::ostream& os) const
+{
+	os << "P6\n" << width << ' ' << height << "\n255\n";
+	os.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+}
+
+bool gi::RasterCanvas::WritePng(std::ostream& os, int level, WorkStealingPool* pool) const
+{
+	return ImageEncoder::WritePng(os, pixels.data(), width, height, level, pool);
+}
+
+bool gi::RasterCanvas::WriteQoi(std::ostream& os) const
+{
+	return ImageEncoder::WriteQoi(os, pixels.data(), width, height);
+}
+
+void gi::RasterCanvas::Plot(int x, int y)
+{
+	if (x < 0 || y < 0 || x >= width || y >= height)
+		return;
+	size_t i = static_cast<size_t>(y) * width + x;
+	covered[i] = 1;
+	pixels[i * 3] = state.colorR;
+	pixels[i * 3 + 1] = state.colorG;
+	pixels[i * 3 + 2] = state.colorB;
+}
+
+void gi::RasterCanvas::Blend(int x, int y, double coverage)
+{
+	if (x < 0 || y < 0 || x >= width || y >= height || !(coverage > 0))
+		return;
+	size_t i = static_cast<size_t>(y) * width + x;
+	covered[i] = 1;
+	const uint8_t color[3] = { state.colorR, state.colorG, state.colorB };
+	coverage = std::min(coverage, 1.0);
+	for (size_t c = 0; c < 3; ++c)
+	{
+		double mixed = pixels[i * 3 + c] + (color[c] - pixels[i * 3 + c]) * coverage;
+		pixels[i * 3 + c] = static_cast<uint8_t>(mixed + 0.5);
+	}
+}
+
+bool gi::ClipSegment(ModelPoint& a, ModelPoint& b, double width, double height)
+{
+	if (!(std::isfinite(a.x) && std::isfinite(a.y) && std::isfinite(b.x) && std::isfinite(b.y)))
+		return false;
+	double t0 = 0.0, t1 = 1.0;
+	double dx = b.x - a.x, dy = b.y - a.y;
+	const double p[4] = { -dx, dx, -dy, dy };
+	const double q[4] = { a.x + 1, width + 1 - a.x, a.y + 1, height + 1 - a.y };
+	for (int i = 0; i < 4; ++i)
+	{
+		if (p[i] == 0)
+		{
+			if (q[i] < 0)
+				return false;
+			continue;
+		}
+		double t = q[i] / p[i];
+		if (p[i] < 0)
+			t0 = std::max(t0, t);
+		else
+			t1 = std::min(t1, t);
+		if (t0 > t1)
+			return false;
+	}
+	ModelPoint from{ a.x + t0 * dx, a.y + t0 * dy };
+	b = { a.x + t1 * dx, a.y + t1 * dy };
+	a = from;
+	return true;
+}
+
+void gi::RasterCanvas::SetAntiAliasing(bool enable)
+{
+	antiAliasing = enable;
+}
+
+void gi::RasterCanvas::SetDrawPointSize(int size)
+{
+	TransformingCanvas::SetDrawPointSize(ClampPointSize(size, width, height));
+}
+
+void gi::RasterCanvas::SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	// the window repaints the background under existing points, do the same
+	background[0] = r;
+	background[1] = g;
+	background[2] = b;
+	for (size_t i = 0; i < covered.size(); ++i)
+	{
+		if (!covered[i])
+			std::copy(background, background + 3, pixels.begin() + i * 3);
+	}
+}
+
+void gi::RasterCanvas::DrawPoint(double x, double y)
+{
+	// same truncation as the window canvas
+	int cx, cy;
+	if (!PixelOf(transform.Apply({ x, y }), cx, cy))
+		return;
+	int64_t size = state.pointSize;
+	if (size == 0)
+	{
+		Plot(cx, cy);
+		return;
+	}
+	int top = static_cast<int>(std::max<int64_t>(cy - size, 0));
+	int bottom = static_cast<int>(std::min<int64_t>(cy + size, height - 1));
+	for (int py = top; py <= bottom; ++py)
+	{
+		int64_t half = DiscHalfWidth(size, py - cy);
+		int left = static_cast<int>(std::max<int64_t>(cx - half, 0));
+		int right = static_cast<int>(std::min<int64_t>(cx + half, width - 1));
+		for (int px = left; px <= right; ++px)
+			Plot(px, py);
+	}
+}
+
+void gi::RasterCanvas::DrawLine(double x0, double y0, double x1, double y1)
+{
+	ModelPoint a = transform.Apply({ x0, y0 });
+	ModelPoint b = transform.Apply({ x1, y1 });
+	if (!ClipSegment(a, b, width, height))
+		return;
+	if (antiAliasing)
+		WalkWu(a.x, a.y, b.x, b.y, [this](int px, int py, double coverage) { Blend(px, py, coverage); });
+	else
+		WalkBresenham(a.x, a.y, b.x, b.y, [this](int px, int py) { Plot(px, py); });
+}
+
+void gi::RasterCanvas::Clear()
+{
+	std::fill(covered.begin(), covered.end(), 0);
+	for (size_t i = 0; i < covered.size(); ++i)
+		std::copy(background, background + 3, pixels.begin() + i * 3);
+}
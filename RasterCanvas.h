@@ -0,0 +1,165 @@
+#pragma once
+
+#include "CanvasStateTracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace gi
+{
+	class WorkStealingPool;
+
+	// Pixel walks shared by the raster canvases, in device space. They hand out every pixel,
+	// bounds are up to plot(x, y) and blend(x, y, coverage).
+
+	// DrawPoint's truncation of a device position, false when too far away to convert
+	inline bool PixelOf(const ModelPoint& p, int& x, int& y)
+	{
+		if (!(std::fabs(p.x) < 1e9 && std::fabs(p.y) < 1e9))
+			return false;
+		x = static_cast<int>(p.x);
+		y = static_cast<int>(p.y);
+		return true;
+	}
+
+	// half width of row dy of a point of size, which covers [cx - half, cx + half].
+	// 64-bit, as are the disc bounds around it: size and center may each be near the int range.
+	inline int64_t DiscHalfWidth(int64_t size, int64_t dy)
+	{
+		return static_cast<int64_t>(std::sqrt(static_cast<double>(size * size - dy * dy) + size * 0.5));
+	}
+
+	// the point sizes a canvas of width x height draws: larger discs only differ for points
+	// centered off the canvas
+	inline int ClampPointSize(int size, int width, int height)
+	{
+		return std::min(size, static_cast<int>(std::ceil(std::hypot(width, height))));
+	}
+
+	// Liang-Barsky against [-1, width + 1] x [-1, height + 1], samples far off screen must not
+	// reach the integer conversion. False if nothing is left or an end is not finite.
+	bool ClipSegment(ModelPoint& a, ModelPoint& b, double width, double height);
+
+	template<class Plot>
+	void WalkBresenham(double x0, double y0, double x1, double y1, Plot plot)
+	{
+		// same truncation as DrawPoint, so a zero length segment is a size 0 point
+		int px = static_cast<int>(x0), py = static_cast<int>(y0);
+		int ex = static_cast<int>(x1), ey = static_cast<int>(y1);
+		int dx = std::abs(ex - px), sx = px < ex ? 1 : -1;
+		int dy = -std::abs(ey - py), sy = py < ey ? 1 : -1;
+		int error = dx + dy;
+		while (true)
+		{
+			plot(px, py);
+			if (px == ex && py == ey)
+				break;
+			int doubled = 2 * error;
+			if (doubled >= dy)
+			{
+				error += dy;
+				px += sx;
+			}
+			if (doubled <= dx)
+			{
+				error += dx;
+				py += sy;
+			}
+		}
+	}
+
+	template<class Blend>
+	void WalkWu(double x0, double y0, double x1, double y1, Blend blend)
+	{
+		// pixel (i, j) covers [i, i + 1) x [j, j + 1), Wu works on pixel centers
+		x0 -= 0.5;
+		y0 -= 0.5;
+		x1 -= 0.5;
+		y1 -= 0.5;
+		bool steep = std::fabs(y1 - y0) > std::fabs(x1 - x0);
+		if (steep)
+		{
+			std::swap(x0, y0);
+			std::swap(x1, y1);
+		}
+		if (x0 > x1)
+		{
+			std::swap(x0, x1);
+			std::swap(y0, y1);
+		}
+		auto plot = [&blend, steep](int major, int minor, double coverage) {
+			if (steep)
+				blend(minor, major, coverage);
+			else
+				blend(major, minor, coverage);
+		};
+		auto fraction = [](double v) { return v - std::floor(v); };
+
+		double dx = x1 - x0;
+		double gradient = dx == 0 ? 1.0 : (y1 - y0) / dx;
+
+		// ends are weighted by how much of their pixel column the segment covers
+		double xEnd = std::round(x0);
+		double yEnd = y0 + gradient * (xEnd - x0);
+		double gap = 1 - fraction(x0 + 0.5);
+		int first = static_cast<int>(xEnd);
+		plot(first, static_cast<int>(std::floor(yEnd)), (1 - fraction(yEnd)) * gap);
+		plot(first, static_cast<int>(std::floor(yEnd)) + 1, fraction(yEnd) * gap);
+		double intersection = yEnd + gradient;
+
+		xEnd = std::round(x1);
+		yEnd = y1 + gradient * (xEnd - x1);
+		gap = fraction(x1 + 0.5);
+		int last = static_cast<int>(xEnd);
+		plot(last, static_cast<int>(std::floor(yEnd)), (1 - fraction(yEnd)) * gap);
+		plot(last, static_cast<int>(std::floor(yEnd)) + 1, fraction(yEnd) * gap);
+
+		for (int major = first + 1; major < last; ++major)
+		{
+			int minor = static_cast<int>(std::floor(intersection));
+			plot(major, minor, 1 - fraction(intersection));
+			plot(major, minor + 1, fraction(intersection));
+			intersection += gradient;
+		}
+	}
+
+	// Headless canvas rendering into an RGB buffer, point shapes follow Canvas::OnPaintWindow:
+	// size 0 is a single pixel, size n a disc inside the box [x - n, x + n].
+	// Lines are one pixel wide, Bresenham by default or Wu anti-aliased.
+	class RasterCanvas : public TransformingCanvas
+	{
+	private:
+		int width;
+		int height;
+		std::vector<uint8_t> pixels;  // RGB, rows top to bottom
+		std::vector<uint8_t> covered; // 1 where a point was drawn, for background changes
+		uint8_t background[3] = { 0xFF, 0xFF, 0xFF };
+		bool antiAliasing = false;
+
+		void Plot(int x, int y);
+		// mix the draw color into the pixel by coverage in [0, 1]
+		void Blend(int x, int y, double coverage);
+	public:
+		RasterCanvas(int width, int height);
+
+		int GetWidth()const;
+		int GetHeight()const;
+		const std::vector<uint8_t>& GetPixels()const;
+		// binary PPM (P6)
+		void WritePpm(std::ostream& os)const;
+		// PNG at a deflate level 0 to 9, strips compressed on pool if given; false if nothing was written
+		bool WritePng(std::ostream& os, int level, WorkStealingPool* pool)const;
+		bool WriteQoi(std::ostream& os)const;
+		// draw lines with Wu's algorithm instead of Bresenham's
+		void SetAntiAliasing(bool enable);
+
+		void SetDrawPointSize(int size) override;
+		void SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b) override;
+		void DrawPoint(double x, double y) override;
+		void DrawLine(double x0, double y0, double x1, double y1) override;
+		void Clear() override;
+	};
+}
@@ -0,0 +1,39 @@
+
+#include "RecordingCanvas.h"
+
+gi::RecordingCanvas::RecordingCanvas()
+{
+}
+
+const std::vector<gi::RecordingCanvas::Point>& gi::RecordingCanvas::GetPoints() const
+{
+	return points;
+}
+
+void gi::RecordingCanvas::Reset()
+{
+	ResetState();
+	points.clear();
+	lineFlags.Break();
+}
+
+void gi::RecordingCanvas::DrawPoint(double x, double y)
+{
+	ModelPoint p = transform.Apply({ x, y });
+	lineFlags.Break();
+	points.push_back({ p.x, p.y, state.pointSize, state.colorR, state.colorG, state.colorB, 0 });
+}
+
+void gi::RecordingCanvas::DrawLine(double x0, double y0, double x1, double y1)
+{
+	// polylines are kept as their vertices, which are the segment ends
+	ModelPoint to = transform.Apply({ x1, y1 });
+	uint8_t flags = lineFlags.Segment(transform.Apply({ x0, y0 }), to);
+	points.push_back({ to.x, to.y, state.pointSize, state.colorR, state.colorG, state.colorB, flags });
+}
+
+void gi::RecordingCanvas::Clear()
+{
+	points.clear();
+	lineFlags.Break();
+}
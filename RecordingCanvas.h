@@ -0,0 +1,30 @@
+#pragma once
+
+#include "CanvasStateTracker.h"
+#include "PointRecord.h"
+
+#include <vector>
+
+namespace gi
+{
+	// Headless canvas keeping every point in device space with the size and color it was drawn with.
+	// Lines are kept as the vertices of their polyline, flagged as such.
+	class RecordingCanvas : public TransformingCanvas
+	{
+	public:
+		using Point = PointRecord;
+	private:
+		std::vector<Point> points;
+		LineVertexFlags lineFlags;
+	public:
+		RecordingCanvas();
+
+		const std::vector<Point>& GetPoints()const;
+		// back to the default draw state without points, keeping the buffer
+		void Reset();
+
+		void DrawPoint(double x, double y) override;
+		void DrawLine(double x0, double y0, double x1, double y1) override;
+		void Clear() override;
+	};
+}
@@ -0,0 +1,284 @@
+
+#include "SvgCanvas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace
+{
+	// path data is written in 1/100 pixel, far below any useful tolerance
+	constexpr double Resolution = 100.0;
+	// a stroke longer than this is simplified and written in pieces
+	constexpr size_t StrokeChunk = 64 * 1024;
+	constexpr size_t BufferFlushBytes = 64 * 1024;
+
+	// same limit as RasterCanvas::DrawPoint, keeps the fixed point values in range
+	bool Drawable(const gi::ModelPoint& p)
+	{
+		return std::fabs(p.x) < 1e9 && std::fabs(p.y) < 1e9;
+	}
+
+	void AppendHex(std::string& out, const uint8_t(&color)[3])
+	{
+		const char digits[] = "0123456789abcdef";
+		for (uint8_t c : color)
+		{
+			out += digits[c >> 4];
+			out += digits[c & 15];
+		}
+	}
+
+	// hundredths as a decimal without trailing zeros, a space only where the sign does not separate
+	void AppendFixed(std::string& out, long long hundredths)
+	{
+		if (hundredths < 0)
+		{
+			out += '-';
+			hundredths = -hundredths;
+		}
+		else
+			out += ' ';
+		out += std::to_string(hundredths / 100);
+		long long fraction = hundredths % 100;
+		if (fraction != 0)
+		{
+			out += '.';
+			out += static_cast<char>('0' + fraction / 10);
+			if (fraction % 10 != 0)
+				out += static_cast<char>('0' + fraction % 10);
+		}
+	}
+}
+
+gi::SvgCanvas::SvgCanvas(std::ostream& os, int width, int height, double tolerance)
+	: os(os), width(std::max(width, 0)), height(std::max(height, 0)), tolerance(tolerance)
+{
+	buffer = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" +
+		std::to_string(this->width) + "\" height=\"" + std::to_string(this->height) +
+		"\" viewBox=\"0 0 " + std::to_string(this->width) + ' ' + std::to_string(this->height) +
+		"\">\n<rect width=\"100%\" height=\"100%\" fill=\"#";
+	os.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+	// the background may still change, Finish patches the final one here
+	backgroundOffset = os.tellp();
+	buffer.clear();
+	AppendHex(buffer, background);
+	buffer += "\"/>\n<g fill=\"none\" stroke-linecap=\"round\" stroke-linejoin=\"round\">\n";
+}
+
+bool gi::SvgCanvas::Finish()
+{
+	EndRun();
+	buffer += "</g>\n</svg>\n";
+	os.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+	buffer.clear();
+	if (backgroundOffset != std::streampos(-1))
+	{
+		std::string color;
+		AppendHex(color, background);
+		std::streampos end = os.tellp();
+		os.seekp(backgroundOffset);
+		os.write(color.data(), static_cast<std::streamsize>(color.size()));
+		os.seekp(end);
+	}
+	os.flush();
+	return !os.fail();
+}
+
+size_t gi::SvgCanvas::GetPointCount() const
+{
+	return pointCount;
+}
+
+size_t gi::SvgCanvas::GetVertexCount() const
+{
+	return vertexCount;
+}
+
+void gi::SvgCanvas::Simplify(std::vector<ModelPoint>& polyline, double tolerance)
+{
+	if (polyline.size() < 3)
+		return;
+	std::vector<char> keep(polyline.size(), 0);
+	keep.front() = 1;
+	keep.back() = 1;
+	// distance to the chord segment rather than its line, a closed curve has a chord of length 0
+	double limit = tolerance * tolerance;
+	std::vector<std::pair<size_t, size_t>> ranges{ { 0, polyline.size() - 1 } };
+	while (!ranges.empty())
+	{
+		auto range = ranges.back();
+		ranges.pop_back();
+		const ModelPoint& a = polyline[range.first];
+		const ModelPoint& b = polyline[range.second];
+		double dx = b.x - a.x, dy = b.y - a.y;
+		double length = dx * dx + dy * dy;
+		double worst = -1.0;
+		size_t index = range.first;
+		for (size_t i = range.first + 1; i < range.second; ++i)
+		{
+			double px = polyline[i].x - a.x, py = polyline[i].y - a.y;
+			double t = length > 0 ? std::clamp((px * dx + py * dy) / length, 0.0, 1.0) : 0.0;
+			double ex = px - t * dx, ey = py - t * dy;
+			double d = ex * ex + ey * ey;
+			if (d > worst)
+			{
+				worst = d;
+				index = i;
+			}
+		}
+		if (worst > limit)
+		{
+			keep[index] = 1;
+			ranges.push_back({ range.first, index });
+			ranges.push_back({ index, range.second });
+		}
+	}
+	size_t kept = 0;
+	for (size_t i = 0; i < polyline.size(); ++i)
+	{
+		if (keep[i])
+			polyline[kept++] = polyline[i];
+	}
+	polyline.resize(kept);
+}
+
+void gi::SvgCanvas::BeginRun(RunKind kind)
+{
+	int size = kind == RunKind::Points ? state.pointSize : 0;
+	if (run == kind && runSize == size &&
+		runColor[0] == state.colorR && runColor[1] == state.colorG && runColor[2] == state.colorB)
+		return;
+	EndRun();
+	run = kind;
+	runSize = size;
+	runColor[0] = state.colorR;
+	runColor[1] = state.colorG;
+	runColor[2] = state.colorB;
+	// Two discs of radius r at distance d are a stroke missing a waist of r - sqrt(r^2 - d^2 / 4)
+	// on each side, they are joined while that stays within tolerance.
+	double radius = size + 0.5;
+	double inset = radius - std::min(tolerance, radius);
+	runGap = 2 * std::sqrt(radius * radius - inset * inset);
+	// a point of size n covers the box [x - n, x + n + 1) in the window
+	buffer += "<path stroke=\"#";
+	AppendHex(buffer, runColor);
+	buffer += "\" stroke-width=\"" + std::to_string(2 * size + 1) + "\" d=\"";
+}
+
+void gi::SvgCanvas::EndRun()
+{
+	EndStroke();
+	if (run == RunKind::None)
+		return;
+	buffer += "\"/>\n";
+	run = RunKind::None;
+	os.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+	buffer.clear();
+}
+
+void gi::SvgCanvas::EndStroke()
+{
+	if (stroke.empty())
+		return;
+	Simplify(stroke, tolerance);
+	auto fixed = [](double v) { return static_cast<long long>(std::llround(v * Resolution)); };
+	long long x = fixed(stroke.front().x), y = fixed(stroke.front().y);
+	buffer += 'M';
+	AppendFixed(buffer, x);
+	AppendFixed(buffer, y);
+	long long penX = x, penY = y;
+	buffer += 'l';
+	if (stroke.size() == 1)
+		buffer += "0 0";
+	for (size_t i = 1; i < stroke.size(); ++i)
+	{
+		// deltas between rounded positions, so the pen does not drift
+		x = fixed(stroke[i].x);
+		y = fixed(stroke[i].y);
+		AppendFixed(buffer, x - penX);
+		AppendFixed(buffer, y - penY);
+		penX = x;
+		penY = y;
+	}
+	vertexCount += stroke.size();
+	stroke.clear();
+	if (buffer.size() >= BufferFlushBytes)
+	{
+		os.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+		buffer.clear();
+	}
+}
+
+void gi::SvgCanvas::SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	// the window repaints the background under existing points, the last color wins
+	background[0] = r;
+	background[1] = g;
+	background[2] = b;
+}
+
+void gi::SvgCanvas::DrawPoint(double x, double y)
+{
+	++pointCount;
+	ModelPoint p = transform.Apply({ x, y });
+	if (!Drawable(p))
+	{
+		EndStroke();
+		return;
+	}
+	// a run opens with its first drawable point, so no path is left without data
+	BeginRun(RunKind::Points);
+	if (!stroke.empty())
+	{
+		if (std::hypot(p.x - stroke.back().x, p.y - stroke.back().y) > runGap)
+			EndStroke();
+		else if (stroke.size() >= StrokeChunk)
+		{
+			ModelPoint last = stroke.back();
+			EndStroke();
+			stroke.push_back(last);
+		}
+	}
+	stroke.push_back(p);
+}
+
+void gi::SvgCanvas::DrawLine(double x0, double y0, double x1, double y1)
+{
+	++pointCount;
+	ModelPoint a = transform.Apply({ x0, y0 });
+	ModelPoint b = transform.Apply({ x1, y1 });
+	if (!Drawable(a) || !Drawable(b))
+	{
+		EndStroke();
+		return;
+	}
+	BeginRun(RunKind::Lines);
+	bool continues = !stroke.empty() && stroke.back().x == a.x && stroke.back().y == a.y;
+	if (a.x == b.x && a.y == b.y)
+	{
+		// the zero length segment starting a polyline, or a repeated vertex
+		if (!continues)
+		{
+			EndStroke();
+			stroke.push_back(b);
+		}
+		return;
+	}
+	if (!continues)
+	{
+		EndStroke();
+		stroke.push_back(a);
+	}
+	else if (stroke.size() >= StrokeChunk)
+	{
+		EndStroke();
+		stroke.push_back(a);
+	}
+	stroke.push_back(b);
+}
+
+void gi::SvgCanvas::Clear()
+{
+	EndStroke();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "CanvasStateTracker.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace gi
+{
+	// Headless canvas streaming SVG: one <path> per run of points drawn with the same color and
+	// size. Points close enough for their discs to look like a stroke become one as wide as the disc,
+	// DRAW LINE polylines a one pixel stroke. Strokes are simplified with Ramer-Douglas-Peucker
+	// before they are written, only the stroke being drawn is kept in memory.
+	class SvgCanvas : public TransformingCanvas
+	{
+	private:
+		enum class RunKind { None, Points, Lines };
+
+		std::ostream& os;
+		int width;
+		int height;
+		double tolerance;
+		uint8_t background[3] = { 0xFF, 0xFF, 0xFF };
+		std::streampos backgroundOffset = -1;
+
+		// open <path>, its style and the stroke being collected in device space
+		RunKind run = RunKind::None;
+		int runSize = 0;
+		double runGap = 0.0; // furthest points of a stroke may be apart
+		uint8_t runColor[3] = { 0, 0, 0 };
+		std::vector<ModelPoint> stroke;
+		// output not yet handed to os
+		std::string buffer;
+
+		size_t pointCount = 0;
+		size_t vertexCount = 0;
+
+		// start a new run unless the open one has kind and the current style
+		void BeginRun(RunKind kind);
+		void EndRun();
+		void EndStroke();
+	public:
+		// writes the header right away, tolerance is the simplification error in pixels
+		SvgCanvas(std::ostream& os, int width, int height, double tolerance);
+
+		// write the open stroke and the closing tag, and patch the background into the header
+		// when the stream is seekable. False if the stream failed.
+		bool Finish();
+
+		// points and line ends drawn
+		size_t GetPointCount()const;
+		// vertices written after simplification
+		size_t GetVertexCount()const;
+
+		// drop the points of polyline that are not needed to stay within tolerance of it
+		static void Simplify(std::vector<ModelPoint>& polyline, double tolerance);
+
+		void SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b) override;
+		void DrawPoint(double x, double y) override;
+		void DrawLine(double x0, double y0, double x1, double y1) override;
+		// written paths stay, only the open stroke ends
+		void Clear() override;
+	};
+}
@@ -1,9 +1,17 @@
 
 #include "Syntax.h"
 #include "Interpreter.h"
+#include "AllocationTracker.h"
+#include "PerfCounters.h"
+#include "PeriodAnalysis.h"
+#include "Trace.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cwctype>
+#include <functional>
+#include <limits>
+#include <optional>
 
 template<size_t N>
 inline void GenericProbeFunction(const gi::ProbeRule(&rules)[N], int& ruleIdOut, const gi::Token& token)
@@ -53,6 +61,13 @@ bool GenericAcceptFunction(const gi::Token& token, std::stack<gi::Nonterminal*>&
 	return ret;
 }
 
+template<typename ... T>
+void HashChildren(gi::StructuralHash& hash, int ruleId, const std::unique_ptr<T>& ... children)
+{
+	hash.Add(ruleId);
+	int dummy[] = { 0, (children ? children->Hash(hash) : void(), 0) ... };
+}
+
 
 bool gi::Symbol::MatchName(const std::wstring& name) const
 {
@@ -69,6 +84,53 @@ bool gi::Symbol::MatchName(const std::wstring& name) const
 }
 
 
+void gi::StructuralHash::AddBytes(const void* data, size_t size)
+{
+	auto* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; ++i)
+	{
+		value ^= bytes[i];
+		value *= 1099511628211ull;
+	}
+}
+
+void gi::StructuralHash::Add(int v)
+{
+	AddBytes(&v, sizeof(v));
+}
+
+void gi::StructuralHash::Add(double v)
+{
+	if (v == 0.0)
+		v = 0.0; // -0.0 and 0.0 evaluate the same
+	AddBytes(&v, sizeof(v));
+}
+
+void gi::StructuralHash::AddIdentifier(const std::wstring& name)
+{
+	if (boundVariable.MatchName(name))
+	{
+		Add(-1);
+		return;
+	}
+	for (wchar_t c : name)
+	{
+		wchar_t upper = static_cast<wchar_t>(std::towupper(c));
+		AddBytes(&upper, sizeof(upper));
+	}
+	Add(static_cast<int>(name.size()));
+}
+
+void gi::StructuralHash::BindVariable(const std::wstring& name)
+{
+	boundVariable.name = name;
+}
+
+uint64_t gi::StructuralHash::Get() const
+{
+	return value;
+}
+
 bool gi::NTAtom::Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols)
 {
 	if (ruleId < 0)
@@ -118,10 +180,26 @@ double gi::NTAtom::Evaluate(EvaluateContext& context)
 		context.operands.push(context.Lookup(identifier));
 		break;
 	case 2:
+		if (auto* recurrence = context.GetTrigRecurrence())
+		{
+			auto* site = recurrence->Find(this);
+			if (!site)
+				site = recurrence->Add(this, identifier,
+					expression->EvaluateAffine({ { recurrence->GetVariable(), Symbol::Type::Variable, 0.0, nullptr }, context }));
+			if (site->stepped)
+			{
+				context.operands.push(recurrence->Evaluate(*site));
+				if (auto* metrics = context.GetMetrics())
+					metrics->CountFunctionCall(identifier);
+				break;
+			}
+		}
 		expression->Evaluate(context);
 		r = context.GetLastResult();
 		context.operands.pop();
 		context.operands.push(context.LookupFunction(identifier)(r));
+		if (auto* metrics = context.GetMetrics())
+			metrics->CountFunctionCall(identifier);
 		break;
 	case 3:
 		expression->Evaluate(context);
@@ -129,9 +207,101 @@ double gi::NTAtom::Evaluate(EvaluateContext& context)
 	default:
 		throw std::runtime_error("Invalid ruleId!");
 	}
+	// every push happens here, so this sees the deepest stack
+	if (auto* metrics = context.GetMetrics())
+		metrics->NoteOperandDepth(context.operands.size());
 	return 0;
 }
 
+void gi::NTAtom::Hash(StructuralHash& hash)
+{
+	switch (ruleId)
+	{
+	case 0:
+		hash.Add(ruleId);
+		hash.Add(literal);
+		break;
+	case 1:
+		hash.Add(ruleId);
+		hash.AddIdentifier(identifier);
+		break;
+	case 2:
+		hash.Add(ruleId);
+		hash.AddIdentifier(identifier);
+		expression->Hash(hash);
+		break;
+	default:
+		HashChildren(hash, ruleId, expression);
+	}
+}
+
+gi::Interval gi::NTAtom::EvaluateInterval(const IntervalEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return Interval::Point(literal);
+	case 1:
+		if (env.variable.MatchName(identifier))
+			return env.value;
+		return Interval::Point(env.context.Lookup(identifier));
+	case 2:
+		return ApplyFunction(identifier, expression->EvaluateInterval(env));
+	case 3:
+		return expression->EvaluateInterval(env);
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+gi::Affine gi::NTAtom::EvaluateAffine(const AffineEnvironment& env)
+{
+	Affine argument;
+	switch (ruleId)
+	{
+	case 0:
+		return Affine::Constant(literal);
+	case 1:
+		if (env.variable.MatchName(identifier))
+			return Affine::Variable();
+		return Affine::Constant(env.context.Lookup(identifier));
+	case 2:
+		argument = expression->EvaluateAffine(env);
+		if (!argument.IsConstant())
+			return Affine::None();
+		return Affine::Constant(env.context.LookupFunction(identifier)(argument.offset));
+	case 3:
+		return expression->EvaluateAffine(env);
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+void gi::NTAtom::Compile(const BatchEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		env.program.PushConstant(literal);
+		break;
+	case 1:
+		if (env.variable.MatchName(identifier))
+			env.program.PushVariable();
+		else
+			env.program.PushConstant(env.context.Lookup(identifier));
+		break;
+	case 2:
+		expression->Compile(env);
+		env.program.PushCall(identifier);
+		break;
+	case 3:
+		expression->Compile(env);
+		break;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
 void gi::NTAtom::Probe(const Token& token, std::vector<Symbol>& symbols)
 {
 	switch (token.type)
@@ -206,6 +376,52 @@ double gi::NTComponent2::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTComponent2::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, component);
+}
+
+gi::Interval gi::NTComponent2::EvaluateInterval(const IntervalEnvironment& env, const Interval& base)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return Pow(base, component->EvaluateInterval(env));
+	case 1:
+		return base;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+gi::Affine gi::NTComponent2::EvaluateAffine(const AffineEnvironment& env, const Affine& base)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return Pow(base, component->EvaluateAffine(env));
+	case 1:
+		return base;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+void gi::NTComponent2::Compile(const BatchEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		component->Compile(env);
+		env.program.Push(BatchProgram::Op::Power);
+		break;
+	case 1:
+		break;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
 bool gi::NTComponent::Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols)
 {
 	return GenericAcceptFunction(token, parseStack, symbols, ruleId, ProbeRules, progress, Rules, this);
@@ -239,6 +455,46 @@ double gi::NTComponent::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTComponent::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, atom, component2);
+}
+
+gi::Interval gi::NTComponent::EvaluateInterval(const IntervalEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return component2->EvaluateInterval(env, atom->EvaluateInterval(env));
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+gi::Affine gi::NTComponent::EvaluateAffine(const AffineEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return component2->EvaluateAffine(env, atom->EvaluateAffine(env));
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+void gi::NTComponent::Compile(const BatchEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		atom->Compile(env);
+		component2->Compile(env);
+		break;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
 bool gi::NTFactor::Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols)
 {
 	return GenericAcceptFunction(token, parseStack, symbols, ruleId, ProbeRules, progress, Rules, this);
@@ -285,6 +541,60 @@ double gi::NTFactor::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTFactor::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, factor, component);
+}
+
+gi::Interval gi::NTFactor::EvaluateInterval(const IntervalEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return factor->EvaluateInterval(env);
+	case 1:
+		return -factor->EvaluateInterval(env);
+	case 2:
+		return component->EvaluateInterval(env);
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+gi::Affine gi::NTFactor::EvaluateAffine(const AffineEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return factor->EvaluateAffine(env);
+	case 1:
+		return -factor->EvaluateAffine(env);
+	case 2:
+		return component->EvaluateAffine(env);
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+void gi::NTFactor::Compile(const BatchEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		factor->Compile(env);
+		break;
+	case 1:
+		factor->Compile(env);
+		env.program.Push(BatchProgram::Op::Negate);
+		break;
+	case 2:
+		component->Compile(env);
+		break;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
 bool gi::NTTerm2::Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols)
 {
 	return GenericAcceptFunction(token, parseStack, symbols, ruleId, ProbeRules, progress, Rules, this);
@@ -340,6 +650,62 @@ double gi::NTTerm2::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTTerm2::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, factor, term2);
+}
+
+gi::Interval gi::NTTerm2::EvaluateInterval(const IntervalEnvironment& env, const Interval& lhs)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return term2->EvaluateInterval(env, lhs * factor->EvaluateInterval(env));
+	case 1:
+		return term2->EvaluateInterval(env, lhs / factor->EvaluateInterval(env));
+	case 2:
+		return lhs;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+gi::Affine gi::NTTerm2::EvaluateAffine(const AffineEnvironment& env, const Affine& lhs)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return term2->EvaluateAffine(env, lhs * factor->EvaluateAffine(env));
+	case 1:
+		return term2->EvaluateAffine(env, lhs / factor->EvaluateAffine(env));
+	case 2:
+		return lhs;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+void gi::NTTerm2::Compile(const BatchEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		factor->Compile(env);
+		env.program.Push(BatchProgram::Op::Multiply);
+		term2->Compile(env);
+		break;
+	case 1:
+		factor->Compile(env);
+		env.program.Push(BatchProgram::Op::Divide);
+		term2->Compile(env);
+		break;
+	case 2:
+		break;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
 bool gi::NTTerm::Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols)
 {
 	return GenericAcceptFunction(token, parseStack, symbols, ruleId, ProbeRules, progress, Rules, this);
@@ -373,6 +739,46 @@ double gi::NTTerm::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTTerm::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, factor, term2);
+}
+
+gi::Interval gi::NTTerm::EvaluateInterval(const IntervalEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return term2->EvaluateInterval(env, factor->EvaluateInterval(env));
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+gi::Affine gi::NTTerm::EvaluateAffine(const AffineEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return term2->EvaluateAffine(env, factor->EvaluateAffine(env));
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+void gi::NTTerm::Compile(const BatchEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		factor->Compile(env);
+		term2->Compile(env);
+		break;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
 bool gi::NTExpression2::Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols)
 {
 	return GenericAcceptFunction(token, parseStack, symbols, ruleId, ProbeRules, progress, Rules, this);
@@ -428,6 +834,62 @@ double gi::NTExpression2::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTExpression2::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, term, expression2);
+}
+
+gi::Interval gi::NTExpression2::EvaluateInterval(const IntervalEnvironment& env, const Interval& lhs)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return expression2->EvaluateInterval(env, lhs + term->EvaluateInterval(env));
+	case 1:
+		return expression2->EvaluateInterval(env, lhs - term->EvaluateInterval(env));
+	case 2:
+		return lhs;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+gi::Affine gi::NTExpression2::EvaluateAffine(const AffineEnvironment& env, const Affine& lhs)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return expression2->EvaluateAffine(env, lhs + term->EvaluateAffine(env));
+	case 1:
+		return expression2->EvaluateAffine(env, lhs - term->EvaluateAffine(env));
+	case 2:
+		return lhs;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+void gi::NTExpression2::Compile(const BatchEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		term->Compile(env);
+		env.program.Push(BatchProgram::Op::Add);
+		expression2->Compile(env);
+		break;
+	case 1:
+		term->Compile(env);
+		env.program.Push(BatchProgram::Op::Subtract);
+		expression2->Compile(env);
+		break;
+	case 2:
+		break;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
 bool gi::NTExpression::Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols)
 {
 	return GenericAcceptFunction(token, parseStack, symbols, ruleId, ProbeRules, progress, Rules, this);
@@ -461,6 +923,46 @@ double gi::NTExpression::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTExpression::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, term, expression2);
+}
+
+gi::Interval gi::NTExpression::EvaluateInterval(const IntervalEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return expression2->EvaluateInterval(env, term->EvaluateInterval(env));
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+gi::Affine gi::NTExpression::EvaluateAffine(const AffineEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		return expression2->EvaluateAffine(env, term->EvaluateAffine(env));
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
+void gi::NTExpression::Compile(const BatchEnvironment& env)
+{
+	switch (ruleId)
+	{
+	case 0:
+		term->Compile(env);
+		expression2->Compile(env);
+		break;
+	default:
+		throw std::runtime_error("Invalid ruleId!");
+	}
+}
+
 bool gi::NTOriginStatement::Accept(const Token& token, std::stack<Nonterminal*>& parseStack,
 	std::vector<Symbol>& symbols)
 {
@@ -506,6 +1008,11 @@ double gi::NTOriginStatement::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTOriginStatement::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, expression1, expression2);
+}
+
 bool gi::NTScaleStatement::Accept(const Token& token, std::stack<Nonterminal*>& parseStack,
 	std::vector<Symbol>& symbols)
 {
@@ -551,6 +1058,11 @@ double gi::NTScaleStatement::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTScaleStatement::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, expression1, expression2);
+}
+
 bool gi::NTRotStatement::Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols)
 {
 	return GenericAcceptFunction(token, parseStack, symbols, ruleId, ProbeRules, progress, Rules, this);
@@ -588,6 +1100,11 @@ double gi::NTRotStatement::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTRotStatement::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, expression);
+}
+
 bool gi::NTForStatement::Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols)
 {
 	return GenericAcceptFunction(token, parseStack, symbols, ruleId, ProbeRules, progress, Rules, this);
@@ -608,6 +1125,8 @@ void gi::NTForStatement::Print(int indent)
 		PrintMessage(JoinAsWideString(IndentString(indent), L"STEP"));
 		step->Print(indent + 2);
 		PrintMessage(JoinAsWideString(IndentString(indent), L"DRAW"));
+		if (lines)
+			PrintMessage(JoinAsWideString(IndentString(indent), L"LINE"));
 		PrintMessage(JoinAsWideString(IndentString(indent), L"("));
 		x->Print(indent + 2);
 		PrintMessage(JoinAsWideString(IndentString(indent), L","));
@@ -619,9 +1138,336 @@ void gi::NTForStatement::Print(int indent)
 	}
 }
 
+gi::ModelPoint gi::NTForStatement::EvaluatePoint(EvaluateContext& context, double iterValue)
+{
+	if (auto* metrics = context.GetMetrics())
+		metrics->CountIteration();
+	{
+		AllocationPhaseScope allocations(AllocationPhase::Bind);
+		context.NewExpression();
+		context.AddVariableSymbol(iter, iterValue);
+	}
+	x->Evaluate(context);
+	double cx = context.GetLastResult();
+	{
+		AllocationPhaseScope allocations(AllocationPhase::Bind);
+		context.NewExpression();
+		context.AddVariableSymbol(iter, iterValue);
+	}
+	y->Evaluate(context);
+	double cy = context.GetLastResult();
+	return { cx, cy };
+}
+
+namespace
+{
+	// Connects the points of one DRAW LINE statement, every point becomes the segment from the previous one
+	class PolylineCanvas : public gi::ICanvas
+	{
+	private:
+		gi::ICanvas* target;
+		bool hasLast = false;
+		gi::ModelPoint last{ 0.0, 0.0 };
+	public:
+		explicit PolylineCanvas(gi::ICanvas* target)
+			: target(target)
+		{
+		}
+
+		void SetDrawOrigin(double x, double y) override { target->SetDrawOrigin(x, y); }
+		void SetDrawRotation(double r) override { target->SetDrawRotation(r); }
+		void SetDrawScale(double x, double y) override { target->SetDrawScale(x, y); }
+		void SetDrawPointSize(int size) override { target->SetDrawPointSize(size); }
+		void SetDrawPointColor(uint8_t r, uint8_t g, uint8_t b) override { target->SetDrawPointColor(r, g, b); }
+		void SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b) override { target->SetDrawBackgroundColor(r, g, b); }
+		void DrawPoint(double x, double y) override
+		{
+			if (!hasLast)
+				last = { x, y };
+			target->DrawLine(last.x, last.y, x, y);
+			hasLast = true;
+			last = { x, y };
+		}
+		void DrawLine(double x0, double y0, double x1, double y1) override { target->DrawLine(x0, y0, x1, y1); }
+		void Clear() override { target->Clear(); }
+	};
+
+	// Samples a curve by bisecting intervals whose ends are further than tolerance apart on screen.
+	// Points landing on the pixel of the previous point are not drawn.
+	class AdaptiveSampler
+	{
+	private:
+		struct Sample
+		{
+			double t;
+			gi::ModelPoint model;
+			gi::ModelPoint device;
+		};
+
+		std::function<gi::ModelPoint(double)> evaluate;
+		gi::CanvasTransform transform;
+		double toleranceSquared;
+		double minWidth;
+		gi::ICanvas* canvas;
+		gi::PointCacheRecorder* record;
+
+		bool hasLast = false;
+		double lastX = 0, lastY = 0; // pixel of the last point, floored
+	public:
+		size_t evaluated = 0;
+		size_t drawn = 0;
+
+		AdaptiveSampler(std::function<gi::ModelPoint(double)> evaluate, const gi::CanvasTransform& transform,
+			double tolerance, double minWidth, gi::ICanvas* canvas, gi::PointCacheRecorder* record)
+			: evaluate(std::move(evaluate)), transform(transform), toleranceSquared(tolerance * tolerance),
+			minWidth(minWidth), canvas(canvas), record(record)
+		{
+		}
+
+		Sample Evaluate(double t)
+		{
+			gi::ModelPoint model = evaluate(t);
+			Sample sample{ t, model, transform.Apply(model) };
+			++evaluated;
+			return sample;
+		}
+
+		void Emit(const Sample& sample)
+		{
+			// floored, truncation would merge the pixels either side of 0
+			double px = std::floor(sample.device.x);
+			double py = std::floor(sample.device.y);
+			if (hasLast && px == lastX && py == lastY)
+				return;
+			hasLast = true;
+			lastX = px;
+			lastY = py;
+			++drawn;
+			canvas->DrawPoint(sample.model.x, sample.model.y);
+			if (record)
+				record->Add(sample.model);
+		}
+
+		// emit points in (a, b]
+		void Refine(const Sample& a, const Sample& b)
+		{
+			double dx = b.device.x - a.device.x;
+			double dy = b.device.y - a.device.y;
+			if (dx * dx + dy * dy > toleranceSquared && b.t - a.t > minWidth)
+			{
+				Sample middle = Evaluate((a.t + b.t) / 2);
+				Refine(a, middle);
+				Refine(middle, b);
+			}
+			else
+			{
+				Emit(b);
+			}
+		}
+	};
+
+	// Evaluates the loop indices [first, last] but skips sub-ranges whose interval
+	// enclosure lies entirely outside the viewport.
+	class ViewportCuller
+	{
+	private:
+		std::function<gi::ModelPoint(size_t)> evaluate;
+		std::function<void(double, double, gi::Interval&, gi::Interval&)> enclose;
+		gi::CanvasTransform transform;
+		double iterFrom, iterStep;
+		double left, top, right, bottom;
+		size_t granularity;
+		gi::ICanvas* canvas;
+		gi::PointCacheRecorder* record;
+
+		bool IsOutside(size_t first, size_t last)
+		{
+			gi::Interval ix, iy;
+			enclose(iterFrom + static_cast<double>(first) * iterStep, iterFrom + static_cast<double>(last) * iterStep, ix, iy);
+			gi::Interval dx = ix * gi::Interval::Point(transform.m00) + iy * gi::Interval::Point(transform.m10) + gi::Interval::Point(transform.tx);
+			gi::Interval dy = ix * gi::Interval::Point(transform.m01) + iy * gi::Interval::Point(transform.m11) + gi::Interval::Point(transform.ty);
+			return dx.hi < left || dx.lo > right || dy.hi < top || dy.lo > bottom;
+		}
+	public:
+		size_t evaluated = 0;
+		size_t culled = 0;
+
+		ViewportCuller(std::function<gi::ModelPoint(size_t)> evaluate,
+			std::function<void(double, double, gi::Interval&, gi::Interval&)> enclose,
+			const gi::CanvasTransform& transform, double iterFrom, double iterStep,
+			double width, double height, double margin, size_t granularity,
+			gi::ICanvas* canvas, gi::PointCacheRecorder* record)
+			: evaluate(std::move(evaluate)), enclose(std::move(enclose)), transform(transform),
+			iterFrom(iterFrom), iterStep(iterStep),
+			left(-margin), top(-margin), right(width + margin), bottom(height + margin),
+			granularity(granularity), canvas(canvas), record(record)
+		{
+		}
+
+		void Run(size_t first, size_t last)
+		{
+			if (IsOutside(first, last))
+			{
+				culled += last - first + 1;
+				return;
+			}
+			if (last - first + 1 > granularity)
+			{
+				size_t middle = first + (last - first) / 2;
+				Run(first, middle);
+				Run(middle + 1, last);
+				return;
+			}
+			for (size_t i = first; i <= last; ++i)
+			{
+				gi::ModelPoint point = evaluate(i);
+				++evaluated;
+				canvas->DrawPoint(point.x, point.y);
+				if (record)
+					record->Add(point);
+			}
+		}
+	};
+
+	// coarsest spacing the adaptive sampler starts from, as a count over the whole range
+	constexpr double AdaptiveInitialSegments = 256;
+	// how far below STEP the adaptive sampler may refine, bounds the work spent on discontinuities
+	constexpr double AdaptiveMaxRefinement = 1024;
+	// relative distance of period / STEP from a whole number that still counts as whole
+	constexpr double PeriodStepTolerance = 1e-9;
+
+	// same indices as the plain loop: it draws up to the first T beyond TO
+	size_t LastUniformIndex(double iterFrom, double iterTo, double iterStep)
+	{
+		size_t last = static_cast<size_t>(std::max(0.0, std::floor((iterTo - iterFrom) / iterStep)));
+		while (iterFrom + static_cast<double>(last) * iterStep <= iterTo)
+			++last;
+		while (last > 0 && iterFrom + static_cast<double>(last - 1) * iterStep > iterTo)
+			--last;
+		return last;
+	}
+}
+
+double gi::NTForStatement::ClampToPeriod(EvaluateContext& context, double iterFrom, double iterTo, double iterStep)
+{
+	Symbol variable{ iter, Symbol::Type::Variable, 0.0, nullptr };
+	BatchProgram programX, programY;
+	x->Compile({ variable, context, programX });
+	y->Compile({ variable, context, programY });
+	double period = PeriodAnalysis::CommonPeriod(PeriodAnalysis::FindPeriod(programX), PeriodAnalysis::FindPeriod(programY));
+	if (!(period > 0) || std::isinf(period))
+		return iterTo;
+
+	// with a whole number of steps per period, index i + steps draws the point of index i
+	double ratio = period / iterStep;
+	double steps = std::round(ratio);
+	if (steps < 1 || std::fabs(ratio - steps) > PeriodStepTolerance * ratio)
+		return iterTo;
+	size_t last = LastUniformIndex(iterFrom, iterTo, iterStep);
+	size_t kept = static_cast<size_t>(steps);
+	// a polyline needs the repeated first point to close the period
+	if (lines)
+		++kept;
+	if (last < kept)
+		return iterTo;
+	PrintMessage(JoinAsWideString(
+		L"periodic FOR: ", iter, L" repeats every ", period, L", drawing ", kept, L" of ", last + 1,
+		L" points, ", last + 1 - kept, L" evaluations saved"));
+	// the loops draw up to the first index past TO, put TO just before index kept - 1
+	return iterFrom + (static_cast<double>(kept) - 1.5) * iterStep;
+}
+
+bool gi::NTForStatement::EvaluateSinglePrecision(EvaluateContext& context, ICanvas* canvas, double iterFrom, double iterStep, size_t last,
+	PointCacheRecorder* recorder)
+{
+	Symbol variable{ iter, Symbol::Type::Variable, 0.0, nullptr };
+	BatchProgram programX, programY;
+	x->Compile({ variable, context, programX });
+	y->Compile({ variable, context, programY });
+	if (!programX.IsValid() || !programY.IsValid())
+		return false;
+
+	// pixels a model space difference moves a point on screen, overflow counts as infinitely far
+	CanvasTransform transform = CanvasTransform::FromState(context.GetCanvasState());
+	auto pixels = [&transform](double dx, double dy) {
+		double d = std::hypot(dx * transform.m00 + dy * transform.m10, dx * transform.m01 + dy * transform.m11);
+		return std::isnan(d) ? std::numeric_limits<double>::infinity() : d;
+	};
+
+	// storing the coordinates in float alone moves them by half an ulp of the largest
+	double iterLast = iterFrom + static_cast<double>(last) * iterStep;
+	IntervalEnvironment env{ variable, { iterFrom, iterLast }, context };
+	Interval ix = x->EvaluateInterval(env);
+	Interval iy = y->EvaluateInterval(env);
+	double halfUlp = std::numeric_limits<float>::epsilon() / 2;
+	double ex = std::max(std::fabs(ix.lo), std::fabs(ix.hi)) * halfUlp;
+	double ey = std::max(std::fabs(iy.lo), std::fabs(iy.hi)) * halfUlp;
+	double error = 0.0;
+	if (std::isfinite(ex) && std::isfinite(ey))
+		error = std::max(pixels(ex, ey), pixels(ex, -ey));
+
+	if (!(error <= context.GetSinglePrecision()))
+	{
+		PrintMessage(JoinAsWideString(
+			L"single precision FOR: kept double, float moves points by up to ", error, L" pixels"));
+		return false;
+	}
+
+	// the expressions may amplify rounding of T anywhere, every block is checked against
+	// the same program in double and drawn in double where float is off by more
+	ExecutionMetrics* metrics = context.GetMetrics();
+	std::vector<float> values(BatchProgram::BlockSize), xs(BatchProgram::BlockSize), ys(BatchProgram::BlockSize), workspace;
+	std::vector<double> exactValues(BatchProgram::BlockSize), exactXs(BatchProgram::BlockSize), exactYs(BatchProgram::BlockSize), exactWorkspace;
+	size_t doubleBlocks = 0, blocks = 0;
+	for (size_t base = 0; base <= last; base += BatchProgram::BlockSize)
+	{
+		size_t count = std::min(BatchProgram::BlockSize, last + 1 - base);
+		for (size_t i = 0; i < count; ++i)
+		{
+			exactValues[i] = iterFrom + static_cast<double>(base + i) * iterStep;
+			values[i] = static_cast<float>(exactValues[i]);
+		}
+		programX.Evaluate(values.data(), xs.data(), count, workspace);
+		programY.Evaluate(values.data(), ys.data(), count, workspace);
+		programX.Evaluate(exactValues.data(), exactXs.data(), count, exactWorkspace);
+		programY.Evaluate(exactValues.data(), exactYs.data(), count, exactWorkspace);
+		bool inFloat = true;
+		for (size_t i = 0; i < count && inFloat; ++i)
+		{
+			double dx = static_cast<double>(xs[i]) - exactXs[i];
+			double dy = static_cast<double>(ys[i]) - exactYs[i];
+			// NaN where double has a value or the other way round keeps the block in double
+			if (std::isnan(dx) || std::isnan(dy))
+				inFloat = std::isnan(exactXs[i]) == std::isnan(xs[i]) && std::isnan(exactYs[i]) == std::isnan(ys[i]);
+			else
+				inFloat = pixels(dx, dy) <= context.GetSinglePrecision();
+		}
+		++blocks;
+		if (!inFloat)
+			++doubleBlocks;
+		for (size_t i = 0; i < count; ++i)
+		{
+			ModelPoint point = inFloat ? ModelPoint{ xs[i], ys[i] } : ModelPoint{ exactXs[i], exactYs[i] };
+			if (metrics)
+				metrics->CountIteration();
+			if (recorder)
+				recorder->Add(point);
+			canvas->DrawPoint(point.x, point.y);
+		}
+	}
+	if (doubleBlocks > 0)
+		PrintMessage(JoinAsWideString(
+			L"single precision FOR: ", doubleBlocks, L" of ", blocks, L" blocks kept double"));
+	return true;
+}
+
 double gi::NTForStatement::Evaluate(EvaluateContext& context)
 {
-	double iterFrom, iterTo, iterStep, iterValue;
+	double iterFrom, iterTo, iterStep, iterValue, tolerance;
+	PointCache* cache;
+	std::optional<PointCacheRecorder> recorder;
+	PolylineCanvas polyline(context.GetCanvas());
+	ICanvas* canvas = lines ? &polyline : context.GetCanvas();
 	switch (ruleId)
 	{
 	case 0:
@@ -640,20 +1486,116 @@ double gi::NTForStatement::Evaluate(EvaluateContext& context)
 			std::swap(iterFrom, iterTo);
 			iterStep = -iterStep;
 		}
-		iterValue = iterFrom;
-		for (size_t i = 0; iterValue <= iterTo; ++i)
+		tolerance = context.GetAdaptiveSampling();
+		if (context.GetPeriodClamping() && tolerance == 0 && iterStep > 0)
+			iterTo = ClampToPeriod(context, iterFrom, iterTo, iterStep);
+		cache = context.GetPointCache();
+		if (cache)
 		{
-			iterValue = iterFrom + static_cast<double>(i) * iterStep;
-			context.NewExpression();
-			context.AddVariableSymbol(iter, iterValue);
-			x->Evaluate(context);
-			double cx = context.GetLastResult();
-			context.NewExpression();
-			context.AddVariableSymbol(iter, iterValue);
-			y->Evaluate(context);
-			double cy = context.GetLastResult();
-			context.GetCanvas()->DrawPoint(cx, cy);
+			StructuralHash hash;
+			hash.BindVariable(iter);
+			x->Hash(hash);
+			y->Hash(hash);
+			if (context.GetTrigRecurrenceInterval() > 0)
+				hash.Add(static_cast<int>(context.GetTrigRecurrenceInterval()));
+			// the same curve as a point statement may have been culled, keep their entries apart
+			if (lines)
+				hash.Add(-1);
+			if (tolerance > 0 || context.GetCullGranularity() > 0 || context.GetFastMath() > 0 || context.GetSinglePrecision() > 0)
+			{
+				// adaptive and culled samples depend on where the curve lands on screen,
+				// fast math and single precision decide from the scale
+				CanvasTransform transform = CanvasTransform::FromState(context.GetCanvasState());
+				for (double v : { tolerance, context.GetFastMath(), context.GetSinglePrecision(), transform.m00, transform.m01, transform.m10, transform.m11, transform.tx, transform.ty })
+					hash.Add(v);
+				hash.Add(context.GetViewportWidth());
+				hash.Add(context.GetViewportHeight());
+				hash.Add(static_cast<int>(context.GetCullGranularity()));
+				hash.Add(context.GetCanvasState().pointSize);
+			}
+			PointCache::Key cacheKey = { hash.Get(), iterFrom, iterTo, iterStep };
+			if (auto* cached = cache->Find(cacheKey))
+			{
+				for (auto& point : *cached)
+					canvas->DrawPoint(point.x, point.y);
+				break;
+			}
+			recorder.emplace(*cache, cacheKey);
 		}
+		if (tolerance > 0 && iterStep > 0)
+		{
+			double width = std::max(iterStep, (iterTo - iterFrom) / AdaptiveInitialSegments);
+			AdaptiveSampler sampler(
+				[this, &context](double t) { return EvaluatePoint(context, t); },
+				CanvasTransform::FromState(context.GetCanvasState()),
+				tolerance,
+				iterStep / AdaptiveMaxRefinement,
+				canvas,
+				recorder ? &*recorder : nullptr);
+			auto last = sampler.Evaluate(iterFrom);
+			sampler.Emit(last);
+			for (size_t i = 1; last.t < iterTo; ++i)
+			{
+				auto next = sampler.Evaluate(std::min(iterFrom + static_cast<double>(i) * width, iterTo));
+				sampler.Refine(last, next);
+				last = next;
+			}
+			// the uniform loop runs while T <= TO and draws one point past it
+			size_t uniform = static_cast<size_t>((iterTo - iterFrom) / iterStep) + 2;
+			if (uniform >= sampler.evaluated)
+				PrintMessage(JoinAsWideString(
+					L"adaptive FOR: ", sampler.evaluated, L" evaluations instead of ", uniform,
+					L", ", uniform - sampler.evaluated, L" saved, ", sampler.drawn, L" points drawn"));
+			else
+				PrintMessage(JoinAsWideString(
+					L"adaptive FOR: ", sampler.evaluated, L" evaluations instead of ", uniform,
+					L", ", sampler.evaluated - uniform, L" extra to close gaps, ", sampler.drawn, L" points drawn"));
+		}
+		else if (context.GetCullGranularity() > 0 && iterStep > 0 && !lines)
+		{
+			// line statements are never culled: a culled range would become a segment across the screen
+			size_t last = LastUniformIndex(iterFrom, iterTo, iterStep);
+
+			IntervalEnvironment env{ { iter, Symbol::Type::Variable, 0.0, nullptr }, Interval::Point(0.0), context };
+			ViewportCuller culler(
+				[this, &context, iterFrom, iterStep](size_t i) { return EvaluatePoint(context, iterFrom + static_cast<double>(i) * iterStep); },
+				[this, &env](double lo, double hi, Interval& ix, Interval& iy) {
+					env.value = { lo, hi };
+					ix = x->EvaluateInterval(env);
+					iy = y->EvaluateInterval(env);
+				},
+				CanvasTransform::FromState(context.GetCanvasState()),
+				iterFrom, iterStep,
+				context.GetViewportWidth(), context.GetViewportHeight(),
+				context.GetCanvasState().pointSize + 1.0,
+				context.GetCullGranularity(),
+				canvas,
+				recorder ? &*recorder : nullptr);
+			culler.Run(0, last);
+			PrintMessage(JoinAsWideString(
+				L"culled FOR: ", culler.culled, L" of ", last + 1, L" samples outside the viewport"));
+		}
+		else if (context.GetSinglePrecision() > 0 && iterStep > 0 &&
+			EvaluateSinglePrecision(context, canvas, iterFrom, iterStep, LastUniformIndex(iterFrom, iterTo, iterStep), recorder ? &*recorder : nullptr))
+		{
+			// drawn in float
+		}
+		else
+		{
+			TrigRecurrence recurrence(context, iter, iterFrom, iterStep, context.GetTrigRecurrenceInterval());
+			iterValue = iterFrom;
+			for (size_t i = 0; iterValue <= iterTo; ++i)
+			{
+				iterValue = iterFrom + static_cast<double>(i) * iterStep;
+				recurrence.SetIndex(i);
+				ModelPoint point = EvaluatePoint(context, iterValue);
+				if (recorder)
+					recorder->Add(point);
+				canvas->DrawPoint(point.x, point.y);
+			}
+		}
+		if (recorder)
+			recorder->Commit();
 		break;
 	default:
 		throw std::runtime_error("Invalid ruleId!");
@@ -661,6 +1603,20 @@ double gi::NTForStatement::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTForStatement::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, from, to, step);
+	hash.BindVariable(iter);
+	HashChildren(hash, ruleId, x, y);
+	if (lines)
+		hash.Add(-1);
+}
+
+bool gi::NTForStatement::DrawsLines() const
+{
+	return lines;
+}
+
 bool gi::NTSizeStatement::Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols)
 {
 	return GenericAcceptFunction(token, parseStack, symbols, ruleId, ProbeRules, progress, Rules, this);
@@ -698,6 +1654,11 @@ double gi::NTSizeStatement::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTSizeStatement::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, expression);
+}
+
 bool gi::NTColorStatement::Accept(const Token& token, std::stack<Nonterminal*>& parseStack,
 	std::vector<Symbol>& symbols)
 {
@@ -760,8 +1721,15 @@ double gi::NTColorStatement::Evaluate(EvaluateContext& context)
 	return 0;
 }
 
+void gi::NTColorStatement::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, expression1, expression2, expression3);
+}
+
 bool gi::NTStatement::Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols)
 {
+	if (ruleId == -1)
+		line = token.line;
 	return GenericAcceptFunction(token, parseStack, symbols, ruleId, ProbeRules, progress, Rules, this);
 }
 
@@ -795,6 +1763,16 @@ void gi::NTStatement::Print(int indent)
 
 double gi::NTStatement::Evaluate(EvaluateContext& context)
 {
+	static const wchar_t* kindNames[] = { L"ORIGIN", L"SCALE", L"ROT", L"FOR", L"SIZE", L"COLOR" };
+	static const char* spanNames[] = { "ORIGIN", "SCALE", "ROT", "FOR", "SIZE", "COLOR" };
+	bool known = ruleId >= 0 && ruleId < 6;
+	TraceSpan span(known ? spanNames[ruleId] : "Statement", "statement");
+	span.SetArg("line", static_cast<int64_t>(line));
+	PerfScope perf(ruleId == 3 ? "FOR" : nullptr, line);
+	AllocationStatementScope allocations(line, known ? spanNames[ruleId] : "Statement");
+	ExecutionMetrics* metrics = context.GetMetrics();
+	if (metrics && known)
+		metrics->BeginStatement(line, kindNames[ruleId]);
 	switch (ruleId)
 	{
 	case 0:
@@ -818,9 +1796,31 @@ double gi::NTStatement::Evaluate(EvaluateContext& context)
 	default:
 		throw std::runtime_error("Invalid ruleId!");
 	}
+	if (metrics)
+		metrics->EndStatement();
 	return 0;
 }
 
+void gi::NTStatement::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, originStatement, scaleStatement, rotStatement, forStatement, sizeStatement, colorStatement);
+}
+
+bool gi::NTStatement::IsForStatement() const
+{
+	return ruleId == 3;
+}
+
+bool gi::NTStatement::DrawsLines() const
+{
+	return ruleId == 3 && forStatement->DrawsLines();
+}
+
+size_t gi::NTStatement::GetLine() const
+{
+	return line;
+}
+
 bool gi::NTProgram::Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols)
 {
 	return GenericAcceptFunction(token, parseStack, symbols, ruleId, ProbeRules, progress, Rules, this);
@@ -859,3 +1859,16 @@ double gi::NTProgram::Evaluate(EvaluateContext& context)
 	}
 	return 0;
 }
+
+void gi::NTProgram::Hash(StructuralHash& hash)
+{
+	HashChildren(hash, ruleId, statement, program);
+}
+
+void gi::NTProgram::CollectStatements(std::vector<NTStatement*>& out)
+{
+	for (NTProgram* p = this; p != nullptr && p->ruleId == 0; p = p->program.get())
+	{
+		out.push_back(p->statement.get());
+	}
+}
@@ -1,16 +1,21 @@
 #pragma once
 #include <cassert>
+#include <cstdint>
 #include <memory>
 #include <stack>
 #include <stdexcept>
 #include <vector>
 
+#include "ICanvas.h"
 #include "ILexer.h"
+#include "Affine.h"
+#include "BatchProgram.h"
+#include "Interval.h"
 #include "Utils.h"
 
 namespace gi
 {
-	static constexpr size_t MAX_RULE_LENGTH = 18;
+	static constexpr size_t MAX_RULE_LENGTH = 19;
 
 	struct Symbol
 	{
@@ -67,9 +72,54 @@ namespace gi
 	}
 
 
+	// FNV-1a over the shape of a syntax tree.
+	// Identifiers compare case-insensitive like Symbol::MatchName, and the bound loop
+	// variable hashes the same whatever it is named.
+	class StructuralHash
+	{
+	private:
+		uint64_t value = 14695981039346656037ull;
+		Symbol boundVariable{ L"", Symbol::Type::Variable, 0.0, nullptr };
+
+		void AddBytes(const void* data, size_t size);
+	public:
+		void Add(int v);
+		void Add(double v);
+		void AddIdentifier(const std::wstring& name);
+		void BindVariable(const std::wstring& name);
+		uint64_t Get()const;
+	};
+
 	class NTExpression;
 	class NTComponent;
 	class EvaluateContext;
+	class PointCacheRecorder;
+
+	// Bindings for interval evaluation: the loop variable ranges over value,
+	// other identifiers are looked up in context.
+	struct IntervalEnvironment
+	{
+		Symbol variable;
+		Interval value;
+		EvaluateContext& context;
+	};
+
+	// Bindings for affine analysis: the loop variable is the variable of the result,
+	// other identifiers are looked up in context.
+	struct AffineEnvironment
+	{
+		Symbol variable;
+		EvaluateContext& context;
+	};
+
+	// Bindings for compiling to a BatchProgram: the loop variable becomes the program variable,
+	// other identifiers are looked up in context and compiled as constants.
+	struct BatchEnvironment
+	{
+		Symbol variable;
+		EvaluateContext& context;
+		BatchProgram& program;
+	};
 
 	class Nonterminal
 	{
@@ -81,6 +131,9 @@ namespace gi
 
 		virtual double Evaluate(EvaluateContext& context) = 0;
 
+		// feed rule ids, literals and identifiers of the subtree into hash
+		virtual void Hash(StructuralHash& hash) = 0;
+
 		virtual ~Nonterminal() = default;
 	};
 
@@ -98,6 +151,14 @@ namespace gi
 		return true;
 	}
 
+	// optional keyword, sets Field when present and leaves the token to the next step otherwise
+	template<typename T, bool T::* Field, TokenType Expected>
+	bool MatchOptionalToken(std::stack<Nonterminal*>& parseStack, const Token& token, T* thiz)
+	{
+		thiz->*Field = token.type == Expected;
+		return thiz->*Field;
+	}
+
 	template<typename T, std::wstring T::* Field>
 	bool TransformTokenAsString(std::stack<Nonterminal*>& parseStack, const Token& token, T* thiz)
 	{
@@ -202,6 +263,10 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
+		Interval EvaluateInterval(const IntervalEnvironment& env);
+		Affine EvaluateAffine(const AffineEnvironment& env);
+		void Compile(const BatchEnvironment& env);
 	private:
 		double literal;
 		std::wstring identifier;
@@ -242,6 +307,10 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
+		Interval EvaluateInterval(const IntervalEnvironment& env, const Interval& base);
+		Affine EvaluateAffine(const AffineEnvironment& env, const Affine& base);
+		void Compile(const BatchEnvironment& env);
 	private:
 		// 0. Component2 -> ** Component
 		// 1. Component2 -> NULL
@@ -265,6 +334,8 @@ namespace gi
 
 		static constexpr ProbeRule ProbeRules[] = {
 			{TokenType::OperatorPower, 0},
+			{TokenType::OperatorPlus, 1},
+			{TokenType::OperatorMinus, 1},
 			{TokenType::OperatorMultiply, 1},
 			{TokenType::OperatorDivide, 1},
 
@@ -283,6 +354,10 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
+		Interval EvaluateInterval(const IntervalEnvironment& env);
+		Affine EvaluateAffine(const AffineEnvironment& env);
+		void Compile(const BatchEnvironment& env);
 	private:
 		// 0. Component -> Atom Component2
 		int ruleId = -1;
@@ -313,6 +388,10 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
+		Interval EvaluateInterval(const IntervalEnvironment& env);
+		Affine EvaluateAffine(const AffineEnvironment& env);
+		void Compile(const BatchEnvironment& env);
 	private:
 		// 0. Factor -> + Factor
 		// 1. Factor -> - Factor
@@ -358,6 +437,10 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
+		Interval EvaluateInterval(const IntervalEnvironment& env, const Interval& lhs);
+		Affine EvaluateAffine(const AffineEnvironment& env, const Affine& lhs);
+		void Compile(const BatchEnvironment& env);
 	private:
 		// 0. Term2 -> * Factor Term2
 		// 1. Term2 -> / Factor Term2
@@ -410,6 +493,10 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
+		Interval EvaluateInterval(const IntervalEnvironment& env);
+		Affine EvaluateAffine(const AffineEnvironment& env);
+		void Compile(const BatchEnvironment& env);
 	private:
 		// 0. Term -> Factor Term2
 		int ruleId = -1;
@@ -442,6 +529,10 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
+		Interval EvaluateInterval(const IntervalEnvironment& env, const Interval& lhs);
+		Affine EvaluateAffine(const AffineEnvironment& env, const Affine& lhs);
+		void Compile(const BatchEnvironment& env);
 	private:
 		// 0. Expression2 -> + Term Expression2
 		// 1. Expression2 -> - Term Expression2
@@ -491,6 +582,11 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
+		// enclosure of every value Evaluate can produce under env
+		Interval EvaluateInterval(const IntervalEnvironment& env);
+		Affine EvaluateAffine(const AffineEnvironment& env);
+		void Compile(const BatchEnvironment& env);
 	private:
 		// 0. Expression -> Term Expression2
 		int ruleId = -1;
@@ -523,6 +619,7 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
 	private:
 		// 0. OriginStatement -> ORIGIN IS ( Expression , Expression )
 		int ruleId = -1;
@@ -555,6 +652,7 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
 	private:
 		// 0. ScaleStatement -> SCALE IS ( Expression, Expression )
 		int ruleId = -1;
@@ -587,6 +685,7 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
 	private:
 		// 0. RotStatement -> ROT IS Expression
 		int ruleId = -1;
@@ -615,14 +714,29 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
+
+		// DRAW LINE: consecutive samples are connected, the canvas gets DrawLine calls
+		bool DrawsLines()const;
 	private:
-		// 0. ForStatement -> FOR IDENTIFIER FROM Expression TO Expression STEP Expression DRAW ( Expression , Expression )
+		// 0. ForStatement -> FOR IDENTIFIER FROM Expression TO Expression STEP Expression DRAW [LINE] ( Expression , Expression )
 		int ruleId = -1;
 		int progress = 0;
 
 		std::wstring iter;
+		bool lines = false;
 		std::unique_ptr<NTExpression> from, to, step, x, y;
 
+		// evaluate (x, y) with the loop variable set to iterValue
+		ModelPoint EvaluatePoint(EvaluateContext& context, double iterValue);
+		// draw indices 0..last through BatchProgram, in float for the blocks within the tolerance,
+		// false if the coordinates do not fit float and nothing was drawn
+		bool EvaluateSinglePrecision(EvaluateContext& context, ICanvas* canvas, double iterFrom, double iterStep, size_t last,
+			PointCacheRecorder* recorder);
+		// iterTo cut to one period of (x, y) when the loop covers more than one and the period
+		// is a whole number of steps, so the points left out repeat points drawn
+		double ClampToPeriod(EvaluateContext& context, double iterFrom, double iterTo, double iterStep);
+
 		static constexpr TransformFunctionEditSymbol<NTForStatement> Rules[][MAX_RULE_LENGTH] = {
 			{
 				SymbolOperationWrapper<NTForStatement, MatchToken<NTForStatement, TokenType::KeywordFor>>,
@@ -634,6 +748,7 @@ namespace gi
 				SymbolOperationWrapper<NTForStatement, MatchToken<NTForStatement, TokenType::KeywordStep>>,
 				SymbolOperationWrapper<NTForStatement, TransformTokenAsNonterminal<NTForStatement, NTExpression, &NTForStatement::step>>,
 				SymbolOperationWrapper<NTForStatement, MatchToken<NTForStatement, TokenType::KeywordDraw>>,
+				SymbolOperationWrapper<NTForStatement, MatchOptionalToken<NTForStatement, &NTForStatement::lines, TokenType::KeywordLine>>,
 				SymbolOperationWrapper<NTForStatement, MatchToken<NTForStatement, TokenType::SplitterLeftBracket>>,
 				AddSymbolEntry<NTForStatement, &NTForStatement::iter,Symbol::Type::Variable>,
 				SymbolOperationWrapper<NTForStatement, TransformTokenAsNonterminal<NTForStatement, NTExpression, &NTForStatement::x>>,
@@ -657,6 +772,7 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
 	private:
 		// 0. SizeStatement -> SIZE IS Expression
 		int ruleId = -1;
@@ -685,6 +801,7 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
 	private:
 		// 0. ColorStatement -> COLOR IS ( Expression, Expression, Expression )
 		int ruleId = -1;
@@ -719,7 +836,16 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
+
+		bool IsForStatement()const;
+		// FOR statement whose points are polyline vertices
+		bool DrawsLines()const;
+		// line of the first token
+		size_t GetLine()const;
 	private:
+		size_t line = 0;
+
 		// 0. Statement -> OriginStatement
 		// 1. Statement -> ScaleStatement
 		// 2. Statement -> RotStatement
@@ -785,6 +911,10 @@ namespace gi
 		bool Accept(const Token& token, std::stack<Nonterminal*>& parseStack, std::vector<Symbol>& symbols) override;
 		void Print(int indent) override;
 		double Evaluate(EvaluateContext& context) override;
+		void Hash(StructuralHash& hash) override;
+
+		// append statements of the program to out, in source order
+		void CollectStatements(std::vector<NTStatement*>& out);
 	private:
 		// 0. Program -> Statement ; Program
 		// 1. Program -> NULL
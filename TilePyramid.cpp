@@ -0,0 +1,283 @@
+
+#include "TilePyramid.h"
+#include "ImageEncoder.h"
+#include "TiledCanvas.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+	constexpr size_t TileBytes = gi::TiledCanvas::TileBytes;
+	static_assert(gi::TilePyramid::TileSize == gi::TiledCanvas::TileSize, "pyramid tiles are canvas tiles");
+
+	// Pans with the mouse, zooms with the wheel around the cursor, and shows the level whose
+	// pixels are closest to screen pixels. Tiles that are not there keep the page background.
+	const char* ViewerScript = R"(const map = document.getElementById('map');
+const shown = new Map(), missing = new Set();
+let scale = Math.min(innerWidth / W, innerHeight / H);
+let ox = (innerWidth - W * scale) / 2, oy = (innerHeight - H * scale) / 2;
+function render() {
+  const z = Math.max(0, Math.min(Z, Z + Math.round(Math.log2(scale))));
+  const step = Math.pow(2, Z - z), size = T * step * scale;
+  const cols = Math.ceil(W / (T * step)), rows = Math.ceil(H / (T * step));
+  const x0 = Math.max(0, Math.floor(-ox / size)), x1 = Math.min(cols - 1, Math.floor((innerWidth - ox) / size));
+  const y0 = Math.max(0, Math.floor(-oy / size)), y1 = Math.min(rows - 1, Math.floor((innerHeight - oy) / size));
+  const keep = new Set();
+  for (let y = y0; y <= y1; ++y) {
+    for (let x = x0; x <= x1; ++x) {
+      const key = z + '/' + x + '/' + y;
+      if (missing.has(key)) continue;
+      keep.add(key);
+      let img = shown.get(key);
+      if (!img) {
+        img = document.createElement('img');
+        img.onerror = () => { missing.add(key); img.remove(); shown.delete(key); };
+        img.src = key + '.png';
+        map.appendChild(img);
+        shown.set(key, img);
+      }
+      img.style.left = (ox + x * size) + 'px';
+      img.style.top = (oy + y * size) + 'px';
+      img.style.width = img.style.height = size + 'px';
+    }
+  }
+  for (const [key, img] of shown) {
+    if (!keep.has(key)) { img.remove(); shown.delete(key); }
+  }
+}
+let drag = null;
+map.onpointerdown = e => { drag = [e.clientX - ox, e.clientY - oy]; map.setPointerCapture(e.pointerId); };
+map.onpointermove = e => { if (drag) { ox = e.clientX - drag[0]; oy = e.clientY - drag[1]; render(); } };
+map.onpointerup = () => { drag = null; };
+map.onwheel = e => {
+  e.preventDefault();
+  const factor = Math.pow(2, -e.deltaY / 300);
+  ox = e.clientX - (e.clientX - ox) * factor;
+  oy = e.clientY - (e.clientY - oy) * factor;
+  scale *= factor;
+  render();
+};
+onresize = render;
+render();
+)";
+}
+
+gi::TilePyramid::TilePyramid(TiledCanvas& canvas, Reduction reduction, int pngLevel)
+	: canvas(canvas), reduction(reduction), pngLevel(pngLevel)
+{
+}
+
+int gi::TilePyramid::GetLevelCount() const
+{
+	return levels;
+}
+
+size_t gi::TilePyramid::GetWrittenCount() const
+{
+	return written;
+}
+
+size_t gi::TilePyramid::GetSkippedCount() const
+{
+	return skipped;
+}
+
+int gi::TilePyramid::Columns(int z) const
+{
+	int64_t span = static_cast<int64_t>(TileSize) << (levels - 1 - z);
+	return static_cast<int>((canvas.GetWidth() + span - 1) / span);
+}
+
+int gi::TilePyramid::Rows(int z) const
+{
+	int64_t span = static_cast<int64_t>(TileSize) << (levels - 1 - z);
+	return static_cast<int>((canvas.GetHeight() + span - 1) / span);
+}
+
+gi::TilePyramid::Tile gi::TilePyramid::Build(int z, int x, int y)
+{
+	if (x >= Columns(z) || y >= Rows(z))
+		return nullptr;
+	if (z == rootLevel)
+		return std::move(roots[static_cast<size_t>(y) * rootColumns + x]);
+	Tile tile(new uint8_t[TileBytes]);
+	bool covered = false;
+	if (z == levels - 1)
+	{
+		std::lock_guard<std::mutex> lock(canvasMutex);
+		covered = canvas.CopyTile(x, y, tile.get());
+	}
+	else
+	{
+		// depth first, so a subtree holds at most four tiles per level
+		Tile children[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			children[i] = Build(z + 1, 2 * x + (i & 1), 2 * y + (i >> 1));
+			covered |= children[i] != nullptr;
+		}
+		if (covered)
+			Reduce(children, tile.get());
+	}
+	if (!covered)
+	{
+		++skipped;
+		return nullptr;
+	}
+	WriteTile(z, x, y, tile.get());
+	return tile;
+}
+
+void gi::TilePyramid::Reduce(const Tile children[4], uint8_t* parent) const
+{
+	const int half = TileSize / 2;
+	for (int i = 0; i < 4; ++i)
+	{
+		int left = (i & 1) * half, top = (i >> 1) * half;
+		const uint8_t* child = children[i].get();
+		for (int py = 0; py < half; ++py)
+		{
+			uint8_t* out = parent + (static_cast<size_t>(top + py) * TileSize + left) * 4;
+			if (!child)
+			{
+				memset(out, 0, static_cast<size_t>(half) * 4);
+				continue;
+			}
+			for (int px = 0; px < half; ++px, out += 4)
+			{
+				const uint8_t* block[4] = {
+					child + (static_cast<size_t>(2 * py) * TileSize + 2 * px) * 4,
+					child + (static_cast<size_t>(2 * py) * TileSize + 2 * px + 1) * 4,
+					child + (static_cast<size_t>(2 * py + 1) * TileSize + 2 * px) * 4,
+					child + (static_cast<size_t>(2 * py + 1) * TileSize + 2 * px + 1) * 4 };
+				int sum[3] = { 0, 0, 0 };
+				int count = 0;
+				out[3] = 0;
+				for (const uint8_t* p : block)
+				{
+					out[3] |= p[3];
+					if (!p[3] && reduction == Reduction::Max)
+						continue;
+					const uint8_t* color = p[3] ? p : background;
+					for (int c = 0; c < 3; ++c)
+						sum[c] += color[c];
+					++count;
+				}
+				for (int c = 0; c < 3; ++c)
+					out[c] = count > 0 ? static_cast<uint8_t>((sum[c] + count / 2) / count) : 0;
+			}
+		}
+	}
+}
+
+void gi::TilePyramid::WriteTile(int z, int x, int y, const uint8_t* pixels)
+{
+	std::vector<uint8_t> rgb(static_cast<size_t>(TileSize) * TileSize * 3);
+	for (size_t i = 0; i < static_cast<size_t>(TileSize) * TileSize; ++i)
+	{
+		const uint8_t* color = pixels[i * 4 + 3] ? pixels + i * 4 : background;
+		std::copy(color, color + 3, rgb.begin() + i * 3);
+	}
+	std::filesystem::path column = directory / std::to_string(z) / std::to_string(x);
+	std::error_code ec;
+	std::filesystem::create_directories(column, ec);
+	std::ofstream os(column / (std::to_string(y) + ".png"), std::ios::binary);
+	if (!ImageEncoder::WritePng(os, rgb.data(), TileSize, TileSize, pngLevel, nullptr))
+	{
+		failed = true;
+		return;
+	}
+	++written;
+}
+
+bool gi::TilePyramid::WriteViewer() const
+{
+	const char digits[] = "0123456789abcdef";
+	std::string color = "#";
+	for (uint8_t c : background)
+	{
+		color += digits[c >> 4];
+		color += digits[c & 15];
+	}
+	std::ofstream os(directory / "index.html", std::ios::binary);
+	os << "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>GraphicInterpreter tiles</title>\n"
+		<< "<style>\nhtml, body { margin: 0; height: 100%; overflow: hidden; background: " << color << "; }\n"
+		<< "#map { position: absolute; inset: 0; cursor: grab; touch-action: none; }\n"
+		<< "#map img { position: absolute; image-rendering: pixelated; user-select: none; pointer-events: none; }\n"
+		<< "</style>\n</head>\n<body>\n<div id=\"map\"></div>\n<script>\n"
+		<< "const W = " << canvas.GetWidth() << ", H = " << canvas.GetHeight()
+		<< ", Z = " << std::max(levels - 1, 0) << ", T = " << TileSize << ";\n"
+		<< ViewerScript << "</script>\n</body>\n</html>\n";
+	os.close();
+	return !os.fail();
+}
+
+bool gi::TilePyramid::Write(const std::filesystem::path& directory, WorkStealingPool* pool)
+{
+	this->directory = directory;
+	written = 0;
+	skipped = 0;
+	failed = false;
+	canvas.Flush();
+	canvas.GetBackgroundColor(background[0], background[1], background[2]);
+	std::error_code ec;
+	std::filesystem::create_directories(directory, ec);
+	int tiles = std::max((canvas.GetWidth() + TileSize - 1) / TileSize, (canvas.GetHeight() + TileSize - 1) / TileSize);
+	levels = 0;
+	if (tiles > 0)
+	{
+		levels = 1;
+		while ((1 << (levels - 1)) < tiles)
+			++levels;
+	}
+	if (levels == 0)
+		return WriteViewer();
+
+	rootLevel = -1;
+	roots.clear();
+	if (pool)
+	{
+		// deep enough for a few subtrees per thread, then reduce the levels above them here
+		int split = 0;
+		while (split < levels - 1 && static_cast<size_t>(Columns(split)) * Rows(split) < 4 * pool->GetThreadCount())
+			++split;
+		rootColumns = Columns(split);
+		std::vector<Tile> built(static_cast<size_t>(rootColumns) * Rows(split));
+		size_t remaining = built.size();
+		std::mutex mutex;
+		std::condition_variable subtreeDone;
+		for (size_t i = 0; i < built.size(); ++i)
+		{
+			pool->Submit([&, i, split](unsigned) {
+				Tile tile;
+				try {
+					tile = Build(split, static_cast<int>(i % rootColumns), static_cast<int>(i / rootColumns));
+				}
+				catch (std::exception&)
+				{
+					failed = true;
+				}
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					built[i] = std::move(tile);
+					--remaining;
+				}
+				subtreeDone.notify_all();
+			});
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		subtreeDone.wait(lock, [&]() { return remaining == 0; });
+		roots = std::move(built);
+		rootLevel = split;
+	}
+	Build(0, 0, 0);
+	roots.clear();
+	rootLevel = -1;
+	return !failed && WriteViewer();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace gi
+{
+	class TiledCanvas;
+	class WorkStealingPool;
+
+	// Zoomable tile pyramid of a TiledCanvas, written as directory/z/x/y.png with a static
+	// index.html viewer. The highest level is the canvas at full resolution, one TiledCanvas tile
+	// per pyramid tile, each level below halves it down to a single tile at level 0.
+	// Levels are reduced from the one above, so the script runs once whatever the zoom.
+	// Tiles without a covered pixel are not written, the viewer shows the background there.
+	class TilePyramid
+	{
+	public:
+		static constexpr int TileSize = 256;
+
+		// Box averages each 2x2 block with the background, Max averages only its covered
+		// pixels, so thin curves stay visible when zoomed out.
+		enum class Reduction { Box, Max };
+	private:
+		using Tile = std::unique_ptr<uint8_t[]>;
+
+		TiledCanvas& canvas;
+		Reduction reduction;
+		int pngLevel;
+		std::filesystem::path directory;
+		int levels = 0;
+		uint8_t background[3] = { 0, 0, 0 };
+		std::mutex canvasMutex; // TiledCanvas reads are not thread safe
+
+		// tiles built by the parallel pass, levels below it are reduced from them
+		int rootLevel = -1;
+		int rootColumns = 0;
+		std::vector<Tile> roots;
+
+		std::atomic<size_t> written{ 0 };
+		std::atomic<size_t> skipped{ 0 };
+		std::atomic<bool> failed{ false };
+
+		int Columns(int z)const;
+		int Rows(int z)const;
+		// tile z, x, y written out unless empty, nullptr if empty
+		Tile Build(int z, int x, int y);
+		void Reduce(const Tile children[4], uint8_t* parent)const;
+		void WriteTile(int z, int x, int y, const uint8_t* pixels);
+		bool WriteViewer()const;
+	public:
+		// the canvas is flushed and read, pngLevel as for ImageEncoder::WritePng
+		TilePyramid(TiledCanvas& canvas, Reduction reduction, int pngLevel);
+
+		// Subtrees are built on pool when given, each reading its canvas tiles once.
+		// False if a file could not be written.
+		bool Write(const std::filesystem::path& directory, WorkStealingPool* pool);
+
+		int GetLevelCount()const;
+		size_t GetWrittenCount()const;
+		size_t GetSkippedCount()const;
+	};
+}
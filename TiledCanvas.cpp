@@ -0,0 +1,446 @@
+
+#include "TiledCanvas.h"
+#include "RasterCanvas.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <winioctl.h>
+#else
+#include <cstdlib>
+#include <unistd.h>
+#endif
+
+gi::TiledCanvas::TiledCanvas(int width, int height, size_t residentTiles)
+	: width(std::max(width, 0)), height(std::max(height, 0)),
+	tilesX((this->width + TileSize - 1) / TileSize), tilesY((this->height + TileSize - 1) / TileSize),
+	residentTiles(std::max<size_t>(residentTiles, 1))
+{
+}
+
+gi::TiledCanvas::~TiledCanvas()
+{
+	CloseTileFile();
+}
+
+size_t gi::TiledCanvas::MemoryBound(size_t residentTiles)
+{
+	return std::max<size_t>(residentTiles, 1) * TileBytes + BinRecords * sizeof(Record);
+}
+
+int gi::TiledCanvas::GetWidth() const
+{
+	return width;
+}
+
+int gi::TiledCanvas::GetHeight() const
+{
+	return height;
+}
+
+uint64_t gi::TiledCanvas::GetTileLoads() const
+{
+	return tileLoads;
+}
+
+void gi::TiledCanvas::SetAntiAliasing(bool enable)
+{
+	antiAliasing = enable;
+}
+
+void gi::TiledCanvas::GetBackgroundColor(uint8_t& r, uint8_t& g, uint8_t& b) const
+{
+	r = background[0];
+	g = background[1];
+	b = background[2];
+}
+
+uint8_t* gi::TiledCanvas::Tile(size_t tile, bool write)
+{
+	auto found = residentIndex.find(tile);
+	if (found != residentIndex.end())
+	{
+		resident.splice(resident.begin(), resident, found->second);
+		found->second->dirty |= write;
+		return found->second->pixels.get();
+	}
+	std::unique_ptr<uint8_t[]> pixels;
+	if (resident.size() >= residentTiles)
+	{
+		Resident& evicted = resident.back();
+		if (evicted.dirty)
+			WriteTile(evicted.tile, evicted.pixels.get());
+		pixels = std::move(evicted.pixels);
+		residentIndex.erase(evicted.tile);
+		resident.pop_back();
+	}
+	else
+		pixels.reset(new uint8_t[TileBytes]);
+	ReadTile(tile, 0, TileBytes, pixels.get());
+	resident.push_front({ tile, std::move(pixels), write });
+	residentIndex[tile] = resident.begin();
+	++tileLoads;
+	return resident.front().pixels.get();
+}
+
+void gi::TiledCanvas::Bin(size_t tile, const Record& record)
+{
+	bins[tile].push_back(record);
+	if (++binned >= BinRecords)
+		Flush();
+}
+
+void gi::TiledCanvas::ApplyBin(size_t tile, const std::vector<Record>& records)
+{
+	uint8_t* view = Tile(tile, true);
+	int left = static_cast<int>(tile % tilesX) * TileSize;
+	int top = static_cast<int>(tile / tilesX) * TileSize;
+	int right = std::min(left + TileSize, width) - 1;
+	int bottom = std::min(top + TileSize, height) - 1;
+	for (const Record& r : records)
+	{
+		auto plot = [&](int x, int y) {
+			uint8_t* p = view + (static_cast<size_t>(y - top) * TileSize + (x - left)) * 4;
+			std::copy(r.color, r.color + 3, p);
+			p[3] = 1;
+		};
+		if (r.size < 0)
+		{
+			// Blend against the background of the time, SetDrawBackgroundColor flushes first
+			uint8_t* p = view + (static_cast<size_t>(r.y - top) * TileSize + (r.x - left)) * 4;
+			if (!p[3])
+				std::copy(background, background + 3, p);
+			double coverage = std::min(r.coverage, 1.0);
+			for (size_t c = 0; c < 3; ++c)
+			{
+				double mixed = p[c] + (r.color[c] - p[c]) * coverage;
+				p[c] = static_cast<uint8_t>(mixed + 0.5);
+			}
+			p[3] = 1;
+		}
+		else if (r.size == 0)
+			plot(r.x, r.y);
+		else
+		{
+			// the rows and columns of the point inside this tile
+			int rowFirst = static_cast<int>(std::max<int64_t>(static_cast<int64_t>(r.y) - r.size, top));
+			int rowLast = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(r.y) + r.size, bottom));
+			for (int py = rowFirst; py <= rowLast; ++py)
+			{
+				int64_t half = DiscHalfWidth(r.size, py - r.y);
+				int columnFirst = static_cast<int>(std::max<int64_t>(r.x - half, left));
+				int columnLast = static_cast<int>(std::min<int64_t>(r.x + half, right));
+				for (int px = columnFirst; px <= columnLast; ++px)
+					plot(px, py);
+			}
+		}
+	}
+}
+
+void gi::TiledCanvas::Flush()
+{
+	if (binned == 0)
+		return;
+	// tile order, so each tile is mapped once per flush when they do not all fit
+	std::vector<size_t> tiles;
+	tiles.reserve(bins.size());
+	for (auto& bin : bins)
+		tiles.push_back(bin.first);
+	std::sort(tiles.begin(), tiles.end());
+	for (size_t tile : tiles)
+		ApplyBin(tile, bins[tile]);
+	bins.clear();
+	binned = 0;
+}
+
+bool gi::TiledCanvas::CopyTile(int tx, int ty, uint8_t* pixels)
+{
+	Flush();
+	if (tx < 0 || ty < 0 || tx >= tilesX || ty >= tilesY)
+	{
+		memset(pixels, 0, TileBytes);
+		return false;
+	}
+	const uint8_t* view = Tile(static_cast<size_t>(ty) * tilesX + tx, false);
+	memcpy(pixels, view, TileBytes);
+	for (size_t i = 3; i < TileBytes; i += 4)
+	{
+		if (pixels[i])
+			return true;
+	}
+	return false;
+}
+
+void gi::TiledCanvas::ReadRegion(int x, int y, int w, int h, uint8_t* rgb)
+{
+	Flush();
+	for (size_t i = 0; i < static_cast<size_t>(w) * h; ++i)
+		std::copy(background, background + 3, rgb + i * 3);
+	int left = std::max(x, 0), right = std::min(x + w, width);
+	int top = std::max(y, 0), bottom = std::min(y + h, height);
+	if (left >= right || top >= bottom)
+		return;
+	std::vector<uint8_t> rows;
+	for (int ty = top / TileSize; ty <= (bottom - 1) / TileSize; ++ty)
+	{
+		int y0 = std::max(top, ty * TileSize), y1 = std::min(bottom, (ty + 1) * TileSize);
+		size_t rowOffset = static_cast<size_t>(y0 - ty * TileSize) * TileSize * 4;
+		for (int tx = left / TileSize; tx <= (right - 1) / TileSize; ++tx)
+		{
+			// a band of a wide canvas would otherwise load every tile of the row once per band
+			size_t tile = static_cast<size_t>(ty) * tilesX + tx;
+			const uint8_t* view;
+			auto found = residentIndex.find(tile);
+			if (found != residentIndex.end())
+				view = found->second->pixels.get() + rowOffset;
+			else
+			{
+				rows.resize(static_cast<size_t>(y1 - y0) * TileSize * 4);
+				ReadTile(tile, rowOffset, rows.size(), rows.data());
+				view = rows.data();
+			}
+			int x0 = std::max(left, tx * TileSize), x1 = std::min(right, (tx + 1) * TileSize);
+			for (int py = y0; py < y1; ++py)
+			{
+				const uint8_t* p = view + (static_cast<size_t>(py - y0) * TileSize + (x0 - tx * TileSize)) * 4;
+				uint8_t* out = rgb + (static_cast<size_t>(py - y) * w + (x0 - x)) * 3;
+				for (int px = x0; px < x1; ++px, p += 4, out += 3)
+				{
+					if (p[3])
+						std::copy(p, p + 3, out);
+				}
+			}
+		}
+	}
+}
+
+void gi::TiledCanvas::WritePpm(std::ostream& os)
+{
+	os << "P6\n" << width << ' ' << height << "\n255\n";
+	if (width == 0)
+		return;
+	// bands as large as the resident tiles, never crossing a tile row
+	size_t rowBytes = static_cast<size_t>(width) * 3;
+	int band = static_cast<int>(std::clamp<size_t>(residentTiles * TileBytes / rowBytes, 1, TileSize));
+	std::vector<uint8_t> rows(rowBytes * band);
+	for (int y = 0; y < height;)
+	{
+		int count = std::min({ band, TileSize - y % TileSize, height - y });
+		ReadRegion(0, y, width, count, rows.data());
+		os.write(reinterpret_cast<const char*>(rows.data()), static_cast<std::streamsize>(rowBytes * count));
+		y += count;
+	}
+}
+
+void gi::TiledCanvas::SetDrawPointSize(int size)
+{
+	TransformingCanvas::SetDrawPointSize(ClampPointSize(size, width, height));
+}
+
+void gi::TiledCanvas::SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	// uncovered pixels take the background when read, binned blends still need the old one
+	Flush();
+	background[0] = r;
+	background[1] = g;
+	background[2] = b;
+}
+
+void gi::TiledCanvas::DrawPoint(double x, double y)
+{
+	int cx, cy;
+	if (!PixelOf(transform.Apply({ x, y }), cx, cy))
+		return;
+	int size = state.pointSize;
+	int64_t reach = size;
+	int left = static_cast<int>(std::max<int64_t>(cx - reach, 0)), right = static_cast<int>(std::min<int64_t>(cx + reach, width - 1));
+	int top = static_cast<int>(std::max<int64_t>(cy - reach, 0)), bottom = static_cast<int>(std::min<int64_t>(cy + reach, height - 1));
+	if (left > right || top > bottom)
+		return;
+	Record record{ cx, cy, size, { state.colorR, state.colorG, state.colorB }, 0.0 };
+	for (int ty = top / TileSize; ty <= bottom / TileSize; ++ty)
+	{
+		for (int tx = left / TileSize; tx <= right / TileSize; ++tx)
+			Bin(static_cast<size_t>(ty) * tilesX + tx, record);
+	}
+}
+
+void gi::TiledCanvas::DrawLine(double x0, double y0, double x1, double y1)
+{
+	ModelPoint a = transform.Apply({ x0, y0 });
+	ModelPoint b = transform.Apply({ x1, y1 });
+	if (!ClipSegment(a, b, width, height))
+		return;
+	// the walk runs over the whole canvas once, its pixels are binned like size 0 points
+	Record record{ 0, 0, 0, { state.colorR, state.colorG, state.colorB }, 0.0 };
+	auto bin = [&](int x, int y) {
+		if (x < 0 || y < 0 || x >= width || y >= height)
+			return;
+		record.x = x;
+		record.y = y;
+		Bin(static_cast<size_t>(y / TileSize) * tilesX + x / TileSize, record);
+	};
+	if (antiAliasing)
+	{
+		record.size = -1;
+		WalkWu(a.x, a.y, b.x, b.y, [&](int x, int y, double coverage) {
+			if (!(coverage > 0))
+				return;
+			record.coverage = coverage;
+			bin(x, y);
+		});
+	}
+	else
+		WalkBresenham(a.x, a.y, b.x, b.y, bin);
+}
+
+void gi::TiledCanvas::Clear()
+{
+	// tiles are all uncovered again, there is nothing to write back
+	bins.clear();
+	binned = 0;
+	resident.clear();
+	residentIndex.clear();
+	CloseTileFile();
+}
+
+#ifdef _WIN32
+
+void gi::TiledCanvas::OpenTileFile()
+{
+	if (hFile != INVALID_HANDLE_VALUE)
+		return;
+	wchar_t directory[MAX_PATH + 1];
+	wchar_t path[MAX_PATH + 1];
+	if (!::GetTempPathW(MAX_PATH + 1, directory) || !::GetTempFileNameW(directory, L"git", 0, path))
+	{
+		PrintMessage(L"failed to create temporary tile file");
+		throw std::runtime_error("tile failure");
+	}
+	hFile = ::CreateFileW(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		PrintMessage(JoinAsWideString(L"failed to open temporary tile file \'", path, L"\'"));
+		throw std::runtime_error("tile failure");
+	}
+	// tiles never written take no disk space
+	DWORD returned = 0;
+	::DeviceIoControl(hFile, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr);
+}
+
+void gi::TiledCanvas::CloseTileFile()
+{
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		::CloseHandle(hFile);
+		hFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+void gi::TiledCanvas::ReadTile(size_t tile, size_t offset, size_t size, uint8_t* pixels)
+{
+	DWORD read = 0;
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		ULARGE_INTEGER position;
+		position.QuadPart = static_cast<ULONGLONG>(tile) * TileBytes + offset;
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = position.LowPart;
+		overlapped.OffsetHigh = position.HighPart;
+		// past the end of file reads nothing
+		if (!::ReadFile(hFile, pixels, static_cast<DWORD>(size), &read, &overlapped) && ::GetLastError() != ERROR_HANDLE_EOF)
+		{
+			PrintMessage(L"failed to read temporary tile file");
+			throw std::runtime_error("tile failure");
+		}
+	}
+	memset(pixels + read, 0, size - read);
+}
+
+void gi::TiledCanvas::WriteTile(size_t tile, const uint8_t* pixels)
+{
+	OpenTileFile();
+	ULARGE_INTEGER offset;
+	offset.QuadPart = static_cast<ULONGLONG>(tile) * TileBytes;
+	OVERLAPPED position = {};
+	position.Offset = offset.LowPart;
+	position.OffsetHigh = offset.HighPart;
+	DWORD written = 0;
+	if (!::WriteFile(hFile, pixels, static_cast<DWORD>(TileBytes), &written, &position) || written != TileBytes)
+	{
+		PrintMessage(L"failed to write temporary tile file");
+		throw std::runtime_error("tile failure");
+	}
+}
+
+#else
+
+void gi::TiledCanvas::OpenTileFile()
+{
+	if (fd >= 0)
+		return;
+	const char* directory = std::getenv("TMPDIR");
+	std::string path = std::string(directory ? directory : "/tmp") + "/gitXXXXXX";
+	fd = ::mkstemp(&path[0]);
+	if (fd < 0)
+	{
+		PrintMessage(L"failed to create temporary tile file");
+		throw std::runtime_error("tile failure");
+	}
+	// the file lives as long as the descriptor, skipped tiles are holes
+	::unlink(path.c_str());
+}
+
+void gi::TiledCanvas::CloseTileFile()
+{
+	if (fd >= 0)
+	{
+		::close(fd);
+		fd = -1;
+	}
+}
+
+void gi::TiledCanvas::ReadTile(size_t tile, size_t offset, size_t size, uint8_t* pixels)
+{
+	size_t read = 0;
+	off_t position = static_cast<off_t>(tile * TileBytes + offset);
+	while (fd >= 0 && read < size)
+	{
+		// short of the end of file, holes read as zeros
+		ssize_t count = ::pread(fd, pixels + read, size - read, position + static_cast<off_t>(read));
+		if (count < 0)
+		{
+			PrintMessage(L"failed to read temporary tile file");
+			throw std::runtime_error("tile failure");
+		}
+		if (count == 0)
+			break;
+		read += static_cast<size_t>(count);
+	}
+	memset(pixels + read, 0, size - read);
+}
+
+void gi::TiledCanvas::WriteTile(size_t tile, const uint8_t* pixels)
+{
+	OpenTileFile();
+	size_t written = 0;
+	off_t offset = static_cast<off_t>(tile) * TileBytes;
+	while (written < TileBytes)
+	{
+		ssize_t count = ::pwrite(fd, pixels + written, TileBytes - written, offset + static_cast<off_t>(written));
+		if (count <= 0)
+		{
+			PrintMessage(L"failed to write temporary tile file");
+			throw std::runtime_error("tile failure");
+		}
+		written += static_cast<size_t>(count);
+	}
+}
+
+#endif
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "CanvasStateTracker.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+namespace gi
+{
+	// Headless canvas for images larger than memory, drawing like RasterCanvas. Pixels live in
+	// TileSize square tiles of a sparse temporary file, each pixel RGB plus a covered byte so the
+	// background is only filled in when reading. Draw calls are binned by tile and applied in tile
+	// order once the bins hold BinRecords, through at most residentTiles tiles in memory that are
+	// written back least recently used first. Memory stays near MemoryBound whatever the canvas size.
+	class TiledCanvas : public TransformingCanvas
+	{
+	public:
+		static constexpr int TileSize = 256;
+		static constexpr size_t TileBytes = static_cast<size_t>(TileSize) * TileSize * 4;
+		static constexpr size_t BinRecords = 1024 * 1024;
+	private:
+		// a point of size >= 0 centered on x, y, or with size -1 a pixel blended by coverage
+		struct Record
+		{
+			int32_t x;
+			int32_t y;
+			int32_t size;
+			uint8_t color[3];
+			double coverage;
+		};
+
+		int width;
+		int height;
+		int tilesX;
+		int tilesY;
+		size_t residentTiles;
+		uint8_t background[3] = { 0xFF, 0xFF, 0xFF };
+		bool antiAliasing = false;
+
+		std::unordered_map<size_t, std::vector<Record>> bins;
+		size_t binned = 0;
+
+		// tiles in memory, most recently used first
+		struct Resident
+		{
+			size_t tile;
+			std::unique_ptr<uint8_t[]> pixels;
+			bool dirty;
+		};
+		std::list<Resident> resident;
+		std::unordered_map<size_t, std::list<Resident>::iterator> residentIndex;
+		uint64_t tileLoads = 0;
+
+#ifdef _WIN32
+		HANDLE hFile = INVALID_HANDLE_VALUE;
+#else
+		int fd = -1;
+#endif
+
+		// Whole tiles are read and written rather than mapped: page faults on a shared mapping of
+		// a fresh file cost far more than one write per tile.
+		void OpenTileFile();
+		void CloseTileFile();
+		// size bytes of the tile from offset on, zeros where the tile was never written
+		void ReadTile(size_t tile, size_t offset, size_t size, uint8_t* pixels);
+		void WriteTile(size_t tile, const uint8_t* pixels);
+		// the tile in memory, reading it and writing back the least recently used one as needed
+		uint8_t* Tile(size_t tile, bool write);
+		void Bin(size_t tile, const Record& record);
+		void ApplyBin(size_t tile, const std::vector<Record>& records);
+	public:
+		// residentTiles is at least 1
+		TiledCanvas(int width, int height, size_t residentTiles);
+		TiledCanvas(const TiledCanvas&) = delete;
+		TiledCanvas& operator=(const TiledCanvas&) = delete;
+		~TiledCanvas();
+
+		// bytes held at most for tiles and bins
+		static size_t MemoryBound(size_t residentTiles);
+
+		int GetWidth()const;
+		int GetHeight()const;
+		// tiles read in so far, a tile is counted again after an eviction
+		uint64_t GetTileLoads()const;
+		void SetAntiAliasing(bool enable);
+
+		void GetBackgroundColor(uint8_t& r, uint8_t& g, uint8_t& b)const;
+
+		// apply every binned draw call
+		void Flush();
+		// tile tx, ty as stored, RGB plus a covered byte per pixel with TileSize pixels to a row,
+		// parts outside the canvas uncovered. False if no pixel is covered. Flushes first.
+		bool CopyTile(int tx, int ty, uint8_t* pixels);
+		// RGB of the w x h region at x, y into rgb, rows top to bottom; flushes first.
+		// Tiles not in memory are read for the rows of the region only, without loading them.
+		void ReadRegion(int x, int y, int w, int h, uint8_t* rgb);
+		// binary PPM (P6), a band of rows at a time; flushes first
+		void WritePpm(std::ostream& os);
+
+		void SetDrawPointSize(int size) override;
+		void SetDrawBackgroundColor(uint8_t r, uint8_t g, uint8_t b) override;
+		void DrawPoint(double x, double y) override;
+		void DrawLine(double x0, double y0, double x1, double y1) override;
+		void Clear() override;
+	};
+}
@@ -0,0 +1,119 @@
+
+#include "Trace.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	// Events of one thread. Only the owning thread writes, readers see an event
+	// once count has been published with release order.
+	struct TraceChunk
+	{
+		static constexpr size_t Capacity = 4096;
+
+		gi::TraceEvent events[Capacity];
+		std::atomic<size_t> count{ 0 };
+		std::atomic<TraceChunk*> next{ nullptr };
+	};
+
+	struct ThreadBuffer
+	{
+		uint32_t threadId;
+		std::unique_ptr<TraceChunk> head = std::make_unique<TraceChunk>();
+		TraceChunk* tail = head.get();
+		std::vector<std::unique_ptr<TraceChunk>> owned;
+	};
+
+	// buffers outlive their threads so the timeline can be written at exit
+	std::mutex registryMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	ThreadBuffer* GetThreadBuffer()
+	{
+		thread_local ThreadBuffer* buffer = nullptr;
+		if (!buffer)
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			registry.push_back(std::make_unique<ThreadBuffer>());
+			buffer = registry.back().get();
+			buffer->threadId = static_cast<uint32_t>(registry.size());
+		}
+		return buffer;
+	}
+
+	void WriteMicroseconds(std::ostream& os, int64_t ns)
+	{
+		os << ns / 1000 << '.';
+		int64_t fraction = ns % 1000;
+		os << static_cast<char>('0' + fraction / 100) << static_cast<char>('0' + fraction / 10 % 10) << static_cast<char>('0' + fraction % 10);
+	}
+}
+
+std::atomic<bool> gi::Trace::enabled{ false };
+
+void gi::Trace::Enable(bool enable)
+{
+	enabled.store(enable, std::memory_order_relaxed);
+}
+
+int64_t gi::Trace::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void gi::Trace::Record(const TraceEvent& event)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	TraceChunk* chunk = buffer->tail;
+	size_t n = chunk->count.load(std::memory_order_relaxed);
+	if (n == TraceChunk::Capacity)
+	{
+		buffer->owned.push_back(std::make_unique<TraceChunk>());
+		TraceChunk* fresh = buffer->owned.back().get();
+		chunk->next.store(fresh, std::memory_order_release);
+		buffer->tail = chunk = fresh;
+		n = 0;
+	}
+	chunk->events[n] = event;
+	chunk->count.store(n + 1, std::memory_order_release);
+}
+
+void gi::Trace::WriteJson(std::ostream& os)
+{
+	std::vector<ThreadBuffer*> buffers;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (auto& buffer : registry)
+			buffers.push_back(buffer.get());
+	}
+
+	os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	bool first = true;
+	for (ThreadBuffer* buffer : buffers)
+	{
+		for (TraceChunk* chunk = buffer->head.get(); chunk; chunk = chunk->next.load(std::memory_order_acquire))
+		{
+			size_t n = chunk->count.load(std::memory_order_acquire);
+			for (size_t i = 0; i < n; ++i)
+			{
+				const TraceEvent& e = chunk->events[i];
+				os << (first ? "\n" : ",\n");
+				first = false;
+				os << "{\"name\": \"" << e.name << "\", \"cat\": \"" << e.category
+					<< "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->threadId << ", \"ts\": ";
+				WriteMicroseconds(os, e.begin);
+				os << ", \"dur\": ";
+				WriteMicroseconds(os, e.end - e.begin);
+				if (e.argName)
+					os << ", \"args\": {\"" << e.argName << "\": " << e.argValue << '}';
+				os << '}';
+			}
+		}
+	}
+	os << "\n]}\n";
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+namespace gi
+{
+	// One complete span, names must be string literals
+	struct TraceEvent
+	{
+		const char* name;
+		const char* category;
+		int64_t begin; // nanoseconds since the first trace call
+		int64_t end;
+		const char* argName; // optional single integer argument, nullptr for none
+		int64_t argValue;
+	};
+
+	// Process wide timeline in Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+	// Every thread appends to its own buffer without locking, the only lock is taken
+	// the first time a thread records an event.
+	class Trace
+	{
+	private:
+		static std::atomic<bool> enabled;
+	public:
+		static void Enable(bool enable);
+		static bool IsEnabled()
+		{
+			return enabled.load(std::memory_order_relaxed);
+		}
+		static int64_t Now();
+		static void Record(const TraceEvent& event);
+		// events published so far by all threads
+		static void WriteJson(std::ostream& os);
+	};
+
+	// Records the lifetime of the object as a span, does nothing while tracing is disabled
+	class TraceSpan
+	{
+	private:
+		TraceEvent event;
+		bool active;
+	public:
+		TraceSpan(const char* name, const char* category)
+			: active(Trace::IsEnabled())
+		{
+			if (active)
+				event = { name, category, Trace::Now(), 0, nullptr, 0 };
+		}
+		~TraceSpan()
+		{
+			if (active)
+			{
+				event.end = Trace::Now();
+				Trace::Record(event);
+			}
+		}
+		TraceSpan(const TraceSpan&) = delete;
+		TraceSpan& operator=(const TraceSpan&) = delete;
+
+		void SetArg(const char* name, int64_t value)
+		{
+			event.argName = name;
+			event.argValue = value;
+		}
+	};
+}
@@ -0,0 +1,109 @@
+
+#include "TrigRecurrence.h"
+#include "Interpreter.h"
+#include "Utils.h"
+
+#include <cmath>
+
+namespace
+{
+	enum Function { Sin, Cos, Tan };
+}
+
+gi::TrigRecurrence::TrigRecurrence(EvaluateContext& context, const std::wstring& variable,
+	double from, double step, size_t resyncInterval)
+	: context(context), variable(variable), from(from), step(step), resyncInterval(resyncInterval)
+{
+	if (resyncInterval == 0)
+		return;
+	// the same functions the direct evaluation uses, fast math included
+	sinFunction = context.LookupFunction(L"SIN");
+	cosFunction = context.LookupFunction(L"COS");
+	context.SetTrigRecurrence(this);
+}
+
+gi::TrigRecurrence::~TrigRecurrence()
+{
+	if (resyncInterval > 0)
+		context.SetTrigRecurrence(nullptr);
+}
+
+const std::wstring& gi::TrigRecurrence::GetVariable() const
+{
+	return variable;
+}
+
+void gi::TrigRecurrence::SetIndex(size_t index)
+{
+	this->index = index;
+}
+
+gi::TrigRecurrence::Site* gi::TrigRecurrence::Find(const void* key)
+{
+	for (auto& site : sites)
+	{
+		if (site.key == key)
+			return &site;
+	}
+	return nullptr;
+}
+
+gi::TrigRecurrence::Site* gi::TrigRecurrence::Add(const void* key, const std::wstring& name, const Affine& argument)
+{
+	Site site = {};
+	site.key = key;
+	if (MatchBuiltinName(name, L"SIN"))
+		site.function = Sin;
+	else if (MatchBuiltinName(name, L"COS"))
+		site.function = Cos;
+	else if (MatchBuiltinName(name, L"TAN"))
+		site.function = Tan;
+	else
+		site.function = -1;
+
+	double angle = argument.slope * step;
+	if (site.function >= 0 && argument.affine && std::isfinite(argument.slope) && std::isfinite(argument.offset) &&
+		std::isfinite(angle))
+	{
+		site.stepped = true;
+		site.slope = argument.slope;
+		site.offset = argument.offset;
+		site.stepSin = std::sin(angle);
+		site.stepCos = std::cos(angle);
+		site.primed = false;
+	}
+	sites.push_back(site);
+	return &sites.back();
+}
+
+double gi::TrigRecurrence::Evaluate(Site& site)
+{
+	if (!site.primed || site.index != index)
+	{
+		if (site.primed && site.index + 1 == index && index % resyncInterval != 0)
+		{
+			double s = site.sin * site.stepCos + site.cos * site.stepSin;
+			double c = site.cos * site.stepCos - site.sin * site.stepSin;
+			site.sin = s;
+			site.cos = c;
+		}
+		else
+		{
+			// same loop variable as NTForStatement computes
+			double argument = site.slope * (from + static_cast<double>(index) * step) + site.offset;
+			site.sin = sinFunction(argument);
+			site.cos = cosFunction(argument);
+		}
+		site.index = index;
+		site.primed = true;
+	}
+	switch (site.function)
+	{
+	case Sin:
+		return site.sin;
+	case Cos:
+		return site.cos;
+	default:
+		return site.sin / site.cos;
+	}
+}
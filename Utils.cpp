@@ -1,9 +1,42 @@
 
 #include "Utils.h"
 
+#include <cwctype>
 #include <iostream>
 
+namespace
+{
+	thread_local std::vector<std::wstring>* capturedMessages = nullptr;
+}
+
 void gi::PrintMessage(const std::wstring& msg)
 {
+	if (capturedMessages)
+	{
+		capturedMessages->push_back(msg);
+		return;
+	}
 	std::wcout << msg << '\n';
 }
+
+bool gi::MatchBuiltinName(const std::wstring& name, const wchar_t* builtin)
+{
+	size_t i = 0;
+	for (; builtin[i] && i < name.size(); ++i)
+	{
+		if (static_cast<wchar_t>(std::towupper(name[i])) != builtin[i])
+			return false;
+	}
+	return !builtin[i] && i == name.size();
+}
+
+gi::MessageCapture::MessageCapture(std::vector<std::wstring>& buffer)
+	: previous(capturedMessages)
+{
+	capturedMessages = &buffer;
+}
+
+gi::MessageCapture::~MessageCapture()
+{
+	capturedMessages = previous;
+}
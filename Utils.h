@@ -2,11 +2,27 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
 
 namespace gi
 {
 	void PrintMessage(const std::wstring& msg);
 
+	// case-insensitive match of a script name against an upper case built-in name
+	bool MatchBuiltinName(const std::wstring& name, const wchar_t* builtin);
+
+	// Collects the messages printed by the current thread during its lifetime instead of printing them
+	class MessageCapture
+	{
+	private:
+		std::vector<std::wstring>* previous;
+	public:
+		explicit MessageCapture(std::vector<std::wstring>& buffer);
+		~MessageCapture();
+		MessageCapture(const MessageCapture&) = delete;
+		MessageCapture& operator=(const MessageCapture&) = delete;
+	};
+
 	template<typename ... Args>
 	std::wstring JoinAsWideString(Args&& ... args)
 	{
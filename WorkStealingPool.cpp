@@ -0,0 +1,164 @@
+
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+
+namespace
+{
+	thread_local const gi::WorkStealingPool* currentPool = nullptr;
+	thread_local unsigned currentIndex = 0;
+}
+
+gi::WorkStealingPool::WorkStealingPool(unsigned threads)
+{
+	if (threads == 0)
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned i = 0; i < threads; ++i)
+		queues.push_back(std::make_unique<Queue>());
+	for (unsigned i = 0; i < threads; ++i)
+		this->threads.emplace_back([this, i]() { WorkerLoop(i); });
+}
+
+gi::WorkStealingPool::~WorkStealingPool()
+{
+	WaitIdle();
+	{
+		std::lock_guard<std::mutex> lock(idleMutex);
+		stopping = true;
+	}
+	idle.notify_all();
+	for (auto& thread : threads)
+		thread.join();
+}
+
+unsigned gi::WorkStealingPool::GetThreadCount() const
+{
+	return static_cast<unsigned>(queues.size());
+}
+
+void gi::WorkStealingPool::Submit(Task task)
+{
+	unsigned target = currentPool == this ? currentIndex : nextQueue.fetch_add(1) % GetThreadCount();
+	pending.fetch_add(1);
+	{
+		std::lock_guard<std::mutex> lock(queues[target]->mutex);
+		queues[target]->tasks.push_back(std::move(task));
+	}
+	queued.fetch_add(1);
+	// a worker raises sleepers before it checks queued, one of the two sees the other
+	if (sleepers.load() > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(idleMutex);
+		}
+		idle.notify_one();
+	}
+}
+
+bool gi::WorkStealingPool::TryTake(unsigned self, Task& task)
+{
+	{
+		Queue& own = *queues[self];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			queued.fetch_sub(1);
+			return true;
+		}
+	}
+	for (unsigned i = 1; i < GetThreadCount(); ++i)
+	{
+		Queue& victim = *queues[(self + i) % GetThreadCount()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			queued.fetch_sub(1);
+			return true;
+		}
+	}
+	return false;
+}
+
+void gi::WorkStealingPool::WorkerLoop(unsigned self)
+{
+	currentPool = this;
+	currentIndex = self;
+	for (;;)
+	{
+		Task task;
+		if (!TryTake(self, task))
+		{
+			std::unique_lock<std::mutex> lock(idleMutex);
+			sleepers.fetch_add(1);
+			idle.wait(lock, [this]() { return stopping || queued.load() > 0; });
+			sleepers.fetch_sub(1);
+			if (stopping && queued.load() == 0)
+				return;
+			// another worker may take it first, then this one looks again
+			continue;
+		}
+		try {
+			task(self);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(idleMutex);
+			if (!error)
+				error = std::current_exception();
+		}
+		// release the task's captures before it counts as finished
+		task = nullptr;
+		if (pending.fetch_sub(1) == 1 && waiters.load() > 0)
+		{
+			{
+				std::lock_guard<std::mutex> lock(idleMutex);
+			}
+			finished.notify_all();
+		}
+	}
+}
+
+void gi::WorkStealingPool::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(idleMutex);
+	waiters.fetch_add(1);
+	finished.wait(lock, [this]() { return pending.load() == 0; });
+	waiters.fetch_sub(1);
+}
+
+void gi::WorkStealingPool::Wait()
+{
+	WaitIdle();
+	std::exception_ptr thrown;
+	{
+		std::lock_guard<std::mutex> lock(idleMutex);
+		std::swap(thrown, error);
+	}
+	if (thrown)
+		std::rethrow_exception(thrown);
+}
+
+gi::MemoryBudget::MemoryBudget(size_t limit)
+	: limit(limit)
+{
+}
+
+void gi::MemoryBudget::Acquire(size_t bytes)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	released.wait(lock, [this, bytes]() { return used == 0 || used + bytes <= limit; });
+	used += bytes;
+}
+
+void gi::MemoryBudget::Release(size_t bytes)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		used -= bytes;
+	}
+	released.notify_all();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gi
+{
+	// Fixed set of threads, each with its own task deque. A thread runs its newest task
+	// first and steals the oldest task of another thread when its deque is empty.
+	// A task that throws does not stop the others, Wait() rethrows the first exception.
+	class WorkStealingPool
+	{
+	public:
+		// argument is the index of the thread running the task, in [0, GetThreadCount())
+		using Task = std::function<void(unsigned)>;
+	private:
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> threads;
+		std::atomic<unsigned> nextQueue{ 0 };
+
+		// counters are atomic so Submit and task completion only take idleMutex when
+		// a thread sleeps on it
+		std::atomic<size_t> queued{ 0 };   // tasks in deques
+		std::atomic<size_t> pending{ 0 };  // tasks submitted and not yet finished
+		std::atomic<unsigned> sleepers{ 0 }; // workers waiting on idle
+		std::atomic<unsigned> waiters{ 0 };  // Wait() callers on finished
+		std::mutex idleMutex;
+		std::condition_variable idle;     // workers wait here for tasks
+		std::condition_variable finished; // Wait() waits here
+		bool stopping = false; // guarded by idleMutex
+		std::exception_ptr error; // first exception thrown by a task, guarded by idleMutex
+
+		bool TryTake(unsigned self, Task& task);
+		void WorkerLoop(unsigned self);
+		void WaitIdle();
+	public:
+		// threads 0 uses the hardware concurrency
+		explicit WorkStealingPool(unsigned threads = 0);
+		// finishes queued tasks first, an exception they threw is dropped
+		~WorkStealingPool();
+		WorkStealingPool(const WorkStealingPool&) = delete;
+		WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+		unsigned GetThreadCount()const;
+		// from a pool thread the task goes to that thread's deque, otherwise round robin
+		void Submit(Task task);
+		// block until every submitted task has run, not from inside a task;
+		// rethrows the first exception a task threw since the last Wait()
+		void Wait();
+	};
+
+	// Bytes shared by concurrent jobs, Acquire blocks until the reservation fits.
+	// A reservation larger than the whole budget is granted once nothing else is held.
+	class MemoryBudget
+	{
+	private:
+		size_t limit;
+		size_t used = 0;
+		std::mutex mutex;
+		std::condition_variable released;
+	public:
+		explicit MemoryBudget(size_t limit);
+		void Acquire(size_t bytes);
+		void Release(size_t bytes);
+	};
+}
@@ -0,0 +1,431 @@
+
+// gi_batch: renders every script of a manifest in one process. Each script is one task on a
+// work-stealing pool with its own EvaluateContext and canvas; the lexer and parser are
+// reused per thread. Outputs are written as soon as their job completes.
+
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING 1
+
+#include "../ImageEncoder.h"
+#include "../Interpreter.h"
+#include "../Lexer.h"
+#include "../Parser.h"
+#include "../PointRecord.h"
+#include "../PointStream.h"
+#include "../RasterCanvas.h"
+#include "../SvgCanvas.h"
+#include "../TiledCanvas.h"
+#include "../TilePyramid.h"
+#include "../WorkStealingPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <codecvt>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <locale>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+using namespace gi;
+namespace fs = std::filesystem;
+
+namespace
+{
+	struct Job
+	{
+		fs::path script;
+		fs::path output;
+	};
+
+	struct Options
+	{
+		fs::path manifest;
+		fs::path outputDirectory = ".";
+		unsigned threads = 0;
+		int width = 0; // 0 writes points instead of an image
+		int height = 0;
+		size_t memoryBudget = 1024ull * 1024 * 1024;
+		bool antiAliasing = false; // DRAW LINE segments in images
+		double svgTolerance = 0.0; // > 0 writes the image as SVG, simplified to this many pixels
+		std::string format = "ppm"; // raster image file: ppm, png or qoi
+		int pngLevel = 1;
+		unsigned encodeThreads = 0; // > 0 compresses PNG strips on a pool of its own
+		size_t residentTiles = 0; // > 0 renders PPM images out of core with this many tiles in memory
+		bool pyramid = false; // a directory of z/x/y.png tiles instead of one image, out of core
+		TilePyramid::Reduction reduction = TilePyramid::Reduction::Box;
+		int streamBits = -1; // >= 0 writes points as a GIPS stream with this many fraction bits
+	};
+
+	// Streams device-space points to a point file, the regression golden layout,
+	// so memory use does not grow with the point count.
+	class PointFileCanvas : public TransformingCanvas
+	{
+	private:
+		PointFileWriter writer;
+		LineVertexFlags lineFlags;
+	public:
+		explicit PointFileCanvas(const fs::path& path)
+			: writer(path)
+		{
+		}
+
+		bool Finish()
+		{
+			return writer.Finish();
+		}
+
+		uint64_t GetCount()const
+		{
+			return writer.GetCount();
+		}
+
+		void DrawPoint(double x, double y) override
+		{
+			ModelPoint p = transform.Apply({ x, y });
+			lineFlags.Break();
+			writer.Write({ p.x, p.y, state.pointSize, state.colorR, state.colorG, state.colorB, 0 });
+		}
+		// the point file has no segments, polylines are written as their flagged vertices
+		void DrawLine(double x0, double y0, double x1, double y1) override
+		{
+			ModelPoint to = transform.Apply({ x1, y1 });
+			uint8_t flags = lineFlags.Segment(transform.Apply({ x0, y0 }), to);
+			writer.Write({ to.x, to.y, state.pointSize, state.colorR, state.colorG, state.colorB, flags });
+		}
+		void Clear() override
+		{
+			lineFlags.Break();
+		}
+	};
+
+	// per thread, building a Lexer compiles its regexes
+	struct ThreadPipeline
+	{
+		Lexer lexer;
+		Parser parser;
+	};
+
+	// file buffers of a point job, roughly
+	constexpr size_t PointJobBytes = 1024 * 1024;
+
+	bool ReadScript(const fs::path& path, std::wstring& content)
+	{
+		std::ifstream is(path, std::ios::binary);
+		if (!is.good())
+			return false;
+		std::ostringstream oss;
+		oss << is.rdbuf();
+		std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+		content = converter.from_bytes(oss.str());
+		return true;
+	}
+
+	bool ReadManifest(const Options& options, std::vector<Job>& jobs)
+	{
+		std::ifstream is(options.manifest);
+		if (!is.good())
+			return false;
+		std::map<std::string, int> stems;
+		std::string line;
+		std::string extension = options.width > 0 ? (options.svgTolerance > 0 ? ".svg" : "." + options.format) : (options.streamBits >= 0 ? ".gips" : ".pts");
+		if (options.pyramid)
+			extension.clear();
+		while (std::getline(is, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			if (line.empty() || line[0] == '#')
+				continue;
+			fs::path script = line;
+			if (script.is_relative())
+				script = options.manifest.parent_path() / script;
+			// scripts sharing a file name get numbered outputs
+			std::string stem = script.stem().string();
+			int seen = stems[stem]++;
+			if (seen > 0)
+				stem += "_" + std::to_string(seen);
+			jobs.push_back({ script, options.outputDirectory / (stem + extension) });
+		}
+		return true;
+	}
+
+	// why the options cannot be honoured together, nullptr if they can
+	const char* InvalidCombination(const Options& options)
+	{
+		if (options.manifest.empty())
+			return "no manifest given";
+		// SVG takes its size from --image
+		if (options.svgTolerance > 0 && options.width == 0)
+			return "--svg needs --image";
+		if (options.streamBits >= 0 && options.width > 0)
+			return "--stream writes points, not images";
+		// tiled images stream PPM only, pyramids are PNG
+		if (options.residentTiles > 0)
+		{
+			if (options.width == 0)
+				return "--tiles and --pyramid need --image";
+			if (options.svgTolerance > 0)
+				return "--tiles and --pyramid do not write SVG";
+			if (!options.pyramid && options.format != "ppm")
+				return "--tiles writes PPM only";
+		}
+		return nullptr;
+	}
+
+	bool ParseArguments(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			if (arg == "--out" && hasValue)
+				options.outputDirectory = argv[++i];
+			else if (arg == "--threads" && hasValue)
+				options.threads = static_cast<unsigned>(std::atoi(argv[++i]));
+			else if (arg == "--image" && hasValue)
+			{
+				if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+					return false;
+			}
+			else if (arg == "--memory-budget" && hasValue)
+				options.memoryBudget = static_cast<size_t>(std::atoll(argv[++i])) * 1024 * 1024;
+			else if (arg == "--svg" && hasValue)
+			{
+				options.svgTolerance = std::atof(argv[++i]);
+				if (!(options.svgTolerance > 0))
+					return false;
+			}
+			else if (arg == "--antialias")
+				options.antiAliasing = true;
+			else if (arg == "--format" && hasValue)
+			{
+				options.format = argv[++i];
+				if (options.format != "ppm" && options.format != "png" && options.format != "qoi")
+					return false;
+			}
+			else if (arg == "--png-level" && hasValue)
+			{
+				options.pngLevel = std::atoi(argv[++i]);
+				if (options.pngLevel < 0 || options.pngLevel > ImageEncoder::MaxPngLevel)
+					return false;
+			}
+			else if (arg == "--encode-threads" && hasValue)
+				options.encodeThreads = static_cast<unsigned>(std::atoi(argv[++i]));
+			else if (arg == "--tiles" && hasValue)
+			{
+				options.residentTiles = static_cast<size_t>(std::atoll(argv[++i]));
+				if (options.residentTiles == 0)
+					return false;
+			}
+			else if (arg == "--stream" && hasValue)
+			{
+				options.streamBits = std::atoi(argv[++i]);
+				if (options.streamBits < 0 || options.streamBits > PointStreamWriter::MaxFractionBits)
+					return false;
+			}
+			else if (arg == "--pyramid" && hasValue)
+			{
+				std::string reduction = argv[++i];
+				if (reduction != "box" && reduction != "max")
+					return false;
+				options.pyramid = true;
+				options.reduction = reduction == "max" ? TilePyramid::Reduction::Max : TilePyramid::Reduction::Box;
+			}
+			else if (options.manifest.empty() && arg.compare(0, 2, "--") != 0)
+				options.manifest = arg;
+			else
+				return false;
+		}
+		if (options.pyramid && options.residentTiles == 0)
+			options.residentTiles = 256;
+		if (const char* problem = InvalidCombination(options))
+		{
+			std::fprintf(stderr, "%s\n", problem);
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseArguments(argc, argv, options))
+	{
+		std::fprintf(stderr,
+			"Usage: %s [--out DIRECTORY] [--threads N] [--image WIDTHxHEIGHT [--svg PIXELS]] [--memory-budget MB] [--antialias]\n"
+			"          [--format ppm|png|qoi] [--png-level 0-9] [--encode-threads N] [--tiles RESIDENT] [--pyramid box|max]\n"
+			"          [--stream FRACTION-BITS] MANIFEST\n"
+			"MANIFEST lists one script path per line, relative to the manifest; '#' starts a comment.\n"
+			"A .gips point stream in the manifest is replayed instead of run.\n", argv[0]);
+		return 2;
+	}
+	std::vector<Job> jobs;
+	if (!ReadManifest(options, jobs))
+	{
+		std::fprintf(stderr, "cannot read %s\n", options.manifest.string().c_str());
+		return 1;
+	}
+	std::error_code error;
+	if (!fs::create_directories(options.outputDirectory, error) && error)
+	{
+		std::fprintf(stderr, "cannot create %s: %s\n", options.outputDirectory.string().c_str(), error.message().c_str());
+		return 1;
+	}
+
+	WorkStealingPool pool(options.threads);
+	// jobs wait for their strips, which must not queue behind other jobs on the same pool
+	std::unique_ptr<WorkStealingPool> encodePool;
+	if (options.encodeThreads > 0 && (options.format == "png" || options.pyramid))
+		encodePool = std::make_unique<WorkStealingPool>(options.encodeThreads);
+	MemoryBudget budget(options.memoryBudget);
+	std::vector<std::unique_ptr<ThreadPipeline>> pipelines;
+	for (unsigned i = 0; i < pool.GetThreadCount(); ++i)
+	{
+		pipelines.push_back(std::make_unique<ThreadPipeline>());
+		pipelines.back()->parser.SetTraceTokens(false);
+	}
+	// SVG keeps one stroke at a time, like point files
+	size_t jobBytes = options.width > 0 && options.svgTolerance == 0 ? static_cast<size_t>(options.width) * options.height * 4 : PointJobBytes;
+	if (options.residentTiles > 0)
+		jobBytes = TiledCanvas::MemoryBound(options.residentTiles);
+
+	std::mutex reportMutex;
+	std::atomic<size_t> failed{ 0 };
+	auto start = std::chrono::steady_clock::now();
+	for (auto& job : jobs)
+	{
+		pool.Submit([&, job](unsigned thread) {
+			budget.Acquire(jobBytes);
+			auto jobStart = std::chrono::steady_clock::now();
+			ThreadPipeline& pipeline = *pipelines[thread];
+			std::string result;
+			bool ok = false;
+			try {
+				bool replay = job.script.extension() == ".gips";
+				std::unique_ptr<NTProgram> ast;
+				if (!replay)
+				{
+					std::wstring content;
+					if (!ReadScript(job.script, content))
+						throw std::runtime_error("cannot read script");
+					pipeline.lexer.Init(content);
+					pipeline.parser.Parse(pipeline.lexer);
+					ast = pipeline.parser.GetASTRoot();
+				}
+				EvaluateContext context;
+				auto run = [&](ICanvas& canvas) {
+					if (!replay)
+					{
+						context.SetCanvas(&canvas);
+						context.Run(ast.get());
+						return;
+					}
+					// decoded on this thread, the pool is busy with jobs
+					std::ifstream is(job.script, std::ios::binary);
+					PointStreamReader reader(is);
+					if (!reader.Replay(canvas, nullptr))
+						throw std::runtime_error("cannot read point stream");
+				};
+				// write to a temporary name so a finished file is always complete
+				fs::path partial = job.output;
+				partial += ".part";
+				if (options.svgTolerance > 0)
+				{
+					std::ofstream os(partial, std::ios::binary);
+					SvgCanvas canvas(os, options.width, options.height, options.svgTolerance);
+					canvas.SetDrawBackgroundColor(0x66, 0xCC, 0xFF);
+					run(canvas);
+					if (!canvas.Finish())
+						throw std::runtime_error("cannot write output");
+					os.close();
+					result = std::to_string(canvas.GetPointCount()) + " points as " + std::to_string(canvas.GetVertexCount()) + " vertices";
+				}
+				else if (options.residentTiles > 0)
+				{
+					TiledCanvas canvas(options.width, options.height, options.residentTiles);
+					canvas.SetDrawBackgroundColor(0x66, 0xCC, 0xFF);
+					canvas.SetAntiAliasing(options.antiAliasing);
+					run(canvas);
+					if (options.pyramid)
+					{
+						TilePyramid pyramid(canvas, options.reduction, options.pngLevel);
+						std::error_code ec;
+						fs::remove_all(partial, ec);
+						if (!pyramid.Write(partial, encodePool.get()))
+							throw std::runtime_error("cannot write output");
+						// a directory is not replaced by rename
+						fs::remove_all(job.output, ec);
+						result = std::to_string(pyramid.GetLevelCount()) + " levels, " + std::to_string(pyramid.GetWrittenCount()) +
+							" tiles, " + std::to_string(pyramid.GetSkippedCount()) + " empty";
+					}
+					else
+					{
+						std::ofstream os(partial, std::ios::binary);
+						canvas.WritePpm(os);
+						os.close();
+						if (os.fail())
+							throw std::runtime_error("cannot write output");
+						result = "image, " + std::to_string(canvas.GetTileLoads()) + " tile loads";
+					}
+				}
+				else if (options.width > 0)
+				{
+					RasterCanvas canvas(options.width, options.height);
+					canvas.SetDrawBackgroundColor(0x66, 0xCC, 0xFF);
+					canvas.SetAntiAliasing(options.antiAliasing);
+					run(canvas);
+					std::ofstream os(partial, std::ios::binary);
+					bool written = true;
+					if (options.format == "png")
+						written = canvas.WritePng(os, options.pngLevel, encodePool.get());
+					else if (options.format == "qoi")
+						written = canvas.WriteQoi(os);
+					else
+						canvas.WritePpm(os);
+					os.close();
+					if (!written || os.fail())
+						throw std::runtime_error("cannot write output");
+					result = "image";
+				}
+				else if (options.streamBits >= 0)
+				{
+					std::ofstream os(partial, std::ios::binary);
+					PointStreamWriter canvas(os, options.streamBits);
+					run(canvas);
+					if (!canvas.Finish())
+						throw std::runtime_error("cannot write output");
+					os.close();
+					result = std::to_string(canvas.GetDrawCount()) + " draws in " + std::to_string(canvas.GetBytesWritten()) + " bytes";
+				}
+				else
+				{
+					PointFileCanvas canvas(partial);
+					run(canvas);
+					if (!canvas.Finish())
+						throw std::runtime_error("cannot write output");
+					result = std::to_string(canvas.GetCount()) + " points";
+				}
+				fs::rename(partial, job.output);
+				ok = true;
+			}
+			catch (std::exception& e)
+			{
+				result = e.what();
+				++failed;
+			}
+			budget.Release(jobBytes);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - jobStart).count();
+			std::lock_guard<std::mutex> lock(reportMutex);
+			std::fprintf(stderr, "%s %s: %s, %.1f ms\n", ok ? "done" : "FAIL", job.script.string().c_str(), result.c_str(), ms);
+		});
+	}
+	pool.Wait();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::fprintf(stderr, "%zu scripts in %.3f s on %u threads, %.1f scripts/s, %zu failed\n",
+		jobs.size(), seconds, pool.GetThreadCount(), static_cast<double>(jobs.size()) / seconds, failed.load());
+	return failed ? 1 : 0;
+}
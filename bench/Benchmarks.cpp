@@ -0,0 +1,646 @@
+
+#include "ScriptGenerator.h"
+
+#include "../AllocationTracker.h"
+#include "../CanvasStateTracker.h"
+#include "../CountingCanvas.h"
+#include "../FastMath.h"
+#include "../Interpreter.h"
+#include "../Lexer.h"
+#include "../Parser.h"
+#include "../PointSpool.h"
+#include "../PointStream.h"
+#include "../RecordingCanvas.h"
+#include "../RasterCanvas.h"
+#include "../SvgCanvas.h"
+#include "../TiledCanvas.h"
+#include "../TilePyramid.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <filesystem>
+#include <random>
+#include <sstream>
+
+using namespace gi;
+
+// Scripts are generated once per benchmark run from a fixed seed so results are comparable.
+static constexpr uint32_t Seed = 20201018;
+
+static std::unique_ptr<NTProgram> ParseScript(const std::wstring& text)
+{
+	Lexer lexer;
+	Parser parser;
+	parser.SetTraceTokens(false);
+	lexer.Init(text);
+	parser.Parse(lexer);
+	return parser.GetASTRoot();
+}
+
+// statements report through PrintMessage, keep that out of the benchmark output
+static void RunCaptured(EvaluateContext& context, NTProgram* program)
+{
+	std::vector<std::wstring> messages;
+	MessageCapture capture(messages);
+	context.Run(program);
+}
+
+// args: statement count, expression depth
+static void BM_Lexer(benchmark::State& state)
+{
+	std::wstring text = ScriptGenerator(Seed).Program(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)), 100);
+	size_t tokens = 0;
+	for (auto _ : state)
+	{
+		Lexer lexer;
+		lexer.Init(text);
+		for (lexer.MoveToNext(); lexer.GetCurrentToken().type != TokenType::None; lexer.MoveToNext())
+			++tokens;
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size() * sizeof(wchar_t)));
+	state.counters["tokens"] = benchmark::Counter(static_cast<double>(tokens), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Lexer)->ArgNames({ "statements", "depth" })->ArgsProduct({ { 10, 100, 1000 }, { 1, 8 } });
+
+// args: statement count, expression depth
+static void BM_Parser(benchmark::State& state)
+{
+	std::wstring text = ScriptGenerator(Seed).Program(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)), 100);
+	for (auto _ : state)
+	{
+		std::unique_ptr<NTProgram> ast = ParseScript(text);
+		benchmark::DoNotOptimize(ast.get());
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size() * sizeof(wchar_t)));
+	state.counters["statements"] = benchmark::Counter(static_cast<double>(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Parser)->ArgNames({ "statements", "depth" })->ArgsProduct({ { 10, 100, 1000 }, { 1, 8 } });
+
+// single FOR statement, args: expression depth, loop iterations
+static void BM_Evaluate(benchmark::State& state)
+{
+	std::wstring text = ScriptGenerator(Seed).ForStatement(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+	std::unique_ptr<NTProgram> ast = ParseScript(text);
+	CountingCanvas canvas;
+	for (auto _ : state)
+	{
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		RunCaptured(context, ast.get());
+	}
+	benchmark::DoNotOptimize(canvas.GetChecksum());
+	state.SetItemsProcessed(static_cast<int64_t>(canvas.GetPointCount()));
+}
+BENCHMARK(BM_Evaluate)->ArgNames({ "depth", "iterations" })->ArgsProduct({ { 1, 4, 16 }, { 1000, 100000 } });
+
+// same as BM_Evaluate with per-statement metrics recorded
+static void BM_EvaluateWithMetrics(benchmark::State& state)
+{
+	std::wstring text = ScriptGenerator(Seed).ForStatement(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+	std::unique_ptr<NTProgram> ast = ParseScript(text);
+	CountingCanvas canvas;
+	ExecutionMetrics metrics;
+	for (auto _ : state)
+	{
+		EvaluateContext context;
+		context.SetMetrics(&metrics);
+		context.SetCanvas(&canvas);
+		RunCaptured(context, ast.get());
+		metrics.Clear();
+	}
+	benchmark::DoNotOptimize(canvas.GetChecksum());
+	state.SetItemsProcessed(static_cast<int64_t>(canvas.GetPointCount()));
+}
+BENCHMARK(BM_EvaluateWithMetrics)->ArgNames({ "depth", "iterations" })->ArgsProduct({ { 1, 4, 16 }, { 1000, 100000 } });
+
+// generated program with FOR statements on a pool, args: statement count, pool threads (0 runs in line)
+static void BM_EvaluateConcurrent(benchmark::State& state)
+{
+	std::wstring text = ScriptGenerator(Seed).Program(static_cast<int>(state.range(0)), 4, 10000);
+	std::unique_ptr<NTProgram> ast = ParseScript(text);
+	std::unique_ptr<WorkStealingPool> pool;
+	if (state.range(1) > 0)
+		pool = std::make_unique<WorkStealingPool>(static_cast<unsigned>(state.range(1)));
+	CountingCanvas canvas;
+	for (auto _ : state)
+	{
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		context.SetWorkerPool(pool.get());
+		RunCaptured(context, ast.get());
+	}
+	benchmark::DoNotOptimize(canvas.GetChecksum());
+	state.SetItemsProcessed(static_cast<int64_t>(canvas.GetPointCount()));
+}
+BENCHMARK(BM_EvaluateConcurrent)->ArgNames({ "statements", "threads" })->ArgsProduct({ { 16, 64 }, { 0, 1, 2, 4, 8 } })->UseRealTime();
+
+// libm reference and FastMath variants, indexed by the function arg
+struct MathFunction
+{
+	const char* name;
+	double(*libm)(double);
+	double(*fast)(FastMath::Tier, double);
+	void(*batch)(FastMath::Tier, const double*, double*, size_t);
+	double lo, hi;
+	bool relative; // the error FastMath.h documents
+	bool logarithmic; // sample exp(uniform(lo, hi))
+};
+
+static const MathFunction MathFunctions[] = {
+	{ "sin", std::sin, FastMath::Sin, FastMath::Sin, -1e6, 1e6, false, false },
+	{ "cos", std::cos, FastMath::Cos, FastMath::Cos, -1e6, 1e6, false, false },
+	{ "tan", std::tan, FastMath::Tan, FastMath::Tan, -1e6, 1e6, true, false },
+	{ "exp", std::exp, FastMath::Exp, FastMath::Exp, -700.0, 700.0, true, false },
+	{ "ln", std::log, FastMath::Ln, FastMath::Ln, -700.0, 700.0, false, true },
+};
+
+static std::vector<double> MathArguments(const MathFunction& function, size_t count)
+{
+	std::mt19937_64 random(Seed);
+	std::uniform_real_distribution<double> distribution(function.lo, function.hi);
+	std::vector<double> in(count);
+	for (auto& x : in)
+		x = function.logarithmic ? std::exp(distribution(random)) : distribution(random);
+	return in;
+}
+
+static double MaxError(const MathFunction& function, const std::vector<double>& in, const std::vector<double>& out)
+{
+	double worst = 0.0;
+	for (size_t i = 0; i < in.size(); ++i)
+	{
+		double expected = function.libm(in[i]);
+		double error = std::fabs(out[i] - expected);
+		worst = std::max(worst, function.relative ? error / std::fabs(expected) : error);
+	}
+	return worst;
+}
+
+// args: function (sin, cos, tan, exp, ln)
+static void BM_Libm(benchmark::State& state)
+{
+	auto& function = MathFunctions[state.range(0)];
+	std::vector<double> in = MathArguments(function, 4096), out(in.size());
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < in.size(); ++i)
+			out[i] = function.libm(in[i]);
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetLabel(function.name);
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * in.size()));
+}
+BENCHMARK(BM_Libm)->ArgName("function")->DenseRange(0, 4);
+
+// args: function, tier (0 coarse, 1 fine), batch (0 scalar calls, 1 SIMD batch)
+static void BM_FastMath(benchmark::State& state)
+{
+	auto& function = MathFunctions[state.range(0)];
+	auto tier = state.range(1) ? FastMath::Tier::Fine : FastMath::Tier::Coarse;
+	std::vector<double> in = MathArguments(function, 4096), out(in.size());
+	for (auto _ : state)
+	{
+		if (state.range(2))
+			function.batch(tier, in.data(), out.data(), in.size());
+		else
+		{
+			for (size_t i = 0; i < in.size(); ++i)
+				out[i] = function.fast(tier, in[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetLabel(function.name);
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * in.size()));
+	state.counters["max_error"] = MaxError(function, in, out);
+}
+BENCHMARK(BM_FastMath)->ArgNames({ "function", "tier", "batch" })->ArgsProduct({ { 0, 1, 2, 3, 4 }, { 0, 1 }, { 0, 1 } });
+
+// trig-heavy FOR statement through the interpreter, args: fast math tolerance in 1/1000 pixel (0 uses libm)
+static void BM_EvaluateFastMath(benchmark::State& state)
+{
+	std::unique_ptr<NTProgram> ast = ParseScript(
+		L"SCALE IS (100, 100);\n"
+		L"FOR T FROM 0 TO 100 STEP 0.001 DRAW (COS(T) * SIN(3 * T) + LN(2 + SIN(T)), SIN(T) * EXP(COS(T)) + TAN(T / 50));\n");
+	CountingCanvas canvas;
+	for (auto _ : state)
+	{
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		context.SetFastMath(static_cast<double>(state.range(0)) / 1000.0);
+		RunCaptured(context, ast.get());
+	}
+	benchmark::DoNotOptimize(canvas.GetChecksum());
+	state.SetItemsProcessed(static_cast<int64_t>(canvas.GetPointCount()));
+}
+BENCHMARK(BM_EvaluateFastMath)->ArgName("millipixels")->Arg(0)->Arg(1)->Arg(1000);
+
+// Lissajous loop of example.txt, args: resync interval of the trig recurrence (0 calls libm every step)
+static void BM_EvaluateTrigRecurrence(benchmark::State& state)
+{
+	std::unique_ptr<NTProgram> ast = ParseScript(
+		L"ORIGIN IS (500, 500);\n"
+		L"SCALE IS (300, 300);\n"
+		L"FOR Q FROM 0 TO PI * 2 STEP PI / 100000 DRAW (SIN(20 * Q), SIN(21 * Q + PI / 3));\n");
+	CountingCanvas canvas;
+	for (auto _ : state)
+	{
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		context.SetTrigRecurrenceInterval(static_cast<size_t>(state.range(0)));
+		RunCaptured(context, ast.get());
+	}
+	benchmark::DoNotOptimize(canvas.GetChecksum());
+	state.SetItemsProcessed(static_cast<int64_t>(canvas.GetPointCount()));
+}
+BENCHMARK(BM_EvaluateTrigRecurrence)->ArgName("resync")->Arg(0)->Arg(16)->Arg(64)->Arg(256);
+
+// same Lissajous loop in float where the precision check allows, args: tolerance in 1/100 pixel (0 keeps double)
+static void BM_EvaluateSinglePrecision(benchmark::State& state)
+{
+	std::unique_ptr<NTProgram> ast = ParseScript(
+		L"ORIGIN IS (500, 500);\n"
+		L"SCALE IS (300, 300);\n"
+		L"FOR Q FROM 0 TO PI * 2 STEP PI / 100000 DRAW (SIN(20 * Q), SIN(21 * Q + PI / 3));\n");
+	CountingCanvas canvas;
+	for (auto _ : state)
+	{
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		context.SetSinglePrecision(static_cast<double>(state.range(0)) / 100.0);
+		RunCaptured(context, ast.get());
+	}
+	benchmark::DoNotOptimize(canvas.GetChecksum());
+	state.SetItemsProcessed(static_cast<int64_t>(canvas.GetPointCount()));
+}
+BENCHMARK(BM_EvaluateSinglePrecision)->ArgName("centipixels")->Arg(0)->Arg(10);
+
+// curve of period 2*PI drawn over 500 periods, args: 1 clamps the loop to one period
+static void BM_EvaluatePeriodClamp(benchmark::State& state)
+{
+	std::unique_ptr<NTProgram> ast = ParseScript(
+		L"ORIGIN IS (500, 500);\n"
+		L"SCALE IS (300, 300);\n"
+		L"FOR T FROM 0 TO 1000 * PI STEP PI / 50 DRAW (COS(T), SIN(2 * T));\n");
+	CountingCanvas canvas;
+	for (auto _ : state)
+	{
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		context.SetPeriodClamping(state.range(0) != 0);
+		RunCaptured(context, ast.get());
+	}
+	benchmark::DoNotOptimize(canvas.GetChecksum());
+	state.SetItemsProcessed(static_cast<int64_t>(canvas.GetPointCount()));
+}
+BENCHMARK(BM_EvaluatePeriodClamp)->ArgName("clamp")->Arg(0)->Arg(1);
+
+// Lissajous curve into an image, args: 0 points at a step fine enough to look continuous,
+// 1 DRAW LINE at a 100 times coarser step, 2 the same with Wu anti-aliasing
+static void BM_RenderPolyline(benchmark::State& state)
+{
+	std::unique_ptr<NTProgram> ast = ParseScript(state.range(0) == 0 ?
+		L"ORIGIN IS (500, 500);\n"
+		L"SCALE IS (300, 300);\n"
+		L"SIZE IS 0;\n"
+		L"FOR Q FROM 0 TO PI * 2 STEP PI / 100000 DRAW (SIN(20 * Q), SIN(21 * Q + PI / 3));\n" :
+		L"ORIGIN IS (500, 500);\n"
+		L"SCALE IS (300, 300);\n"
+		L"SIZE IS 0;\n"
+		L"FOR Q FROM 0 TO PI * 2 STEP PI / 1000 DRAW LINE (SIN(20 * Q), SIN(21 * Q + PI / 3));\n");
+	RasterCanvas canvas(1000, 1000);
+	canvas.SetAntiAliasing(state.range(0) == 2);
+	for (auto _ : state)
+	{
+		canvas.Clear();
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		RunCaptured(context, ast.get());
+	}
+	benchmark::DoNotOptimize(canvas.GetPixels().data());
+}
+BENCHMARK(BM_RenderPolyline)->ArgName("mode")->Arg(0)->Arg(1)->Arg(2);
+
+// dense Lissajous curve exported as SVG, args: simplification tolerance in 1/100 pixel,
+// 0 writes one dot per sample
+static void BM_ExportSvg(benchmark::State& state)
+{
+	std::unique_ptr<NTProgram> ast = ParseScript(
+		L"ORIGIN IS (500, 500);\n"
+		L"SCALE IS (300, 300);\n"
+		L"SIZE IS 1;\n"
+		L"FOR Q FROM 0 TO PI * 2 STEP PI / 100000 DRAW (SIN(20 * Q), SIN(21 * Q + PI / 3));\n");
+	size_t bytes = 0, vertices = 0;
+	for (auto _ : state)
+	{
+		std::ostringstream os;
+		SvgCanvas canvas(os, 1000, 1000, static_cast<double>(state.range(0)) / 100.0);
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		RunCaptured(context, ast.get());
+		canvas.Finish();
+		bytes = static_cast<size_t>(os.tellp());
+		vertices = canvas.GetVertexCount();
+	}
+	state.counters["bytes"] = static_cast<double>(bytes);
+	state.counters["vertices"] = static_cast<double>(vertices);
+}
+BENCHMARK(BM_ExportSvg)->ArgName("centipixels")->Arg(0)->Arg(10)->Arg(25);
+
+// 2048x2048 Lissajous curve of size 1 points over a background, what gi_batch encodes
+static const RasterCanvas& EncoderImage()
+{
+	static const RasterCanvas canvas = []() {
+		std::unique_ptr<NTProgram> ast = ParseScript(
+			L"ORIGIN IS (1024, 1024);\n"
+			L"SCALE IS (900, 900);\n"
+			L"SIZE IS 1;\n"
+			L"COLOR IS (200, 40, 40);\n"
+			L"FOR Q FROM 0 TO PI * 2 STEP PI / 100000 DRAW (SIN(20 * Q), SIN(21 * Q + PI / 3));\n");
+		RasterCanvas image(2048, 2048);
+		image.SetDrawBackgroundColor(0x66, 0xCC, 0xFF);
+		EvaluateContext context;
+		context.SetCanvas(&image);
+		RunCaptured(context, ast.get());
+		return image;
+	}();
+	return canvas;
+}
+
+// PNG of EncoderImage, args: deflate level, encoder threads (0 without a pool)
+static void BM_EncodePng(benchmark::State& state)
+{
+	const RasterCanvas& image = EncoderImage();
+	std::unique_ptr<WorkStealingPool> pool;
+	if (state.range(1) > 0)
+		pool = std::make_unique<WorkStealingPool>(static_cast<unsigned>(state.range(1)));
+	size_t bytes = 0;
+	for (auto _ : state)
+	{
+		std::ostringstream os;
+		image.WritePng(os, static_cast<int>(state.range(0)), pool.get());
+		bytes = static_cast<size_t>(os.tellp());
+	}
+	state.counters["bytes"] = static_cast<double>(bytes);
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * image.GetPixels().size()));
+}
+BENCHMARK(BM_EncodePng)->ArgNames({ "level", "threads" })
+	->Args({ 0, 0 })->Args({ 1, 0 })->Args({ 6, 0 })->Args({ 1, 4 })->Args({ 6, 4 })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_EncodeQoi(benchmark::State& state)
+{
+	const RasterCanvas& image = EncoderImage();
+	size_t bytes = 0;
+	for (auto _ : state)
+	{
+		std::ostringstream os;
+		image.WriteQoi(os);
+		bytes = static_cast<size_t>(os.tellp());
+	}
+	state.counters["bytes"] = static_cast<double>(bytes);
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * image.GetPixels().size()));
+}
+BENCHMARK(BM_EncodeQoi)->Unit(benchmark::kMillisecond);
+
+// 100000x100000 canvas, far beyond memory as a flat buffer, args: resident tiles.
+// 2M points of a size 1 Lissajous curve spread over the whole canvas, flushed each iteration.
+static void BM_RenderTiled(benchmark::State& state)
+{
+	std::unique_ptr<NTProgram> ast = ParseScript(
+		L"ORIGIN IS (50000, 50000);\n"
+		L"SCALE IS (49000, 49000);\n"
+		L"SIZE IS 1;\n"
+		L"FOR Q FROM 0 TO PI * 2 STEP PI / 1000000 DRAW (SIN(3 * Q), SIN(4 * Q + PI / 3));\n");
+	TiledCanvas canvas(100000, 100000, static_cast<size_t>(state.range(0)));
+	uint64_t loads = 0;
+	for (auto _ : state)
+	{
+		canvas.Clear();
+		uint64_t before = canvas.GetTileLoads();
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		RunCaptured(context, ast.get());
+		canvas.Flush();
+		loads = canvas.GetTileLoads() - before;
+	}
+	state.counters["tile_loads"] = static_cast<double>(loads);
+	state.counters["memory_bound"] = static_cast<double>(TiledCanvas::MemoryBound(static_cast<size_t>(state.range(0))));
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * 2000000));
+}
+BENCHMARK(BM_RenderTiled)->ArgName("resident")->Arg(16)->Arg(256)->Unit(benchmark::kMillisecond);
+
+// pyramid of a rendered 16384x16384 canvas at PNG level 1 into a temporary directory,
+// args: threads (0 without a pool)
+static void BM_BuildPyramid(benchmark::State& state)
+{
+	std::unique_ptr<NTProgram> ast = ParseScript(
+		L"ORIGIN IS (8192, 8192);\n"
+		L"SCALE IS (8000, 8000);\n"
+		L"SIZE IS 1;\n"
+		L"FOR Q FROM 0 TO PI * 2 STEP PI / 200000 DRAW (SIN(3 * Q), SIN(4 * Q + PI / 3));\n");
+	TiledCanvas canvas(16384, 16384, 256);
+	EvaluateContext context;
+	context.SetCanvas(&canvas);
+	RunCaptured(context, ast.get());
+	std::unique_ptr<WorkStealingPool> pool;
+	if (state.range(0) > 0)
+		pool = std::make_unique<WorkStealingPool>(static_cast<unsigned>(state.range(0)));
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / "gi_bench_pyramid";
+	size_t written = 0, skipped = 0;
+	for (auto _ : state)
+	{
+		TilePyramid pyramid(canvas, TilePyramid::Reduction::Max, 1);
+		pyramid.Write(directory, pool.get());
+		written = pyramid.GetWrittenCount();
+		skipped = pyramid.GetSkippedCount();
+	}
+	std::error_code ec;
+	std::filesystem::remove_all(directory, ec);
+	state.counters["tiles"] = static_cast<double>(written);
+	state.counters["empty"] = static_cast<double>(skipped);
+}
+BENCHMARK(BM_BuildPyramid)->ArgName("threads")->Arg(0)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// 1M device-space points of a Lissajous curve on a 2048x2048 image, as recorded from a script
+static const std::vector<RecordingCanvas::Point>& StreamPoints()
+{
+	static const std::vector<RecordingCanvas::Point> points = []() {
+		std::unique_ptr<NTProgram> ast = ParseScript(
+			L"ORIGIN IS (1024, 1024);\n"
+			L"SCALE IS (900, 900);\n"
+			L"SIZE IS 1;\n"
+			L"FOR Q FROM 0 TO PI * 2 STEP PI / 500000 DRAW (SIN(20 * Q), SIN(21 * Q + PI / 3));\n");
+		RecordingCanvas canvas;
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		RunCaptured(context, ast.get());
+		return canvas.GetPoints();
+	}();
+	return points;
+}
+
+static std::string EncodeStream(int fractionBits, size_t& bytes)
+{
+	std::ostringstream os;
+	PointStreamWriter writer(os, fractionBits);
+	writer.SetDrawPointSize(1);
+	for (const RecordingCanvas::Point& p : StreamPoints())
+		writer.DrawPoint(p.x, p.y);
+	writer.Finish();
+	bytes = static_cast<size_t>(writer.GetBytesWritten());
+	return os.str();
+}
+
+// StreamPoints into GIPS, args: fraction bits. Throughput and ratio are against 16 byte
+// pairs of doubles.
+static void BM_PointStreamEncode(benchmark::State& state)
+{
+	const size_t raw = StreamPoints().size() * 2 * sizeof(double);
+	size_t bytes = 0;
+	for (auto _ : state)
+		benchmark::DoNotOptimize(EncodeStream(static_cast<int>(state.range(0)), bytes));
+	state.counters["bytes"] = static_cast<double>(bytes);
+	state.counters["ratio"] = static_cast<double>(raw) / static_cast<double>(bytes);
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * raw));
+}
+BENCHMARK(BM_PointStreamEncode)->ArgName("bits")->Arg(0)->Arg(8)->Arg(16)->Unit(benchmark::kMillisecond);
+
+// 8 fraction bit stream of StreamPoints replayed into a CountingCanvas, args: decoder threads
+// (0 decodes on the replaying thread)
+static void BM_PointStreamDecode(benchmark::State& state)
+{
+	size_t bytes = 0;
+	const std::string stream = EncodeStream(8, bytes);
+	std::unique_ptr<WorkStealingPool> pool;
+	if (state.range(0) > 0)
+		pool = std::make_unique<WorkStealingPool>(static_cast<unsigned>(state.range(0)));
+	for (auto _ : state)
+	{
+		std::istringstream is(stream);
+		PointStreamReader reader(is);
+		CountingCanvas canvas;
+		if (!reader.Replay(canvas, pool.get()))
+			state.SkipWithError("corrupt stream");
+		benchmark::DoNotOptimize(canvas.GetChecksum());
+	}
+	state.counters["bytes"] = static_cast<double>(bytes);
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * StreamPoints().size() * 2 * sizeof(double)));
+}
+BENCHMARK(BM_PointStreamDecode)->ArgName("threads")->Arg(0)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// BatchProgram alone on a polynomial block, float against double lanes
+template<class T>
+static void BM_BatchProgram(benchmark::State& state)
+{
+	// 3 * T * T - T / 7 + 2
+	BatchProgram program;
+	program.PushConstant(3.0);
+	program.PushVariable();
+	program.Push(BatchProgram::Op::Multiply);
+	program.PushVariable();
+	program.Push(BatchProgram::Op::Multiply);
+	program.PushVariable();
+	program.PushConstant(7.0);
+	program.Push(BatchProgram::Op::Divide);
+	program.Push(BatchProgram::Op::Subtract);
+	program.PushConstant(2.0);
+	program.Push(BatchProgram::Op::Add);
+	std::vector<T> in(BatchProgram::BlockSize), out(BatchProgram::BlockSize), workspace;
+	for (size_t i = 0; i < in.size(); ++i)
+		in[i] = static_cast<T>(i) / 100;
+	for (auto _ : state)
+	{
+		program.Evaluate(in.data(), out.data(), in.size(), workspace);
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * in.size()));
+}
+BENCHMARK_TEMPLATE(BM_BatchProgram, float);
+BENCHMARK_TEMPLATE(BM_BatchProgram, double);
+
+// ICanvas::DrawPoint of 64K points under a rotated, scaled transform, args: 0 CountingCanvas
+// (transform only), 1 RecordingCanvas (transform and storage), 2 RasterCanvas (transform and pixels)
+static void BM_CanvasDrawPoint(benchmark::State& state)
+{
+	std::vector<ModelPoint> points(1 << 16);
+	for (size_t i = 0; i < points.size(); ++i)
+		points[i] = { std::cos(i * 0.001), std::sin(i * 0.001) };
+	CountingCanvas counting;
+	RecordingCanvas recording;
+	RasterCanvas raster(720, 480);
+	ICanvas* canvases[] = { &counting, &recording, &raster };
+	ICanvas* canvas = canvases[state.range(0)];
+	for (auto _ : state)
+	{
+		if (state.range(0) == 1)
+			recording.Reset();
+		canvas->SetDrawOrigin(360.0, 240.0);
+		canvas->SetDrawScale(100.0, 50.0);
+		canvas->SetDrawRotation(0.5);
+		for (auto& p : points)
+			canvas->DrawPoint(p.x, p.y);
+	}
+	benchmark::DoNotOptimize(counting.GetChecksum());
+	benchmark::DoNotOptimize(recording.GetPoints().data());
+	benchmark::DoNotOptimize(raster.GetPixels().data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * points.size()));
+}
+BENCHMARK(BM_CanvasDrawPoint)->ArgName("canvas")->Arg(0)->Arg(1)->Arg(2);
+
+// the window Canvas's point storage, 1M records, args: memory budget in chunks (0 unlimited)
+static void BM_PointSpoolPush(benchmark::State& state)
+{
+	const size_t count = 1 << 20;
+	PointSpool spool(state.range(0) > 0 ? static_cast<size_t>(state.range(0)) * PointSpool::ChunkBytes : SIZE_MAX);
+	for (auto _ : state)
+	{
+		spool.Clear();
+		for (size_t i = 0; i < count; ++i)
+			spool.Push({ static_cast<double>(i), 1.0, 1, 0 });
+	}
+	benchmark::DoNotOptimize(spool.Size());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+BENCHMARK(BM_PointSpoolPush)->ArgName("chunks")->Arg(0)->Arg(2)->Unit(benchmark::kMillisecond);
+
+// Reports allocations of one extra run of every benchmark (allocs_per_iter, max_bytes_used in the output).
+// Tracking is on only during that run, the timed runs pay nothing for it.
+class AllocationMemoryManager : public benchmark::MemoryManager
+{
+private:
+	AllocationTracker::Totals start;
+	int64_t startLive = 0;
+public:
+	void Start() override
+	{
+		AllocationTracker::Enable();
+		AllocationTracker::ResetPeak();
+		start = AllocationTracker::GetTotals();
+		startLive = AllocationTracker::GetLiveBytes();
+	}
+	void Stop(Result* result) override
+	{
+		Stop(*result);
+	}
+	void Stop(Result& result) override
+	{
+		AllocationTracker::Disable();
+		AllocationTracker::Totals stop = AllocationTracker::GetTotals();
+		result.num_allocs = stop.allocations - start.allocations;
+		result.total_allocated_bytes = stop.bytes - start.bytes;
+		// what the run added on top of what was live when it started
+		result.max_bytes_used = stop.peakLive - startLive;
+	}
+};
+
+int main(int argc, char** argv)
+{
+	AllocationMemoryManager memoryManager;
+	benchmark::RegisterMemoryManager(&memoryManager);
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,91 @@
+
+#include "ScriptGenerator.h"
+
+gi::ScriptGenerator::ScriptGenerator(uint32_t seed)
+	: random(seed)
+{
+}
+
+std::wstring gi::ScriptGenerator::Literal()
+{
+	std::uniform_int_distribution<int> digits(1, 99);
+	int value = digits(random);
+	if (value % 3 == 0)
+		return std::to_wstring(value / 10) + L'.' + std::to_wstring(value % 10);
+	return std::to_wstring(value);
+}
+
+std::wstring gi::ScriptGenerator::Atom(const std::wstring& variable)
+{
+	switch (std::uniform_int_distribution<int>(0, 3)(random))
+	{
+	case 0:
+		return Literal();
+	case 1:
+		return L"PI";
+	default:
+		return variable;
+	}
+}
+
+std::wstring gi::ScriptGenerator::Expression(int depth, const std::wstring& variable)
+{
+	static const wchar_t* operators[] = { L"+", L"-", L"*", L"/" };
+	static const wchar_t* functions[] = { L"sin", L"cos", L"sqrt", L"exp" };
+
+	if (depth <= 0)
+		return Atom(variable);
+	// grow on one side only so the text is linear in depth
+	std::wstring inner = Expression(depth - 1, variable);
+	switch (std::uniform_int_distribution<int>(0, 5)(random))
+	{
+	case 0:
+		return std::wstring(functions[std::uniform_int_distribution<int>(0, 1)(random)]) + L'(' + inner + L')';
+	case 1:
+		// keep sqrt and exp finite for any input
+		return std::wstring(functions[std::uniform_int_distribution<int>(2, 3)(random)]) + L"(sin(" + inner + L"))";
+	case 2:
+		// never emit two adjacent '-', that starts a comment
+		return L"-(" + inner + L')';
+	case 3:
+		return L'(' + inner + L")**2";
+	default:
+		return L'(' + inner + L' ' + operators[std::uniform_int_distribution<int>(0, 3)(random)] + L' ' + Atom(variable) + L')';
+	}
+}
+
+std::wstring gi::ScriptGenerator::ForStatement(int depth, int iterations)
+{
+	return L"for t from 0 to " + std::to_wstring(iterations - 1) + L" step 1 draw (" +
+		Expression(depth, L"t") + L", " + Expression(depth, L"t") + L");\n";
+}
+
+std::wstring gi::ScriptGenerator::Program(int count, int depth, int iterations)
+{
+	std::wstring text;
+	for (int i = 0; i < count; ++i)
+	{
+		switch (std::uniform_int_distribution<int>(0, 5)(random))
+		{
+		case 0:
+			text += L"origin is (" + Expression(depth, L"PI") + L", " + Literal() + L");\n";
+			break;
+		case 1:
+			text += L"scale is (" + Literal() + L", " + Expression(depth, L"E") + L");\n";
+			break;
+		case 2:
+			text += L"rot is " + Expression(depth, L"PI") + L";\n";
+			break;
+		case 3:
+			text += L"size is " + Literal() + L";\n";
+			break;
+		case 4:
+			text += L"color is (" + Literal() + L", " + Literal() + L", " + Literal() + L");\n";
+			break;
+		default:
+			text += ForStatement(depth, iterations);
+			break;
+		}
+	}
+	return text;
+}
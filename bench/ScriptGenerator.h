@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+
+namespace gi
+{
+	// Builds syntactically valid scripts of a chosen shape, same seed gives the same text.
+	class ScriptGenerator
+	{
+	private:
+		std::mt19937 random;
+
+		std::wstring Literal();
+		std::wstring Atom(const std::wstring& variable);
+	public:
+		explicit ScriptGenerator(uint32_t seed);
+
+		// expression with depth nested operators / calls / parentheses around variable
+		std::wstring Expression(int depth, const std::wstring& variable);
+		// FOR statement running iterations times, both coordinates of the given depth
+		std::wstring ForStatement(int depth, int iterations);
+		// count statements mixing ORIGIN, SCALE, ROT, SIZE, COLOR and FOR
+		std::wstring Program(int count, int depth, int iterations);
+	};
+}
@@ -0,0 +1,354 @@
+
+// End-to-end regression run: every script goes through Lexer, Parser and EvaluateContext
+// into a RecordingCanvas. The device-space points are compared with a golden file and
+// the median pipeline time with a stored baseline.
+
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING 1
+
+#include "../bench/ScriptGenerator.h"
+
+#include "../Interpreter.h"
+#include "../Lexer.h"
+#include "../Parser.h"
+#include "../PointRecord.h"
+#include "../RecordingCanvas.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <codecvt>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <locale>
+#include <map>
+#include <sstream>
+
+using namespace gi;
+namespace fs = std::filesystem;
+
+namespace
+{
+	struct Options
+	{
+		bool update = false;
+		bool timing = true;
+		double threshold = 0.25;  // allowed slowdown as a fraction of the baseline
+		double tolerance = 1e-9;  // allowed relative difference of a coordinate
+		double minMilliseconds = 1.0; // slowdowns below this are noise
+		int repeat = 5;
+		unsigned jobs = 0;        // FOR statements on a pool of this many threads, 0 runs them in line
+		double fastMath = 0.0;    // EvaluateContext::SetFastMath tolerance in pixels
+		size_t trigRecurrence = 0; // EvaluateContext::SetTrigRecurrenceInterval
+		double singlePrecision = 0.0; // EvaluateContext::SetSinglePrecision tolerance in pixels
+		bool periodClamping = false;
+		fs::path goldenDirectory;
+		fs::path baselineFile;
+		fs::path generateDirectory;
+		std::vector<fs::path> scripts;
+	};
+
+	// printf to the console through PrintMessage, stdout is wide oriented once the interpreter prints
+	void Report(const char* format, ...)
+	{
+		char message[512];
+		va_list args;
+		va_start(args, format);
+		std::vsnprintf(message, sizeof(message), format, args);
+		va_end(args);
+		PrintMessage(JoinAsWideString(message));
+	}
+
+	bool ReadScript(const fs::path& path, std::wstring& content)
+	{
+		std::ifstream is(path, std::ios::binary);
+		if (!is.good())
+			return false;
+		std::ostringstream oss;
+		oss << is.rdbuf();
+		std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+		content = converter.from_bytes(oss.str());
+		return true;
+	}
+
+	// full pipeline, returns wall time in milliseconds
+	double RunScript(const std::wstring& content, RecordingCanvas& canvas, const Options& options, WorkStealingPool* pool)
+	{
+		auto start = std::chrono::steady_clock::now();
+		Lexer lexer;
+		Parser parser;
+		parser.SetTraceTokens(false);
+		lexer.Init(content);
+		parser.Parse(lexer);
+		std::unique_ptr<NTProgram> ast = parser.GetASTRoot();
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		context.SetWorkerPool(pool);
+		context.SetFastMath(options.fastMath);
+		context.SetTrigRecurrenceInterval(options.trigRecurrence);
+		context.SetSinglePrecision(options.singlePrecision);
+		context.SetPeriodClamping(options.periodClamping);
+		context.Run(ast.get());
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// goldens are point files
+	bool WriteGolden(const fs::path& path, const std::vector<RecordingCanvas::Point>& points)
+	{
+		PointFileWriter writer(path);
+		writer.Write(points);
+		return writer.Finish();
+	}
+
+	bool ReadGolden(const fs::path& path, std::vector<RecordingCanvas::Point>& points)
+	{
+		return ReadPointFile(path, points);
+	}
+
+	bool CoordinateMatches(double a, double b, double tolerance)
+	{
+		if (std::isnan(a) || std::isnan(b))
+			return std::isnan(a) && std::isnan(b);
+		if (std::isinf(a) || std::isinf(b))
+			return a == b;
+		return std::fabs(a - b) <= tolerance * std::max({ 1.0, std::fabs(a), std::fabs(b) });
+	}
+
+	// empty if equal, otherwise a description of the first difference
+	std::string ComparePoints(const std::vector<RecordingCanvas::Point>& expected,
+		const std::vector<RecordingCanvas::Point>& actual, double tolerance)
+	{
+		char message[320];
+		if (expected.size() != actual.size())
+		{
+			std::snprintf(message, sizeof(message), "%zu points, golden has %zu", actual.size(), expected.size());
+			return message;
+		}
+		for (size_t i = 0; i < expected.size(); ++i)
+		{
+			auto& e = expected[i];
+			auto& a = actual[i];
+			if (!CoordinateMatches(e.x, a.x, tolerance) || !CoordinateMatches(e.y, a.y, tolerance) ||
+				e.pointSize != a.pointSize || e.colorR != a.colorR || e.colorG != a.colorG || e.colorB != a.colorB ||
+				e.flags != a.flags)
+			{
+				std::snprintf(message, sizeof(message),
+					"point %zu is (%.17g, %.17g) size %d color %d,%d,%d flags %d, golden has (%.17g, %.17g) size %d color %d,%d,%d flags %d",
+					i, a.x, a.y, a.pointSize, a.colorR, a.colorG, a.colorB, a.flags,
+					e.x, e.y, e.pointSize, e.colorR, e.colorG, e.colorB, e.flags);
+				return message;
+			}
+		}
+		return {};
+	}
+
+	// baseline file: one "name milliseconds" pair per line
+	std::map<std::string, double> ReadBaseline(const fs::path& path)
+	{
+		std::map<std::string, double> baseline;
+		std::ifstream is(path);
+		std::string name;
+		double milliseconds;
+		while (is >> name >> milliseconds)
+			baseline[name] = milliseconds;
+		return baseline;
+	}
+
+	bool WriteBaseline(const fs::path& path, const std::map<std::string, double>& baseline)
+	{
+		std::ofstream os(path);
+		for (auto& entry : baseline)
+			os << entry.first << ' ' << entry.second << '\n';
+		return os.good();
+	}
+
+	// stress scripts of the corpus, regenerate with --generate
+	bool GenerateCorpus(const fs::path& directory)
+	{
+		ScriptGenerator generator(20201018);
+		std::wstring deepExpressions = generator.Program(6, 24, 500);
+		std::wstring longLoops = L"origin is (400, 300);\nscale is (40, 40);\n";
+		for (int i = 0; i < 4; ++i)
+		{
+			deepExpressions += generator.ForStatement(24, 500);
+			longLoops += generator.ForStatement(3, 3000);
+		}
+		struct Script
+		{
+			const char* name;
+			std::wstring text;
+		};
+		Script scripts[] = {
+			{ "stress_many_statements", generator.Program(200, 2, 20) },
+			{ "stress_deep_expressions", deepExpressions },
+			{ "stress_long_loops", longLoops },
+		};
+		std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+		for (auto& script : scripts)
+		{
+			std::ofstream os(directory / (std::string(script.name) + ".txt"), std::ios::binary);
+			os << converter.to_bytes(script.text);
+			if (!os.good())
+			{
+				std::fprintf(stderr, "cannot write %s\n", script.name);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool ParseArguments(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			if (arg == "--update")
+				options.update = true;
+			else if (arg == "--no-timing")
+				options.timing = false;
+			else if (arg == "--threshold" && hasValue)
+				options.threshold = std::atof(argv[++i]);
+			else if (arg == "--tolerance" && hasValue)
+				options.tolerance = std::atof(argv[++i]);
+			else if (arg == "--min-ms" && hasValue)
+				options.minMilliseconds = std::atof(argv[++i]);
+			else if (arg == "--repeat" && hasValue)
+				options.repeat = std::max(1, std::atoi(argv[++i]));
+			else if (arg == "--fast-math" && hasValue)
+				options.fastMath = std::atof(argv[++i]);
+			else if (arg == "--trig-recurrence" && hasValue)
+				options.trigRecurrence = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+			else if (arg == "--single-precision" && hasValue)
+				options.singlePrecision = std::atof(argv[++i]);
+			else if (arg == "--period-clamp")
+				options.periodClamping = true;
+			else if (arg == "--jobs" && hasValue)
+				options.jobs = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+			else if (arg == "--golden" && hasValue)
+				options.goldenDirectory = argv[++i];
+			else if (arg == "--baseline" && hasValue)
+				options.baselineFile = argv[++i];
+			else if (arg == "--generate" && hasValue)
+				options.generateDirectory = argv[++i];
+			else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0)
+				return false;
+			else
+				options.scripts.push_back(arg);
+		}
+		return !options.generateDirectory.empty() || (!options.goldenDirectory.empty() && !options.scripts.empty());
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseArguments(argc, argv, options))
+	{
+		std::fprintf(stderr,
+			"Usage: %s --golden DIRECTORY [--baseline FILE] [--update] [--no-timing] [--threshold FRACTION]\n"
+			"          [--tolerance RELATIVE] [--min-ms MS] [--repeat N] [--jobs N]\n"
+			"          [--fast-math PIXELS] [--trig-recurrence STEPS] [--single-precision PIXELS]\n"
+			"          [--period-clamp] SCRIPT...\n"
+			"       %s --generate DIRECTORY\n", argv[0], argv[0]);
+		return 2;
+	}
+	if (!options.generateDirectory.empty())
+		return GenerateCorpus(options.generateDirectory) ? 0 : 1;
+
+	std::map<std::string, double> baseline;
+	if (options.timing && !options.baselineFile.empty())
+		baseline = ReadBaseline(options.baselineFile);
+	std::map<std::string, double> measured;
+	int failures = 0;
+	std::unique_ptr<WorkStealingPool> pool;
+	if (options.jobs > 0)
+		pool = std::make_unique<WorkStealingPool>(options.jobs);
+
+	for (auto& script : options.scripts)
+	{
+		std::string name = script.stem().string();
+		std::wstring content;
+		if (!ReadScript(script, content))
+		{
+			Report("FAIL %s: cannot read %s", name.c_str(), script.string().c_str());
+			++failures;
+			continue;
+		}
+
+		RecordingCanvas canvas;
+		std::vector<double> times;
+		try {
+			for (int i = 0; i < options.repeat; ++i)
+			{
+				canvas = RecordingCanvas();
+				times.push_back(RunScript(content, canvas, options, pool.get()));
+			}
+		}
+		catch (std::exception& e)
+		{
+			Report("FAIL %s: %s", name.c_str(), e.what());
+			++failures;
+			continue;
+		}
+		std::sort(times.begin(), times.end());
+		double median = times[times.size() / 2];
+		measured[name] = median;
+
+		fs::path golden = options.goldenDirectory / (name + ".gold");
+		if (options.update)
+		{
+			if (!WriteGolden(golden, canvas.GetPoints()))
+			{
+				Report("FAIL %s: cannot write %s", name.c_str(), golden.string().c_str());
+				++failures;
+				continue;
+			}
+			Report("UPDATED %s: %zu points, %.3f ms", name.c_str(), canvas.GetPoints().size(), median);
+			continue;
+		}
+
+		std::vector<RecordingCanvas::Point> expected;
+		if (!ReadGolden(golden, expected))
+		{
+			Report("FAIL %s: missing or bad golden file %s", name.c_str(), golden.string().c_str());
+			++failures;
+			continue;
+		}
+		std::string difference = ComparePoints(expected, canvas.GetPoints(), options.tolerance);
+		if (!difference.empty())
+		{
+			Report("FAIL %s: output diverges, %s", name.c_str(), difference.c_str());
+			++failures;
+			continue;
+		}
+
+		auto it = baseline.find(name);
+		if (options.timing && it != baseline.end())
+		{
+			double limit = it->second * (1.0 + options.threshold);
+			if (median > limit && median - it->second > options.minMilliseconds)
+			{
+				Report("FAIL %s: %.3f ms, baseline %.3f ms (+%.0f%%, limit +%.0f%%)", name.c_str(),
+					median, it->second, (median / it->second - 1.0) * 100.0, options.threshold * 100.0);
+				++failures;
+				continue;
+			}
+			Report("PASS %s: %zu points, %.3f ms, baseline %.3f ms", name.c_str(), expected.size(), median, it->second);
+		}
+		else
+		{
+			Report("PASS %s: %zu points, %.3f ms", name.c_str(), expected.size(), median);
+		}
+	}
+
+	if (options.update && options.timing && !options.baselineFile.empty() && !WriteBaseline(options.baselineFile, measured))
+	{
+		Report("FAIL cannot write %s", options.baselineFile.string().c_str());
+		++failures;
+	}
+	Report("%d of %zu scripts failed", failures, options.scripts.size());
+	return failures ? 1 : 0;
+}
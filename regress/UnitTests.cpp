@@ -0,0 +1,519 @@
+// Unit tests of the portable core, for what the end-to-end goldens cannot pin down.
+//   gi_unit [NAME-SUBSTRING]
+
+#include "../Interpreter.h"
+#include "../Lexer.h"
+#include "../Parser.h"
+#include "../PeriodAnalysis.h"
+#include "../PointSpool.h"
+#include "../RasterCanvas.h"
+#include "../RecordingCanvas.h"
+#include "../SvgCanvas.h"
+#include "../TiledCanvas.h"
+#include "../WorkStealingPool.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace gi;
+
+namespace
+{
+	int failures = 0;
+
+	void Check(bool ok, const char* expression, const char* file, int line)
+	{
+		if (ok)
+			return;
+		++failures;
+		std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+	}
+
+#define CHECK(expression) Check((expression), #expression, __FILE__, __LINE__)
+
+	std::vector<PointSpool::Record> Collect(const PointSpool& spool)
+	{
+		std::vector<PointSpool::Record> records;
+		spool.ForEachChunk([&](const PointSpool::Record* chunk, size_t count) {
+			records.insert(records.end(), chunk, chunk + count);
+		});
+		return records;
+	}
+
+	void PushNumbered(PointSpool& spool, size_t from, size_t count)
+	{
+		for (size_t i = from; i < from + count; ++i)
+			spool.Push({ static_cast<double>(i), -static_cast<double>(i), static_cast<int32_t>(i % 7), static_cast<uint32_t>(i) });
+	}
+
+	bool IsNumbered(const std::vector<PointSpool::Record>& records)
+	{
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			const PointSpool::Record& r = records[i];
+			if (r.x != static_cast<double>(i) || r.y != -static_cast<double>(i) || r.pointSize != static_cast<int32_t>(i % 7) || r.color != static_cast<uint32_t>(i))
+				return false;
+		}
+		return true;
+	}
+
+	// spilled chunks come back first and in order, then the ones in memory
+	void TestPointSpoolSpillOrder()
+	{
+		const size_t n = PointSpool::ChunkRecords;
+		PointSpool spool(2 * PointSpool::ChunkBytes);
+		PushNumbered(spool, 0, 5 * n + n / 2);
+		CHECK(spool.Size() == 5 * n + n / 2);
+		CHECK(spool.GetSpilledChunkCount() == 4);
+		std::vector<PointSpool::Record> records = Collect(spool);
+		CHECK(records.size() == spool.Size());
+		CHECK(IsNumbered(records));
+
+		// lowering the budget spills down to the chunk being filled
+		spool.SetMemoryBudget(0);
+		CHECK(spool.GetSpilledChunkCount() == 5);
+		PushNumbered(spool, spool.Size(), n);
+		records = Collect(spool);
+		CHECK(records.size() == 6 * n + n / 2);
+		CHECK(IsNumbered(records));
+
+		spool.Clear();
+		CHECK(spool.Size() == 0);
+		CHECK(spool.GetSpilledChunkCount() == 0);
+		CHECK(Collect(spool).empty());
+		PushNumbered(spool, 0, 3);
+		CHECK(IsNumbered(Collect(spool)));
+	}
+
+	// a budget of exactly k chunks keeps k chunks in memory, one byte less keeps k - 1
+	void TestPointSpoolBudgetBoundary()
+	{
+		const size_t n = PointSpool::ChunkRecords;
+		PointSpool exact(2 * PointSpool::ChunkBytes);
+		PushNumbered(exact, 0, 2 * n);
+		CHECK(exact.GetSpilledChunkCount() == 0);
+		PushNumbered(exact, 2 * n, 1);
+		CHECK(exact.GetSpilledChunkCount() == 1);
+		CHECK(IsNumbered(Collect(exact)));
+
+		PointSpool under(2 * PointSpool::ChunkBytes - 1);
+		PushNumbered(under, 0, n);
+		CHECK(under.GetSpilledChunkCount() == 0);
+		PushNumbered(under, n, 1);
+		CHECK(under.GetSpilledChunkCount() == 1);
+		CHECK(IsNumbered(Collect(under)));
+
+		// the chunk being filled stays in memory whatever the budget
+		PointSpool none(0);
+		PushNumbered(none, 0, n);
+		CHECK(none.GetSpilledChunkCount() == 0);
+		PushNumbered(none, n, 1);
+		CHECK(none.GetSpilledChunkCount() == 1);
+		CHECK(IsNumbered(Collect(none)));
+	}
+
+	void TestPointCacheRecorderOverflow()
+	{
+		PointCache cache(4);
+		PointCache::Key fits = { 1, 0.0, 1.0, 0.25 };
+		PointCache::Key tooLarge = { 2, 0.0, 1.0, 0.2 };
+		PointCacheRecorder exact(cache, fits);
+		for (int i = 0; i < 4; ++i)
+			exact.Add({ static_cast<double>(i), 0.0 });
+		exact.Commit();
+		auto* found = cache.Find(fits);
+		CHECK(found != nullptr && found->size() == 4);
+
+		// a statement larger than the cache is dropped instead of buffered to the end
+		PointCacheRecorder over(cache, tooLarge);
+		for (int i = 0; i < 5; ++i)
+			over.Add({ static_cast<double>(i), 0.0 });
+		over.Commit();
+		CHECK(cache.Find(tooLarge) == nullptr);
+		CHECK(cache.Find(fits) != nullptr);
+	}
+
+	std::vector<RecordingCanvas::Point> RunScript(const std::wstring& text, double singlePrecision = 0.0, ExecutionMetrics* metrics = nullptr)
+	{
+		Lexer lexer;
+		Parser parser;
+		parser.SetTraceTokens(false);
+		lexer.Init(text);
+		parser.Parse(lexer);
+		std::unique_ptr<NTProgram> ast = parser.GetASTRoot();
+		RecordingCanvas canvas;
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		context.SetSinglePrecision(singlePrecision);
+		context.SetMetrics(metrics);
+		context.Run(ast.get());
+		return canvas.GetPoints();
+	}
+
+	// '+' and '-' end a Component2, so they may follow a call or a power without parentheses
+	void TestParseAdditiveAfterComponent()
+	{
+		// a FOR statement also draws the first value past TO
+		std::vector<RecordingCanvas::Point> points = RunScript(
+			L"for t from 0 to 2 step 1 draw (sin(t)-2, t**2+1);"
+			L"for t from 1 to 1 step 1 draw (cos(t)+t, 2**t-t**2-1);");
+		CHECK(points.size() == 6);
+		if (points.size() != 6)
+			return;
+		for (int t = 0; t <= 3; ++t)
+		{
+			CHECK(points[t].x == std::sin(t) - 2);
+			CHECK(points[t].y == t * t + 1);
+		}
+		for (int t = 1; t <= 2; ++t)
+		{
+			CHECK(points[3 + t].x == std::cos(t) + t);
+			CHECK(points[3 + t].y == std::pow(2, t) - t * t - 1);
+		}
+	}
+
+	// FOR statements on a pool print their messages and draw their points in program order,
+	// also when there are more of them than may be in flight at once
+	void TestConcurrentMessagesInOrder()
+	{
+		std::wstring text;
+		for (int i = 0; i < 12; ++i)
+			text += L"for t from " + std::to_wstring(i + 1) + L" to 0 step -0.5 draw (t, " + std::to_wstring(i) + L");";
+		Lexer lexer;
+		Parser parser;
+		parser.SetTraceTokens(false);
+		lexer.Init(text);
+		parser.Parse(lexer);
+		std::unique_ptr<NTProgram> ast = parser.GetASTRoot();
+
+		auto run = [&](WorkStealingPool* pool, std::vector<std::wstring>& messages) {
+			RecordingCanvas canvas;
+			EvaluateContext context;
+			context.SetCanvas(&canvas);
+			context.SetWorkerPool(pool);
+			MessageCapture capture(messages);
+			context.Run(ast.get());
+			return canvas.GetPoints();
+		};
+		std::vector<std::wstring> expectedMessages, messages;
+		std::vector<RecordingCanvas::Point> expected = run(nullptr, expectedMessages);
+		WorkStealingPool pool(2);
+		std::vector<RecordingCanvas::Point> points = run(&pool, messages);
+		CHECK(expectedMessages.size() == 12);
+		CHECK(messages == expectedMessages);
+		CHECK(points.size() == expected.size());
+		bool same = points.size() == expected.size();
+		for (size_t i = 0; same && i < points.size(); ++i)
+			same = points[i].x == expected[i].x && points[i].y == expected[i].y;
+		CHECK(same);
+	}
+
+	// a FOR statement that fails to parse leaves no loop variable behind for the next parse
+	void TestParseErrorUnbindsLoopVariable()
+	{
+		Lexer lexer;
+		Parser parser;
+		parser.SetTraceTokens(false);
+		size_t symbols = parser.symbols.size();
+		bool threw = false;
+		try
+		{
+			lexer.Init(L"for t from 0 to 1 step 1 draw (t, );");
+			parser.Parse(lexer);
+		}
+		catch (std::exception&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+		CHECK(parser.symbols.size() == symbols);
+
+		// t is unknown outside a FOR statement again
+		threw = false;
+		try
+		{
+			lexer.Init(L"origin is (t, 0);");
+			parser.Parse(lexer);
+		}
+		catch (std::exception&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	// discs far off the canvas or larger than it must not overflow the pixel arithmetic
+	void TestRasterHugePointSize()
+	{
+		RasterCanvas canvas(8, 6);
+		canvas.SetDrawPointColor(255, 0, 0);
+		canvas.SetDrawPointSize(2000000000);
+		canvas.DrawPoint(4, 3);
+		canvas.SetDrawPointSize(1);
+		canvas.DrawPoint(-9e8, 9e8);
+		bool allRed = true;
+		for (size_t i = 0; i < canvas.GetPixels().size(); i += 3)
+			allRed = allRed && canvas.GetPixels()[i] == 255 && canvas.GetPixels()[i + 1] == 0;
+		CHECK(allRed);
+	}
+
+	// a throwing task does not stop the others, Wait rethrows it once
+	void TestPoolTaskException()
+	{
+		WorkStealingPool pool(3);
+		std::atomic<int> ran{ 0 };
+		for (int i = 0; i < 200; ++i)
+		{
+			pool.Submit([&ran, i, &pool](unsigned) {
+				if (i == 17)
+					throw std::runtime_error("task failed");
+				// tasks submitted from a task go to that thread's deque
+				if (i % 50 == 0)
+					pool.Submit([&ran](unsigned) { ++ran; });
+				++ran;
+			});
+		}
+		bool threw = false;
+		try
+		{
+			pool.Wait();
+		}
+		catch (std::runtime_error&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+		CHECK(ran.load() == 199 + 4);
+		threw = false;
+		try
+		{
+			pool.Wait();
+		}
+		catch (std::exception&)
+		{
+			threw = true;
+		}
+		CHECK(!threw);
+	}
+
+	// float rounds T next to the branch point of SQRT by far more than the tolerance allows,
+	// those blocks are drawn in double, each point once
+	void TestSinglePrecisionNearSingularity()
+	{
+		const wchar_t* text = L"origin is (100,300); scale is (100,100); for t from 0 to 2 step 0.000001 draw (t, sqrt(t - 1) * 1000);";
+		std::vector<RecordingCanvas::Point> expected = RunScript(text);
+		ExecutionMetrics metrics;
+		std::vector<RecordingCanvas::Point> points = RunScript(text, 0.05, &metrics);
+		CHECK(points.size() == expected.size());
+		bool close = points.size() == expected.size();
+		for (size_t i = 0; close && i < points.size(); ++i)
+		{
+			if (std::isnan(expected[i].y) || std::isnan(points[i].y))
+				close = std::isnan(expected[i].y) == std::isnan(points[i].y);
+			else
+				close = std::hypot(points[i].x - expected[i].x, points[i].y - expected[i].y) <= 0.05;
+		}
+		CHECK(close);
+		size_t iterations = 0;
+		for (auto& statement : metrics.GetStatements())
+			iterations += statement.iterations;
+		CHECK(iterations == points.size());
+	}
+
+	// a*T + b under a built-in, with SIN, COS or TAN for call
+	BatchProgram AffineCall(double a, double b, const wchar_t* call)
+	{
+		BatchProgram program;
+		program.PushConstant(a);
+		program.PushVariable();
+		program.Push(BatchProgram::Op::Multiply);
+		program.PushConstant(b);
+		program.Push(BatchProgram::Op::Add);
+		program.PushCall(call);
+		return program;
+	}
+
+	void TestPeriodAnalysis()
+	{
+		const double pi = 3.14159265358979323846;
+		CHECK(std::fabs(PeriodAnalysis::FindPeriod(AffineCall(2, 1, L"SIN")) - pi) < 1e-12);
+		CHECK(std::fabs(PeriodAnalysis::FindPeriod(AffineCall(-0.5, 0, L"TAN")) - 2 * pi) < 1e-12);
+
+		// sin(2T) * cos(3T) repeats every 2 pi, sqrt(T) and T do not repeat, a constant always does
+		BatchProgram product = AffineCall(2, 0, L"SIN");
+		product.PushConstant(3);
+		product.PushVariable();
+		product.Push(BatchProgram::Op::Multiply);
+		product.PushCall(L"COS");
+		product.Push(BatchProgram::Op::Multiply);
+		CHECK(std::fabs(PeriodAnalysis::FindPeriod(product) - 2 * pi) < 1e-12);
+		CHECK(PeriodAnalysis::FindPeriod(AffineCall(1, 0, L"SQRT")) == 0.0);
+		BatchProgram variable;
+		variable.PushVariable();
+		CHECK(PeriodAnalysis::FindPeriod(variable) == 0.0);
+		BatchProgram constant;
+		constant.PushConstant(2);
+		CHECK(std::isinf(PeriodAnalysis::FindPeriod(constant)));
+
+		// ratios are matched to fractions with denominators up to MaxDenominator
+		CHECK(PeriodAnalysis::CommonPeriod(3, 2) == 6);
+		CHECK(PeriodAnalysis::CommonPeriod(1, 1.0 / 3 * (1 + 1e-12)) == 1);
+		CHECK(std::fabs(PeriodAnalysis::CommonPeriod(1, 1000.0 / 999) - 1000) < 1e-9);
+		CHECK(PeriodAnalysis::CommonPeriod(1, 1001.0 / 1000) == 0);
+		CHECK(PeriodAnalysis::CommonPeriod(1, std::sqrt(2.0)) == 0);
+		CHECK(PeriodAnalysis::CommonPeriod(0, 1) == 0);
+		CHECK(PeriodAnalysis::CommonPeriod(2, std::numeric_limits<double>::infinity()) == 2);
+	}
+
+	uint64_t Fnv1a(const std::vector<uint8_t>& bytes)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (uint8_t b : bytes)
+			hash = (hash ^ b) * 1099511628211ull;
+		return hash;
+	}
+
+	uint64_t RenderCorpusScript(const char* name, bool antiAliasing)
+	{
+		std::ifstream is(std::string(GI_REGRESS_CORPUS) + "/" + name, std::ios::binary);
+		std::string text((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+		CHECK(!text.empty());
+		Lexer lexer;
+		Parser parser;
+		parser.SetTraceTokens(false);
+		// the corpus is ASCII
+		lexer.Init(std::wstring(text.begin(), text.end()));
+		parser.Parse(lexer);
+		std::unique_ptr<NTProgram> ast = parser.GetASTRoot();
+		RasterCanvas canvas(720, 480);
+		canvas.SetAntiAliasing(antiAliasing);
+		EvaluateContext context;
+		context.SetCanvas(&canvas);
+		context.Run(ast.get());
+		return Fnv1a(canvas.GetPixels());
+	}
+
+	// pixels of the DRAW LINE corpus script, Bresenham and Wu. A change here is intended
+	// only when a rasterizer changes, the goldens hold the vertices alone.
+	void TestRasterPolyline()
+	{
+		uint64_t plain = RenderCorpusScript("polyline.txt", false);
+		uint64_t antiAliased = RenderCorpusScript("polyline.txt", true);
+		CHECK(plain == 0x73fcf8014ddd4977ull);
+		CHECK(antiAliased == 0x9395f7e1f9fe7bdbull);
+	}
+
+	void TestSvgSimplify()
+	{
+		// points within tolerance of the chord go, the corner stays
+		std::vector<ModelPoint> polyline = { { 0, 0 }, { 5, 0.2 }, { 10, 0 }, { 10, 5 }, { 10.3, 10 } };
+		SvgCanvas::Simplify(polyline, 0.5);
+		CHECK(polyline.size() == 3);
+		if (polyline.size() == 3)
+			CHECK(polyline[1].x == 10 && polyline[1].y == 0);
+
+		// a closed curve has a chord of length 0, its points are measured from the shared end
+		std::vector<ModelPoint> square = { { 0, 0 }, { 10, 0 }, { 10, 10 }, { 0, 10 }, { 0, 0 } };
+		SvgCanvas::Simplify(square, 0.5);
+		CHECK(square.size() == 5);
+		std::vector<ModelPoint> dot = { { 3, 3 }, { 3.1, 3 }, { 3, 3.1 }, { 3, 3 } };
+		SvgCanvas::Simplify(dot, 0.5);
+		CHECK(dot.size() == 2);
+
+		std::vector<ModelPoint> pair = { { 0, 0 }, { 1, 1 } };
+		SvgCanvas::Simplify(pair, 10);
+		CHECK(pair.size() == 2);
+	}
+
+	// points too far off to be written do not open a path of their own
+	void TestSvgUndrawableRun()
+	{
+		std::ostringstream oss;
+		SvgCanvas canvas(oss, 100, 100, 0.5);
+		canvas.SetDrawPointColor(255, 0, 0);
+		canvas.DrawPoint(1e12, 0);
+		canvas.SetDrawPointColor(0, 0, 255);
+		canvas.DrawLine(0, 0, 1e12, 0);
+		canvas.DrawPoint(10, 10);
+		CHECK(canvas.Finish());
+		std::string svg = oss.str();
+		CHECK(svg.find("d=\"\"") == std::string::npos);
+		CHECK(svg.find("<path") == svg.rfind("<path"));
+		CHECK(svg.find("#ff0000") == std::string::npos);
+	}
+
+	// a tiled canvas with fewer tiles in memory than a tile row writes the same image as a
+	// raster canvas, without loading tiles again for each band
+	void TestTiledPpmBands()
+	{
+		const int width = 5 * TiledCanvas::TileSize + 40, height = 2 * TiledCanvas::TileSize + 10;
+		RasterCanvas raster(width, height);
+		TiledCanvas tiled(width, height, 2);
+		for (ICanvas* canvas : { static_cast<ICanvas*>(&raster), static_cast<ICanvas*>(&tiled) })
+		{
+			canvas->SetDrawBackgroundColor(0x66, 0xCC, 0xFF);
+			canvas->SetDrawPointSize(3);
+			for (int i = 0; i < 400; ++i)
+			{
+				canvas->SetDrawPointColor(static_cast<uint8_t>(i), 0, 0);
+				canvas->DrawPoint(i * 3.3, i * 1.4);
+				canvas->DrawLine(i * 3.3, 0, width - i * 3.3, height);
+			}
+		}
+		std::ostringstream expected, actual;
+		raster.WritePpm(expected);
+		tiled.Flush();
+		uint64_t loads = tiled.GetTileLoads();
+		tiled.WritePpm(actual);
+		CHECK(actual.str() == expected.str());
+		CHECK(tiled.GetTileLoads() == loads);
+	}
+
+	struct TestCase
+	{
+		const char* name;
+		void (*run)();
+	};
+
+	const TestCase Tests[] = {
+		{ "PointSpoolSpillOrder", TestPointSpoolSpillOrder },
+		{ "PointSpoolBudgetBoundary", TestPointSpoolBudgetBoundary },
+		{ "PointCacheRecorderOverflow", TestPointCacheRecorderOverflow },
+		{ "ParseAdditiveAfterComponent", TestParseAdditiveAfterComponent },
+		{ "ConcurrentMessagesInOrder", TestConcurrentMessagesInOrder },
+		{ "ParseErrorUnbindsLoopVariable", TestParseErrorUnbindsLoopVariable },
+		{ "RasterHugePointSize", TestRasterHugePointSize },
+		{ "PoolTaskException", TestPoolTaskException },
+		{ "SinglePrecisionNearSingularity", TestSinglePrecisionNearSingularity },
+		{ "PeriodAnalysis", TestPeriodAnalysis },
+		{ "RasterPolyline", TestRasterPolyline },
+		{ "SvgSimplify", TestSvgSimplify },
+		{ "SvgUndrawableRun", TestSvgUndrawableRun },
+		{ "TiledPpmBands", TestTiledPpmBands },
+	};
+}
+
+int main(int argc, char** argv)
+{
+	const char* filter = argc > 1 ? argv[1] : "";
+	int run = 0;
+	for (const TestCase& test : Tests)
+	{
+		if (!std::strstr(test.name, filter))
+			continue;
+		int before = failures;
+		test.run();
+		++run;
+		std::printf("%s %s\n", failures == before ? "ok  " : "FAIL", test.name);
+	}
+	std::printf("%d tests, %d failed checks\n", run, failures);
+	return failures == 0 && run > 0 ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+
+#include "LatencyHistogram.h"
+
+#include <cstdio>
+
+namespace
+{
+	// bucket i holds latencies in [2^(i-1), 2^i) microseconds, bucket 0 below 1us
+	int BucketOf(uint64_t nanoseconds)
+	{
+		uint64_t us = nanoseconds / 1000;
+		int bucket = 0;
+		while (us > 0 && bucket < 39)
+		{
+			us >>= 1;
+			++bucket;
+		}
+		return bucket;
+	}
+
+	double BucketUpperMicroseconds(int bucket)
+	{
+		return static_cast<double>(uint64_t(1) << bucket);
+	}
+}
+
+void gi::LatencyHistogram::Record(uint64_t nanoseconds)
+{
+	counts[BucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+	totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+	uint64_t max = maxNanoseconds.load(std::memory_order_relaxed);
+	while (nanoseconds > max && !maxNanoseconds.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+	{
+	}
+}
+
+uint64_t gi::LatencyHistogram::GetCount() const
+{
+	uint64_t n = 0;
+	for (auto& c : counts)
+		n += c.load(std::memory_order_relaxed);
+	return n;
+}
+
+double gi::LatencyHistogram::GetQuantile(double q) const
+{
+	uint64_t n = GetCount();
+	if (n == 0)
+		return 0.0;
+	uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(n - 1)) + 1;
+	uint64_t seen = 0;
+	for (int i = 0; i < Buckets; ++i)
+	{
+		seen += counts[i].load(std::memory_order_relaxed);
+		if (seen >= rank)
+			return BucketUpperMicroseconds(i);
+	}
+	return BucketUpperMicroseconds(Buckets - 1);
+}
+
+std::string gi::LatencyHistogram::Format(const char* name) const
+{
+	uint64_t n = GetCount();
+	char line[256];
+	std::snprintf(line, sizeof(line), "%s: %llu requests, mean %.1f us, p50 <%.0f us, p90 <%.0f us, p99 <%.0f us, max %.1f us\n",
+		name, static_cast<unsigned long long>(n),
+		n ? static_cast<double>(totalNanoseconds.load(std::memory_order_relaxed)) / 1000.0 / static_cast<double>(n) : 0.0,
+		GetQuantile(0.5), GetQuantile(0.9), GetQuantile(0.99),
+		static_cast<double>(maxNanoseconds.load(std::memory_order_relaxed)) / 1000.0);
+	std::string text = line;
+	for (int i = 0; i < Buckets; ++i)
+	{
+		uint64_t c = counts[i].load(std::memory_order_relaxed);
+		if (c == 0)
+			continue;
+		std::snprintf(line, sizeof(line), "  <%10.0f us %llu\n", BucketUpperMicroseconds(i), static_cast<unsigned long long>(c));
+		text += line;
+	}
+	return text;
+}
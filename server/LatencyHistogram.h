@@ -0,0 +1,25 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace gi
+{
+	// Lock-free latency histogram with power of two microsecond buckets
+	class LatencyHistogram
+	{
+	private:
+		static constexpr int Buckets = 40;
+		std::atomic<uint64_t> counts[Buckets] = {};
+		std::atomic<uint64_t> totalNanoseconds{ 0 };
+		std::atomic<uint64_t> maxNanoseconds{ 0 };
+	public:
+		void Record(uint64_t nanoseconds);
+		uint64_t GetCount()const;
+		// upper bound of the bucket holding the given quantile, in microseconds
+		double GetQuantile(double q)const;
+		// summary line and non-empty buckets
+		std::string Format(const char* name)const;
+	};
+}
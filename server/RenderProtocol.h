@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../PointRecord.h"
+
+#include <cstdint>
+
+// Messages of the render server socket, native byte order (the socket is local).
+// A connection carries any number of request/response pairs.
+namespace gi
+{
+	enum class RenderRequestKind : uint32_t
+	{
+		Points = 0,     // payload: PointRecord array in device space
+		ImagePpm = 1,   // payload: binary PPM of width x height
+		Statistics = 2, // payload: latency histograms as text, no script
+	};
+
+	struct RenderRequestHeader
+	{
+		char magic[4];        // "GIRQ"
+		uint32_t version;     // RenderProtocolVersion
+		RenderRequestKind kind;
+		uint32_t width;       // image size, ignored for other kinds
+		uint32_t height;
+		uint32_t scriptBytes; // UTF-8 script following the header
+	};
+
+	enum class RenderStatus : uint32_t
+	{
+		Ok = 0,
+		ScriptError = 1,  // payload: message
+		BadRequest = 2,   // payload: message, the server closes the connection
+	};
+
+	struct RenderResponseHeader
+	{
+		char magic[4];       // "GIRS"
+		RenderStatus status;
+		uint64_t payloadBytes;
+		uint64_t serverNanoseconds; // time from request read to response ready
+	};
+
+	constexpr uint32_t RenderProtocolVersion = 1;
+	constexpr uint32_t MaxScriptBytes = 16 * 1024 * 1024;
+	constexpr uint32_t MaxImageSide = 8192;
+}
@@ -0,0 +1,326 @@
+
+#include "RenderServer.h"
+
+#include "../Interpreter.h"
+#include "../Lexer.h"
+#include "../Parser.h"
+#include "../RasterCanvas.h"
+#include "../RecordingCanvas.h"
+
+#include <chrono>
+#include <codecvt>
+#include <cstring>
+#include <locale>
+#include <sstream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace gi
+{
+	// warm per-thread pipeline
+	struct RenderWorker
+	{
+		Lexer lexer;
+		Parser parser;
+		EvaluateContext context;
+		RecordingCanvas recording;
+		std::vector<char> script;
+		std::string payload;
+	};
+}
+
+namespace
+{
+	constexpr int IoTimeoutSeconds = 5;
+
+	bool ReadFull(int fd, void* buffer, size_t size)
+	{
+		char* p = static_cast<char*>(buffer);
+		while (size > 0)
+		{
+			ssize_t n = read(fd, p, size);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			p += n;
+			size -= static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+	bool WriteFull(int fd, const void* buffer, size_t size)
+	{
+		const char* p = static_cast<const char*>(buffer);
+		while (size > 0)
+		{
+			ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			p += n;
+			size -= static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+	bool SendResponse(int fd, gi::RenderStatus status, const std::string& payload, uint64_t nanoseconds)
+	{
+		gi::RenderResponseHeader header = { { 'G', 'I', 'R', 'S' }, status, payload.size(), nanoseconds };
+		return WriteFull(fd, &header, sizeof(header)) && WriteFull(fd, payload.data(), payload.size());
+	}
+}
+
+gi::RenderServer::~RenderServer()
+{
+	Stop();
+	for (auto& worker : workers)
+	{
+		if (worker.joinable())
+			worker.join();
+	}
+	for (int fd : readyConnections)
+		close(fd);
+	for (int fd : returnedConnections)
+		close(fd);
+	for (int fd : { listenFd, wakeFds[0], wakeFds[1] })
+	{
+		if (fd != -1)
+			close(fd);
+	}
+	if (listenFd != -1)
+		unlink(socketPath.c_str());
+}
+
+bool gi::RenderServer::Start(const std::string& path, unsigned threads)
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+	{
+		PrintMessage(L"socket path too long");
+		return false;
+	}
+	std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+	if (pipe2(wakeFds, O_CLOEXEC | O_NONBLOCK) != 0)
+		return false;
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listenFd == -1)
+		return false;
+	// a stale socket file from a killed server would make bind fail
+	unlink(path.c_str());
+	if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenFd, 128) != 0)
+	{
+		PrintMessage(JoinAsWideString(L"cannot listen on socket: ", strerror(errno)));
+		close(listenFd);
+		listenFd = -1;
+		return false;
+	}
+	socketPath = path;
+
+	for (unsigned i = 0; i < std::max(threads, 1u); ++i)
+		workers.emplace_back([this]() { WorkerLoop(); });
+	return true;
+}
+
+void gi::RenderServer::Stop()
+{
+	stopping.store(true);
+	if (wakeFds[1] != -1)
+	{
+		char c = 0;
+		ssize_t ignored = write(wakeFds[1], &c, 1);
+		(void)ignored;
+	}
+}
+
+void gi::RenderServer::ReturnConnection(int fd)
+{
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		returnedConnections.push_back(fd);
+	}
+	char c = 0;
+	ssize_t ignored = write(wakeFds[1], &c, 1);
+	(void)ignored;
+}
+
+void gi::RenderServer::Run()
+{
+	std::vector<int> idle;
+	std::vector<pollfd> polled;
+	while (!stopping.load())
+	{
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			idle.insert(idle.end(), returnedConnections.begin(), returnedConnections.end());
+			returnedConnections.clear();
+		}
+		polled.clear();
+		polled.push_back({ wakeFds[0], POLLIN, 0 });
+		polled.push_back({ listenFd, POLLIN, 0 });
+		for (int fd : idle)
+			polled.push_back({ fd, POLLIN, 0 });
+		if (poll(polled.data(), polled.size(), -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (polled[0].revents)
+		{
+			char drain[64];
+			while (read(wakeFds[0], drain, sizeof(drain)) > 0)
+			{
+			}
+		}
+		if (polled[1].revents & POLLIN)
+		{
+			int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+			if (fd != -1)
+			{
+				// a client stalling mid-request must not hold a worker for longer than this
+				timeval timeout = { IoTimeoutSeconds, 0 };
+				setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+				setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+				idle.push_back(fd);
+			}
+		}
+		// readable (or hung up) connections go to the workers, EOF is seen there
+		std::vector<int> stillIdle;
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			for (size_t i = 2; i < polled.size(); ++i)
+			{
+				if (polled[i].revents)
+					readyConnections.push_back(polled[i].fd);
+				else
+					stillIdle.push_back(polled[i].fd);
+			}
+		}
+		queueReady.notify_all();
+		// connections accepted in this round were not polled yet
+		for (int fd : idle)
+		{
+			bool wasPolled = false;
+			for (size_t i = 2; i < polled.size() && !wasPolled; ++i)
+				wasPolled = polled[i].fd == fd;
+			if (!wasPolled)
+				stillIdle.push_back(fd);
+		}
+		idle.swap(stillIdle);
+	}
+	for (int fd : idle)
+		close(fd);
+	queueReady.notify_all();
+}
+
+void gi::RenderServer::WorkerLoop()
+{
+	RenderWorker worker;
+	worker.parser.SetTraceTokens(false);
+	for (;;)
+	{
+		int fd;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueReady.wait(lock, [this]() { return stopping.load() || !readyConnections.empty(); });
+			if (readyConnections.empty())
+				return;
+			fd = readyConnections.front();
+			readyConnections.pop_front();
+		}
+		if (ServeRequest(fd, worker))
+			ReturnConnection(fd);
+		else
+			close(fd);
+	}
+}
+
+bool gi::RenderServer::ServeRequest(int fd, RenderWorker& worker)
+{
+	RenderRequestHeader request;
+	if (!ReadFull(fd, &request, sizeof(request)))
+		return false;
+	auto start = std::chrono::steady_clock::now();
+	auto elapsed = [&start]() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	};
+
+	if (std::memcmp(request.magic, "GIRQ", 4) != 0 || request.version != RenderProtocolVersion ||
+		request.scriptBytes > MaxScriptBytes ||
+		(request.kind == RenderRequestKind::ImagePpm && (request.width > MaxImageSide || request.height > MaxImageSide)))
+	{
+		SendResponse(fd, RenderStatus::BadRequest, "bad request header", elapsed());
+		return false;
+	}
+	worker.script.resize(request.scriptBytes);
+	if (!ReadFull(fd, worker.script.data(), worker.script.size()))
+		return false;
+
+	if (request.kind == RenderRequestKind::Statistics)
+		return SendResponse(fd, RenderStatus::Ok, FormatStatistics(), elapsed());
+	if (request.kind != RenderRequestKind::Points && request.kind != RenderRequestKind::ImagePpm)
+	{
+		SendResponse(fd, RenderStatus::BadRequest, "unknown request kind", elapsed());
+		return false;
+	}
+
+	worker.payload.clear();
+	// parse errors and statement reports go to the client instead of the server's stdout
+	std::vector<std::wstring> messages;
+	std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+	try {
+		MessageCapture capture(messages);
+		std::wstring content = converter.from_bytes(worker.script.data(), worker.script.data() + worker.script.size());
+		worker.lexer.Init(content);
+		worker.parser.Parse(worker.lexer);
+		std::unique_ptr<NTProgram> ast = worker.parser.GetASTRoot();
+		if (request.kind == RenderRequestKind::Points)
+		{
+			worker.recording.Reset();
+			worker.context.SetCanvas(&worker.recording);
+			worker.context.Run(ast.get());
+			auto& points = worker.recording.GetPoints();
+			// recorded points are already in the reply layout
+			worker.payload.assign(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(PointRecord));
+		}
+		else
+		{
+			RasterCanvas raster(static_cast<int>(request.width), static_cast<int>(request.height));
+			raster.SetDrawBackgroundColor(0x66, 0xCC, 0xFF);
+			worker.context.SetCanvas(&raster);
+			worker.context.Run(ast.get());
+			worker.context.SetCanvas(nullptr);
+			std::ostringstream oss;
+			raster.WritePpm(oss);
+			worker.payload = oss.str();
+		}
+	}
+	catch (std::exception& e)
+	{
+		uint64_t ns = elapsed();
+		errorLatency.Record(ns);
+		std::string text;
+		for (auto& message : messages)
+			text += converter.to_bytes(message) + '\n';
+		text += e.what();
+		return SendResponse(fd, RenderStatus::ScriptError, text, ns);
+	}
+
+	uint64_t ns = elapsed();
+	(request.kind == RenderRequestKind::Points ? pointsLatency : imageLatency).Record(ns);
+	return SendResponse(fd, RenderStatus::Ok, worker.payload, ns);
+}
+
+std::string gi::RenderServer::FormatStatistics() const
+{
+	return pointsLatency.Format("points") + imageLatency.Format("image") + errorLatency.Format("script errors");
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+#include "RenderProtocol.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gi
+{
+	// Headless render service on a Unix domain socket.
+	// Worker threads keep their Lexer, Parser and EvaluateContext between requests, so the
+	// regex compilation and symbol tables are paid once per worker instead of once per job.
+	// Idle connections wait in poll() on the accept thread, a worker only holds a
+	// connection while it serves one request.
+	class RenderServer
+	{
+	private:
+		std::string socketPath;
+		int listenFd = -1;
+		int wakeFds[2] = { -1, -1 }; // self-pipe, wakes the poll loop
+		std::atomic<bool> stopping{ false };
+
+		std::mutex queueMutex;
+		std::condition_variable queueReady;
+		std::deque<int> readyConnections; // readable, waiting for a worker
+		std::vector<int> returnedConnections; // served, back to the poll set
+
+		std::vector<std::thread> workers;
+
+		LatencyHistogram pointsLatency;
+		LatencyHistogram imageLatency;
+		LatencyHistogram errorLatency;
+
+		void WorkerLoop();
+		// false if the connection is finished
+		bool ServeRequest(int fd, struct RenderWorker& worker);
+		void ReturnConnection(int fd);
+	public:
+		RenderServer() = default;
+		~RenderServer();
+		RenderServer(const RenderServer&) = delete;
+		RenderServer& operator=(const RenderServer&) = delete;
+
+		// bind the socket and start threads workers, false on failure
+		bool Start(const std::string& path, unsigned threads);
+		// serve until Stop, call from one thread
+		void Run();
+		// async-signal-safe
+		void Stop();
+		std::string FormatStatistics()const;
+	};
+}
@@ -0,0 +1,227 @@
+
+// gi_server: headless render server on a Unix domain socket, and a reference client
+// that replays a script with concurrent connections and prints latency histograms.
+
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING 1
+
+#include "LatencyHistogram.h"
+#include "RenderProtocol.h"
+#include "RenderServer.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace gi;
+
+namespace
+{
+	RenderServer* runningServer = nullptr;
+
+	void OnSignal(int)
+	{
+		if (runningServer)
+			runningServer->Stop();
+	}
+
+	int Connect(const std::string& path)
+	{
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path))
+			return -1;
+		std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd != -1 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	bool Transfer(int fd, void* buffer, size_t size, bool sending)
+	{
+		char* p = static_cast<char*>(buffer);
+		while (size > 0)
+		{
+			ssize_t n = sending ? send(fd, p, size, MSG_NOSIGNAL) : read(fd, p, size);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			p += n;
+			size -= static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+	// one request/response on an open connection
+	bool Request(int fd, RenderRequestKind kind, uint32_t width, uint32_t height, const std::string& script,
+		RenderResponseHeader& response, std::string& payload)
+	{
+		RenderRequestHeader header = { { 'G', 'I', 'R', 'Q' }, RenderProtocolVersion, kind, width, height,
+			static_cast<uint32_t>(script.size()) };
+		std::string body = script;
+		if (!Transfer(fd, &header, sizeof(header), true) || !Transfer(fd, &body[0], body.size(), true))
+			return false;
+		if (!Transfer(fd, &response, sizeof(response), false))
+			return false;
+		payload.resize(static_cast<size_t>(response.payloadBytes));
+		return Transfer(fd, &payload[0], payload.size(), false);
+	}
+
+	int RunClient(const std::string& path, const std::string& scriptFile, RenderRequestKind kind,
+		uint32_t width, uint32_t height, int requests, int connections, const char* output)
+	{
+		std::string script;
+		if (kind != RenderRequestKind::Statistics)
+		{
+			std::ifstream is(scriptFile, std::ios::binary);
+			std::ostringstream oss;
+			oss << is.rdbuf();
+			if (!is.good())
+			{
+				std::fprintf(stderr, "cannot read %s\n", scriptFile.c_str());
+				return 1;
+			}
+			script = oss.str();
+		}
+
+		LatencyHistogram roundTrip;
+		std::atomic<int> failures{ 0 };
+		std::string lastPayload;
+		std::vector<std::thread> clients;
+		auto begin = std::chrono::steady_clock::now();
+		for (int c = 0; c < connections; ++c)
+		{
+			clients.emplace_back([&, c]() {
+				int fd = Connect(path);
+				if (fd == -1)
+				{
+					failures += requests / connections + (c < requests % connections);
+					return;
+				}
+				RenderResponseHeader response = {};
+				std::string payload;
+				for (int i = c; i < requests; i += connections)
+				{
+					auto start = std::chrono::steady_clock::now();
+					if (!Request(fd, kind, width, height, script, response, payload))
+					{
+						++failures;
+						std::fprintf(stderr, "connection lost\n");
+						break;
+					}
+					if (response.status != RenderStatus::Ok)
+					{
+						++failures;
+						std::fprintf(stderr, "request failed: %.*s\n", static_cast<int>(payload.size()), payload.c_str());
+						break;
+					}
+					roundTrip.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+						std::chrono::steady_clock::now() - start).count()));
+				}
+				close(fd);
+				if (c == 0)
+					lastPayload = payload;
+			});
+		}
+		for (auto& client : clients)
+			client.join();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+		if (kind == RenderRequestKind::Statistics)
+			std::fputs(lastPayload.c_str(), stdout);
+		else
+		{
+			std::fputs(roundTrip.Format("round trip").c_str(), stdout);
+			std::printf("%llu requests in %.3f s, %.1f requests/s, %d failed\n",
+				static_cast<unsigned long long>(roundTrip.GetCount()), seconds,
+				static_cast<double>(roundTrip.GetCount()) / seconds, failures.load());
+		}
+		if (output)
+		{
+			std::ofstream os(output, std::ios::binary);
+			os.write(lastPayload.data(), static_cast<std::streamsize>(lastPayload.size()));
+		}
+		return failures ? 1 : 0;
+	}
+
+	void PrintUsage(const char* self)
+	{
+		std::fprintf(stderr,
+			"Usage: %s --socket PATH [--threads N]\n"
+			"       %s --client PATH [--image WIDTHxHEIGHT] [--requests N] [--connections N] [--out FILE] SCRIPT\n"
+			"       %s --client PATH --stats\n", self, self, self);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string socketPath, clientPath, scriptFile;
+	unsigned threads = std::thread::hardware_concurrency();
+	RenderRequestKind kind = RenderRequestKind::Points;
+	uint32_t width = 0, height = 0;
+	int requests = 1, connections = 1;
+	const char* output = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--socket" && hasValue)
+			socketPath = argv[++i];
+		else if (arg == "--threads" && hasValue)
+			threads = static_cast<unsigned>(std::atoi(argv[++i]));
+		else if (arg == "--client" && hasValue)
+			clientPath = argv[++i];
+		else if (arg == "--image" && hasValue && std::sscanf(argv[++i], "%ux%u", &width, &height) == 2)
+			kind = RenderRequestKind::ImagePpm;
+		else if (arg == "--stats")
+			kind = RenderRequestKind::Statistics;
+		else if (arg == "--requests" && hasValue)
+			requests = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--connections" && hasValue)
+			connections = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--out" && hasValue)
+			output = argv[++i];
+		else if (scriptFile.empty() && arg.compare(0, 2, "--") != 0)
+			scriptFile = arg;
+		else
+		{
+			PrintUsage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (!clientPath.empty() && (!scriptFile.empty() || kind == RenderRequestKind::Statistics))
+		return RunClient(clientPath, scriptFile, kind, width, height, requests, std::min(connections, requests), output);
+	if (socketPath.empty())
+	{
+		PrintUsage(argv[0]);
+		return 2;
+	}
+
+	RenderServer server;
+	if (!server.Start(socketPath, threads))
+		return 1;
+	runningServer = &server;
+	std::signal(SIGINT, OnSignal);
+	std::signal(SIGTERM, OnSignal);
+	std::fprintf(stderr, "listening on %s with %u threads\n", socketPath.c_str(), threads);
+	server.Run();
+	runningServer = nullptr;
+	std::fputs(server.FormatStatistics().c_str(), stderr);
+	return 0;
+}
@@ -0,0 +1,89 @@
+
+#include "SharedPointCanvas.h"
+
+gi::SharedPointCanvas::SharedPointCanvas(SharedPointRing& ring)
+	: ring(ring)
+{
+}
+
+bool gi::SharedPointCanvas::AcquireBlock()
+{
+	block = ring.Acquire();
+	if (!block)
+		return false;
+	block->flags = pendingFlags;
+	pendingFlags = 0;
+	records = SharedPointRing::Records(block);
+	used = 0;
+	return true;
+}
+
+void gi::SharedPointCanvas::PublishBlock()
+{
+	block->count = used;
+	ring.Publish();
+	block = nullptr;
+	records = nullptr;
+	used = 0;
+}
+
+void gi::SharedPointCanvas::Flush()
+{
+	if (block && (used > 0 || block->flags != 0))
+		PublishBlock();
+	else if (!block && pendingFlags != 0 && AcquireBlock())
+		PublishBlock();
+}
+
+void gi::SharedPointCanvas::Finish()
+{
+	Flush();
+	ring.Close();
+}
+
+uint64_t gi::SharedPointCanvas::GetPointCount() const
+{
+	return pointCount;
+}
+
+uint64_t gi::SharedPointCanvas::GetDroppedCount() const
+{
+	return droppedCount;
+}
+
+void gi::SharedPointCanvas::Push(const ModelPoint& p, uint8_t flags)
+{
+	if (!block && !AcquireBlock())
+	{
+		++droppedCount;
+		return;
+	}
+	records[used++] = { p.x, p.y, state.pointSize, state.colorR, state.colorG, state.colorB, flags };
+	++pointCount;
+	if (used == ring.GetBlockPoints())
+		PublishBlock();
+}
+
+void gi::SharedPointCanvas::DrawPoint(double x, double y)
+{
+	lineFlags.Break();
+	Push(transform.Apply({ x, y }), 0);
+}
+
+void gi::SharedPointCanvas::DrawLine(double x0, double y0, double x1, double y1)
+{
+	ModelPoint to = transform.Apply({ x1, y1 });
+	Push(to, lineFlags.Segment(transform.Apply({ x0, y0 }), to));
+}
+
+void gi::SharedPointCanvas::Clear()
+{
+	lineFlags.Break();
+	// points before the clear must not arrive in the same block as the flag
+	if (block && used > 0)
+		PublishBlock();
+	if (block)
+		block->flags |= SharedBlockCleared;
+	else
+		pendingFlags |= SharedBlockCleared;
+}
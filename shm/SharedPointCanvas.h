@@ -0,0 +1,43 @@
+#pragma once
+
+#include "SharedPointRing.h"
+
+#include "../CanvasStateTracker.h"
+
+namespace gi
+{
+	// Canvas writing device-space points straight into the slots of a producer SharedPointRing,
+	// a block is published once full. Lines are kept as the flagged vertices of their polyline,
+	// like RecordingCanvas. Points drawn after the consumer detached are dropped.
+	class SharedPointCanvas : public TransformingCanvas
+	{
+	private:
+		SharedPointRing& ring;
+
+		SharedPointBlock* block = nullptr; // acquired, being filled
+		SharedPointRecord* records = nullptr;
+		uint32_t used = 0;
+		uint32_t pendingFlags = 0; // for the next block
+		uint64_t pointCount = 0;
+		uint64_t droppedCount = 0;
+		LineVertexFlags lineFlags;
+
+		bool AcquireBlock();
+		void PublishBlock();
+		void Push(const ModelPoint& p, uint8_t flags);
+	public:
+		explicit SharedPointCanvas(SharedPointRing& ring);
+
+		// publish the partly filled block, if any
+		void Flush();
+		// flush and close the ring
+		void Finish();
+
+		uint64_t GetPointCount()const;
+		uint64_t GetDroppedCount()const;
+
+		void DrawPoint(double x, double y) override;
+		void DrawLine(double x0, double y0, double x1, double y1) override;
+		void Clear() override;
+	};
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../PointRecord.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Layout of a shared-memory point ring (shm_open name, one producer, one consumer):
+//
+//   SharedPointHeader, then blockCount slots of BlockStride(blockPoints) bytes,
+//   each a SharedPointBlock followed by up to blockPoints SharedPointRecords.
+//
+// head and tail count blocks published and released modulo 2^31; their top bit marks the
+// producer closed and the consumer detached. Slot i is block i % blockCount. A side that finds
+// nothing to do sets its waiting word and sleeps on the other side's counter, which is a futex
+// word on Linux, so the other side only makes a system call when someone sleeps. Sleeps are
+// bounded, so either side notices when the pid of the other one no longer exists.
+namespace gi
+{
+	// same record as the goldens and the render server
+	using SharedPointRecord = PointRecord;
+
+	enum SharedPointBlockFlags : uint32_t
+	{
+		SharedBlockCleared = 1, // the canvas was cleared before these points
+	};
+
+	struct SharedPointBlock
+	{
+		uint32_t count; // records that follow
+		uint32_t flags;
+	};
+
+	struct alignas(64) SharedPointHeader
+	{
+		char magic[4];          // "GISM", written last by the producer
+		uint32_t version;       // SharedPointProtocolVersion
+		uint32_t blockPoints;
+		uint32_t blockCount;    // a power of two
+
+		alignas(64) std::atomic<uint32_t> head;
+		std::atomic<uint32_t> consumerWaiting;
+		alignas(64) std::atomic<uint32_t> tail;
+		std::atomic<uint32_t> producerWaiting;
+		std::atomic<int32_t> consumerPid; // 0 until a consumer opens the ring
+		std::atomic<int32_t> producerPid;
+	};
+
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring counters are shared between processes");
+	static_assert(std::atomic<int32_t>::is_always_lock_free, "the pids are shared between processes");
+	static_assert(sizeof(SharedPointRecord) == 24, "records match the regression golden layout");
+
+	constexpr uint32_t SharedPointProtocolVersion = 3;
+	constexpr uint32_t SharedCounterMask = 0x7FFFFFFF;
+	constexpr uint32_t SharedEndBit = 0x80000000;
+
+	constexpr size_t SharedBlockStride(uint32_t blockPoints)
+	{
+		return (sizeof(SharedPointBlock) + static_cast<size_t>(blockPoints) * sizeof(SharedPointRecord) + 63) / 64 * 64;
+	}
+}
@@ -0,0 +1,334 @@
+
+#include "SharedPointRing.h"
+
+#include "../Utils.h"
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+	// loads of the other side's counter before sleeping, a publish is often that close
+	constexpr int SpinCount = 256;
+	constexpr uint32_t MaxBlockCount = 1u << 30;
+#ifdef __linux__
+	// longest sleep, how late a producer notices that its consumer was killed
+	constexpr long SleepTimeoutNanoseconds = 100 * 1000 * 1000;
+#endif
+
+	size_t SegmentBytes(uint32_t blockPoints, uint32_t blockCount)
+	{
+		return sizeof(gi::SharedPointHeader) + static_cast<size_t>(blockCount) * gi::SharedBlockStride(blockPoints);
+	}
+
+	void Sleep(std::atomic<uint32_t>& word, uint32_t value)
+	{
+#ifdef __linux__
+		// returns at once if word already changed, shared so the other process can wake it
+		timespec timeout = { 0, SleepTimeoutNanoseconds };
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value, &timeout, nullptr, 0);
+#else
+		// no cross-process futex here, poll instead
+		(void)word;
+		(void)value;
+		timespec delay = { 0, 50000 };
+		nanosleep(&delay, nullptr);
+#endif
+	}
+
+	// a pid reused since stays alive to this test, the other side then has to end the stream itself
+	bool ProcessGone(int32_t pid)
+	{
+		return pid > 0 && kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH;
+	}
+
+	void Wake(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiting)
+	{
+		if (!waiting.load())
+			return;
+#ifdef __linux__
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+		(void)word;
+#endif
+	}
+}
+
+gi::SharedPointRing::~SharedPointRing()
+{
+	if (header)
+	{
+		if (owner)
+			Close();
+		else
+			Detach();
+	}
+	Unmap();
+	if (owner)
+		shm_unlink(name.c_str());
+}
+
+void gi::SharedPointRing::Unmap()
+{
+	if (header)
+		munmap(header, mappedBytes);
+	header = nullptr;
+	slots = nullptr;
+	mappedBytes = 0;
+}
+
+bool gi::SharedPointRing::Create(const std::string& name, uint32_t blockPoints, uint32_t blockCount)
+{
+	if (blockPoints == 0 || blockCount == 0 || blockCount > MaxBlockCount)
+	{
+		PrintMessage(L"shared ring needs at least one block of one point");
+		return false;
+	}
+	uint32_t count = 1;
+	while (count < blockCount)
+		count <<= 1;
+	size_t bytes = SegmentBytes(blockPoints, count);
+
+	shm_unlink(name.c_str());
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd == -1 || ftruncate(fd, static_cast<off_t>(bytes)) != 0)
+	{
+		PrintMessage(JoinAsWideString(L"cannot create shared memory: ", strerror(errno)));
+		if (fd != -1)
+		{
+			close(fd);
+			shm_unlink(name.c_str());
+		}
+		return false;
+	}
+	int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+	// fault the ring in now rather than on the first lap
+	flags |= MAP_POPULATE;
+#endif
+	void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED)
+	{
+		PrintMessage(JoinAsWideString(L"cannot map shared memory: ", strerror(errno)));
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	Unmap();
+	this->name = name;
+	owner = true;
+	mappedBytes = bytes;
+	header = new (memory) SharedPointHeader();
+	slots = static_cast<uint8_t*>(memory) + sizeof(SharedPointHeader);
+	header->version = SharedPointProtocolVersion;
+	header->blockPoints = blockPoints;
+	header->blockCount = count;
+	header->producerPid.store(static_cast<int32_t>(getpid()));
+	position = 0;
+	// a consumer takes the segment as ready once it sees the magic
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(header->magic, "GISM", 4);
+	return true;
+}
+
+bool gi::SharedPointRing::Open(const std::string& name)
+{
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if (fd == -1)
+		return false;
+	struct stat info;
+	void* memory = MAP_FAILED;
+	size_t bytes = 0;
+	if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(SharedPointHeader))
+	{
+		bytes = static_cast<size_t>(info.st_size);
+		memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (memory == MAP_FAILED)
+		return false;
+
+	auto* shared = static_cast<SharedPointHeader*>(memory);
+	bool ready = std::memcmp(shared->magic, "GISM", 4) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (!ready || shared->version != SharedPointProtocolVersion || shared->blockPoints == 0 ||
+		shared->blockCount == 0 || shared->blockCount > MaxBlockCount || bytes != SegmentBytes(shared->blockPoints, shared->blockCount) ||
+		(shared->tail.load() & SharedEndBit))
+	{
+		munmap(memory, bytes);
+		return false;
+	}
+
+	Unmap();
+	this->name = name;
+	owner = false;
+	mappedBytes = bytes;
+	header = shared;
+	slots = static_cast<uint8_t*>(memory) + sizeof(SharedPointHeader);
+	position = header->tail.load() & SharedCounterMask;
+	truncated = false;
+	header->consumerPid.store(static_cast<int32_t>(getpid()));
+	return true;
+}
+
+uint32_t gi::SharedPointRing::GetBlockPoints() const
+{
+	return header ? header->blockPoints : 0;
+}
+
+uint32_t gi::SharedPointRing::GetBlockCount() const
+{
+	return header ? header->blockCount : 0;
+}
+
+uint64_t gi::SharedPointRing::GetSleepCount() const
+{
+	return sleeps;
+}
+
+gi::SharedPointRecord* gi::SharedPointRing::Records(SharedPointBlock* block)
+{
+	return reinterpret_cast<SharedPointRecord*>(block + 1);
+}
+
+const gi::SharedPointRecord* gi::SharedPointRing::Records(const SharedPointBlock* block)
+{
+	return reinterpret_cast<const SharedPointRecord*>(block + 1);
+}
+
+gi::SharedPointBlock* gi::SharedPointRing::Slot(uint32_t index) const
+{
+	size_t slot = index & (header->blockCount - 1);
+	return reinterpret_cast<SharedPointBlock*>(slots + slot * SharedBlockStride(header->blockPoints));
+}
+
+void gi::SharedPointRing::WaitWhile(std::atomic<uint32_t>& word, uint32_t value, std::atomic<uint32_t>& waiting)
+{
+	for (int i = 0; i < SpinCount; ++i)
+	{
+		if (word.load(std::memory_order_acquire) != value)
+			return;
+	}
+	// set before the last look, so the other side either sees it or has already moved word
+	waiting.store(1);
+	if (word.load() == value)
+	{
+		++sleeps;
+		Sleep(word, value);
+	}
+	waiting.store(0);
+}
+
+bool gi::SharedPointRing::ConsumerGone() const
+{
+	return ProcessGone(header->consumerPid.load());
+}
+
+bool gi::SharedPointRing::ProducerGone() const
+{
+	return ProcessGone(header->producerPid.load());
+}
+
+gi::SharedPointBlock* gi::SharedPointRing::Acquire()
+{
+	while (true)
+	{
+		uint32_t tail = header->tail.load(std::memory_order_acquire);
+		if (tail & SharedEndBit)
+			return nullptr;
+		if (((position - tail) & SharedCounterMask) < header->blockCount)
+			break;
+		if (ConsumerGone())
+		{
+			header->tail.fetch_or(SharedEndBit);
+			return nullptr;
+		}
+		WaitWhile(header->tail, tail, header->producerWaiting);
+	}
+	SharedPointBlock* block = Slot(position);
+	block->count = 0;
+	block->flags = 0;
+	return block;
+}
+
+void gi::SharedPointRing::Publish()
+{
+	position = (position + 1) & SharedCounterMask;
+	header->head.store(position);
+	Wake(header->head, header->consumerWaiting);
+}
+
+void gi::SharedPointRing::Close()
+{
+	if (header->head.fetch_or(SharedEndBit) & SharedEndBit)
+		return;
+	Wake(header->head, header->consumerWaiting);
+}
+
+bool gi::SharedPointRing::WaitDrained()
+{
+	while (true)
+	{
+		uint32_t tail = header->tail.load(std::memory_order_acquire);
+		if ((tail & SharedCounterMask) == position)
+			return true;
+		if (tail & SharedEndBit)
+			return false;
+		if (ConsumerGone())
+		{
+			header->tail.fetch_or(SharedEndBit);
+			return false;
+		}
+		WaitWhile(header->tail, tail, header->producerWaiting);
+	}
+}
+
+const gi::SharedPointBlock* gi::SharedPointRing::Next()
+{
+	while (true)
+	{
+		uint32_t head = header->head.load(std::memory_order_acquire);
+		if ((head & SharedCounterMask) != position)
+			return Slot(position);
+		if (head & SharedEndBit)
+			return nullptr;
+		if (ProducerGone())
+		{
+			truncated = true;
+			return nullptr;
+		}
+		WaitWhile(header->head, head, header->consumerWaiting);
+	}
+}
+
+bool gi::SharedPointRing::WasTruncated() const
+{
+	return truncated;
+}
+
+void gi::SharedPointRing::Release()
+{
+	position = (position + 1) & SharedCounterMask;
+	header->tail.store(position);
+	Wake(header->tail, header->producerWaiting);
+}
+
+void gi::SharedPointRing::Detach()
+{
+	if (header->tail.fetch_or(SharedEndBit) & SharedEndBit)
+		return;
+	Wake(header->tail, header->producerWaiting);
+}
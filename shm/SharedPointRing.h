@@ -0,0 +1,74 @@
+#pragma once
+
+#include "SharedPointProtocol.h"
+
+#include <string>
+
+namespace gi
+{
+	// One end of a shared-memory point ring, see SharedPointProtocol.h. The producer creates
+	// the segment and removes its name when destroyed, a consumer opens it by name. Blocks are
+	// filled and read in place, nothing is copied between the two processes.
+	// A consumer killed before it detaches counts as detached once the producer waits on it,
+	// a producer killed before it closes ends the stream early for a consumer waiting on it.
+	class SharedPointRing
+	{
+	private:
+		std::string name;
+		bool owner = false;
+		SharedPointHeader* header = nullptr;
+		uint8_t* slots = nullptr;
+		size_t mappedBytes = 0;
+		uint32_t position = 0; // producer: next block to publish, consumer: next to release
+		uint64_t sleeps = 0;
+		bool truncated = false;
+
+		SharedPointBlock* Slot(uint32_t index)const;
+		// until word is no longer value or a bounded sleep ended, spinning briefly before sleeping
+		void WaitWhile(std::atomic<uint32_t>& word, uint32_t value, std::atomic<uint32_t>& waiting);
+		// producer: the consumer process has exited without detaching
+		bool ConsumerGone()const;
+		// consumer: the producer process has exited without closing
+		bool ProducerGone()const;
+		void Unmap();
+	public:
+		SharedPointRing() = default;
+		~SharedPointRing();
+		SharedPointRing(const SharedPointRing&) = delete;
+		SharedPointRing& operator=(const SharedPointRing&) = delete;
+
+		// producer: a new segment under name, replacing a stale one. blockCount is rounded up to
+		// a power of two. False on failure.
+		bool Create(const std::string& name, uint32_t blockPoints, uint32_t blockCount);
+		// consumer: false if name does not exist or its producer has not finished creating it
+		bool Open(const std::string& name);
+
+		uint32_t GetBlockPoints()const;
+		uint32_t GetBlockCount()const;
+		// times this end went to sleep waiting for the other
+		uint64_t GetSleepCount()const;
+
+		static SharedPointRecord* Records(SharedPointBlock* block);
+		static const SharedPointRecord* Records(const SharedPointBlock* block);
+
+		// producer: the next free slot, empty, waiting while the ring is full.
+		// nullptr once the consumer has detached.
+		SharedPointBlock* Acquire();
+		// hand the acquired slot to the consumer
+		void Publish();
+		// no more blocks, the consumer sees the end after the last one
+		void Close();
+		// after Close, until every block is released; false if the consumer detached first
+		bool WaitDrained();
+
+		// consumer: the oldest published block, waiting for one; nullptr after the last one
+		// or once the producer has exited without closing
+		const SharedPointBlock* Next();
+		// consumer: Next ended because the producer exited, the segment is left for the consumer to unlink
+		bool WasTruncated()const;
+		// hand the block from Next back to the producer
+		void Release();
+		// stop consuming, the producer drops what is left
+		void Detach();
+	};
+}
@@ -0,0 +1,267 @@
+
+// gi_shm: runs a script into a shared-memory point ring, a reference consumer that reads it
+// from another process, and a throughput benchmark that forks one of each.
+
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING 1
+
+#include "SharedPointCanvas.h"
+#include "SharedPointRing.h"
+
+#include "../Interpreter.h"
+#include "../Lexer.h"
+#include "../Parser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <codecvt>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace gi;
+
+namespace
+{
+	constexpr uint32_t DefaultBlockPoints = 4096;
+	constexpr uint32_t DefaultBlockCount = 64;
+
+	struct ConsumerSummary
+	{
+		uint64_t points = 0;
+		uint64_t blocks = 0;
+		uint64_t clears = 0;
+		double minX = std::numeric_limits<double>::infinity();
+		double minY = std::numeric_limits<double>::infinity();
+		double maxX = -std::numeric_limits<double>::infinity();
+		double maxY = -std::numeric_limits<double>::infinity();
+		double sumX = 0.0;
+		double sumY = 0.0;
+	};
+
+	// reads every record in place until the producer closes the ring
+	void Consume(SharedPointRing& ring, ConsumerSummary& summary)
+	{
+		while (const SharedPointBlock* block = ring.Next())
+		{
+			const SharedPointRecord* records = SharedPointRing::Records(block);
+			if (block->flags & SharedBlockCleared)
+				++summary.clears;
+			for (uint32_t i = 0; i < block->count; ++i)
+			{
+				const SharedPointRecord& p = records[i];
+				summary.minX = std::min(summary.minX, p.x);
+				summary.minY = std::min(summary.minY, p.y);
+				summary.maxX = std::max(summary.maxX, p.x);
+				summary.maxY = std::max(summary.maxY, p.y);
+				summary.sumX += p.x;
+				summary.sumY += p.y;
+			}
+			summary.points += block->count;
+			++summary.blocks;
+			ring.Release();
+		}
+	}
+
+	void PrintThroughput(const char* what, uint64_t points, double seconds, uint64_t sleeps)
+	{
+		std::printf("%s %llu points in %.3f s, %.1f Mpoints/s, %.2f GB/s, %llu sleeps\n", what,
+			static_cast<unsigned long long>(points), seconds, static_cast<double>(points) / seconds / 1e6,
+			static_cast<double>(points * sizeof(SharedPointRecord)) / seconds / 1e9, static_cast<unsigned long long>(sleeps));
+	}
+
+	void PrintSummary(const ConsumerSummary& summary, double seconds, uint64_t sleeps)
+	{
+		PrintThroughput("consumed", summary.points, seconds, sleeps);
+		std::printf("%llu blocks, %llu clears, bounds [%g, %g] x [%g, %g], checksum %.17g\n",
+			static_cast<unsigned long long>(summary.blocks), static_cast<unsigned long long>(summary.clears),
+			summary.minX, summary.maxX, summary.minY, summary.maxY, summary.sumX + summary.sumY);
+	}
+
+	int RunConsumer(const std::string& name, double waitSeconds)
+	{
+		SharedPointRing ring;
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(waitSeconds);
+		// the producer may not have created the segment yet
+		while (!ring.Open(name))
+		{
+			if (std::chrono::steady_clock::now() >= deadline)
+			{
+				std::fprintf(stderr, "cannot open %s\n", name.c_str());
+				return 1;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		ConsumerSummary summary;
+		auto start = std::chrono::steady_clock::now();
+		Consume(ring, summary);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		PrintSummary(summary, seconds, ring.GetSleepCount());
+		if (ring.WasTruncated())
+		{
+			// nobody else is left to remove the name
+			std::fprintf(stderr, "producer exited without closing, stream truncated after %llu points\n",
+				static_cast<unsigned long long>(summary.points));
+			shm_unlink(name.c_str());
+			return 1;
+		}
+		return 0;
+	}
+
+	int RunProducer(const std::string& name, uint32_t blockPoints, uint32_t blockCount, const std::string& scriptFile)
+	{
+		std::ifstream is(scriptFile, std::ios::binary);
+		std::ostringstream oss;
+		oss << is.rdbuf();
+		if (!is.good())
+		{
+			std::fprintf(stderr, "cannot read %s\n", scriptFile.c_str());
+			return 1;
+		}
+		SharedPointRing ring;
+		if (!ring.Create(name, blockPoints, blockCount))
+			return 1;
+		auto start = std::chrono::steady_clock::now();
+		SharedPointCanvas canvas(ring);
+		try {
+			std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+			Lexer lexer;
+			Parser parser;
+			parser.SetTraceTokens(false);
+			lexer.Init(converter.from_bytes(oss.str()));
+			parser.Parse(lexer);
+			std::unique_ptr<NTProgram> ast = parser.GetASTRoot();
+			EvaluateContext context;
+			context.SetCanvas(&canvas);
+			context.Run(ast.get());
+		}
+		catch (std::exception& e)
+		{
+			// what was drawn is still handed over
+			std::fprintf(stderr, "script failed: %s\n", e.what());
+		}
+		canvas.Finish();
+		// the name goes away with the ring, so wait until the consumer is done with it
+		bool drained = ring.WaitDrained();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		PrintThroughput("produced", canvas.GetPointCount(), seconds, ring.GetSleepCount());
+		if (!drained || canvas.GetDroppedCount() > 0)
+		{
+			std::fprintf(stderr, "consumer detached, %llu points dropped\n", static_cast<unsigned long long>(canvas.GetDroppedCount()));
+			return 1;
+		}
+		return 0;
+	}
+
+	// a forked consumer against this process drawing a precomputed curve
+	int RunBenchmark(uint64_t points, uint32_t blockPoints, uint32_t blockCount)
+	{
+		std::string name = "/gi_shm_bench." + std::to_string(getpid());
+		SharedPointRing ring;
+		if (!ring.Create(name, blockPoints, blockCount))
+			return 1;
+		std::fflush(stdout);
+		pid_t child = fork();
+		if (child == -1)
+		{
+			std::perror("fork");
+			return 1;
+		}
+		if (child == 0)
+		{
+			SharedPointRing consumer;
+			if (!consumer.Open(name))
+				_exit(1);
+			ConsumerSummary summary;
+			auto start = std::chrono::steady_clock::now();
+			Consume(consumer, summary);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			PrintSummary(summary, seconds, consumer.GetSleepCount());
+			std::fflush(stdout);
+			// the inherited producer ring must not unlink the segment
+			_exit(summary.points == points ? 0 : 1);
+		}
+
+		const size_t tableSize = 1 << 16;
+		std::vector<double> xs(tableSize), ys(tableSize);
+		for (size_t i = 0; i < tableSize; ++i)
+		{
+			double t = 2 * 3.14159265358979323846 * static_cast<double>(i) / tableSize;
+			xs[i] = 500 + 400 * std::sin(20 * t);
+			ys[i] = 500 + 400 * std::sin(21 * t + 1.0471975511965976);
+		}
+		auto start = std::chrono::steady_clock::now();
+		SharedPointCanvas canvas(ring);
+		for (uint64_t i = 0; i < points; ++i)
+			canvas.DrawPoint(xs[i & (tableSize - 1)], ys[i & (tableSize - 1)]);
+		canvas.Finish();
+		bool drained = ring.WaitDrained();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		PrintThroughput("produced", canvas.GetPointCount(), seconds, ring.GetSleepCount());
+		std::fflush(stdout);
+		int status = 0;
+		waitpid(child, &status, 0);
+		return drained && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+	}
+
+	void PrintUsage(const char* self)
+	{
+		std::fprintf(stderr,
+			"Usage: %s --produce NAME [--block POINTS] [--blocks N] SCRIPT\n"
+			"       %s --consume NAME [--wait SECONDS]\n"
+			"       %s --bench POINTS [--block POINTS] [--blocks N]\n"
+			"NAME is a shm_open name such as /gi_points. The producer exits once the consumer has read everything.\n",
+			self, self, self);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string produceName, consumeName, scriptFile;
+	uint64_t benchPoints = 0;
+	uint32_t blockPoints = DefaultBlockPoints, blockCount = DefaultBlockCount;
+	double waitSeconds = 10.0;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--produce" && hasValue)
+			produceName = argv[++i];
+		else if (arg == "--consume" && hasValue)
+			consumeName = argv[++i];
+		else if (arg == "--bench" && hasValue)
+			benchPoints = std::strtoull(argv[++i], nullptr, 10);
+		else if (arg == "--block" && hasValue)
+			blockPoints = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+		else if (arg == "--blocks" && hasValue)
+			blockCount = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+		else if (arg == "--wait" && hasValue)
+			waitSeconds = std::atof(argv[++i]);
+		else if (scriptFile.empty() && arg.compare(0, 2, "--") != 0)
+			scriptFile = arg;
+		else
+		{
+			PrintUsage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (!produceName.empty() && !scriptFile.empty())
+		return RunProducer(produceName, blockPoints, blockCount, scriptFile);
+	if (!consumeName.empty())
+		return RunConsumer(consumeName, waitSeconds);
+	if (benchPoints > 0)
+		return RunBenchmark(benchPoints, blockPoints, blockCount);
+	PrintUsage(argv[0]);
+	return 2;
+}